@@ -224,6 +224,20 @@ static int seek_stat_counter(void *_stream,opus_int64 _offset,int _whence){
   return (*real_seek)(_stream,_offset,_whence);
 }
 
+static opus_int64 nreal_requests;
+
+/*Over HTTP, the number of requests made to the server is a better measure of
+   the cost of seeking than the seek count, since a seek within the data
+   already on the way does not need a new one.*/
+static void print_request_stats(FILE *_fp,const OggOpusFile *_of){
+  opus_int64 nrequests;
+  nrequests=op_url_request_count(_of);
+  /*Not a URL stream.*/
+  if(nrequests<0)return;
+  fprintf(_fp,"Total HTTP requests: %li.\n",(long)(nrequests-nreal_requests));
+  nreal_requests=nrequests;
+}
+
 #define NSEEK_TESTS (1000)
 
 static void print_duration(FILE *_fp,ogg_int64_t _nsamples){
@@ -302,6 +316,7 @@ int main(int _argc,const char **_argv){
     nlinks=op_link_count(of);
     fprintf(stderr,"Opened file containing %i links with %li seeks "
      "(%0.3f per link).\n",nlinks,nreal_seeks,nreal_seeks/(double)nlinks);
+    print_request_stats(stderr,of);
     /*Reset the seek counter.*/
     nreal_seeks=0;
     nsamples=0;
@@ -418,6 +433,7 @@ int main(int _argc,const char **_argv){
     }
     fprintf(stderr,"\rTotal seek operations: %li (%.3f per raw seek, %li maximum).\n",
      nreal_seeks,nreal_seeks/(double)NSEEK_TESTS,max_seeks);
+    print_request_stats(stderr,of);
     nreal_seeks=0;
     fprintf(stderr,"Testing exact PCM seeking to random places in %li "
      "samples (",(long)pcm_length);
@@ -449,6 +465,7 @@ int main(int _argc,const char **_argv){
     }
     fprintf(stderr,"\rTotal seek operations: %li (%.3f per exact seek, %li maximum).\n",
      nreal_seeks,nreal_seeks/(double)NSEEK_TESTS,max_seeks);
+    print_request_stats(stderr,of);
     nreal_seeks=0;
     fprintf(stderr,"OK.\n");
     _ogg_free(bigassbuffer);
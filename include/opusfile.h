@@ -129,7 +129,11 @@ typedef struct OpusHead          OpusHead;
 typedef struct OpusTags          OpusTags;
 typedef struct OpusPictureTag    OpusPictureTag;
 typedef struct OpusServerInfo    OpusServerInfo;
+typedef struct OpusHTTPContext   OpusHTTPContext;
 typedef struct OpusFileCallbacks OpusFileCallbacks;
+typedef struct OpusFileStats     OpusFileStats;
+typedef struct OpusProbeLink     OpusProbeLink;
+typedef struct OpusProbeInfo     OpusProbeInfo;
 typedef struct OggOpusFile       OggOpusFile;
 
 /*Warning attributes for libopusfile functions.*/
@@ -163,6 +167,9 @@ typedef struct OggOpusFile       OggOpusFile;
 /**There was a hole in the page sequence numbers (e.g., a page was corrupt or
     missing).*/
 #define OP_HOLE          (-3)
+/**A non-blocking stream would have had to wait for more data.
+   See op_url_set_nonblocking().*/
+#define OP_EAGAIN        (-4)
 /**An underlying read, seek, or tell operation failed when it should have
     succeeded.*/
 #define OP_EREAD         (-128)
@@ -697,6 +704,15 @@ void opus_picture_tag_clear(OpusPictureTag *_pic) OP_ARG_NONNULL(1);
 #define OP_HTTP_PROXY_USER_REQUEST            (6656)
 #define OP_HTTP_PROXY_PASS_REQUEST            (6720)
 #define OP_GET_SERVER_INFO_REQUEST            (6784)
+#define OP_HTTP_CACHE_SIZE_REQUEST            (6848)
+#define OP_HTTP_DISK_CACHE_DIR_REQUEST        (6912)
+#define OP_HTTP_DISK_CACHE_SIZE_REQUEST       (6976)
+#define OP_HTTP_CONNECTIONS_MAX_REQUEST       (7040)
+#define OP_HTTP_PREFETCH_REQUEST              (7104)
+#define OP_HTTP_CONTEXT_REQUEST               (7168)
+#define OP_HTTP_READAHEAD_BDP_PCT_REQUEST     (7232)
+#define OP_HTTP_PIPELINE_REQUEST_BDP_PCT_REQUEST (7296)
+#define OP_HTTP_PIPELINE_CHUNK_BDP_PCT_REQUEST (7360)
 
 #define OP_URL_OPT(_request) ((char *)(_request))
 
@@ -705,6 +721,9 @@ void opus_picture_tag_clear(OpusPictureTag *_pic) OP_ARG_NONNULL(1);
 #define OP_CHECK_INT(_x) ((void)((_x)==(opus_int32)0),(opus_int32)(_x))
 #define OP_CHECK_CONST_CHAR_PTR(_x) ((_x)+((_x)-(const char *)(_x)))
 #define OP_CHECK_SERVER_INFO_PTR(_x) ((_x)+((_x)-(OpusServerInfo *)(_x)))
+/*OpusHTTPContext is opaque, so we can't use pointer arithmetic to check it.*/
+#define OP_CHECK_HTTP_CONTEXT_PTR(_x) \
+ ((void)((_x)==(OpusHTTPContext *)0),(OpusHTTPContext *)(_x))
 
 /**@endcond*/
 
@@ -763,6 +782,59 @@ void opus_server_info_init(OpusServerInfo *_info) OP_ARG_NONNULL(1);
    \note If you use this function, you must link against <tt>libopusurl</tt>.*/
 void opus_server_info_clear(OpusServerInfo *_info) OP_ARG_NONNULL(1);
 
+/**A locking function for an #OpusHTTPContext, for link information shared
+    with op_share_links(), or for a decode-ahead buffer.
+   \param _lock_ctx The application-provided pointer passed to
+                     op_http_context_create(), op_share_links(), or
+                     op_set_decode_ahead().*/
+typedef void (*op_lock_func)(void *_lock_ctx);
+
+/**Creates a context that can be shared by several HTTP/HTTPS streams.
+   Streams created with the #OP_HTTP_CONTEXT option remember the addresses of
+    the hosts they connect to and the TLS sessions they negotiate in the
+    context, so that later streams to the same host can skip the DNS lookup
+    and do an abbreviated TLS handshake.
+   When a stream is closed, its idle persistent connections are also handed
+    to the context, and a later stream to the same host uses one of them
+    instead of opening a new connection, if it is still open.
+   This is useful for applications that open many URLs from the same server,
+    e.g., to scan a playlist.
+   TLS sessions and the certificates used to verify them are only shared
+    between streams that check certificates (see
+    #OP_SSL_SKIP_CERTIFICATE_CHECK).
+   Connections made through a proxy are not kept.
+   This library does not depend on a threading library, so the context has no
+    locking of its own.
+   If streams using the same context may be opened, read, or closed from
+    different threads at the same time, the application must supply
+    functions to lock and unlock a mutex.
+   \param _lock     A function called to lock the context before it is
+                     accessed, or <code>NULL</code> if the application
+                     ensures that only one thread uses the context (or any
+                     stream created with it) at a time.
+   \param _unlock   A function called to unlock the context after it is
+                     accessed.
+                    This must be <code>NULL</code> if and only if \a _lock is.
+   \param _lock_ctx An application-provided pointer passed to \a _lock and
+                     \a _unlock.
+   \return A new context, or <code>NULL</code> on error, or if the library
+            was built without HTTP support.
+   \note If you use this function, you must link against <tt>libopusurl</tt>.*/
+OpusHTTPContext *op_http_context_create(op_lock_func _lock,
+ op_lock_func _unlock,void *_lock_ctx) OP_WARN_UNUSED_RESULT;
+
+/**Releases the application's reference to an #OpusHTTPContext.
+   Streams that are still using the context keep it alive until they are
+    closed, so it is safe to call this as soon as no new streams need to be
+    created with it.
+   The idle connections and TLS sessions it holds are released when the last
+    stream using it is closed.
+   \param _ctx The context to release.
+               This may be <code>NULL</code>, in which case this function does
+                nothing.
+   \note If you use this function, you must link against <tt>libopusurl</tt>.*/
+void op_http_context_free(OpusHTTPContext *_ctx);
+
 /**Skip the certificate check when connecting via TLS/SSL (https).
    \param _b <code>opus_int32</code>: Whether or not to skip the certificate
               check.
@@ -843,6 +915,211 @@ void opus_server_info_clear(OpusServerInfo *_info) OP_ARG_NONNULL(1);
 #define OP_GET_SERVER_INFO(_info) \
  OP_URL_OPT(OP_GET_SERVER_INFO_REQUEST),OP_CHECK_SERVER_INFO_PTR(_info)
 
+/**Cache data read from the server in memory.
+   The cache holds fixed-size blocks of the resource, and discards the least
+    recently used block when it is full.
+   Seeking then only contacts the server when it needs data that is not in the
+    cache.
+   This can substantially reduce the number of requests made when opening a
+    stream (which reads and re-reads data near the start and end of each link
+    to find its boundaries and duration) and when seeking (which repeatedly
+    bisects the same regions of the stream).
+   The cache is only used if the server supports range requests.
+   Otherwise we could not seek anyway.
+   \param _size <code>opus_int32</code>: The maximum amount of memory to use
+                 for cached data, in bytes.
+                This is rounded down to a multiple of the block size
+                 (currently 16 kB).
+                If this is less than one block, the cache is disabled, which
+                 is the default.
+                This must be non-negative, or the URL function this is passed
+                 to will fail.
+   \hideinitializer*/
+#define OP_HTTP_CACHE_SIZE(_size) \
+ OP_URL_OPT(OP_HTTP_CACHE_SIZE_REQUEST),OP_CHECK_INT(_size)
+
+/**Keep a copy of the data read from the server in a directory on disk.
+   Each resource gets its own file in this directory, holding the blocks of
+    the resource that have been read, along with its length, its URL (without
+    any user name, password, or query), and the validators (the
+    <code>ETag</code> and <code>Last-Modified</code> headers) the server sent
+    with it.
+   Since the query is left out, URLs that differ only in their query (such as
+    signed URLs whose signature changes from one request to the next) share
+    a file, and the validators decide whether its contents can be used.
+   When the same URL is opened again, the initial request includes an
+    <code>If-Range</code> header with one of the stored validators.
+   If the server confirms the resource has not changed, and reports the same
+    length and validators, the stored blocks are read from disk instead of
+    requested from the server.
+   Otherwise the file is discarded and started over.
+   The server's response is then used as-is if it advertises support for byte
+    ranges, and the initial request is repeated without the
+    <code>If-Range</code> header if it does not.
+   This requires the in-memory cache, and enables it with a small default size
+    if #OP_HTTP_CACHE_SIZE was not specified or was smaller than that.
+   Like that cache, it is only used if the server supports range requests,
+    and it is also only used if the server sends at least one validator.
+   The directory must already exist.
+   It may be shared by any number of streams, in this process or others.
+   A stream locks the file for its resource while it is open, and any other
+    stream opened for the same resource during that time runs without the
+    disk cache instead of waiting for it.
+   The application may remove files from it at any time the resource is not
+    open.
+   Errors creating, reading, or writing the cache file are not fatal: the
+    stream just stops using the disk cache.
+   \param _dir <code>const char *</code>: The directory to store cached data
+                in, in the platform's native encoding.
+               This may be <code>NULL</code> to disable the disk cache, which
+                is the default.
+   \hideinitializer*/
+#define OP_HTTP_DISK_CACHE_DIR(_dir) \
+ OP_URL_OPT(OP_HTTP_DISK_CACHE_DIR_REQUEST),OP_CHECK_CONST_CHAR_PTR(_dir)
+
+/**The maximum amount of data to store on disk for a single resource with
+    #OP_HTTP_DISK_CACHE_DIR.
+   Blocks are stored one after another in the order they are read, no matter
+    where they are in the resource, so this also bounds the size of the file
+    (apart from a small header and index).
+   Blocks read after this limit is reached are still cached in memory, but
+    are not written to disk.
+   The limit only applies to each resource separately: the application is
+    responsible for bounding the total size of the directory.
+   \param _size <code>opus_int32</code>: The maximum number of bytes of data
+                 to store for a resource.
+                The default is 1 MB.
+                This must be non-negative, or the URL function this is passed
+                 to will fail.
+   \hideinitializer*/
+#define OP_HTTP_DISK_CACHE_SIZE(_size) \
+ OP_URL_OPT(OP_HTTP_DISK_CACHE_SIZE_REQUEST),OP_CHECK_INT(_size)
+
+/**The maximum number of simultaneous connections to keep open to the server.
+   Only one connection is read from at a time.
+   The others are kept open after a seek, so that seeking back to where they
+    left off does not require a new request, and so that a new request can be
+    made on them without the cost of opening a new connection.
+   They are closed after a few seconds of inactivity.
+   More connections can reduce the number of connections opened while seeking,
+    and let #OP_HTTP_PREFETCH fetch more data in advance, at the cost of
+    making more requests to the server in parallel.
+   \param _n <code>opus_int32</code>: The maximum number of connections.
+             The default is 4.
+             Values larger than 15 are treated as 15.
+             This must be positive, or the URL function this is passed to will
+              fail.
+   \hideinitializer*/
+#define OP_HTTP_CONNECTIONS_MAX(_n) \
+ OP_URL_OPT(OP_HTTP_CONNECTIONS_MAX_REQUEST),OP_CHECK_INT(_n)
+
+/**Prefetch data on idle connections.
+   When a seek needs data that is not immediately available, this guesses
+    where the next few seeks will go, and sends requests for that data on
+    other connections that are open but idle.
+   It never opens new connections itself, so it only starts to help once
+    earlier seeks have opened some (up to the limit set by
+    #OP_HTTP_CONNECTIONS_MAX).
+   The guesses are tailored to the bisection searches used to find the links
+    in a stream when opening it and to seek within it, so the response to the
+    next seek is often already on its way when it is made, hiding part of the
+    round trip to the server.
+   How far ahead this can look depends on the number of connections
+    available: each step of a bisection search uses two for the next step and
+    four more for the step after that.
+   Sequential reading already requests more data in advance on the current
+    connection, and does not need this.
+   Prefetching is only done for servers that support range requests and
+    HTTP/1.1 persistent connections.
+   Data for guesses that turn out to be wrong is discarded, so this increases
+    the number of requests and the amount of data transferred.
+   Combining this with #OP_HTTP_CACHE_SIZE avoids prefetching data that is
+    already cached.
+   \param _b <code>opus_int32</code>: Whether or not to prefetch data.
+             Data will be prefetched if \a _b is non-zero, and will not be if
+              \a _b is zero, which is the default.
+   \hideinitializer*/
+#define OP_HTTP_PREFETCH(_b) \
+ OP_URL_OPT(OP_HTTP_PREFETCH_REQUEST),OP_CHECK_INT(_b)
+
+/**Share host addresses, TLS sessions, and idle connections with other
+    streams through the given context.
+   See op_http_context_create() for details.
+   The stream keeps its own reference to the context, so the application may
+    free it with op_http_context_free() while the stream is still open.
+   \param _ctx <code>OpusHTTPContext *</code>: The context to use.
+               This may be <code>NULL</code> to not share anything, which is
+                the default.
+   \hideinitializer*/
+#define OP_HTTP_CONTEXT(_ctx) \
+ OP_URL_OPT(OP_HTTP_CONTEXT_REQUEST),OP_CHECK_HTTP_CONTEXT_PTR(_ctx)
+
+/**How far to read ahead on an open connection when seeking, instead of making
+    a new request.
+   This and the following options are given in percent of the
+    bandwidth-delay product of the connection: the number of bytes it
+    delivers in the time it takes to get the response to a new request, as
+    estimated from the time taken to connect and the rate data has arrived so
+    far.
+   Reading ahead this much takes about as long as a new request would, so
+    100% would break even.
+   The default biases away from re-using connections, to account for the
+    time it takes a connection that has been idle to reach full speed again.
+   Regardless of this setting, seeks of up to 32&nbsp;kB are always made by
+    reading ahead.
+   \param _pct <code>opus_int32</code>: The read-ahead limit, in percent of
+                the bandwidth-delay product.
+               The default is 50.
+               Values larger than 10000 are treated as 10000.
+               This must be non-negative, or the URL function this is passed
+                to will fail.
+   \hideinitializer*/
+#define OP_HTTP_READAHEAD_BDP_PCT(_pct) \
+ OP_URL_OPT(OP_HTTP_READAHEAD_BDP_PCT_REQUEST),OP_CHECK_INT(_pct)
+
+/**How much of the current response to a pipelined request may remain when
+    reading sequentially before the request for the next chunk of the
+    resource is sent.
+   With less than 100%, reading pauses at the end of each chunk until the
+    next response arrives.
+   The request is never sent before the last quarter of the current chunk,
+    whatever this is set to.
+   This only applies to servers that support range requests and HTTP/1.1
+    persistent connections.
+   \param _pct <code>opus_int32</code>: The request threshold, in percent of
+                the bandwidth-delay product (see #OP_HTTP_READAHEAD_BDP_PCT).
+               The default is 125.
+               Values larger than 10000 are treated as 10000.
+               This must be non-negative, or the URL function this is passed
+                to will fail.
+   \hideinitializer*/
+#define OP_HTTP_PIPELINE_REQUEST_BDP_PCT(_pct) \
+ OP_URL_OPT(OP_HTTP_PIPELINE_REQUEST_BDP_PCT_REQUEST),OP_CHECK_INT(_pct)
+
+/**The size to grow pipelined requests towards when reading sequentially.
+   After a seek, the first few requests are small, in case the application
+    seeks again soon.
+   Each request after that is at least twice the size of the previous one,
+    and grows up to four times larger to reach this target.
+   Since the next request is not sent until the last quarter of the current
+    chunk, this needs to be at least four times
+    #OP_HTTP_PIPELINE_REQUEST_BDP_PCT for reading never to pause.
+   However, data requested past the point where the application next seeks
+    is discarded, and opening a chained stream seeks a lot, so larger values
+    transfer more data overall.
+   Zero disables this, and the chunk size just doubles with each request.
+   This only applies to servers that support range requests and HTTP/1.1
+    persistent connections.
+   \param _pct <code>opus_int32</code>: The chunk size target, in percent of
+                the bandwidth-delay product (see #OP_HTTP_READAHEAD_BDP_PCT).
+               The default is 250.
+               Values larger than 10000 are treated as 10000.
+               This must be non-negative, or the URL function this is passed
+                to will fail.
+   \hideinitializer*/
+#define OP_HTTP_PIPELINE_CHUNK_BDP_PCT(_pct) \
+ OP_URL_OPT(OP_HTTP_PIPELINE_CHUNK_BDP_PCT_REQUEST),OP_CHECK_INT(_pct)
+
 /**@}*/
 /**@}*/
 
@@ -986,6 +1263,29 @@ OP_WARN_UNUSED_RESULT void *op_freopen(OpusFileCallbacks *_cb,
 OP_WARN_UNUSED_RESULT void *op_mem_stream_create(OpusFileCallbacks *_cb,
  const unsigned char *_data,size_t _size) OP_ARG_NONNULL(1);
 
+/**Opens a stream by mapping the given file into memory and fills in a set of
+    callbacks that can be used to access it.
+   When a stream created this way is passed to op_open_callbacks() or
+    op_test_callbacks() without any initial data, Ogg pages are framed
+    directly out of the mapping, without copying them through an intermediate
+    buffer.
+   This is also true of streams created with op_mem_stream_create().
+   The file must be a regular file, and must not be truncated while it is
+    open, or the application may receive a <code>SIGBUS</code> signal (or
+    the equivalent exception on other platforms).
+   \param[out] _cb   The callbacks to use for this file.
+                     If there is an error opening the file, nothing will be
+                      filled in here.
+   \param      _path The path to the file to open.
+                     On Windows, this string must be UTF-8 (to allow access to
+                      files whose names cannot be represented in the current
+                      MBCS code page).
+                     All other systems use the native character encoding.
+   \return A stream handle to use with the callbacks, or <code>NULL</code> on
+            error.*/
+OP_WARN_UNUSED_RESULT void *op_mmap_open(OpusFileCallbacks *_cb,
+ const char *_path) OP_ARG_NONNULL(1) OP_ARG_NONNULL(2);
+
 /**Creates a stream that reads from the given URL.
    This function behaves identically to op_url_stream_create(), except that it
     takes a va_list instead of a variable number of arguments.
@@ -1103,6 +1403,20 @@ OP_WARN_UNUSED_RESULT OggOpusFile *op_open_file(const char *_path,int *_error)
 OP_WARN_UNUSED_RESULT OggOpusFile *op_open_memory(const unsigned char *_data,
  size_t _size,int *_error);
 
+/**Open a stream by mapping the given file into memory.
+   This avoids copying the file contents through an intermediate buffer.
+   \see op_mmap_open
+   \param      _path  The path to the file to open.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      The failure code will be #OP_EFAULT if the file could not
+                       be opened or mapped, or one of the other failure codes
+                       from op_open_callbacks() otherwise.
+   \return A freshly opened \c OggOpusFile, or <code>NULL</code> on error.*/
+OP_WARN_UNUSED_RESULT OggOpusFile *op_open_mmap(const char *_path,int *_error)
+ OP_ARG_NONNULL(1);
+
 /**Open a stream from a URL.
    This function behaves identically to op_open_url(), except that it
     takes a va_list instead of a variable number of arguments.
@@ -1255,6 +1569,20 @@ OP_WARN_UNUSED_RESULT OggOpusFile *op_test_file(const char *_path,int *_error)
 OP_WARN_UNUSED_RESULT OggOpusFile *op_test_memory(const unsigned char *_data,
  size_t _size,int *_error);
 
+/**Partially open a stream by mapping the given file into memory.
+   \see op_test_callbacks
+   \see op_mmap_open
+   \param      _path  The path to the file to open.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      The failure code will be #OP_EFAULT if the file could not
+                       be opened or mapped, or one of the other failure codes
+                       from op_open_callbacks() otherwise.
+   \return A partially opened \c OggOpusFile, or <code>NULL</code> on error.*/
+OP_WARN_UNUSED_RESULT OggOpusFile *op_test_mmap(const char *_path,int *_error)
+ OP_ARG_NONNULL(1);
+
 /**Partially open a stream from a URL.
    This function behaves identically to op_test_url(), except that it
     takes a va_list instead of a variable number of arguments.
@@ -1402,10 +1730,461 @@ OP_WARN_UNUSED_RESULT OggOpusFile *op_test_callbacks(void *_stream,
                               validity checks.*/
 int op_test_open(OggOpusFile *_of) OP_ARG_NONNULL(1);
 
+/**Finish opening a stream partially opened with op_test_callbacks() or one of
+    the associated convenience functions, using a link table previously saved
+    with op_export_links() instead of scanning the stream.
+   Opening a seekable stream normally requires searching for the start of every
+    link and the end of the stream, which can take dozens of seeks for a
+    chained file.
+   Instead, this function checks that the table matches the size of the
+    stream and the headers of the first link (which have already been read),
+    and that the first and last pages of the first link, the last link, and a
+    small, fixed number of links spread between them are where the table says
+    they are.
+   The number of seeks this takes does not depend on the number of links.
+   Every entry in the table is still checked for consistency with the others,
+    but a damaged or stale table that passes these checks might not be
+    detected until seeking or decoding reaches one of the links that was not
+    checked.
+   If the table is rejected, the stream remains partially open, and can still
+    be opened normally with op_test_open().
+   If any other error occurs, you are still responsible for freeing the
+    \c OggOpusFile with op_free().
+   \param _of         The \c OggOpusFile to finish opening.
+   \param _links      The link table saved by op_export_links().
+   \param _links_size The number of bytes in the link table.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EREAD         An underlying read, seek, or tell operation failed
+                              when it should have succeeded.
+   \retval #OP_EFAULT        There was a memory allocation failure, or an
+                              internal library error.
+   \retval #OP_EINVAL        The stream was not partially opened with
+                              op_test_callbacks() or one of the associated
+                              convenience functions, or the link table was
+                              not properly formatted.
+   \retval #OP_ENOSEEK       The stream is not seekable.
+   \retval #OP_EVERSION      The link table was written by an incompatible
+                              version of this library.
+   \retval #OP_EBADLINK      The link table did not match the contents of the
+                              stream.
+   \retval #OP_EBADTIMESTAMP The first or last timestamp in a link failed basic
+                              validity checks.*/
+int op_test_open_links(OggOpusFile *_of,
+ const unsigned char *_links,size_t _links_size) OP_ARG_NONNULL(1)
+ OP_ARG_NONNULL(2);
+
+/**Finish opening a stream partially opened with op_test_callbacks() or one of
+    the associated convenience functions, without searching for every link up
+    front.
+   Opening a seekable stream normally requires finding the start and end of
+    every link, which for a chained stream with thousands of links means
+    thousands of header parses and seeks before the first sample can be
+    decoded.
+   Instead, this function only searches for the start of the second link (if
+    there is one), so that the first link can be played back, and the time it
+    takes does not depend on the number of links.
+   The remaining links are found as they are needed: when playback reaches the
+    start of a link that has not been found yet, when seeking to a position in
+    one, or when op_enumerate_links() is called.
+   Until then, op_link_count() returns the number of links found so far, and
+    op_pcm_total(), op_raw_total(), and op_bitrate() fail for the last of
+    those links and (except for op_raw_total()) for the stream as a whole.
+   For unseekable streams, this is the same as op_test_open().
+   If this function fails, you are still responsible for freeing the
+    \c OggOpusFile with op_free().
+   \param _of The \c OggOpusFile to finish opening.
+   \return 0 on success, or a negative value on error.
+           See op_test_open() for a list of failure codes.*/
+int op_test_open_lazy(OggOpusFile *_of) OP_ARG_NONNULL(1);
+
+/**Opens another handle to the same stream, for use by
+    op_test_open_parallel().
+   This may be called from any thread used by the #op_run_func passed to
+    op_test_open_parallel(), and from several of them at once.
+   \param      _ctx The application-provided pointer passed to
+                     op_test_open_parallel().
+   \param[out] _cb  Returns the callbacks used to access the new handle.
+                    These must include \ref op_seek_func "seek()" and
+                     \ref op_tell_func "tell()" functions, and, if a
+                     \ref op_close_func "close()" function is provided, it
+                     will be used to close the handle once the library is done
+                     with it.
+   \return The new stream handle, or <code>NULL</code> on error.
+           Its position does not matter, as the library will seek before
+            reading from it.*/
+typedef void *(*op_open_stream_func)(void *_ctx,OpusFileCallbacks *_cb);
+
+/**A task to be run by an #op_run_func.
+   \param _task_ctx The task context passed to the #op_run_func.
+   \param _ti       The index of the task to run.*/
+typedef void (*op_task_func)(void *_task_ctx,int _ti);
+
+/**Runs a set of independent tasks, possibly concurrently.
+   This must call <code>(*_task)(_task_ctx,ti)</code> exactly once for each
+    <code>ti</code> in the range <code>[0,_ntasks)</code>, and not return
+    until all of those calls have returned.
+   The calls may be made from any threads in any order, including all from the
+    calling thread, one after another.
+   \param _ctx      The application-provided pointer passed to
+                     op_test_open_parallel().
+   \param _task     The task to run.
+   \param _task_ctx The context to pass to each call to \a _task.
+   \param _ntasks   The number of tasks to run.*/
+typedef void (*op_run_func)(void *_ctx,op_task_func _task,void *_task_ctx,
+ int _ntasks);
+
+/**Finish opening a stream partially opened with op_test_callbacks() or one of
+    the associated convenience functions, scanning separate byte ranges of the
+    stream for links at the same time.
+   Opening a seekable stream normally requires searching for the start of every
+    link one after another through a single handle, so for a chained stream
+    with many links, most of the time is spent waiting on individual reads and
+    seeks.
+   Instead, this function splits the stream into (up to) \a _nranges byte
+    ranges, opens a new handle to the stream for each one with
+    \a _open_stream, and finds the links that start in each range using that
+    handle.
+   The resulting link tables are then checked against each other and merged,
+    giving the same result as op_test_open().
+   If they do not fit together (e.g., because a link starting in one range has
+    streams multiplexed with it in another), or any of the scans fail, this
+    falls back to scanning the stream normally with the original handle.
+   This library does not depend on a threading library, so it does not create
+    any threads itself.
+   Instead, it passes the scan of each range to \a _run as a separate task,
+    which can run them on a pool of threads managed by the application.
+   This is most useful for streams with many links on storage where several
+    requests can be in flight at once, such as an SSD or an HTTP server
+    reached through several connections.
+   Streams with a single link are opened as with op_test_open(), without
+    opening any new handles, as are unseekable streams.
+   The reads and seeks made through the new handles are included in the
+    statistics returned by op_get_stats().
+   If this function fails, you are still responsible for freeing the
+    \c OggOpusFile with op_free().
+   \param _of          The \c OggOpusFile to finish opening.
+   \param _nranges     The maximum number of byte ranges to scan at once.
+                       Fewer ranges are used if the stream is small.
+   \param _open_stream The function used to open another handle to the same
+                        stream for each range.
+                       The stream contents seen through each handle must be
+                        identical to those of the original.
+   \param _open_ctx    An application-provided pointer to pass to
+                        \a _open_stream.
+   \param _run         The function used to run the scans, or
+                        <code>NULL</code> to run them one after another on the
+                        calling thread.
+   \param _run_ctx     An application-provided pointer to pass to \a _run.
+   \return 0 on success, or a negative value on error.
+           See op_test_open() for a list of failure codes.*/
+int op_test_open_parallel(OggOpusFile *_of,int _nranges,
+ op_open_stream_func _open_stream,void *_open_ctx,
+ op_run_func _run,void *_run_ctx) OP_ARG_NONNULL(1) OP_ARG_NONNULL(3);
+
+/**Prepare the link information of a stream to be shared with handles opened
+    by op_open_shared() from several threads.
+   The handles sharing the link information keep a count of references to it,
+    so that the last one freed can free it.
+   This library does not depend on a threading library, so the application
+    supplies functions to lock and unlock a mutex (or similar) that protects
+    the count.
+   This must be called before any handle shares the links of \a _of.
+   \param _of       The \c OggOpusFile whose links will be shared.
+                    This must be a fully opened, seekable stream, and all of
+                     its links must have been found (see op_enumerate_links()).
+   \param _lock     The function used to lock the reference count.
+   \param _unlock   The function used to unlock the reference count.
+   \param _lock_ctx An application-provided pointer to pass to \a _lock and
+                     \a _unlock.
+   \retval 0           Success.
+   \retval #OP_EFAULT  There was a memory allocation failure.
+   \retval #OP_EINVAL  \a _of was not fully opened, not all of its links have
+                        been found yet, or its links are already shared.
+   \retval #OP_ENOSEEK \a _of is not seekable.*/
+int op_share_links(OggOpusFile *_of,op_lock_func _lock,op_lock_func _unlock,
+ void *_lock_ctx) OP_ARG_NONNULL(1) OP_ARG_NONNULL(2) OP_ARG_NONNULL(3);
+
+/**Open another handle to a stream that is already open, sharing the
+    information about its links with the original.
+   Applications that play the same file for many listeners at once would
+    otherwise have to open it again for each one, searching for every link and
+    keeping a separate copy of all of the headers and tags.
+   Instead, the new \c OggOpusFile reads from a new stream handle, but shares a
+    reference-counted copy of the link information (the ID and comment headers,
+    serial numbers, offsets, and timestamps of each link) with \a _of, which
+    cannot change once all of the links have been found.
+   The only I/O needed to open it is a seek to the start of the audio data in
+    the first link (and a read of the page there).
+   The new handle is otherwise independent: it starts at the beginning of the
+    stream, with the default settings for the decode rate, gain, dithering,
+    seek index, and so on, and can be read, seeked, and freed without regard to
+    \a _of.
+   The shared information is freed when the last handle using it is freed with
+    op_free().
+   If the handles sharing the link information are created or freed from
+    different threads, call op_share_links() on \a _of first to supply a lock
+    for the reference count.
+   After that, this function may be called on \a _of from any thread, even
+    while another thread is reading from \a _of, and the handles it returns
+    may be freed from any thread.
+   Without a lock, calls to this function must not be made at the same time as
+    any other call using \a _of, nor at the same time as a call to op_free() on
+    any handle sharing its links.
+   \param      _of     The \c OggOpusFile whose links should be shared.
+                       This must be a fully opened, seekable stream.
+                       If it was opened with op_test_open_lazy(), all of its
+                        links must have been found (see op_enumerate_links()).
+   \param      _stream The new handle to the stream to read from.
+                       This value will be passed verbatim as the first
+                        argument to all of the callbacks.
+                       The contents of the stream must be identical to those
+                        of the one used by \a _of.
+   \param      _cb     The callbacks with which to access the new handle.
+                       \ref op_read_func "read()", \ref op_seek_func "seek()",
+                        and \ref op_tell_func "tell()" must be implemented.
+                       \ref op_close_func "close()" may be <code>NULL</code>,
+                        but if it is not, it will be called when the \c
+                        OggOpusFile is destroyed by op_free().
+                       It will not be called if op_open_shared() fails with an
+                        error.
+   \param[out] _error  Returns 0 on success, or a failure code on error.
+                       You may pass in <code>NULL</code> if you don't want the
+                        failure code.
+                       The failure code will be one of
+                       <dl>
+                         <dt>#OP_EREAD</dt>
+                         <dd>An underlying read or seek operation failed, or
+                          the new handle does not implement the required
+                          callbacks.</dd>
+                         <dt>#OP_EFAULT</dt>
+                         <dd>There was a memory allocation failure, or an
+                          internal library error.</dd>
+                         <dt>#OP_EINVAL</dt>
+                         <dd>\a _of was not fully opened, or not all of its
+                          links have been found yet.</dd>
+                         <dt>#OP_ENOSEEK</dt>
+                         <dd>\a _of is not seekable.</dd>
+                         <dt>#OP_EBADLINK</dt>
+                         <dd>We failed to find data we had seen before after
+                          seeking.</dd>
+                       </dl>
+   \return A freshly opened \c OggOpusFile, or <code>NULL</code> on error.
+           <tt>libopusfile</tt> does <em>not</em> take ownership of the stream
+            if the call fails.
+           The calling application is responsible for closing the stream if
+            this call returns an error.*/
+OP_WARN_UNUSED_RESULT OggOpusFile *op_open_shared(OggOpusFile *_of,
+ void *_stream,const OpusFileCallbacks *_cb,int *_error)
+ OP_ARG_NONNULL(1) OP_ARG_NONNULL(3);
+
+/**Open another handle to a stream that is already open from the given file
+    path, sharing the information about its links with the original.
+   See op_open_shared() for details.
+   \param      _of    The \c OggOpusFile whose links should be shared.
+   \param      _path  The path to the file to open.
+                      This must be the same file \a _of was opened from.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      The failure code will be #OP_EFAULT if the file could not
+                       be opened, or one of the other failure codes from
+                       op_open_shared() otherwise.
+   \return A freshly opened \c OggOpusFile, or <code>NULL</code> on error.*/
+OP_WARN_UNUSED_RESULT OggOpusFile *op_open_shared_file(OggOpusFile *_of,
+ const char *_path,int *_error) OP_ARG_NONNULL(1) OP_ARG_NONNULL(2);
+
 /**Release all memory used by an \c OggOpusFile.
    \param _of The \c OggOpusFile to free.*/
 void op_free(OggOpusFile *_of);
 
+/**Retrieves the stream an \c OggOpusFile is reading from and the callbacks it
+    uses to access it.
+   These are the values passed to whichever function opened the stream.
+   For a stream opened with op_open_url() or one of the other convenience
+    functions, this returns the stream they created internally.
+   This lets a library that provides its own kind of stream, like
+    <tt>libopusurl</tt>, recognize its streams and get at their state.
+   The application must not read from, seek in, or close the stream itself.
+   \param      _of The \c OggOpusFile whose stream should be returned.
+   \param[out] _cb Returns the callbacks used to access the stream.
+                   You may pass in <code>NULL</code> if you don't want them.
+   \return The stream pointer passed as the first argument to the callbacks.*/
+void *op_get_stream(const OggOpusFile *_of,OpusFileCallbacks *_cb)
+ OP_ARG_NONNULL(1);
+
+/**Lets the stream's \ref op_read_func "read()" callback return #OP_EAGAIN
+    instead of blocking.
+   Most reads cannot be safely restarted after the stream runs out of data,
+    so a stream may only return #OP_EAGAIN while \a *_flag is non-zero.
+   This library sets \a *_flag before each read from the stream that it can
+    restart later, and clears it again afterwards.
+   When the callback returns #OP_EAGAIN for such a read, op_read() and the
+    other read functions return #OP_EAGAIN to the application, which can call
+    them again once the stream has more data.
+   If the callback returns #OP_EAGAIN at any other time, it is treated as a
+    read error.
+   The stream must keep returning #OP_EAGAIN without losing data until it can
+    return more data.
+   This is used by op_url_set_nonblocking() to implement non-blocking reads,
+    and there is normally no reason for an application to call it directly.
+   \param _of   The \c OggOpusFile whose stream can return #OP_EAGAIN.
+   \param _flag The flag to set around reads that can be restarted, or
+                 <code>NULL</code> to disable non-blocking reads.
+                This must remain valid until the \c OggOpusFile is freed or
+                 this function is called again.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EINVAL The stream was only partially open.*/
+int op_set_nonblocking_flag(OggOpusFile *_of,int *_flag) OP_ARG_NONNULL(1);
+
+/**Information about a single link of a stream examined with
+    op_probe_callbacks().*/
+struct OpusProbeLink{
+  /**The ID header of this link.*/
+  OpusHead    head;
+  /**The comment header of this link.*/
+  OpusTags    tags;
+  /**The serial number of the Opus stream in this link.*/
+  opus_uint32 serialno;
+  /**The byte offset of the start of this link.
+     This is <code>-1</code> if the stream is not seekable.*/
+  opus_int64  offset;
+  /**The size of this link in bytes (see op_raw_total()).
+     This is <code>-1</code> if the stream is not seekable.*/
+  opus_int64  size;
+  /**The duration of this link, in samples at 48&nbsp;kHz (see
+      op_pcm_total()).
+     This is <code>-1</code> if the stream is not seekable.*/
+  ogg_int64_t pcm_total;
+  /**The average bitrate of this link, in bits per second (see op_bitrate()).
+     This is <code>-1</code> if the stream is not seekable.*/
+  opus_int32  bitrate;
+};
+
+/**Information about a stream examined with op_probe_callbacks().
+   This is everything the stream information functions would return for an
+    \c OggOpusFile opened on the same stream.*/
+struct OpusProbeInfo{
+  /**Whether or not the stream was seekable (see op_seekable()).
+     If it was not, only the first link is available, and none of the sizes,
+      durations, or bitrates are known.*/
+  int            seekable;
+  /**The number of links in \a links.*/
+  int            nlinks;
+  /**The information for each link.*/
+  OpusProbeLink *links;
+  /**The total size of the stream in bytes, or <code>-1</code> if it is not
+      seekable.*/
+  opus_int64     size;
+  /**The total duration of the stream, in samples at 48&nbsp;kHz, or
+      <code>-1</code> if it is not seekable.*/
+  ogg_int64_t    pcm_total;
+  /**The average bitrate of the stream, in bits per second, or
+      <code>-1</code> if it is not seekable.*/
+  opus_int32     bitrate;
+};
+
+/**Read the headers, link structure, and durations of a stream without
+    preparing it for decoding.
+   This does all of the work of op_open_callbacks() needed to answer the
+    stream information queries, but never creates a decoder, and does not keep
+    the stream or any of its buffers once it returns.
+   It is intended for applications that scan large numbers of files only to
+    collect their metadata.
+   \param _stream        The stream to read from (e.g., a <code>FILE *</code>).
+                         This value will be passed verbatim as the first
+                          argument to all of the callbacks.
+   \param _cb            The callbacks with which to access the stream.
+                         The requirements are the same as for
+                          op_open_callbacks(), except that
+                          \ref op_close_func "close()" is never called: the
+                          calling application is always responsible for
+                          closing the stream.
+   \param _initial_data  An initial buffer of data from the start of the
+                          stream.
+                         See op_open_callbacks() for details.
+   \param _initial_bytes The number of bytes in \a _initial_data.
+   \param[out] _error    Returns 0 on success, or a failure code on error.
+                         You may pass in <code>NULL</code> if you don't want
+                          the failure code.
+                         See op_open_callbacks() for a full list of failure
+                          codes.
+   \return The information about the stream, which must be freed with
+            op_probe_free(), or <code>NULL</code> on error.*/
+OP_WARN_UNUSED_RESULT OpusProbeInfo *op_probe_callbacks(void *_stream,
+ const OpusFileCallbacks *_cb,const unsigned char *_initial_data,
+ size_t _initial_bytes,int *_error) OP_ARG_NONNULL(2);
+
+/**Read the headers, link structure, and durations of a file without preparing
+    it for decoding.
+   \param      _path  The path to the file to probe.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      The failure code will be #OP_EFAULT if the file could not
+                       be opened, or one of the other failure codes from
+                       op_open_callbacks() otherwise.
+   \return The information about the file, which must be freed with
+            op_probe_free(), or <code>NULL</code> on error.
+   \see op_probe_callbacks*/
+OP_WARN_UNUSED_RESULT OpusProbeInfo *op_probe_file(const char *_path,
+ int *_error) OP_ARG_NONNULL(1);
+
+/**Read the headers, link structure, and durations of a stream stored in memory
+    without preparing it for decoding.
+   \param      _data  The memory buffer to probe.
+   \param      _size  The number of bytes available in the buffer.
+   \param[out] _error Returns 0 on success, or a failure code on error.
+                      You may pass in <code>NULL</code> if you don't want the
+                       failure code.
+                      See op_open_callbacks() for a full list of failure
+                       codes.
+   \return The information about the stream, which must be freed with
+            op_probe_free(), or <code>NULL</code> on error.
+   \see op_probe_callbacks*/
+OP_WARN_UNUSED_RESULT OpusProbeInfo *op_probe_memory(const unsigned char *_data,
+ size_t _size,int *_error);
+
+/**Compute the total duration of a stream without preparing it for decoding.
+   This returns the same value as op_pcm_total() with a \a _li of
+    <code>-1</code> would for an \c OggOpusFile opened on the same stream.
+   For a stream with a single link, this reads only the headers at the start of
+    the stream and the window at the end of the stream that contains the last
+    page, the latter with a single call to \ref op_read_func "read()".
+   The links of a chained stream still have to be enumerated, so this is no
+    faster than op_probe_callbacks() for those.
+   \param _stream        The stream to read from (e.g., a <code>FILE *</code>).
+                         This value will be passed verbatim as the first
+                          argument to all of the callbacks.
+   \param _cb            The callbacks with which to access the stream.
+                         See op_probe_callbacks() for the requirements.
+                         \ref op_close_func "close()" is never called.
+   \param _initial_data  An initial buffer of data from the start of the
+                          stream.
+                         See op_open_callbacks() for details.
+   \param _initial_bytes The number of bytes in \a _initial_data.
+   \return The duration of the stream, in samples at 48&nbsp;kHz, or a negative
+            value on error.
+   \retval #OP_ENOSEEK The stream is not seekable, so its duration cannot be
+                        determined without reading all of it.
+           See op_open_callbacks() for a list of the other failure codes.*/
+ogg_int64_t op_probe_duration_callbacks(void *_stream,
+ const OpusFileCallbacks *_cb,const unsigned char *_initial_data,
+ size_t _initial_bytes) OP_ARG_NONNULL(2);
+
+/**Compute the total duration of a file without preparing it for decoding.
+   \param _path The path to the file to probe.
+   \return The duration of the file, in samples at 48&nbsp;kHz, or a negative
+            value on error.
+   \retval #OP_EFAULT The file could not be opened.
+           See op_probe_duration_callbacks() for a list of the other failure
+            codes.
+   \see op_probe_duration_callbacks*/
+ogg_int64_t op_probe_duration_file(const char *_path) OP_ARG_NONNULL(1);
+
+/**Release all memory used by an \c OpusProbeInfo.
+   \param _info The \c OpusProbeInfo to free.*/
+void op_probe_free(OpusProbeInfo *_info);
+
 /**@}*/
 /**@}*/
 
@@ -1449,9 +2228,35 @@ int op_seekable(const OggOpusFile *_of) OP_ARG_NONNULL(1);
    \param _of The \c OggOpusFile from which to retrieve the link count.
    \return For fully-open seekable streams, this returns the total number of
             links in the whole stream, which will be at least 1.
+           For streams opened with op_test_open_lazy(), this returns the
+            number of links found so far, which may grow as more are found.
            For partially-open or unseekable streams, this always returns 1.*/
 int op_link_count(const OggOpusFile *_of) OP_ARG_NONNULL(1);
 
+/**Find more of the links in a stream opened with op_test_open_lazy().
+   Link \a _li is complete once the start of the link after it has been found
+    (or it turned out to be the last one), after which op_pcm_total(),
+    op_raw_total(), and op_bitrate() work for it.
+   This does not disturb playback: decoding continues from the same position
+    afterwards.
+   For streams opened any other way, all the links are already known, and this
+    does nothing.
+   \param _of The \c OggOpusFile in which to find more links.
+   \param _li The index of the link that should be complete on return.
+              Use a negative number to find all of the links.
+   \return 0 if all the links in the stream have been found, 1 if there are
+            more, or a negative value on error.
+           If an error occurs, the links that were already complete can still
+            be used, but no more will be found.
+   \retval #OP_EINVAL   The stream was only partially open.
+   \retval #OP_ENOSEEK  The stream is not seekable.
+   \retval #OP_EREAD    An underlying read, seek, or tell operation failed.
+   \retval #OP_EFAULT   There was a memory allocation failure, or an internal
+                         library error.
+   \retval #OP_EBADLINK We failed to find data we had seen before, or the
+                         stream was damaged.*/
+int op_enumerate_links(OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
+
 /**Get the serial number of the given link in a (possibly-chained) Ogg Opus
     stream.
    This function may be called on partially-opened streams, but it will always
@@ -1503,7 +2308,9 @@ int op_channel_count(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
             file.
    \retval #OP_EINVAL The stream is not seekable (so we can't know the length),
                        \a _li wasn't less than the total number of links in
-                       the stream, or the stream was only partially open.*/
+                       the stream, the stream was only partially open, or
+                       the end of link \a _li has not been found yet (see
+                       op_test_open_lazy()).*/
 opus_int64 op_raw_total(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
 
 /**Get the total PCM length (number of samples at 48 kHz) of the stream, or of
@@ -1521,7 +2328,10 @@ opus_int64 op_raw_total(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
             error.
    \retval #OP_EINVAL The stream is not seekable (so we can't know the length),
                        \a _li wasn't less than the total number of links in
-                       the stream, or the stream was only partially open.*/
+                       the stream, the stream was only partially open, or
+                       the end of link \a _li (or, if \a _li is negative,
+                       some link) has not been found yet (see
+                       op_test_open_lazy()).*/
 ogg_int64_t op_pcm_total(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
 
 /**Get the ID header information for the given link in a (possibly chained) Ogg
@@ -1575,6 +2385,25 @@ const OpusTags *op_tags(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
    \retval #OP_EINVAL The stream was only partially open.*/
 int op_current_link(const OggOpusFile *_of) OP_ARG_NONNULL(1);
 
+/**Save the table of links found while opening a seekable stream.
+   This includes the location and timing of each link, along with its ID and
+    comment headers.
+   The table can be passed to op_test_open_links() to open the same stream
+    again later without having to scan it.
+   \param      _of   The \c OggOpusFile from which to save the link table.
+   \param[out] _data The buffer in which to store the table.
+                     This may be <code>NULL</code> to just query the size of
+                      the table.
+   \param      _size The size of the buffer.
+                     If this is smaller than the size of the table, nothing is
+                      stored.
+   \return The size of the link table in bytes, or a negative value on error.
+   \retval #OP_EINVAL The stream was only partially open, is not seekable, or
+                       was opened with op_test_open_lazy() and not all of its
+                       links have been found yet.*/
+opus_int64 op_export_links(const OggOpusFile *_of,
+ unsigned char *_data,size_t _size) OP_ARG_NONNULL(1);
+
 /**Computes the bitrate of the stream, or of an individual link in a
     (possibly-chained) Ogg Opus stream.
    The stream must be seekable to compute the bitrate.
@@ -1593,8 +2422,10 @@ int op_current_link(const OggOpusFile *_of) OP_ARG_NONNULL(1);
               Use a negative number to get the bitrate of the whole stream.
    \return The bitrate on success, or a negative value on error.
    \retval #OP_EINVAL The stream was only partially open, the stream was not
-                       seekable, or \a _li was larger than the number of
-                       links.*/
+                       seekable, \a _li was larger than the number of
+                       links, or the end of link \a _li (or, if \a _li is
+                       negative, some link) has not been found yet (see
+                       op_test_open_lazy()).*/
 opus_int32 op_bitrate(const OggOpusFile *_of,int _li) OP_ARG_NONNULL(1);
 
 /**Compute the instantaneous bitrate, measured as the ratio of bits to playable
@@ -1625,6 +2456,82 @@ opus_int64 op_raw_tell(const OggOpusFile *_of) OP_ARG_NONNULL(1);
    \retval #OP_EINVAL The stream was only partially open.*/
 ogg_int64_t op_pcm_tell(const OggOpusFile *_of) OP_ARG_NONNULL(1);
 
+/**Cumulative counts of the work done by an \c OggOpusFile.
+   These are intended for diagnosing files that are unusually expensive to
+    open, seek in, or decode, and for tuning the underlying storage.
+   All counts start at zero when the \c OggOpusFile is opened (so they include
+    the work done by the open itself), and are reset by op_reset_stats().
+   Pages are framed directly from streams whose contents are already resident
+    in memory (such as those opened with op_open_memory() or op_open_mmap()),
+    so no reads or seeks are counted for them.*/
+struct OpusFileStats{
+  /**The number of calls made to the \ref op_read_func "read()" callback.*/
+  opus_int64 nreads;
+  /**The number of bytes returned by the \ref op_read_func "read()"
+      callback.*/
+  opus_int64 bytes_read;
+  /**The number of calls made to the \ref op_seek_func "seek()" callback.*/
+  opus_int64 nseeks;
+  /**The number of Ogg pages found in the stream.
+     This includes pages that were examined while seeking or enumerating links
+      and then discarded.*/
+  opus_int64 pages_synced;
+  /**The number of pages skipped during playback because they belonged to a
+      logical stream other than the Opus stream being decoded (e.g., a
+      multiplexed video stream).*/
+  opus_int64 pages_skipped;
+  /**The number of bisection steps taken by op_pcm_seek() to locate its target
+      page.*/
+  opus_int64 seek_bisections;
+  /**The number of bisection steps taken to locate the boundaries between the
+      links of a chained stream while opening it.*/
+  opus_int64 link_bisections;
+  /**The number of packets decoded.*/
+  opus_int64 packets_decoded;
+  /**The number of samples (per channel, at 48&nbsp;kHz) that were decoded and
+      then discarded for pre-skip or seek pre-roll.*/
+  opus_int64 samples_discarded;
+  /**The time spent decoding packets, in microseconds.
+     This is only measured while enabled with op_set_decode_timing_enabled(),
+      and is 0 otherwise.
+     This is processor time, not wall time, so time the decoding thread
+      spends blocked or waiting to be scheduled is not counted.
+     Where the platform supports it, this is the processor time used by the
+      thread doing the decoding, so it is not inflated by other threads
+      decoding at the same time.
+     Otherwise, it is the processor time used by the whole process, as
+      reported by <code>clock()</code>, which does include other threads.
+     This includes processor time spent in any callback installed with
+      op_set_decode_callback().*/
+  opus_int64 decode_time_us;
+};
+
+/**Retrieves the cumulative I/O and decoding statistics for a stream.
+   These may be retrieved at any time, including from a stream that is only
+    partially open.
+   \param      _of    The \c OggOpusFile from which to retrieve the
+                       statistics.
+   \param[out] _stats Returns the counts accumulated since the stream was
+                       opened or the last call to op_reset_stats(), whichever
+                       was most recent.*/
+void op_get_stats(const OggOpusFile *_of,OpusFileStats *_stats)
+ OP_ARG_NONNULL(1) OP_ARG_NONNULL(2);
+
+/**Resets all of the statistics for a stream to zero.
+   \param _of The \c OggOpusFile whose statistics should be reset.*/
+void op_reset_stats(OggOpusFile *_of) OP_ARG_NONNULL(1);
+
+/**Sets whether or not to measure the time spent decoding each packet for the
+    \ref OpusFileStats::decode_time_us "decode_time_us" statistic.
+   This reads a clock twice for every packet decoded, so it is disabled by
+    default.
+   \param _of      The \c OggOpusFile on which to enable or disable decode
+                    timing.
+   \param _enabled A non-zero value to enable decode timing, or 0 to disable
+                    it.*/
+void op_set_decode_timing_enabled(OggOpusFile *_of,int _enabled)
+ OP_ARG_NONNULL(1);
+
 /**@}*/
 /**@}*/
 
@@ -1675,6 +2582,8 @@ int op_raw_seek(OggOpusFile *_of,opus_int64 _byte_offset) OP_ARG_NONNULL(1);
 
 /**Seek to the specified PCM offset, such that decoding will begin at exactly
     the requested position.
+   If the stream was opened with op_test_open_lazy(), this first finds the link
+    containing the target, if it has not been found already.
    \param _of         The \c OggOpusFile in which to seek.
    \param _pcm_offset The PCM offset to seek to.
                       This is in samples at 48 kHz relative to the start of the
@@ -1689,6 +2598,96 @@ int op_raw_seek(OggOpusFile *_of,opus_int64 _byte_offset) OP_ARG_NONNULL(1);
                          seeking to the target destination was impossible.*/
 int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset) OP_ARG_NONNULL(1);
 
+/**Sets whether or not to remember the locations of pages seen while decoding
+    for use by later seeks.
+   When enabled, each time a page with a valid timestamp is read from a
+    seekable stream, its offset and granule position are recorded (keeping at
+    most one page per second of audio).
+   op_pcm_seek() then uses the nearest recorded pages on either side of the
+    target to narrow its initial search range, which avoids most of the
+    bisection reads when seeking back to a region that has already been played.
+   This is particularly useful for applications that seek repeatedly within a
+    stream over a slow or high-latency transport.
+   The index is disabled by default.
+   Disabling it discards any locations already recorded.
+   This has no effect on unseekable streams.
+   \param _of      The \c OggOpusFile on which to enable or disable the seek
+                    index.
+   \param _enabled A non-zero value to enable the seek index, or 0 to disable
+                    it.*/
+void op_set_seek_index_enabled(OggOpusFile *_of,int _enabled)
+ OP_ARG_NONNULL(1);
+
+/**Builds a complete seek index for the stream.
+   This makes a single linear pass over the data pages of every link, reading
+    only the page headers (and checksums) without decoding any audio, and
+    records the location of a page at least every \a _granularity_ms
+    milliseconds.
+   Any locations already in the index are discarded first, and any recorded
+    during later playback will use the same spacing.
+   Once built, op_pcm_seek() can usually locate its target with a single seek,
+    followed by the usual 80&nbsp;ms of pre-roll decoding.
+   Because this reads the entire stream, it is best done once, with the result
+    saved using op_export_seek_index() and restored in later sessions with
+    op_import_seek_index().
+   The current decoding position is not changed.
+   \param _of             The \c OggOpusFile for which to build the index.
+   \param _granularity_ms The minimum spacing between entries in the index, in
+                           milliseconds.
+                          Use 0 to record every page.
+   \return 0 on success, or a negative value on error.
+           On failure, the index contains any locations found before the error
+            occurred.
+   \retval #OP_EREAD    An underlying read or seek operation failed.
+   \retval #OP_EFAULT   An internal memory allocation failed.
+   \retval #OP_EINVAL   The stream was only partially open, or
+                         \a _granularity_ms was negative or too large.
+   \retval #OP_ENOSEEK  This stream is not seekable.
+   \retval #OP_EBADLINK We failed to find data we had seen before.*/
+int op_build_seek_index(OggOpusFile *_of,
+ opus_int32 _granularity_ms) OP_ARG_NONNULL(1);
+
+/**Serializes the seek index into a buffer.
+   The result can be passed to op_import_seek_index() on a later
+    \c OggOpusFile opened on the same stream.
+   It is not tied to the architecture of the machine that created it.
+   \param      _of   The \c OggOpusFile whose seek index should be saved.
+   \param[out] _data The buffer in which to store the index.
+                     This may be <code>NULL</code>, in which case only the
+                      required size is returned.
+   \param      _size The size of the buffer, in bytes.
+                     If this is smaller than the required size, nothing is
+                      written.
+   \return The number of bytes required to store the index, or a negative
+            value on error.
+   \retval #OP_EINVAL The stream was only partially open, or is not
+                       seekable.*/
+opus_int64 op_export_seek_index(const OggOpusFile *_of,
+ unsigned char *_data,size_t _size) OP_ARG_NONNULL(1);
+
+/**Replaces the seek index with one saved by op_export_seek_index().
+   The index is checked against the size of the stream and the link table, so
+    an index saved from a different or modified stream will usually be
+    rejected.
+   This does not enable recording of new locations during playback; use
+    op_set_seek_index_enabled() for that.
+   \param _of   The \c OggOpusFile into which to load the index.
+   \param _data The buffer containing the saved index.
+   \param _size The size of the buffer, in bytes.
+   \return 0 on success, or a negative value on error.
+           On failure, the existing index is left unchanged.
+   \retval #OP_EFAULT     An internal memory allocation failed.
+   \retval #OP_EINVAL     The stream was only partially open or is not
+                           seekable, or the index was saved from a stream with
+                           a different size.
+   \retval #OP_ENOTFORMAT The buffer does not contain a seek index.
+   \retval #OP_EVERSION   The index was saved in an unrecognized format
+                           version.
+   \retval #OP_EBADHEADER The index was corrupt, or did not match the links in
+                           this stream.*/
+int op_import_seek_index(OggOpusFile *_of,
+ const unsigned char *_data,size_t _size) OP_ARG_NONNULL(1);
+
 /**@}*/
 /**@}*/
 
@@ -1851,6 +2850,221 @@ int op_set_gain_offset(OggOpusFile *_of,
    \param _enabled A non-zero value to enable dithering, or 0 to disable it.*/
 void op_set_dither_enabled(OggOpusFile *_of,int _enabled) OP_ARG_NONNULL(1);
 
+/**Sets the sampling rate at which to decode.
+   By default, audio is decoded at 48&nbsp;kHz.
+   <code>libopus</code> can decode directly at a lower rate at a substantially
+    reduced CPU cost, which is useful for applications that only need to
+    analyze the audio (e.g., to draw a waveform or compute a fingerprint) and
+    would otherwise immediately resample it.
+   When a lower rate is set, op_read(), op_read_float(), op_read_stereo(), and
+    op_read_float_stereo() return samples at that rate, and their return values
+    count samples at that rate.
+   Everything else, including op_pcm_tell(), op_pcm_seek(), op_pcm_total(),
+    and the pre-skip and end-trimming values in the headers, continues to use
+    samples at 48&nbsp;kHz.
+   Pre-skip, pre-roll, and end-trimming are applied at 48&nbsp;kHz
+    resolution, and a decoded sample is kept if the 48&nbsp;kHz sample it
+    starts with is kept.
+   Any decode callback set with op_set_decode_callback() receives a decoder
+    created at this rate, and \a _nsamples is also in samples at this rate.
+   If a decoder is already active on a seekable stream, this re-seeks to the
+    current position so that decoding continues seamlessly at the new rate.
+   On an unseekable stream, any samples already decoded but not yet returned
+    are discarded, and decoding restarts at the next packet without pre-roll.
+   \param _of   The \c OggOpusFile on which to set the decoding rate.
+   \param _rate The sampling rate, in Hz.
+                This must be one of 8000, 12000, 16000, 24000, or 48000.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EINVAL  \a _rate was not one of the supported rates.
+   \retval #OP_EFAULT  An internal memory allocation failed.
+   \retval #OP_EREAD   An underlying read or seek operation failed while
+                        re-seeking to the current position.
+   \retval #OP_EBADLINK We failed to find data we had seen before while
+                         re-seeking to the current position.*/
+int op_set_decode_rate(OggOpusFile *_of,opus_int32 _rate) OP_ARG_NONNULL(1);
+
+/**Sets the size of the decode-ahead buffer.
+   When this is non-zero, op_decode_ahead() can be used to decode audio before
+    the application asks for it, at a time (and on a thread) of its choosing,
+    so that later calls to op_read(), op_read_float(), op_read_stereo(), or
+    op_read_float_stereo() simply copy (or convert) samples from the buffer
+    without performing any I/O or decoding.
+   The buffer holds samples from several links at once, so filling it does not
+    stop at the end of a link.
+   <tt>libopusfile</tt> does not create any threads itself.
+   If \a _lock and \a _unlock are provided, op_decode_ahead() may run on one
+    thread while the read functions and op_pcm_tell() run on another.
+   This library does not depend on a threading library, so the application
+    supplies functions to lock and unlock a mutex (or similar).
+   These are only held while the position of the buffered samples is read or
+    updated, never while decoding or waiting for data, so the read functions
+    do not wait for a slow read.
+   In this mode, if the buffer is empty, the read functions return
+    #OP_EAGAIN instead of decoding more data themselves, or 0 once
+    op_decode_ahead() has reached the end of the stream.
+   No other function may be called on \a _of while op_decode_ahead() is
+    running, and no two threads may read from it at the same time.
+   Without \a _lock and \a _unlock, the \c OggOpusFile may still only be used by
+    one thread at a time, and the read functions decode more data themselves
+    once the buffer is empty.
+   Seeking discards the contents of the buffer.
+   If the buffer contains samples when its size is changed, a seekable stream
+    will seek back to the current position and decode them again, while an
+    unseekable stream will lose them.
+   \param _of       The \c OggOpusFile on which to set the buffer size.
+   \param _nsamples The number of samples per channel to decode ahead, at the
+                     rate set with op_set_decode_rate(), for the link with the
+                     most channels.
+                    Links with fewer channels can buffer more samples.
+                    Use 0 to disable decoding ahead and free the buffer.
+   \param _lock     The function used to lock the buffer, or <code>NULL</code>
+                     if op_decode_ahead() will only be called on the same
+                     thread as the read functions.
+   \param _unlock   The function used to unlock the buffer, or
+                     <code>NULL</code>.
+   \param _lock_ctx An application-provided pointer to pass to \a _lock and
+                     \a _unlock.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EINVAL The stream was only partially open, \a _nsamples was
+                       negative or too large, or only one of \a _lock and
+                       \a _unlock was provided.
+   \retval #OP_EFAULT An internal memory allocation failed.
+                      Decoding ahead is disabled.*/
+int op_set_decode_ahead(OggOpusFile *_of,int _nsamples,
+ op_lock_func _lock,op_lock_func _unlock,void *_lock_ctx) OP_ARG_NONNULL(1);
+
+/**Decodes audio into the decode-ahead buffer until it is full.
+   The samples are decoded outside of the lock passed to op_set_decode_ahead(),
+    so the read functions can keep taking samples out of the buffer while this
+    waits for data.
+   This does nothing if op_set_decode_ahead() has not been called with a
+    non-zero size.
+   \param _of The \c OggOpusFile from which to decode.
+   \return The number of samples per channel now in the buffer, or a negative
+            value on error.
+           The possible failure codes are the same as for op_read().
+           In particular, #OP_HOLE is returned here, instead of by a later
+            read, if a hole is found while decoding ahead.
+           Samples buffered before the error remain in the buffer, and this
+            function may be called again to continue past the hole.
+           If non-blocking reads are enabled with op_url_set_nonblocking() and
+            the stream runs out of data after some samples have been
+            buffered, this returns the number buffered instead of
+            #OP_EAGAIN.*/
+int op_decode_ahead(OggOpusFile *_of) OP_ARG_NONNULL(1);
+
+/**Indicates that op_url_poll_fd() is waiting for its socket to become
+    readable.*/
+#define OP_POLL_IN  (1)
+/**Indicates that op_url_poll_fd() is waiting for its socket to become
+    writable.*/
+#define OP_POLL_OUT (2)
+
+/**A socket descriptor returned by op_url_poll_fd().
+   On Windows, this is the same size as a <code>SOCKET</code>, and can be cast
+    to one without losing any bits.
+   Everywhere else it is a file descriptor.*/
+# if defined(_WIN32)
+typedef size_t op_socket;
+# else
+typedef int op_socket;
+# endif
+
+/**Enables or disables non-blocking reads from a stream opened with
+    op_open_url() or op_test_url() (or with op_open_callbacks() or
+    op_test_callbacks() using a stream created by op_url_stream_create()).
+   By default, reading from a URL blocks until data arrives from the server.
+   With non-blocking reads enabled, op_read(), op_read_float(),
+    op_read_stereo(), op_read_float_stereo(), and op_read_packet() instead
+    return #OP_EAGAIN if they would have to wait before they could return
+    anything.
+   The application can then wait for the socket returned by op_url_poll_fd()
+    to become ready, along with any others it is managing, and call the read
+    function again, which picks up where it left off.
+   This allows a single thread to drive many streams at once.
+   The stream is found with op_get_stream(), and non-blocking reads are turned
+    on with op_set_nonblocking_flag(), so the stream's callbacks must not be
+    wrapped by the application, or it will not be recognized as a URL stream.
+
+   Reading stays non-blocking when the server closes the connection or a
+    pipelined request has to be answered: a new connection to the address
+    that worked last time is started without waiting, and its TLS handshake,
+    request, and response headers are handled in steps, each of which returns
+    #OP_EAGAIN until the server responds.
+   \warning Some operations still block, just as if non-blocking reads were
+    disabled, for as long as it takes the server to respond (up to the usual
+    timeouts).
+   In particular:
+   <ul>
+   <li>Opening the stream blocks.</li>
+   <li>Seeking (op_raw_seek(), op_pcm_seek(), and anything else that seeks,
+    such as op_test_open_parallel()) blocks, since it may need to open new
+    connections and wait for the responses to new requests.</li>
+   <li>Reconnecting blocks if the address of the server has to be looked up
+    again (because the cached address is too old, or connecting to it
+    failed), or if the connection goes through a proxy, which needs a
+    <code>CONNECT</code> tunnel for <https:> URLs.</li>
+   <li>Reading the headers of a new link blocks until its first audio data
+    arrives.</li>
+   <li>Writing a request to the server, and reading the trailer at the end of
+    a chunked response, may block for a short time.</li>
+   </ul>
+   Non-blocking reads do not need to be disabled before seeking.
+   \param _of          The \c OggOpusFile on which to enable or disable
+                        non-blocking reads.
+   \param _nonblocking Non-zero to enable non-blocking reads, or zero to
+                        disable them.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_EINVAL The stream was only partially open, it was not a URL
+                       stream, or <tt>libopusurl</tt> was built without
+                       support for HTTP.*/
+int op_url_set_nonblocking(OggOpusFile *_of,int _nonblocking)
+ OP_ARG_NONNULL(1);
+
+/**Retrieves the socket a read function is waiting on after it returned
+    #OP_EAGAIN for a stream with non-blocking reads enabled.
+   The socket and the events to wait for may change after every call to a
+    read or seek function, so this should be called again after each one
+    returns #OP_EAGAIN.
+   The application must not read from, write to, or close the socket
+    itself.
+   \param      _of     The \c OggOpusFile whose socket should be returned.
+   \param[out] _fd     Returns the socket descriptor.
+                       This is only set on success.
+   \param[out] _events Returns the events to wait for: either #OP_POLL_IN or
+                        #OP_POLL_OUT.
+                       This is only set on success.
+   \return 0 on success, or a negative value on error.
+   \retval #OP_FALSE  There is no open connection, so there is nothing to wait
+                       for.
+                      The next read will reach the end of the stream.
+   \retval #OP_EINVAL The stream was not a URL stream, or <tt>libopusurl</tt>
+                       was built without support for HTTP.*/
+int op_url_poll_fd(const OggOpusFile *_of,op_socket *_fd,int *_events)
+ OP_ARG_NONNULL(1) OP_ARG_NONNULL(2) OP_ARG_NONNULL(3);
+
+/**Retrieves the number of HTTP requests made for a stream opened with
+    op_open_url() or op_test_url() (or with op_open_callbacks() or
+    op_test_callbacks() using a stream created by op_url_stream_create()).
+   This counts every request written to the server through this stream,
+    including the initial request and any repeated after a redirect,
+    pipelined requests for later chunks of the resource, and requests made by
+    #OP_HTTP_PREFETCH.
+   It does not include requests made through other streams opened for the
+    same URL, such as those opened by op_test_open_parallel() or
+    op_decode_range_parallel().
+   Unlike the statistics returned by op_get_stats(), this is not cleared by
+    op_reset_stats().
+   The stream is found with op_get_stream(), so the stream's callbacks must
+    not be wrapped by the application, or it will not be recognized as a URL
+    stream.
+   \param _of The \c OggOpusFile whose requests should be counted.
+   \return The number of requests made since the stream was created, or a
+            negative value on error.
+   \retval #OP_EINVAL The stream was not a URL stream, or <tt>libopusurl</tt>
+                       was built without support for HTTP.*/
+opus_int64 op_url_request_count(const OggOpusFile *_of) OP_ARG_NONNULL(1);
+
 /**Reads more samples from the stream.
    \note Although \a _buf_size must indicate the total number of values that
     can be stored in \a _pcm, the return value is the number of samples
@@ -1912,6 +3126,11 @@ void op_set_dither_enabled(OggOpusFile *_of,int _enabled) OP_ARG_NONNULL(1);
    \retval #OP_EREAD         An underlying read operation failed.
                              This may signal a truncation attack from an
                               <https:> source.
+   \retval #OP_EAGAIN        Non-blocking reads were enabled with
+                              op_url_set_nonblocking(), and no more data was
+                              available yet.
+                             Call this function again once the socket
+                              returned by op_url_poll_fd() is ready.
    \retval #OP_EFAULT        An internal memory allocation failed.
    \retval #OP_EIMPL         An unseekable stream encountered a new link that
                               used a feature that is not implemented, such as
@@ -1993,6 +3212,11 @@ OP_WARN_UNUSED_RESULT int op_read(OggOpusFile *_of,
    \retval #OP_EREAD         An underlying read operation failed.
                              This may signal a truncation attack from an
                               <https:> source.
+   \retval #OP_EAGAIN        Non-blocking reads were enabled with
+                              op_url_set_nonblocking(), and no more data was
+                              available yet.
+                             Call this function again once the socket
+                              returned by op_url_poll_fd() is ready.
    \retval #OP_EFAULT        An internal memory allocation failed.
    \retval #OP_EIMPL         An unseekable stream encountered a new link that
                               used a feature that is not implemented, such as
@@ -2054,6 +3278,11 @@ OP_WARN_UNUSED_RESULT int op_read_float(OggOpusFile *_of,
    \retval #OP_EREAD         An underlying read operation failed.
                              This may signal a truncation attack from an
                               <https:> source.
+   \retval #OP_EAGAIN        Non-blocking reads were enabled with
+                              op_url_set_nonblocking(), and no more data was
+                              available yet.
+                             Call this function again once the socket
+                              returned by op_url_poll_fd() is ready.
    \retval #OP_EFAULT        An internal memory allocation failed.
    \retval #OP_EIMPL         An unseekable stream encountered a new link that
                               used a feature that is not implemented, such as
@@ -2115,6 +3344,11 @@ OP_WARN_UNUSED_RESULT int op_read_stereo(OggOpusFile *_of,
    \retval #OP_EREAD         An underlying read operation failed.
                              This may signal a truncation attack from an
                               <https:> source.
+   \retval #OP_EAGAIN        Non-blocking reads were enabled with
+                              op_url_set_nonblocking(), and no more data was
+                              available yet.
+                             Call this function again once the socket
+                              returned by op_url_poll_fd() is ready.
    \retval #OP_EFAULT        An internal memory allocation failed.
    \retval #OP_EIMPL         An unseekable stream encountered a new link that
                               used a feature that is not implemented, such as
@@ -2137,6 +3371,141 @@ OP_WARN_UNUSED_RESULT int op_read_stereo(OggOpusFile *_of,
 OP_WARN_UNUSED_RESULT int op_read_float_stereo(OggOpusFile *_of,
  float *_pcm,int _buf_size) OP_ARG_NONNULL(1);
 
+/**Receives samples decoded by op_decode_range_parallel().
+   Each segment's samples are delivered in order, from the thread decoding
+    that segment, but the calls for different segments may be made from
+    several threads at once, in any order.
+   Concatenating everything delivered for segment 0, then segment 1, and so
+    on, gives exactly what repeated calls to op_read_float() would return,
+    starting from the beginning of the stream.
+   \param _ctx      The application-provided pointer passed to
+                     op_decode_range_parallel().
+   \param _si       The index of the segment the samples belong to.
+                    Segments are numbered in stream order, starting from 0.
+   \param _li       The index of the link the samples came from.
+                    Use op_channel_count() to find how many channels it has.
+   \param _pcm      The decoded samples, in the same format as
+                     op_read_float().
+                    These remain valid only until this function returns.
+   \param _nsamples The number of samples (per channel) in \a _pcm.
+   \return A non-negative value to continue decoding, or a negative value to
+            stop decoding this segment.
+           If any segment is stopped this way, op_decode_range_parallel()
+            returns the value returned here (or an error from an earlier
+            segment).*/
+typedef int (*op_write_pcm_func)(void *_ctx,int _si,int _li,
+ const float *_pcm,int _nsamples);
+
+/**Decodes an entire seekable stream by splitting it into segments and decoding
+    each one through a separate handle, possibly on several threads at once.
+   This is intended for applications like offline transcoders that want the
+    whole stream decoded as quickly as possible.
+   The decoder is reset at the start of every link in a chained stream, so the
+    stream is only split at link boundaries, and the output is bit-for-bit
+    identical to what repeated calls to op_read_float() would return, starting
+    from the beginning of the stream.
+   The links are divided into at most \a _nsegments groups of about the same
+    duration.
+   A stream with a single link is decoded as a single segment, with no
+    parallelism.
+   The samples are handed to \a _write_pcm as they are decoded, a packet or so
+    at a time, so the memory used does not depend on the length of the
+    stream, only on the number of segments being decoded at once.
+   The application is responsible for putting the output of each segment in
+    the right place, e.g., by writing it to a separate file or buffer per
+    segment, or by holding back later segments until the earlier ones are
+    done.
+   Each segment opens a new handle to the stream with \a _open_stream, and
+    uses the same decode rate, gain, decode callback, and decode timing
+    setting as \a _of.
+   If a callback is installed with op_set_decode_callback(), it may be called
+    from several threads at once.
+   \a _of itself is not read from, and its current position is unchanged, but
+    the statistics from all of the segments are added to those reported by
+    op_get_stats().
+   \param _of          The \c OggOpusFile to decode.
+                       This must be a fully opened, seekable stream.
+                       If it was opened with op_test_open_lazy(), all of its
+                        links must have been found (see op_enumerate_links()).
+   \param _nsegments   The maximum number of segments to decode at once.
+   \param _write_pcm   The function that receives the decoded samples.
+   \param _write_ctx   An application-provided pointer to pass to
+                        \a _write_pcm.
+   \param _open_stream The function used to open another handle to the same
+                        stream for each segment.
+                       The stream contents seen through each handle must be
+                        identical to those of the original.
+   \param _open_ctx    An application-provided pointer to pass to
+                        \a _open_stream.
+   \param _run         The function used to decode the segments, or
+                        <code>NULL</code> to decode them one after another on
+                        the calling thread.
+   \param _run_ctx     An application-provided pointer to pass to \a _run.
+   \return The total number of values (not samples per channel, since the
+            channel count can change between links) passed to
+            \a _write_pcm, or a negative value on failure.
+           This may be any of the failure codes returned by op_read_float(),
+            a value returned by \a _write_pcm, or one of the following.
+   \retval #OP_EINVAL  \a _of was not fully opened, not all of its links have
+                        been found yet, or \a _nsegments was less than 1.
+   \retval #OP_ENOSEEK \a _of is not seekable.
+   \retval #OP_EREAD   \a _open_stream failed, or returned a stream that does
+                        not implement the \ref op_read_func "read()",
+                        \ref op_seek_func "seek()", and
+                        \ref op_tell_func "tell()" callbacks.
+   \retval #OP_EFAULT  There was a memory allocation failure.*/
+OP_WARN_UNUSED_RESULT opus_int64 op_decode_range_parallel(OggOpusFile *_of,
+ int _nsegments,op_write_pcm_func _write_pcm,void *_write_ctx,
+ op_open_stream_func _open_stream,void *_open_ctx,
+ op_run_func _run,void *_run_ctx)
+ OP_ARG_NONNULL(1) OP_ARG_NONNULL(3) OP_ARG_NONNULL(5);
+
+/**Reads the next audio packet from the stream without decoding it.
+   This is intended for applications that remux Opus streams into another
+    container, and so never need the decoded audio, but still want
+    <tt>libopusfile</tt>'s handling of chained streams, holes, and timestamps.
+   The packets returned are exactly the ones that op_read() would have decoded,
+    in the same order, and the pre-skip, pre-roll (after seeking), and
+    end-trimming that would have been applied to them are reported alongside
+    each one.
+   Seeking with op_pcm_seek() works as usual: the first packets returned
+    afterwards will be the ones needed for pre-roll, with \a _skip covering
+    all of the samples before the target.
+   Reading packets and decoded samples from the same \c OggOpusFile can be
+    mixed, but any decoded samples that have been buffered but not yet returned
+    are discarded when a packet is read, and the decoder will not have seen
+    any of the packets returned by this function.
+   Seek before decoding again to avoid artifacts.
+   \param      _of   The \c OggOpusFile from which to read.
+   \param[out] _op   Returns the packet.
+                     The \c granulepos field contains the timestamp of the end
+                      of this packet, computed for every packet (not just the
+                      last one on each page), and sanitized the same way as for
+                      decoding.
+                     The packet data remains valid only until the next call
+                      to a function that reads from or seeks in \a _of.
+   \param[out] _skip Returns the number of samples at the start of the packet
+                      (at 48&nbsp;kHz) that should be discarded after
+                      decoding, due to pre-skip or pre-roll.
+                     This may be <code>NULL</code> if the caller does not
+                      need it.
+   \param[out] _trim Returns the number of samples at the end of the packet
+                      (at 48&nbsp;kHz) that should be discarded after
+                      decoding, due to end-trimming.
+                     This may be <code>NULL</code> if the caller does not
+                      need it.
+   \param[out] _li   Returns the index of the link this packet came from.
+                     This may be <code>NULL</code> if the caller does not
+                      need it.
+   \return The duration of the packet, in samples at 48&nbsp;kHz, before any
+            trimming, 0 if end-of-file was reached, or a negative value on
+            failure.
+           The possible failure codes are the same as for op_read(), except
+            that #OP_EBADPACKET is never returned.*/
+OP_WARN_UNUSED_RESULT int op_read_packet(OggOpusFile *_of,ogg_packet *_op,
+ opus_int32 *_skip,opus_int32 *_trim,int *_li) OP_ARG_NONNULL(1)
+ OP_ARG_NONNULL(2);
+
 /**@}*/
 /**@}*/
 
@@ -50,7 +50,10 @@
 typedef struct OpusParsedURL   OpusParsedURL;
 typedef struct OpusStringBuf   OpusStringBuf;
 typedef struct OpusHTTPConn    OpusHTTPConn;
+typedef struct OpusHTTPCacheBlock OpusHTTPCacheBlock;
 typedef struct OpusHTTPStream  OpusHTTPStream;
+typedef struct OpusHTTPHost    OpusHTTPHost;
+typedef struct OpusHTTPIdleConn OpusHTTPIdleConn;
 
 static char *op_string_range_dup(const char *_start,const char *_end){
   size_t  len;
@@ -209,10 +212,18 @@ static const char *op_parse_file_url(const char *_src){
   return path;
 }
 
+/*The default limit on the amount of data we store on disk for each resource.
+  This is enough for the headers and the data near the end of each link that we
+   read when opening most streams.*/
+#define OP_HTTP_DISK_CACHE_SIZE_DEFAULT (1024*(opus_int32)1024)
+
 #if defined(OP_ENABLE_HTTP)
 # if defined(_WIN32)
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
+#  include <io.h>
+#  include <fcntl.h>
+#  include <sys/stat.h>
 #  include <openssl/ssl.h>
 #  include <openssl/asn1.h>
 #  include "winerrno.h"
@@ -339,6 +350,7 @@ int SSL_CTX_set_default_verify_paths_win32(SSL_CTX *_ssl_ctx);
 #  endif
 #  include <sys/ioctl.h>
 #  include <sys/types.h>
+#  include <sys/file.h>
 #  include <sys/socket.h>
 #  include <arpa/inet.h>
 #  include <netinet/in.h>
@@ -374,14 +386,18 @@ typedef struct timeb op_time;
 #  define OPENSSL_VERSION_NUMBER 0x1000115fL
 # endif
 
-/*The maximum number of simultaneous connections.
+/*The default maximum number of simultaneous connections.
   RFC 2616 says this SHOULD NOT be more than 2, but everyone on the modern web
    ignores that (e.g., IE 8 bumped theirs up from 2 to 6, Firefox uses 15).
   If it makes you feel better, we'll only ever actively read from one of these
    at a time.
   The others are kept around mainly to avoid slow-starting a new connection
-   when seeking, and time out rapidly.*/
-# define OP_NCONNS_MAX (4)
+   when seeking (or to prefetch data we expect to seek to), and time out
+   rapidly.*/
+# define OP_NCONNS_DEFAULT (4)
+/*The largest number of simultaneous connections the application can ask for.
+  This matches Firefox.*/
+# define OP_NCONNS_MAX (15)
 
 /*The amount of time before we attempt to re-resolve the host.
   This is 10 minutes, as recommended in RFC 6555 for expiring cached connection
@@ -419,6 +435,41 @@ typedef struct timeb op_time;
    opening a new connection.*/
 # define OP_READAHEAD_THRESH_MIN (32*(opus_int32)1024)
 
+/*The following tunables are in percent of the bandwidth-delay product of a
+   connection: the number of bytes it delivers in the time it takes to get the
+   response to a new request (see op_http_conn_bdp()).
+  These are the defaults; the application can change them with the
+   OP_HTTP_*_BDP_PCT() URL options.*/
+/*When seeking, we will read ahead up to this much on an existing connection
+   in preference to issuing a new request.
+  Breaking even would be 100%, but we bias away from connection re-use (which
+   roughly compensates for the lag required to reopen the TCP window of a
+   connection that's been idle).*/
+# define OP_READAHEAD_BDP_PCT_DEFAULT (50)
+/*When reading sequentially, we send the request for the next chunk once there
+   is less than this much left of the current one.
+  Anything less than 100% means we will wait on the new response.*/
+# define OP_PIPELINE_REQUEST_BDP_PCT_DEFAULT (125)
+/*Each chunk we request is at least this large (and at least double the size
+   of the previous one), so that we spend most of our time reading data
+   instead of waiting on request boundaries.
+  We won't request the next chunk until there is only a quarter of the
+   current one left, so anything less than 4 times the request threshold
+   means we will wait on the new response some of the time.
+  Larger chunks waste more data when we seek away before reaching their end,
+   which is common while opening a chained stream, so we accept a small wait
+   here.*/
+# define OP_PIPELINE_CHUNK_BDP_PCT_DEFAULT (250)
+/*The largest percentage the application can ask for.
+  This keeps op_http_conn_bdp() from overflowing.*/
+# define OP_BDP_PCT_MAX (10000)
+/*The base-2 log of the most we will grow the chunk size by from one request
+   to the next in order to reach the size above.
+  Without a bandwidth-delay product estimate, it just doubles.*/
+# if !defined(OP_PIPELINE_CHUNK_GROWTH_MAX)
+#  define OP_PIPELINE_CHUNK_GROWTH_MAX (2)
+# endif
+
 /*The amount of data to request after a seek.
   This is a trade-off between read throughput after a seek vs. the the ability
    to quickly perform another seek with the same connection.*/
@@ -442,6 +493,23 @@ typedef struct timeb op_time;
    while reading forward afterwards.*/
 # define OP_PIPELINE_MIN_REQUESTS   (7)
 
+/*The size of the blocks in the (optional) data cache.
+  Blocks start at multiples of this size, and a read that misses the cache
+   fetches data from the start of the missing part of its block, so this also
+   bounds the amount of extra data we fetch after a seek.*/
+# define OP_HTTP_CACHE_BLOCK_SIZE (16*(opus_int32)1024)
+
+/*The magic number (including a version number in the last byte) at the start
+   of each disk cache file.*/
+# define OP_HTTP_DISK_CACHE_MAGIC "OpusHTC\2"
+/*The size of the fixed part of the header of a disk cache file: the magic
+   number, the length of the resource, the number of slots, and the lengths of
+   the key and the two validators.*/
+# define OP_HTTP_DISK_CACHE_HEADER_SIZE (32)
+/*The minimum size of the in-memory cache when the disk cache is enabled.
+  Blocks move between the disk and the rest of the stream through it.*/
+# define OP_HTTP_DISK_CACHE_MEMORY_MIN (4*OP_HTTP_CACHE_BLOCK_SIZE)
+
 /*Is this an https URL?
   For now we can simply check the last letter of the scheme.*/
 # define OP_URL_IS_SSL(_url) ((_url)->scheme[4]=='s')
@@ -711,6 +779,28 @@ static int op_sb_append_port(OpusStringBuf *_sb,unsigned _port){
   return op_sb_append_string(_sb,port_buf);
 }
 
+/*Append the _nbytes least significant bytes of _i in little-endian order.
+  This is used to build binary data, not strings.*/
+static int op_sb_append_le(OpusStringBuf *_sb,opus_int64 _i,int _nbytes){
+  int ret;
+  ret=0;
+  while(_nbytes-->0){
+    char c;
+    c=(char)(_i&0xFF);
+    ret|=op_sb_append(_sb,&c,1);
+    _i>>=8;
+  }
+  return ret;
+}
+
+/*Read an integer stored in _nbytes bytes in little-endian order.*/
+static opus_int64 op_read_le(const unsigned char *_buf,int _nbytes){
+  opus_int64 ret;
+  ret=0;
+  while(_nbytes-->0)ret=ret<<8|_buf[_nbytes];
+  return ret;
+}
+
 static int op_sb_append_nonnegative_int64(OpusStringBuf *_sb,opus_int64 _i){
   char digit;
   int  nbuf_start;
@@ -826,13 +916,56 @@ struct OpusHTTPConn{
   int           nrequests_left;
   /*The chunk size to use for pipelining requests.*/
   opus_int32    chunk_size;
+  /*The number of bytes left in the current chunk of a response body sent with
+     the chunked transfer-coding.
+    When this reaches 0, the next thing to read is the header of the next
+     chunk.*/
+  opus_int64    chunk_left;
+  /*Where we are in a response body sent with the chunked transfer-coding
+     (one of the OP_CHUNK_* values below).*/
+  int           chunk_state;
+  /*How far along we are in opening this connection without blocking (one of
+     the OP_CONN_* values below).*/
+  int           state;
+  /*Whether or not we have read part of the header of the next response into
+     the stream's response buffer, and have to finish it before doing anything
+     else with the connection.*/
+  int           reading_response;
+  /*When we started opening this connection without blocking.*/
+  op_time       open_time;
+  /*The position and size of the chunk to request once a connection opened
+     without blocking is ready.*/
+  opus_int64    open_pos;
+  opus_int32    open_chunk_size;
 };
 
+/*The current response body is not chunked.*/
+# define OP_CHUNK_NONE    (0)
+/*We are reading the chunks of the current response body.*/
+# define OP_CHUNK_DATA    (1)
+/*We have read the last chunk, and are reading the trailer.*/
+# define OP_CHUNK_TRAILER (2)
+/*We have read the whole response body.*/
+# define OP_CHUNK_END     (3)
+
+/*The connection is open (and has sent its first request and read the
+   response, if we opened it).*/
+# define OP_CONN_OPEN       (0)
+/*We are waiting for connect() to finish.*/
+# define OP_CONN_CONNECTING (1)
+/*We are waiting for the TLS handshake to finish.*/
+# define OP_CONN_HANDSHAKE  (2)
+/*We have sent the first request, and are waiting for the response.*/
+# define OP_CONN_REQUESTED  (3)
+
 static void op_http_conn_init(OpusHTTPConn *_conn){
   _conn->next_pos=-1;
   _conn->ssl_conn=NULL;
   _conn->next=NULL;
   _conn->fd=OP_INVALID_SOCKET;
+  _conn->chunk_state=OP_CHUNK_NONE;
+  _conn->state=OP_CONN_OPEN;
+  _conn->reading_response=0;
 }
 
 static void op_http_conn_clear(OpusHTTPConn *_conn){
@@ -841,81 +974,296 @@ static void op_http_conn_clear(OpusHTTPConn *_conn){
   if(_conn->fd!=OP_INVALID_SOCKET)close(_conn->fd);
 }
 
+/*The number of hosts a shared context remembers addresses and TLS sessions
+   for.*/
+# define OP_HTTP_CONTEXT_NHOSTS (16)
+/*The number of idle connections a shared context keeps open.*/
+# define OP_HTTP_CONTEXT_NCONNS (16)
+
+/*What a shared context remembers about a host.*/
+struct OpusHTTPHost{
+  /*The host name, or NULL if this entry is unused.*/
+  char            *host;
+  /*The port.*/
+  unsigned         port;
+  /*Whether or not addr_info is valid.*/
+  int              has_addr;
+  /*Information about the address we last connected to.*/
+  struct addrinfo  addr_info;
+  /*The address we last connected to.*/
+  union{
+    struct sockaddr     s;
+    struct sockaddr_in  v4;
+    struct sockaddr_in6 v6;
+  }                addr;
+  /*The last time we resolved the host.*/
+  op_time          resolve_time;
+  /*The TLS session to resume, or NULL.
+    Only sessions from connections whose certificates were checked are kept.*/
+  SSL_SESSION     *ssl_session;
+  /*Whether or not the server supported persistent connections the last time
+     we asked.*/
+  int              pipeline;
+  /*The last time this entry was used, so we can replace the oldest.*/
+  op_time          use_time;
+};
+
+/*An idle persistent connection kept open by a shared context.*/
+struct OpusHTTPIdleConn{
+  /*The connection.
+    Only the socket, SSL connection, and request count are meaningful.*/
+  OpusHTTPConn  conn;
+  /*The host this is a connection to, or NULL if this entry is unused.*/
+  char         *host;
+  /*The port this is a connection to.*/
+  unsigned      port;
+  /*Whether or not this is an https connection.*/
+  int           ssl;
+  /*Whether or not the server's certificate was checked.*/
+  int           verified;
+  /*The time the connection became idle.*/
+  op_time       idle_time;
+};
+
+struct OpusHTTPContext{
+  /*The hosts we've connected to.*/
+  OpusHTTPHost      hosts[OP_HTTP_CONTEXT_NHOSTS];
+  /*The idle connections.*/
+  OpusHTTPIdleConn  conns[OP_HTTP_CONTEXT_NCONNS];
+  /*The TLS configuration shared by all streams that check certificates, or
+     NULL if none has been created yet.
+    Once set, this does not change.*/
+  SSL_CTX          *ssl_ctx;
+  /*The application's locking functions, or NULL.*/
+  op_lock_func      lock;
+  op_lock_func      unlock;
+  void             *lock_ctx;
+  /*The number of references to this context: one for the application, plus
+     one for each stream using it.*/
+  int               nrefs;
+};
+
+static void op_http_context_lock(OpusHTTPContext *_ctx){
+  if(_ctx->lock!=NULL)(*_ctx->lock)(_ctx->lock_ctx);
+}
+
+static void op_http_context_unlock(OpusHTTPContext *_ctx){
+  if(_ctx->unlock!=NULL)(*_ctx->unlock)(_ctx->lock_ctx);
+}
+
+static void op_http_context_ref(OpusHTTPContext *_ctx){
+  op_http_context_lock(_ctx);
+  _ctx->nrefs++;
+  op_http_context_unlock(_ctx);
+}
+
+/*Drop a reference to a shared context, and free it if that was the last
+   one.*/
+static void op_http_context_unref(OpusHTTPContext *_ctx){
+  int nrefs;
+  int i;
+  op_http_context_lock(_ctx);
+  nrefs=--_ctx->nrefs;
+  op_http_context_unlock(_ctx);
+  if(nrefs>0)return;
+  for(i=0;i<OP_HTTP_CONTEXT_NCONNS;i++){
+    if(_ctx->conns[i].host!=NULL){
+      op_http_conn_clear(&_ctx->conns[i].conn);
+      _ogg_free(_ctx->conns[i].host);
+    }
+  }
+  for(i=0;i<OP_HTTP_CONTEXT_NHOSTS;i++){
+    if(_ctx->hosts[i].ssl_session!=NULL){
+      SSL_SESSION_free(_ctx->hosts[i].ssl_session);
+    }
+    _ogg_free(_ctx->hosts[i].host);
+  }
+  if(_ctx->ssl_ctx!=NULL)SSL_CTX_free(_ctx->ssl_ctx);
+  _ogg_free(_ctx);
+}
+
+/*A block of data cached from the resource.*/
+struct OpusHTTPCacheBlock{
+  /*The offset of the start of this block in the resource.
+    This is always a multiple of OP_HTTP_CACHE_BLOCK_SIZE.*/
+  opus_int64          pos;
+  /*The next block in the LRU list.*/
+  OpusHTTPCacheBlock *next;
+  /*The data, with room for OP_HTTP_CACHE_BLOCK_SIZE bytes.*/
+  unsigned char      *buf;
+  /*The number of bytes at the start of this block that are valid.
+    This is less than OP_HTTP_CACHE_BLOCK_SIZE at the end of the resource or if
+     we stopped reading before filling the block.*/
+  int                 nbuf;
+};
+
 /*The global stream state.*/
 struct OpusHTTPStream{
   /*The list of connections.*/
-  OpusHTTPConn     conns[OP_NCONNS_MAX];
+  OpusHTTPConn       *conns;
   /*The context object used as a framework for TLS/SSL functions.*/
-  SSL_CTX         *ssl_ctx;
+  SSL_CTX            *ssl_ctx;
+  /*The shared context this stream pools its resources with, or NULL.*/
+  OpusHTTPContext    *ctx;
   /*The cached session to reuse for future connections.*/
-  SSL_SESSION     *ssl_session;
+  SSL_SESSION        *ssl_session;
   /*The LRU list (ordered from MRU to LRU) of currently connected
      connections.*/
-  OpusHTTPConn    *lru_head;
+  OpusHTTPConn       *lru_head;
   /*The free list.*/
-  OpusHTTPConn    *free_head;
+  OpusHTTPConn       *free_head;
+  /*The storage for the data cache, or NULL if it is disabled.*/
+  OpusHTTPCacheBlock *cache_blocks;
+  /*The LRU list (ordered from MRU to LRU) of cache blocks in use.*/
+  OpusHTTPCacheBlock *cache_head;
   /*The URL to connect to.*/
-  OpusParsedURL    url;
+  OpusParsedURL       url;
   /*Information about the address we connected to.*/
-  struct addrinfo  addr_info;
+  struct addrinfo     addr_info;
   /*The address we connected to.*/
   union{
     struct sockaddr     s;
     struct sockaddr_in  v4;
     struct sockaddr_in6 v6;
-  }                addr;
+  }                   addr;
   /*The last time we re-resolved the host.*/
-  op_time          resolve_time;
+  op_time             resolve_time;
   /*A buffer used to build HTTP requests.*/
-  OpusStringBuf    request;
+  OpusStringBuf       request;
   /*A buffer used to build proxy CONNECT requests.*/
-  OpusStringBuf    proxy_connect;
+  OpusStringBuf       proxy_connect;
   /*A buffer used to receive the response headers.*/
-  OpusStringBuf    response;
+  OpusStringBuf       response;
   /*The Content-Length, if specified, or -1 otherwise.
     This will always be specified for seekable streams.*/
-  opus_int64       content_length;
-  /*The position indicator used when no connection is active.*/
-  opus_int64       pos;
+  opus_int64          content_length;
+  /*The position indicator used when no connection is active.
+    If the data cache is enabled, this is always the position indicator, as the
+     connections are only used to fill the cache.*/
+  opus_int64          pos;
   /*The host we actually connected to.*/
-  char            *connect_host;
+  char               *connect_host;
+  /*The entity tag of the resource, if the server sent a strong one, or NULL
+     otherwise.*/
+  char               *etag;
+  /*The Last-Modified date of the resource, or NULL if the server did not send
+     one.*/
+  char               *last_modified;
+  /*The file holding the disk cache, or NULL if it is disabled.*/
+  FILE               *disk_cache;
+  /*The path of the disk cache file, or NULL if it is disabled.*/
+  char               *disk_cache_path;
+  /*The key the disk cache file was made for: the URL without any user name or
+     password.*/
+  char               *disk_cache_key;
+  /*The validator to send in an If-Range header with the initial request, or
+     NULL if we have no copy of the resource to validate.*/
+  char               *disk_cache_if_range;
+  /*The slot in the disk cache holding each block, or -1 if it isn't stored.*/
+  int                *disk_cache_slots;
+  /*The file offset of the index of the block stored in each slot.*/
+  long                disk_cache_index_pos;
+  /*The file offset of the data of the first slot.*/
+  long                disk_cache_data_pos;
+  /*The number of slots in the disk cache.*/
+  int                 disk_cache_nslots;
+  /*The number of slots that have been used.*/
+  int                 disk_cache_nslots_used;
   /*The port we actually connected to.*/
-  unsigned         connect_port;
+  unsigned            connect_port;
   /*The connection we're currently reading from.
     This can be -1 if no connection is active.*/
-  int              cur_conni;
+  int                 cur_conni;
   /*Whether or not the server supports range requests.*/
-  int              seekable;
+  int                 seekable;
   /*Whether or not the server supports HTTP/1.1 with persistent connections.*/
-  int              pipeline;
+  int                 pipeline;
+  /*Whether or not to prefetch data on idle connections.*/
+  int                 prefetch;
+  /*The tunables in percent of the bandwidth-delay product.*/
+  int                 readahead_bdp_pct;
+  int                 request_bdp_pct;
+  int                 chunk_bdp_pct;
+  /*Whether or not the current read may fail with OP_EAGAIN instead of
+     blocking.
+    If non-blocking reads are enabled, the file reading from this stream sets
+     this while it is at a point where it can restart the read later, and
+     clears it again afterwards.*/
+  int                 eagain_ok;
   /*Whether or not we should skip certificate checks.*/
-  int              skip_certificate_check;
+  int                 skip_certificate_check;
+  /*Whether or not ssl_ctx belongs to the shared context.*/
+  int                 ssl_ctx_shared;
   /*The offset of the tail of the request.
     Only the offset in the Range: header appears after this, allowing us to
      quickly edit the request to ask for a new range.*/
-  int              request_tail;
+  int                 request_tail;
   /*The estimated time required to open a new connection, in milliseconds.*/
-  opus_int32       connect_rate;
+  opus_int32          connect_rate;
+  /*The position of the last seek that needed data we did not have, or -1 if
+     there has not been one yet.
+    This is used to predict the next seek when prefetching.*/
+  opus_int64          prefetch_pos;
+  /*The number of blocks in the data cache.*/
+  int                 ncache_blocks;
+  /*The number of cache blocks that have been used so far.*/
+  int                 ncache_blocks_used;
+  /*The number of requests written to the server so far.*/
+  opus_int64          nrequests;
+  /*The number of entries in the connection list.*/
+  int                 nconns;
 };
 
-static void op_http_stream_init(OpusHTTPStream *_stream){
+/*Initialize the stream.
+  _nconns: The number of connections to use.
+           This must be between 1 and OP_NCONNS_MAX, inclusive.
+  Return: 0 on success, or OP_EFAULT if the connection list could not be
+           allocated, in which case the stream need not be cleared.*/
+static int op_http_stream_init(OpusHTTPStream *_stream,int _nconns){
   OpusHTTPConn **pnext;
   int            ci;
+  OP_ASSERT(_nconns>0&&_nconns<=OP_NCONNS_MAX);
+  _stream->conns=(OpusHTTPConn *)_ogg_malloc(
+   sizeof(*_stream->conns)*_nconns);
+  if(OP_UNLIKELY(_stream->conns==NULL))return OP_EFAULT;
+  _stream->nconns=_nconns;
   pnext=&_stream->free_head;
-  for(ci=0;ci<OP_NCONNS_MAX;ci++){
+  for(ci=0;ci<_nconns;ci++){
     op_http_conn_init(_stream->conns+ci);
     *pnext=_stream->conns+ci;
     pnext=&_stream->conns[ci].next;
   }
   _stream->ssl_ctx=NULL;
   _stream->ssl_session=NULL;
+  _stream->ctx=NULL;
   _stream->lru_head=NULL;
+  _stream->cache_blocks=NULL;
+  _stream->cache_head=NULL;
+  _stream->ncache_blocks=0;
+  _stream->ncache_blocks_used=0;
+  _stream->nrequests=0;
   op_parsed_url_init(&_stream->url);
   op_sb_init(&_stream->request);
   op_sb_init(&_stream->proxy_connect);
   op_sb_init(&_stream->response);
   _stream->connect_host=NULL;
+  _stream->etag=NULL;
+  _stream->last_modified=NULL;
+  _stream->disk_cache=NULL;
+  _stream->disk_cache_path=NULL;
+  _stream->disk_cache_key=NULL;
+  _stream->disk_cache_if_range=NULL;
+  _stream->disk_cache_slots=NULL;
   _stream->seekable=0;
+  _stream->skip_certificate_check=0;
+  _stream->ssl_ctx_shared=0;
+  _stream->prefetch=0;
+  _stream->readahead_bdp_pct=OP_READAHEAD_BDP_PCT_DEFAULT;
+  _stream->request_bdp_pct=OP_PIPELINE_REQUEST_BDP_PCT_DEFAULT;
+  _stream->chunk_bdp_pct=OP_PIPELINE_CHUNK_BDP_PCT_DEFAULT;
+  _stream->prefetch_pos=-1;
+  _stream->eagain_ok=0;
+  return 0;
 }
 
 /*Close the connection and move it to the free list.
@@ -939,6 +1287,9 @@ static void op_http_conn_close(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
   _conn->next_pos=-1;
   _conn->ssl_conn=NULL;
   _conn->fd=OP_INVALID_SOCKET;
+  _conn->chunk_state=OP_CHUNK_NONE;
+  _conn->state=OP_CONN_OPEN;
+  _conn->reading_response=0;
   OP_ASSERT(*_pnext==_conn);
   *_pnext=_conn->next;
   _conn->next=_stream->free_head;
@@ -950,12 +1301,30 @@ static void op_http_stream_clear(OpusHTTPStream *_stream){
     op_http_conn_close(_stream,_stream->lru_head,&_stream->lru_head,0);
   }
   if(_stream->ssl_session!=NULL)SSL_SESSION_free(_stream->ssl_session);
-  if(_stream->ssl_ctx!=NULL)SSL_CTX_free(_stream->ssl_ctx);
+  if(_stream->ssl_ctx!=NULL&&!_stream->ssl_ctx_shared){
+    SSL_CTX_free(_stream->ssl_ctx);
+  }
+  if(_stream->ctx!=NULL)op_http_context_unref(_stream->ctx);
+  if(_stream->cache_blocks!=NULL){
+    int bi;
+    for(bi=0;bi<_stream->ncache_blocks_used;bi++){
+      _ogg_free(_stream->cache_blocks[bi].buf);
+    }
+    _ogg_free(_stream->cache_blocks);
+  }
+  if(_stream->disk_cache!=NULL)fclose(_stream->disk_cache);
+  _ogg_free(_stream->disk_cache_slots);
+  _ogg_free(_stream->disk_cache_if_range);
+  _ogg_free(_stream->disk_cache_key);
+  _ogg_free(_stream->disk_cache_path);
+  _ogg_free(_stream->last_modified);
+  _ogg_free(_stream->etag);
   op_sb_clear(&_stream->response);
   op_sb_clear(&_stream->proxy_connect);
   op_sb_clear(&_stream->request);
   if(_stream->connect_host!=_stream->url.host)_ogg_free(_stream->connect_host);
   op_parsed_url_clear(&_stream->url);
+  _ogg_free(_stream->conns);
 }
 
 static int op_http_conn_write_fully(OpusHTTPConn *_conn,
@@ -1055,6 +1424,15 @@ static opus_int32 op_time_diff_ms(const op_time *_end, const op_time *_start){
 # endif
 }
 
+/*Estimate the bandwidth-delay product of a connection, scaled by the given
+   percentage.
+  There's no overflow checking here, because it's vanishingly unlikely, and
+   all it would do is cause us to make poor decisions.*/
+static opus_int64 op_http_conn_bdp(const OpusHTTPStream *_stream,
+ const OpusHTTPConn *_conn,int _pct){
+  return _stream->connect_rate*_conn->read_rate*_pct/100000;
+}
+
 /*Update the read rate estimate for this connection.*/
 static void op_http_conn_read_rate_update(OpusHTTPConn *_conn){
   op_time      read_time;
@@ -1078,8 +1456,10 @@ static void op_http_conn_read_rate_update(OpusHTTPConn *_conn){
   _buf_size:  The size of the buffer.
   _blocking:  Whether or not to block until some data is retrieved.
   Return: A positive number of bytes read on success.
-          0:        The read would block, or the connection was closed.
-          OP_EREAD: There was a fatal read error.*/
+          0:         The connection was closed.
+          OP_EAGAIN: _blocking was 0, and no data could be read without
+                      blocking.
+          OP_EREAD:  There was a fatal read error.*/
 static int op_http_conn_read(OpusHTTPConn *_conn,
  char *_buf,int _buf_size,int _blocking){
   struct pollfd  fd;
@@ -1144,7 +1524,7 @@ static int op_http_conn_read(OpusHTTPConn *_conn,
     _conn->read_bytes+=nread_unblocked;
     op_http_conn_read_rate_update(_conn);
     nread_unblocked=0;
-    if(!_blocking)break;
+    if(!_blocking)return OP_EAGAIN;
     /*Need to wait to get any data at all.*/
     if(poll(&fd,1,OP_POLL_TIMEOUT_MS)<=0)return OP_EREAD;
   }
@@ -1155,8 +1535,13 @@ static int op_http_conn_read(OpusHTTPConn *_conn,
 
 /*Tries to look at the pending data for a connection without consuming it.
   [out] _buf: Returns the data at which we're peeking.
-  _buf_size:  The size of the buffer.*/
-static int op_http_conn_peek(OpusHTTPConn *_conn,char *_buf,int _buf_size){
+  _buf_size:  The size of the buffer.
+  _blocking:  Whether or not to block until some data is available.
+  Return: The number of bytes available, 0 if the connection was closed or
+           there was an error, or OP_EAGAIN if _blocking was 0 and no data was
+           available yet.*/
+static int op_http_conn_peek(OpusHTTPConn *_conn,
+ char *_buf,int _buf_size,int _blocking){
   struct pollfd   fd;
   SSL            *ssl_conn;
   int             ret;
@@ -1183,6 +1568,7 @@ static int op_http_conn_peek(OpusHTTPConn *_conn,char *_buf,int _buf_size){
       if(err!=EAGAIN&&err!=EWOULDBLOCK)return 0;
       fd.events=POLLIN;
     }
+    if(!_blocking)return OP_EAGAIN;
     /*Need to wait to get any data at all.*/
     if(poll(&fd,1,OP_POLL_TIMEOUT_MS)<=0)return 0;
   }
@@ -1194,13 +1580,18 @@ static int op_http_conn_peek(OpusHTTPConn *_conn,char *_buf,int _buf_size){
 
 /*Reads the entirety of a response to an HTTP request into the response buffer.
   Actual parsing and validation is done later.
+  The caller must empty the response buffer before the first call for a given
+   response.
+  _blocking: Whether or not to block until the whole response has arrived.
+             If not, whatever has arrived so far is kept in the response
+              buffer, and another call picks up where this one left off.
   Return: The number of bytes in the response on success, OP_EREAD if the
-           connection was closed before reading any data, or another negative
-           value on any other error.*/
+           connection was closed before reading any data, OP_EAGAIN if
+           _blocking was 0 and the rest of the response has not arrived yet,
+           or another negative value on any other error.*/
 static int op_http_conn_read_response(OpusHTTPConn *_conn,
- OpusStringBuf *_response){
+ OpusStringBuf *_response,int _blocking){
   int ret;
-  _response->nbuf=0;
   ret=op_sb_ensure_capacity(_response,OP_RESPONSE_SIZE_MIN);
   if(OP_UNLIKELY(ret<0))return ret;
   for(;;){
@@ -1220,7 +1611,8 @@ static int op_http_conn_read_response(OpusHTTPConn *_conn,
       if(OP_UNLIKELY(size>=capacity))return OP_EIMPL;
     }
     buf=_response->buf;
-    ret=op_http_conn_peek(_conn,buf+size,capacity-size);
+    ret=op_http_conn_peek(_conn,buf+size,capacity-size,_blocking);
+    if(ret==OP_EAGAIN)return ret;
     if(OP_UNLIKELY(ret<=0))return size<=0?OP_EREAD:OP_FALSE;
     /*We read some data.*/
     /*Make sure the starting characters are "HTTP".
@@ -1261,6 +1653,160 @@ static int op_http_conn_read_response(OpusHTTPConn *_conn,
   return OP_EIMPL;
 }
 
+/*Reads a single line (up to and including the LF) into the given buffer.
+  This is used for the chunk headers and trailers in a response body sent with
+   the chunked transfer-coding.
+  Like op_http_conn_read_response(), we peek at the data first, so that we
+   consume exactly the line and nothing after it.
+  Unlike op_http_conn_read_response(), we never grow the buffer past
+   OP_RESPONSE_SIZE_MIN, so the response buffer (which has already been used
+   to read the response header) is never reallocated, and can still be used to
+   hold the data we discard in op_http_conn_read_ahead().
+  _blocking: Whether or not to block until the line starts to arrive.
+             Once we've consumed part of the line, we always block for the
+              rest.
+  Return: The length of the line on success, OP_EAGAIN if _blocking was 0 and
+           no data was available, or a negative value on any other error.*/
+static int op_http_conn_read_line(OpusHTTPConn *_conn,
+ OpusStringBuf *_line,int _blocking){
+  char *buf;
+  int   size;
+  int   capacity;
+  int   ret;
+  ret=op_sb_ensure_capacity(_line,OP_RESPONSE_SIZE_MIN);
+  if(OP_UNLIKELY(ret<0))return ret;
+  buf=_line->buf;
+  capacity=_line->cbuf-1;
+  size=0;
+  for(;;){
+    char *eol;
+    int   read_limit;
+    /*The line was too long.*/
+    if(OP_UNLIKELY(size>=capacity))return OP_EIMPL;
+    ret=op_http_conn_peek(_conn,buf+size,capacity-size,_blocking||size>0);
+    if(ret==OP_EAGAIN)return ret;
+    if(OP_UNLIKELY(ret<=0))return OP_EREAD;
+    eol=(char *)memchr(buf+size,'\n',ret);
+    read_limit=eol!=NULL?(int)(eol-buf)+1:size+ret;
+    ret=op_http_conn_read(_conn,buf+size,read_limit-size,1);
+    if(OP_UNLIKELY(ret<=0))return OP_EREAD;
+    size+=ret;
+    if(eol!=NULL&&OP_LIKELY(size>=read_limit))break;
+  }
+  buf[size]='\0';
+  _line->nbuf=size;
+  return size;
+}
+
+/*Reads chunk headers (and the trailer after the last chunk) of a response
+   body sent with the chunked transfer-coding until we find the next chunk
+   with data in it or reach the end of the body.
+  The lines are parsed in place in the response buffer, so the chunk data
+   itself can be read directly into the caller's buffer.
+  Each line is handled separately, so if _blocking is 0 and we have to stop,
+   we can pick up where we left off on the next call.
+  Return: 0 on success, OP_EAGAIN if _blocking was 0 and no data was
+           available, or a negative value on any other error.*/
+static int op_http_conn_read_chunk_header(OpusHTTPConn *_conn,
+ OpusStringBuf *_line,int _blocking){
+  OP_ASSERT(_conn->chunk_state==OP_CHUNK_DATA&&_conn->chunk_left==0
+   ||_conn->chunk_state==OP_CHUNK_TRAILER);
+  for(;;){
+    opus_int64  chunk_size;
+    char       *buf;
+    int         empty;
+    int         ret;
+    int         i;
+    ret=op_http_conn_read_line(_conn,_line,_blocking);
+    if(ret<0)return ret;
+    buf=_line->buf;
+    /*We don't require the leading '\r' thanks to broken servers.*/
+    empty=buf[0]=='\n'||buf[0]=='\r'&&buf[1]=='\n';
+    if(_conn->chunk_state==OP_CHUNK_TRAILER){
+      /*We ignore any trailer fields, and stop at the empty line that ends
+         the trailer.*/
+      if(empty){
+        _conn->chunk_state=OP_CHUNK_END;
+        return 0;
+      }
+      continue;
+    }
+    /*This is the CRLF that ends the data of the previous chunk.*/
+    if(empty)continue;
+    chunk_size=0;
+    for(i=0;;i++){
+      int c;
+      c=buf[i];
+      if(c>='0'&&c<='9')c-='0';
+      else if(c>='a'&&c<='f')c-='a'-10;
+      else if(c>='A'&&c<='F')c-='A'-10;
+      else break;
+      /*Don't let the chunk size overflow.*/
+      if(OP_UNLIKELY(chunk_size>OP_INT64_MAX>>4))return OP_FALSE;
+      chunk_size=chunk_size<<4|c;
+    }
+    /*The size may be followed by chunk extensions, which we ignore.*/
+    if(OP_UNLIKELY(i<=0)||OP_UNLIKELY(strchr(";\t \r\n",buf[i])==NULL)){
+      return OP_FALSE;
+    }
+    if(chunk_size>0){
+      _conn->chunk_left=chunk_size;
+      return 0;
+    }
+    /*This was the last chunk.*/
+    _conn->chunk_state=OP_CHUNK_TRAILER;
+  }
+}
+
+/*Reads data from the current response body.
+  This is op_http_conn_read(), but it removes the chunked transfer-coding, if
+   the response body uses it.
+  Return: A positive number of bytes read on success.
+          0:         The connection was closed, or we reached the end of a
+                      chunked response body.
+          OP_EAGAIN: _blocking was 0, and no data could be read without
+                      blocking.
+          OP_EREAD:  There was a fatal read error.*/
+static int op_http_conn_read_data(OpusHTTPConn *_conn,OpusStringBuf *_line,
+ char *_buf,int _buf_size,int _blocking){
+  int nread;
+  int ret;
+  if(_conn->chunk_state==OP_CHUNK_NONE){
+    return op_http_conn_read(_conn,_buf,_buf_size,_blocking);
+  }
+  if(_conn->chunk_state==OP_CHUNK_DATA&&_conn->chunk_left<=0
+   ||_conn->chunk_state==OP_CHUNK_TRAILER){
+    ret=op_http_conn_read_chunk_header(_conn,_line,_blocking);
+    if(ret==OP_EAGAIN)return ret;
+    if(OP_UNLIKELY(ret<0))return OP_EREAD;
+  }
+  if(_conn->chunk_state==OP_CHUNK_END)return 0;
+  nread=op_http_conn_read(_conn,_buf,
+   (int)OP_MIN(_buf_size,_conn->chunk_left),_blocking);
+  if(nread>0)_conn->chunk_left-=nread;
+  return nread;
+}
+
+/*Reads the rest of a chunked response body after its last byte of data.
+  This consumes the last chunk header and the trailer, so that the next
+   response (if any) can be parsed.
+  Return: 0 on success, or a negative value on error.*/
+static int op_http_conn_finish_body(OpusHTTPConn *_conn,
+ OpusStringBuf *_line){
+  while(_conn->chunk_state==OP_CHUNK_DATA
+   ||_conn->chunk_state==OP_CHUNK_TRAILER){
+    int ret;
+    /*The server sent more data than we asked for.*/
+    if(OP_UNLIKELY(_conn->chunk_state==OP_CHUNK_DATA&&_conn->chunk_left>0)){
+      return OP_FALSE;
+    }
+    ret=op_http_conn_read_chunk_header(_conn,_line,1);
+    if(OP_UNLIKELY(ret<0))return ret;
+    if(OP_UNLIKELY(_conn->chunk_state==OP_CHUNK_DATA))return OP_FALSE;
+  }
+  return 0;
+}
+
 # define OP_HTTP_DIGIT "0123456789"
 
 /*The Reason-Phrase is not allowed to contain control characters, except
@@ -1501,10 +2047,66 @@ static int op_http_parse_connection(char *_cdr){
   return OP_UNLIKELY(*_cdr!='\0')?OP_FALSE:ret;
 }
 
+/*Parse the Accept-Ranges response header and look for a "bytes" token.
+  Return: 1 if a "bytes" token is found, 0 if it's not found, and a negative
+           value on error.*/
+static int op_http_parse_accept_ranges(char *_cdr){
+  size_t d;
+  int    ret;
+  ret=0;
+  for(;;){
+    d=strcspn(_cdr,OP_HTTP_CTOKEN);
+    if(OP_UNLIKELY(d<=0))return OP_FALSE;
+    if(d==5&&op_strncasecmp(_cdr,"bytes",5)==0)ret=1;
+    _cdr+=d;
+    d=op_http_lwsspn(_cdr);
+    if(*(_cdr+d)==','){
+      _cdr+=d+1;
+      d=op_http_lwsspn(_cdr);
+    }
+    else if(d<=0)break;
+    _cdr+=d;
+  }
+  return OP_UNLIKELY(*_cdr!='\0')?OP_FALSE:ret;
+}
+
+/*Parse the Transfer-Encoding response header.
+  The only transfer-coding we support is "chunked".
+  Return: 1 if the response body is chunked, 0 if it is not, and a negative
+           value on error or if it uses some other transfer-coding.*/
+static int op_http_parse_transfer_encoding(char *_cdr){
+  size_t d;
+  int    ret;
+  ret=0;
+  for(;;){
+    d=strcspn(_cdr,OP_HTTP_CTOKEN);
+    if(OP_UNLIKELY(d<=0))return OP_FALSE;
+    /*"chunked" must be the last transfer-coding applied, and may not be
+       applied more than once.*/
+    if(OP_UNLIKELY(ret))return OP_FALSE;
+    if(d==7&&op_strncasecmp(_cdr,"chunked",7)==0)ret=1;
+    /*"identity" was removed by RFC 7230, but old servers might send it.*/
+    else if(d!=8||op_strncasecmp(_cdr,"identity",8)!=0)return OP_EIMPL;
+    _cdr+=d;
+    d=op_http_lwsspn(_cdr);
+    if(*(_cdr+d)==','){
+      _cdr+=d+1;
+      d=op_http_lwsspn(_cdr);
+    }
+    else if(d<=0)break;
+    _cdr+=d;
+  }
+  return OP_UNLIKELY(*_cdr!='\0')?OP_FALSE:ret;
+}
+
 typedef int (*op_ssl_step_func)(SSL *_ssl_conn);
 
-/*Try to run an SSL function to completion (blocking if necessary).*/
-static int op_do_ssl_step(SSL *_ssl_conn,op_sock _fd,op_ssl_step_func _step){
+/*Try to run an SSL function to completion.
+  _blocking: Whether or not to block if necessary.
+  Return: The return value of the function, OP_EAGAIN if _blocking was 0 and
+           the function has to wait for the socket, or OP_FALSE on error.*/
+static int op_do_ssl_step(SSL *_ssl_conn,op_sock _fd,op_ssl_step_func _step,
+ int _blocking){
   struct pollfd fd;
   fd.fd=_fd;
   for(;;){
@@ -1516,6 +2118,7 @@ static int op_do_ssl_step(SSL *_ssl_conn,op_sock _fd,op_ssl_step_func _step){
     if(err==SSL_ERROR_WANT_READ)fd.events=POLLIN;
     else if(err==SSL_ERROR_WANT_WRITE)fd.events=POLLOUT;
     else return OP_FALSE;
+    if(!_blocking)return OP_EAGAIN;
     if(poll(&fd,1,OP_POLL_TIMEOUT_MS)<=0)return OP_FALSE;
   }
 }
@@ -1574,6 +2177,8 @@ static long op_bio_retry_ctrl(BIO *_b,int _cmd,long _num,void *_ptr){
 #  define BIO_set_data(_b,_ptr) ((_b)->ptr=(_ptr))
 #  define BIO_set_init(_b,_init) ((_b)->init=(_init))
 #  define ASN1_STRING_get0_data ASN1_STRING_data
+#  define SSL_SESSION_up_ref(_session) \
+ CRYPTO_add(&(_session)->references,1,CRYPTO_LOCK_SSL_SESSION)
 # endif
 
 static int op_bio_retry_new(BIO *_b){
@@ -1652,7 +2257,8 @@ static int op_http_conn_establish_tunnel(OpusHTTPStream *_stream,
   /*Only now do we disable write coalescing, to allow the CONNECT
      request and the start of the TLS handshake to be combined.*/
   op_sock_set_tcp_nodelay(_fd,1);
-  ret=op_http_conn_read_response(_conn,&_stream->response);
+  _stream->response.nbuf=0;
+  ret=op_http_conn_read_response(_conn,&_stream->response,1);
   if(OP_UNLIKELY(ret<0))return ret;
   next=op_http_parse_status_line(NULL,&status_code,_stream->response.buf);
   /*According to RFC 2817, "Any successful (2xx) response to a
@@ -1919,13 +2525,57 @@ static int op_http_verify_hostname(OpusHTTPStream *_stream,SSL *_ssl_conn){
 }
 # endif
 
-/*Perform the TLS handshake on a new connection.*/
-static int op_http_conn_start_tls(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
- op_sock _fd,SSL *_ssl_conn){
+/*Run the TLS handshake on a new connection until it finishes.
+  This may be called again after it returns OP_EAGAIN to continue.
+  _blocking: Whether or not to block until the handshake finishes.
+  Return: 0 on success, OP_EAGAIN if _blocking was 0 and the handshake has to
+           wait for the server, or a negative value on error.*/
+static int op_http_conn_finish_tls(OpusHTTPStream *_stream,
+ op_sock _fd,SSL *_ssl_conn,int _blocking){
   SSL_SESSION *ssl_session;
-  BIO         *ssl_bio;
-  int          skip_certificate_check;
   int          ret;
+  ret=op_do_ssl_step(_ssl_conn,_fd,SSL_connect,_blocking);
+  if(ret==OP_EAGAIN)return ret;
+  if(OP_UNLIKELY(ret<=0))return OP_FALSE;
+  ssl_session=_stream->ssl_session;
+  if(ssl_session==NULL
+# if (OPENSSL_VERSION_NUMBER<0x10002000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
+   ||!_stream->skip_certificate_check
+# endif
+   ){
+    ret=op_do_ssl_step(_ssl_conn,_fd,SSL_do_handshake,_blocking);
+    if(ret==OP_EAGAIN)return ret;
+    if(OP_UNLIKELY(ret<=0))return OP_FALSE;
+# if (OPENSSL_VERSION_NUMBER<0x10002000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
+    /*OpenSSL before version 1.0.2 does not do automatic hostname verification,
+       despite the fact that we just passed it the hostname above in the call
+       to SSL_set_tlsext_host_name().
+      Do it for them.*/
+    if(!_stream->skip_certificate_check
+     &&!op_http_verify_hostname(_stream,_ssl_conn)){
+      return OP_FALSE;
+    }
+# endif
+    if(ssl_session==NULL){
+      /*Save the session for later resumption.*/
+      _stream->ssl_session=SSL_get1_session(_ssl_conn);
+    }
+  }
+  return 0;
+}
+
+/*Start the TLS handshake on a new connection.
+  _blocking: Whether or not to block until the handshake finishes.
+             If not, op_http_conn_finish_tls() must be called to finish it.
+             This still blocks to establish a tunnel through a proxy.
+  Return: 0 on success, OP_EAGAIN if _blocking was 0 and the handshake has to
+           wait for the server, or a negative value on error.
+          The connection only takes ownership of _fd and _ssl_conn if this
+           does not fail.*/
+static int op_http_conn_start_tls(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
+ op_sock _fd,SSL *_ssl_conn,int _blocking){
+  BIO *ssl_bio;
+  int  ret;
   /*This always takes an int, even though with Winsock op_sock is a SOCKET.*/
   ssl_bio=BIO_new_socket((int)_fd,BIO_NOCLOSE);
   if(OP_LIKELY(ssl_bio==NULL))return OP_FALSE;
@@ -1933,11 +2583,10 @@ static int op_http_conn_start_tls(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
   /*Support for RFC 6066 Server Name Indication.*/
   SSL_set_tlsext_host_name(_ssl_conn,_stream->url.host);
 # endif
-  skip_certificate_check=_stream->skip_certificate_check;
 # if (OPENSSL_VERSION_NUMBER>=0x10002000L||LIBRESSL_VERSION_NUMBER>=0x2070000fL)
   /*As of version 1.0.2, OpenSSL can finally do hostname checks automatically.
     Of course, they make it much more complicated than it needs to be.*/
-  if(!skip_certificate_check){
+  if(!_stream->skip_certificate_check){
     X509_VERIFY_PARAM *param;
     struct addrinfo   *addr;
     char              *host;
@@ -1993,94 +2642,113 @@ static int op_http_conn_start_tls(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
     SSL_set_bio(_ssl_conn,ssl_bio,ssl_bio);
     SSL_set_connect_state(_ssl_conn);
   }
-  ret=op_do_ssl_step(_ssl_conn,_fd,SSL_connect);
-  if(OP_UNLIKELY(ret<=0))return OP_FALSE;
-  ssl_session=_stream->ssl_session;
-  if(ssl_session==NULL
-# if (OPENSSL_VERSION_NUMBER<0x10002000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
-   ||!skip_certificate_check
-# endif
-   ){
-    ret=op_do_ssl_step(_ssl_conn,_fd,SSL_do_handshake);
-    if(OP_UNLIKELY(ret<=0))return OP_FALSE;
-# if (OPENSSL_VERSION_NUMBER<0x10002000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
-    /*OpenSSL before version 1.0.2 does not do automatic hostname verification,
-       despite the fact that we just passed it the hostname above in the call
-       to SSL_set_tlsext_host_name().
-      Do it for them.*/
-    if(!skip_certificate_check&&!op_http_verify_hostname(_stream,_ssl_conn)){
-      return OP_FALSE;
-    }
-# endif
-    if(ssl_session==NULL){
-      /*Save the session for later resumption.*/
-      _stream->ssl_session=SSL_get1_session(_ssl_conn);
-    }
-  }
+  ret=op_http_conn_finish_tls(_stream,_fd,_ssl_conn,_blocking);
+  if(OP_UNLIKELY(ret<0)&&ret!=OP_EAGAIN)return ret;
   _conn->ssl_conn=_ssl_conn;
   _conn->fd=_fd;
   _conn->nrequests_left=OP_PIPELINE_MAX_REQUESTS;
-  return 0;
-}
-
-/*Try to start a connection to the next address in the given list of a given
-   type.
-  _fd:           The socket to connect with.
-  [inout] _addr: A pointer to the list of addresses.
-                 This will be advanced to the first one that matches the given
-                  address family (possibly the current one).
-  _ai_family:    The address family to connect to.
-  Return: 1        If the connection was successful.
-          0        If the connection is in progress.
-          OP_FALSE If the connection failed and there were no more addresses
-                    left to try.
-                    *_addr will be set to NULL in this case.*/
-static int op_sock_connect_next(op_sock _fd,
- struct addrinfo **_addr,int _ai_family){
-  struct addrinfo *addr;
-  int              err;
-  for(addr=*_addr;;addr=addr->ai_next){
-    /*Move to the next address of the requested type.*/
-    for(;addr!=NULL&&addr->ai_family!=_ai_family;addr=addr->ai_next);
-    *_addr=addr;
-    /*No more: failure.*/
-    if(addr==NULL)return OP_FALSE;
-    if(connect(_fd,addr->ai_addr,addr->ai_addrlen)>=0)return 1;
-    err=op_errno();
-    /*Winsock will set WSAEWOULDBLOCK.*/
-    if(OP_LIKELY(err==EINPROGRESS||err==EWOULDBLOCK))return 0;
-  }
+  return ret;
 }
 
-/*The number of address families to try connecting to simultaneously.*/
+/*The number of address families we connect to.*/
 # define OP_NPROTOS (2)
 
-static int op_http_connect_impl(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
- struct addrinfo *_addrs,op_time *_start_time){
+/*The maximum number of resolved addresses we will try to connect to.*/
+# define OP_NADDRS_MAX (16)
+
+/*The maximum number of connection attempts we will have in flight at once.*/
+# define OP_NCONNECT_ATTEMPTS_MAX (8)
+
+/*The number of milliseconds to give a connection attempt before starting the
+   next one in parallel.
+  RFC 8305 Section 5 recommends 250 ms, with a minimum of 100 ms and a maximum
+   of 2 s.*/
+# define OP_CONNECT_ATTEMPT_DELAY_MS (250)
+
+/*Order a list of resolved addresses to connect to.
+  RFC 8305 Section 4 says to alternate between address families, starting
+   with the family of the first address returned by the resolver.
+  We put the address we connected to last time (if it is in the list) first,
+   since it is the one most likely to work.
+  _dst:   Returns the ordered addresses.
+          This must have room for OP_NADDRS_MAX entries.
+  _addrs: The list of resolved addresses.
+  _last:  The address we connected to last time, or NULL if there was none.
+  Return: The number of addresses stored in _dst.*/
+static int op_http_order_addrs(struct addrinfo **_dst,
+ struct addrinfo *_addrs,const struct addrinfo *_last){
+  struct addrinfo *addrs[OP_NPROTOS][OP_NADDRS_MAX];
   struct addrinfo *addr;
-  struct addrinfo *addrs[OP_NPROTOS];
-  struct pollfd    fds[OP_NPROTOS];
+  int              naddrs[OP_NPROTOS];
   int              ai_family;
-  int              nprotos;
-  int              ret;
+  int              ndst;
   int              pi;
-  int              pj;
-  for(pi=0;pi<OP_NPROTOS;pi++)addrs[pi]=NULL;
-  /*Try connecting via both IPv4 and IPv6 simultaneously, and keep the first
-     one that succeeds.
-    Start by finding the first address from each family.
-    We order the first connection attempts in the same order the address
-     families were returned in the DNS records in accordance with RFC 6555.*/
-  for(addr=_addrs,nprotos=0;addr!=NULL&&nprotos<OP_NPROTOS;addr=addr->ai_next){
+  int              ai;
+  ndst=0;
+  for(pi=0;pi<OP_NPROTOS;pi++)naddrs[pi]=0;
+  ai_family=AF_UNSPEC;
+  for(addr=_addrs;addr!=NULL;addr=addr->ai_next){
     if(addr->ai_family==AF_INET6||addr->ai_family==AF_INET){
       OP_ASSERT(addr->ai_addrlen<=
        OP_MAX(sizeof(struct sockaddr_in6),sizeof(struct sockaddr_in)));
-      /*If we've seen this address family before, skip this address for now.*/
-      for(pi=0;pi<nprotos;pi++)if(addrs[pi]->ai_family==addr->ai_family)break;
-      if(pi<nprotos)continue;
-      addrs[nprotos++]=addr;
+      if(_last!=NULL&&ndst==0&&addr->ai_family==_last->ai_family
+       &&addr->ai_addrlen==_last->ai_addrlen
+       &&memcmp(addr->ai_addr,_last->ai_addr,addr->ai_addrlen)==0){
+        _dst[ndst++]=addr;
+        continue;
+      }
+      if(ai_family==AF_UNSPEC)ai_family=addr->ai_family;
+      pi=addr->ai_family!=ai_family;
+      if(naddrs[pi]<OP_NADDRS_MAX)addrs[pi][naddrs[pi]++]=addr;
+    }
+  }
+  /*Alternate address families.
+    If we already put the last address we connected to first, its family is
+     already covered, so start with the other one.*/
+  if(ndst>0&&_dst[0]->ai_family==ai_family){
+    for(ai=0;;ai++){
+      if(ai<naddrs[1]&&ndst<OP_NADDRS_MAX)_dst[ndst++]=addrs[1][ai];
+      if(ai<naddrs[0]&&ndst<OP_NADDRS_MAX)_dst[ndst++]=addrs[0][ai];
+      if(ai>=naddrs[0]&&ai>=naddrs[1])break;
+    }
+  }
+  else{
+    for(ai=0;;ai++){
+      if(ai<naddrs[0]&&ndst<OP_NADDRS_MAX)_dst[ndst++]=addrs[0][ai];
+      if(ai<naddrs[1]&&ndst<OP_NADDRS_MAX)_dst[ndst++]=addrs[1][ai];
+      if(ai>=naddrs[0]&&ai>=naddrs[1])break;
     }
   }
+  return ndst;
+}
+
+/*Connect to the first address that responds.
+  This follows the "Happy Eyeballs" algorithm from RFC 8305: we start a
+   connection attempt to each address in turn, without waiting for the
+   earlier ones to finish, but spacing them OP_CONNECT_ATTEMPT_DELAY_MS
+   apart (or starting the next one as soon as one fails), and keep whichever
+   connects first.
+  That way a host or address family that silently drops our packets only
+   delays the connection by a fraction of a second, instead of until the
+   connection attempt times out.
+  _addrs: The list of resolved addresses.
+  _last:  The address we connected to last time, or NULL if there was none.*/
+static int op_http_connect_impl(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
+ struct addrinfo *_addrs,const struct addrinfo *_last,op_time *_start_time){
+  struct addrinfo *addrs[OP_NADDRS_MAX];
+  struct addrinfo *fd_addrs[OP_NCONNECT_ATTEMPTS_MAX];
+  struct pollfd    fds[OP_NCONNECT_ATTEMPTS_MAX];
+  struct addrinfo *addr;
+  op_time          attempt_time;
+  op_time          now;
+  op_sock          fd;
+  int              start_next;
+  int              naddrs;
+  int              nfds;
+  int              ret;
+  int              ai;
+  int              pi;
+  naddrs=op_http_order_addrs(addrs,_addrs,_last);
   /*Pop the connection off the free list and put it on the LRU list.*/
   OP_ASSERT(_stream->free_head==_conn);
   _stream->free_head=_conn->next;
@@ -2090,39 +2758,60 @@ static int op_http_connect_impl(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
   _conn->read_time=*_start_time;
   _conn->read_bytes=0;
   _conn->read_rate=0;
-  /*Try to start a connection to each protocol.
-    RFC 6555 says it is RECOMMENDED that connection attempts be paced
-     150...250 ms apart "to balance human factors against network load", but
-     that "stateful algorithms" (that's us) "are expected to be more
-     aggressive".
-    We are definitely more aggressive: we don't pace at all.*/
-  for(pi=0;pi<nprotos;pi++){
-    ai_family=addrs[pi]->ai_family;
-    fds[pi].fd=socket(ai_family,SOCK_STREAM,addrs[pi]->ai_protocol);
-    fds[pi].events=POLLOUT;
-    if(OP_LIKELY(fds[pi].fd!=OP_INVALID_SOCKET)){
-      if(OP_LIKELY(op_sock_set_nonblocking(fds[pi].fd,1)>=0)){
-        ret=op_sock_connect_next(fds[pi].fd,addrs+pi,ai_family);
-        if(OP_UNLIKELY(ret>0)){
-          /*It succeeded right away (technically possible), so stop.*/
-          nprotos=pi+1;
-          break;
+  now=attempt_time=*_start_time;
+  fd=OP_INVALID_SOCKET;
+  addr=NULL;
+  start_next=1;
+  nfds=0;
+  ai=0;
+  for(;;){
+    opus_int32 elapsed_ms;
+    opus_int32 timeout_ms;
+    elapsed_ms=op_time_diff_ms(&now,&attempt_time);
+    if(ai<naddrs&&nfds<OP_NCONNECT_ATTEMPTS_MAX
+     &&(start_next||elapsed_ms>=OP_CONNECT_ATTEMPT_DELAY_MS)){
+      int err;
+      /*Start a connection attempt to the next address.*/
+      addr=addrs[ai++];
+      fd=socket(addr->ai_family,SOCK_STREAM,addr->ai_protocol);
+      if(OP_UNLIKELY(fd==OP_INVALID_SOCKET))continue;
+      if(OP_LIKELY(op_sock_set_nonblocking(fd,1)>=0)){
+        /*It succeeded right away (technically possible), so stop.*/
+        if(connect(fd,addr->ai_addr,addr->ai_addrlen)>=0)break;
+        err=op_errno();
+        /*Winsock will set WSAEWOULDBLOCK.*/
+        if(OP_LIKELY(err==EINPROGRESS||err==EWOULDBLOCK)){
+          fds[nfds].fd=fd;
+          fds[nfds].events=POLLOUT;
+          fd_addrs[nfds]=addr;
+          nfds++;
+          attempt_time=now;
+          start_next=0;
+          fd=OP_INVALID_SOCKET;
+          continue;
         }
-        /*Otherwise go on to the next protocol, and skip the clean-up below.*/
-        else if(ret==0)continue;
-        /*Tried all the addresses for this protocol.*/
       }
-      /*Clean up the socket.*/
-      close(fds[pi].fd);
+      /*This address failed immediately: try the next one.*/
+      close(fd);
+      fd=OP_INVALID_SOCKET;
+      start_next=1;
+      continue;
     }
-    /*Remove this protocol from the list.*/
-    memmove(addrs+pi,addrs+pi+1,sizeof(*addrs)*(nprotos-pi-1));
-    nprotos--;
-    pi--;
-  }
-  /*Wait for one of the connections to finish.*/
-  while(pi>=nprotos&&nprotos>0&&poll(fds,nprotos,OP_POLL_TIMEOUT_MS)>0){
-    for(pi=0;pi<nprotos;pi++){
+    /*We've run out of addresses.*/
+    if(nfds<=0)break;
+    /*Wait for one of the connections to finish, or until it's time to start
+       the next one.*/
+    if(ai<naddrs&&nfds<OP_NCONNECT_ATTEMPTS_MAX){
+      timeout_ms=OP_CONNECT_ATTEMPT_DELAY_MS-elapsed_ms;
+    }
+    else{
+      timeout_ms=OP_POLL_TIMEOUT_MS-elapsed_ms;
+      /*We've given up on all of them.*/
+      if(timeout_ms<=0)break;
+    }
+    if(poll(fds,nfds,timeout_ms)<0)break;
+    op_time_get(&now);
+    for(pi=0;pi<nfds;pi++){
       socklen_t errlen;
       int       err;
       /*Still waiting...*/
@@ -2133,34 +2822,34 @@ static int op_http_connect_impl(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
       ret=getsockopt(fds[pi].fd,SOL_SOCKET,SO_ERROR,&err,&errlen);
       if(ret<0)err=op_errno();
       /*Success!*/
-      if(err==0||err==EISCONN)break;
-      /*Move on to the next address for this protocol.*/
-      ai_family=addrs[pi]->ai_family;
-      addrs[pi]=addrs[pi]->ai_next;
-      ret=op_sock_connect_next(fds[pi].fd,addrs+pi,ai_family);
-      /*It succeeded right away, so stop.*/
-      if(ret>0)break;
-      /*Otherwise go on to the next protocol, and skip the clean-up below.*/
-      else if(ret==0)continue;
-      /*Tried all the addresses for this protocol.
-        Remove it from the list.*/
-      close(fds[pi].fd);
-      memmove(fds+pi,fds+pi+1,sizeof(*fds)*(nprotos-pi-1));
-      memmove(addrs+pi,addrs+pi+1,sizeof(*addrs)*(nprotos-pi-1));
-      nprotos--;
+      if(err==0||err==EISCONN){
+        fd=fds[pi].fd;
+        addr=fd_addrs[pi];
+      }
+      /*This attempt failed, so start the next one right away.*/
+      else{
+        close(fds[pi].fd);
+        start_next=1;
+      }
+      /*Either way, remove it from the list.*/
+      memmove(fds+pi,fds+pi+1,sizeof(*fds)*(nfds-pi-1));
+      memmove(fd_addrs+pi,fd_addrs+pi+1,sizeof(*fd_addrs)*(nfds-pi-1));
+      nfds--;
       pi--;
+      if(fd!=OP_INVALID_SOCKET)break;
     }
+    if(fd!=OP_INVALID_SOCKET)break;
   }
   /*Close all the other sockets.*/
-  for(pj=0;pj<nprotos;pj++)if(pi!=pj)close(fds[pj].fd);
+  for(pi=0;pi<nfds;pi++)close(fds[pi].fd);
   /*If none of them succeeded, we're done.*/
-  if(pi>=nprotos)return OP_FALSE;
+  if(fd==OP_INVALID_SOCKET)return OP_FALSE;
   /*Save this address for future connection attempts.*/
-  if(addrs[pi]!=&_stream->addr_info){
-    memcpy(&_stream->addr_info,addrs[pi],sizeof(_stream->addr_info));
+  if(addr!=&_stream->addr_info){
+    memcpy(&_stream->addr_info,addr,sizeof(_stream->addr_info));
     _stream->addr_info.ai_addr=&_stream->addr.s;
     _stream->addr_info.ai_next=NULL;
-    memcpy(&_stream->addr,addrs[pi]->ai_addr,addrs[pi]->ai_addrlen);
+    memcpy(&_stream->addr,addr->ai_addr,addr->ai_addrlen);
   }
   if(OP_URL_IS_SSL(&_stream->url)){
     SSL *ssl_conn;
@@ -2168,33 +2857,35 @@ static int op_http_connect_impl(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
     OP_ASSERT(_stream->ssl_ctx!=NULL);
     ssl_conn=SSL_new(_stream->ssl_ctx);
     if(OP_LIKELY(ssl_conn!=NULL)){
-      ret=op_http_conn_start_tls(_stream,_conn,fds[pi].fd,ssl_conn);
+      ret=op_http_conn_start_tls(_stream,_conn,fd,ssl_conn,1);
       if(OP_LIKELY(ret>=0))return ret;
       SSL_free(ssl_conn);
     }
-    close(fds[pi].fd);
+    close(fd);
     _conn->fd=OP_INVALID_SOCKET;
     return OP_FALSE;
   }
   /*Just a normal non-SSL connection.*/
   _conn->ssl_conn=NULL;
-  _conn->fd=fds[pi].fd;
+  _conn->fd=fd;
   _conn->nrequests_left=OP_PIPELINE_MAX_REQUESTS;
   /*Disable write coalescing.
     We always send whole requests at once and always parse the response headers
      before sending another one.*/
-  op_sock_set_tcp_nodelay(fds[pi].fd,1);
+  op_sock_set_tcp_nodelay(fd,1);
   return 0;
 }
 
 static int op_http_connect(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
  struct addrinfo *_addrs,op_time *_start_time){
-  op_time          resolve_time;
-  struct addrinfo *new_addrs;
-  int              ret;
+  op_time                resolve_time;
+  struct addrinfo       *new_addrs;
+  const struct addrinfo *last;
+  int                    ret;
   /*Re-resolve the host if we need to (RFC 6555 says we MUST do so
      occasionally).*/
   new_addrs=NULL;
+  last=_addrs==&_stream->addr_info?&_stream->addr_info:NULL;
   op_time_get(&resolve_time);
   if(_addrs!=&_stream->addr_info||op_time_diff_ms(&resolve_time,
    &_stream->resolve_time)>=OP_RESOLVE_CACHE_TIMEOUT_MS){
@@ -2205,7 +2896,7 @@ static int op_http_connect(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
     }
     else if(OP_LIKELY(_addrs==NULL))return OP_FALSE;
   }
-  ret=op_http_connect_impl(_stream,_conn,_addrs,_start_time);
+  ret=op_http_connect_impl(_stream,_conn,_addrs,last,_start_time);
   if(new_addrs!=NULL)freeaddrinfo(new_addrs);
   return ret;
 }
@@ -2323,47 +3014,432 @@ static int op_http_allow_pipelining(const char *_server){
 # undef NBAD_SERVERS
 }
 
-static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
- int _skip_certificate_check,const char *_proxy_host,unsigned _proxy_port,
- const char *_proxy_user,const char *_proxy_pass,OpusServerInfo *_info){
-  struct addrinfo *addrs;
-  int              nredirs;
-  int              ret;
-#if defined(_WIN32)
-  op_init_winsock();
-#endif
-  ret=op_parse_url(&_stream->url,_url);
-  if(OP_UNLIKELY(ret<0))return ret;
-  if(_proxy_host!=NULL){
-    if(OP_UNLIKELY(_proxy_port>65535U))return OP_EINVAL;
-    _stream->connect_host=op_string_dup(_proxy_host);
-    _stream->connect_port=_proxy_port;
+/*Find what a shared context remembers about a host.
+  The context must be locked.
+  _create: Whether or not to replace the least-recently used entry if the host
+            is not found.
+  Return: The entry for the host, or NULL if there was none (or we failed to
+           create one).*/
+static OpusHTTPHost *op_http_context_find_host(OpusHTTPContext *_ctx,
+ const char *_host,unsigned _port,int _create){
+  OpusHTTPHost *host;
+  OpusHTTPHost *oldest;
+  op_time       now;
+  char         *name;
+  int           hi;
+  op_time_get(&now);
+  oldest=NULL;
+  for(hi=0;hi<OP_HTTP_CONTEXT_NHOSTS;hi++){
+    host=_ctx->hosts+hi;
+    if(host->host==NULL){
+      /*Prefer an empty entry to replacing one.*/
+      if(oldest==NULL||oldest->host!=NULL)oldest=host;
+    }
+    else if(host->port==_port&&strcmp(host->host,_host)==0){
+      host->use_time=now;
+      return host;
+    }
+    else if(oldest==NULL||oldest->host!=NULL
+     &&op_time_diff_ms(&host->use_time,&oldest->use_time)<0){
+      oldest=host;
+    }
   }
-  else{
-    _stream->connect_host=_stream->url.host;
-    _stream->connect_port=_stream->url.port;
+  if(!_create)return NULL;
+  name=op_string_dup(_host);
+  if(OP_UNLIKELY(name==NULL))return NULL;
+  host=oldest;
+  if(host->ssl_session!=NULL)SSL_SESSION_free(host->ssl_session);
+  _ogg_free(host->host);
+  host->host=name;
+  host->port=_port;
+  host->has_addr=0;
+  host->ssl_session=NULL;
+  host->pipeline=0;
+  host->use_time=now;
+  return host;
+}
+
+/*Load what the shared context remembers about the hosts we're about to
+   connect to.
+  _addrs:    The addresses we were going to connect to, or NULL to resolve the
+              host.
+  _pipeline: Returns whether or not the server is known to support persistent
+              connections.
+  Return: The addresses to connect to, or NULL to resolve the host.*/
+static struct addrinfo *op_http_context_load(OpusHTTPStream *_stream,
+ struct addrinfo *_addrs,int *_pipeline){
+  OpusHTTPContext *ctx;
+  OpusHTTPHost    *host;
+  *_pipeline=0;
+  ctx=_stream->ctx;
+  if(ctx==NULL)return _addrs;
+  op_http_context_lock(ctx);
+  if(_addrs==NULL){
+    host=op_http_context_find_host(ctx,
+     _stream->connect_host,_stream->connect_port,0);
+    if(host!=NULL&&host->has_addr){
+      /*This keeps the original resolve_time, so op_http_connect() still
+         re-resolves the host on schedule.*/
+      memcpy(&_stream->addr_info,&host->addr_info,sizeof(_stream->addr_info));
+      memcpy(&_stream->addr,&host->addr,sizeof(_stream->addr));
+      _stream->addr_info.ai_addr=&_stream->addr.s;
+      _stream->resolve_time=host->resolve_time;
+      _addrs=&_stream->addr_info;
+    }
   }
-  addrs=NULL;
-  for(nredirs=0;nredirs<OP_REDIRECT_LIMIT;nredirs++){
-    OpusParsedURL  next_url;
-    op_time        start_time;
-    op_time        end_time;
-    char          *next;
-    char          *status_code;
-    int            minor_version_pos;
-    int            v1_1_compat;
-    /*Initialize the SSL library if necessary.*/
-    if(OP_URL_IS_SSL(&_stream->url)&&_stream->ssl_ctx==NULL){
-      SSL_CTX *ssl_ctx;
-# if (OPENSSL_VERSION_NUMBER<0x10100000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
-#  if !defined(OPENSSL_NO_LOCKING)
-      /*The documentation says SSL_library_init() is not reentrant.
-        We don't want to add our own depenencies on a threading library, and it
-         appears that it's safe to call OpenSSL's locking functions before the
-         library is initialized, so that's what we'll do (really OpenSSL should
-         do this for us).
-        This doesn't guarantee that _other_ threads in the application aren't
-         calling SSL_library_init() at the same time, but there's not much we
+  host=op_http_context_find_host(ctx,_stream->url.host,_stream->url.port,0);
+  if(host!=NULL){
+    *_pipeline=host->pipeline&&_stream->connect_host==_stream->url.host;
+    if(OP_URL_IS_SSL(&_stream->url)&&_stream->ssl_session==NULL
+     &&!_stream->skip_certificate_check&&host->ssl_session!=NULL
+     &&SSL_SESSION_up_ref(host->ssl_session)){
+      _stream->ssl_session=host->ssl_session;
+    }
+  }
+  op_http_context_unlock(ctx);
+  return _addrs;
+}
+
+/*Save the address we connected to and the TLS session we negotiated in the
+   shared context.*/
+static void op_http_context_save(OpusHTTPStream *_stream){
+  OpusHTTPContext *ctx;
+  OpusHTTPHost    *host;
+  ctx=_stream->ctx;
+  if(ctx==NULL)return;
+  op_http_context_lock(ctx);
+  host=op_http_context_find_host(ctx,
+   _stream->connect_host,_stream->connect_port,1);
+  if(OP_LIKELY(host!=NULL)){
+    memcpy(&host->addr_info,&_stream->addr_info,sizeof(host->addr_info));
+    memcpy(&host->addr,&_stream->addr,sizeof(host->addr));
+    host->addr_info.ai_addr=&host->addr.s;
+    host->addr_info.ai_canonname=NULL;
+    host->addr_info.ai_next=NULL;
+    host->resolve_time=_stream->resolve_time;
+    host->has_addr=1;
+  }
+  host=op_http_context_find_host(ctx,_stream->url.host,_stream->url.port,1);
+  if(OP_LIKELY(host!=NULL)&&_stream->connect_host==_stream->url.host){
+    /*We upgrade the first request to HTTP/1.1 for servers that have supported
+       persistent connections before.
+      The response to an HTTP/1.1 request may use the chunked
+       transfer-coding, but we handle that, so this applies to live streams
+       as well as seekable resources.*/
+    host->pipeline=_stream->pipeline;
+  }
+  if(_stream->ssl_session!=NULL&&!_stream->skip_certificate_check){
+    if(OP_LIKELY(host!=NULL)&&host->ssl_session!=_stream->ssl_session
+     &&SSL_SESSION_up_ref(_stream->ssl_session)){
+      if(host->ssl_session!=NULL)SSL_SESSION_free(host->ssl_session);
+      host->ssl_session=_stream->ssl_session;
+    }
+  }
+  op_http_context_unlock(ctx);
+}
+
+/*Get the TLS configuration for streams that check certificates from the
+   shared context.
+  _ssl_ctx: A new configuration to share if the context does not have one yet,
+             or NULL.
+            This is freed if the context already has one.
+  Return: The shared configuration, or NULL if there is none yet.*/
+static SSL_CTX *op_http_context_share_ssl_ctx(OpusHTTPContext *_ctx,
+ SSL_CTX *_ssl_ctx){
+  SSL_CTX *ret;
+  op_http_context_lock(_ctx);
+  if(_ctx->ssl_ctx==NULL)_ctx->ssl_ctx=_ssl_ctx;
+  ret=_ctx->ssl_ctx;
+  op_http_context_unlock(_ctx);
+  if(_ssl_ctx!=NULL&&_ssl_ctx!=ret)SSL_CTX_free(_ssl_ctx);
+  return ret;
+}
+
+/*Hand the stream's idle persistent connections to the shared context, so that
+   the next stream from the same host doesn't need to open a new one.*/
+static void op_http_context_pool_conns(OpusHTTPStream *_stream){
+  OpusHTTPContext *ctx;
+  OpusHTTPConn    *conn;
+  op_time          now;
+  ctx=_stream->ctx;
+  /*Only HTTP/1.1 servers will accept another request on the same connection.
+    We also don't bother pooling connections to a proxy.*/
+  if(ctx==NULL||!_stream->pipeline
+   ||_stream->connect_host!=_stream->url.host){
+    return;
+  }
+  op_time_get(&now);
+  op_http_context_lock(ctx);
+  for(conn=_stream->lru_head;conn!=NULL;conn=conn->next){
+    OpusHTTPIdleConn *idle;
+    char             *host;
+    int               ci;
+    /*Skip connections with any part of a response left to read.*/
+    if(conn->state!=OP_CONN_OPEN||conn->reading_response
+     ||conn->nrequests_left<=0||conn->next_pos>=0
+     ||conn->end_pos<0||conn->pos<conn->end_pos){
+      continue;
+    }
+    /*The end of a chunked response body almost always arrives with the last
+       of its data, so try to read it without blocking.*/
+    if(conn->chunk_state==OP_CHUNK_DATA||conn->chunk_state==OP_CHUNK_TRAILER){
+      if(conn->chunk_state==OP_CHUNK_DATA&&conn->chunk_left>0)continue;
+      if(op_http_conn_read_chunk_header(conn,&_stream->response,0)<0
+       ||conn->chunk_state!=OP_CHUNK_END){
+        continue;
+      }
+    }
+    /*Use an empty entry, or replace the oldest one.*/
+    idle=NULL;
+    for(ci=0;ci<OP_HTTP_CONTEXT_NCONNS;ci++){
+      if(ctx->conns[ci].host==NULL){
+        idle=ctx->conns+ci;
+        break;
+      }
+      if(idle==NULL
+       ||op_time_diff_ms(&ctx->conns[ci].idle_time,&idle->idle_time)<0){
+        idle=ctx->conns+ci;
+      }
+    }
+    host=op_string_dup(_stream->url.host);
+    if(OP_UNLIKELY(host==NULL))break;
+    if(idle->host!=NULL){
+      op_http_conn_clear(&idle->conn);
+      _ogg_free(idle->host);
+    }
+    idle->conn=*conn;
+    idle->host=host;
+    idle->port=_stream->url.port;
+    idle->ssl=conn->ssl_conn!=NULL;
+    idle->verified=idle->ssl&&!_stream->skip_certificate_check;
+    idle->idle_time=now;
+    /*The stream will now close the connection without touching the socket.*/
+    conn->ssl_conn=NULL;
+    conn->fd=OP_INVALID_SOCKET;
+  }
+  op_http_context_unlock(ctx);
+}
+
+/*Take an idle connection to the current host from the shared context, if it
+   has one that still looks usable.
+  Return: 0 on success, or OP_FALSE if there was none.*/
+static int op_http_conn_reuse(OpusHTTPStream *_stream,OpusHTTPConn *_conn,
+ op_time *_start_time){
+  OpusHTTPContext *ctx;
+  OpusHTTPConn     idle_conn;
+  int              ssl;
+  ctx=_stream->ctx;
+  if(ctx==NULL||_stream->connect_host!=_stream->url.host)return OP_FALSE;
+  ssl=OP_URL_IS_SSL(&_stream->url);
+  op_time_get(_start_time);
+  for(;;){
+    OpusHTTPIdleConn *idle;
+    struct pollfd     fd;
+    int               ci;
+    op_http_context_lock(ctx);
+    idle=NULL;
+    for(ci=0;ci<OP_HTTP_CONTEXT_NCONNS;ci++){
+      OpusHTTPIdleConn *cur;
+      cur=ctx->conns+ci;
+      if(cur->host==NULL)continue;
+      /*The server has probably closed connections idle for this long.*/
+      if(op_time_diff_ms(_start_time,&cur->idle_time)
+       >=OP_CONNECTION_IDLE_TIMEOUT_MS){
+        op_http_conn_clear(&cur->conn);
+        _ogg_free(cur->host);
+        cur->host=NULL;
+        continue;
+      }
+      if(cur->port!=_stream->url.port||cur->ssl!=ssl
+       ||strcmp(cur->host,_stream->url.host)!=0){
+        continue;
+      }
+      /*Never skip a certificate check we were asked to make.*/
+      if(ssl&&!cur->verified&&!_stream->skip_certificate_check)continue;
+      /*Prefer the most recently used connection.*/
+      if(idle==NULL||op_time_diff_ms(&cur->idle_time,&idle->idle_time)>0){
+        idle=cur;
+      }
+    }
+    if(idle!=NULL){
+      idle_conn=idle->conn;
+      _ogg_free(idle->host);
+      idle->host=NULL;
+    }
+    op_http_context_unlock(ctx);
+    if(idle==NULL)return OP_FALSE;
+    /*An idle connection should have nothing to read.
+      If it does, the server closed it (or sent something we didn't ask for).*/
+    fd.fd=idle_conn.fd;
+    fd.events=POLLIN;
+    if(poll(&fd,1,0)==0)break;
+    op_http_conn_clear(&idle_conn);
+  }
+  /*Pop the connection off the free list and put it on the LRU list.*/
+  OP_ASSERT(_stream->free_head==_conn);
+  _stream->free_head=_conn->next;
+  _conn->next=_stream->lru_head;
+  _stream->lru_head=_conn;
+  _conn->read_time=*_start_time;
+  _conn->read_bytes=0;
+  _conn->read_rate=0;
+  _conn->ssl_conn=idle_conn.ssl_conn;
+  _conn->fd=idle_conn.fd;
+  /*Count the request we are about to send.*/
+  _conn->nrequests_left=idle_conn.nrequests_left-1;
+  return 0;
+}
+
+/*Find the disk cache file for this resource in the given directory, before
+   making the initial request.
+  The file is named after a hash of a key made from the scheme, host, port,
+   and path of the URL.
+  The key leaves out any user name and password and the query, so they are
+   never written to disk.
+  If the file exists and was made for the same key, we keep it open and
+   remember one of the validators stored in it, so that the initial request
+   can ask the server to confirm the resource has not changed.
+  Any failure here just leaves the disk cache disabled.*/
+static void op_http_disk_cache_lookup(OpusHTTPStream *_stream,
+ const char *_dir){
+  unsigned char  header[OP_HTTP_DISK_CACHE_HEADER_SIZE];
+  OpusStringBuf  key;
+  OpusStringBuf  path;
+  FILE          *fp;
+  opus_uint32    h0;
+  opus_uint32    h1;
+  int            hi;
+  int            ret;
+  op_sb_init(&key);
+  ret=op_sb_append_string(&key,_stream->url.scheme);
+  ret|=op_sb_append(&key,"://",3);
+  ret|=op_sb_append_string(&key,_stream->url.host);
+  ret|=op_sb_append_port(&key,_stream->url.port);
+  /*Leave out the query, too, since it often holds access tokens that change
+     from one request to the next.
+    The validators and length stored with the data are what tell us it belongs
+     to the same resource.*/
+  ret|=op_sb_append(&key,_stream->url.path,
+   (int)strcspn(_stream->url.path,"?"));
+  if(OP_UNLIKELY(ret<0)){
+    op_sb_clear(&key);
+    return;
+  }
+  /*Hash the key to get the file name.
+    This is two interleaved 32-bit FNV-1a hashes with different offsets, to
+     avoid needing 64-bit multiplies.*/
+  h0=2166136261U;
+  h1=2166136261U^0x5A5A5A5AU;
+  for(hi=0;hi<key.nbuf;hi++){
+    h0=(h0^(unsigned char)key.buf[hi])*16777619U&0xFFFFFFFFU;
+    h1=(h1^(unsigned char)key.buf[hi])*16777619U&0xFFFFFFFFU;
+  }
+  op_sb_init(&path);
+  ret=op_sb_append_string(&path,_dir);
+  ret|=op_sb_append(&path,"/",1);
+  for(hi=0;hi<16;hi++){
+    opus_uint32 h;
+    h=hi<8?h0:h1;
+    ret|=op_sb_append(&path,"0123456789abcdef"+(h>>(28-4*(hi&7))&0xF),1);
+  }
+  ret|=op_sb_append(&path,".opc",4);
+  if(OP_UNLIKELY(ret<0)){
+    op_sb_clear(&path);
+    op_sb_clear(&key);
+    return;
+  }
+  _stream->disk_cache_key=key.buf;
+  _stream->disk_cache_path=path.buf;
+  fp=fopen(path.buf,"rb");
+  if(fp==NULL)return;
+  if(fread(header,1,sizeof(header),fp)==sizeof(header)
+   &&memcmp(header,OP_HTTP_DISK_CACHE_MAGIC,8)==0){
+    opus_int64 key_len;
+    opus_int64 etag_len;
+    opus_int64 last_modified_len;
+    key_len=op_read_le(header+20,4);
+    etag_len=op_read_le(header+24,4);
+    last_modified_len=op_read_le(header+28,4);
+    if(key_len==key.nbuf&&etag_len<=OP_RESPONSE_SIZE_MAX
+     &&last_modified_len<=OP_RESPONSE_SIZE_MAX){
+      size_t  nstrings;
+      char   *strings;
+      nstrings=(size_t)(key_len+etag_len+last_modified_len);
+      strings=(char *)_ogg_malloc(sizeof(*strings)*nstrings);
+      if(strings!=NULL&&fread(strings,1,nstrings,fp)==nstrings
+       &&memcmp(strings,key.buf,(size_t)key_len)==0){
+        const char *validator;
+        size_t      validator_len;
+        size_t      vi;
+        /*Prefer the entity tag, since it changes whenever the resource
+           does.*/
+        validator=strings+key_len;
+        validator_len=(size_t)etag_len;
+        if(validator_len==0){
+          validator+=etag_len;
+          validator_len=(size_t)last_modified_len;
+        }
+        /*Don't let a damaged file inject anything into the request.*/
+        for(vi=0;vi<validator_len;vi++){
+          if((unsigned char)validator[vi]<0x20)break;
+        }
+        if(validator_len>0&&vi>=validator_len){
+          _stream->disk_cache_if_range=op_string_range_dup(validator,
+           validator+validator_len);
+        }
+      }
+      _ogg_free(strings);
+    }
+  }
+  fclose(fp);
+}
+
+static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
+ int _skip_certificate_check,const char *_proxy_host,unsigned _proxy_port,
+ const char *_proxy_user,const char *_proxy_pass,const char *_disk_cache_dir,
+ OpusServerInfo *_info){
+  struct addrinfo *addrs;
+  int              nredirs;
+  int              ret;
+#if defined(_WIN32)
+  op_init_winsock();
+#endif
+  ret=op_parse_url(&_stream->url,_url);
+  if(OP_UNLIKELY(ret<0))return ret;
+  if(_disk_cache_dir!=NULL)op_http_disk_cache_lookup(_stream,_disk_cache_dir);
+  if(_proxy_host!=NULL){
+    if(OP_UNLIKELY(_proxy_port>65535U))return OP_EINVAL;
+    _stream->connect_host=op_string_dup(_proxy_host);
+    _stream->connect_port=_proxy_port;
+  }
+  else{
+    _stream->connect_host=_stream->url.host;
+    _stream->connect_port=_stream->url.port;
+  }
+  addrs=NULL;
+  for(nredirs=0;nredirs<OP_REDIRECT_LIMIT;nredirs++){
+    OpusParsedURL  next_url;
+    op_time        start_time;
+    op_time        end_time;
+    char          *next;
+    char          *status_code;
+    int            minor_version_pos;
+    int            if_range_pos;
+    int            if_range_end;
+    int            v1_1_compat;
+    int            pipeline_known;
+    /*Initialize the SSL library if necessary.*/
+    if(OP_URL_IS_SSL(&_stream->url)&&_stream->ssl_ctx==NULL){
+      SSL_CTX *ssl_ctx;
+# if (OPENSSL_VERSION_NUMBER<0x10100000L&&LIBRESSL_VERSION_NUMBER<0x2070000fL)
+#  if !defined(OPENSSL_NO_LOCKING)
+      /*The documentation says SSL_library_init() is not reentrant.
+        We don't want to add our own depenencies on a threading library, and it
+         appears that it's safe to call OpenSSL's locking functions before the
+         library is initialized, so that's what we'll do (really OpenSSL should
+         do this for us).
+        This doesn't guarantee that _other_ threads in the application aren't
+         calling SSL_library_init() at the same time, but there's not much we
          can do about that.*/
       CRYPTO_w_lock(CRYPTO_LOCK_SSL);
 #  endif
@@ -2377,15 +3453,29 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
       /*Finally, OpenSSL does this for us, but as penance, it can now fail.*/
       if(!OPENSSL_init_ssl(0,NULL))return OP_EFAULT;
 # endif
-      ssl_ctx=SSL_CTX_new(SSLv23_client_method());
-      if(ssl_ctx==NULL)return OP_EFAULT;
-      if(!_skip_certificate_check){
-        /*We don't do anything if this fails, since it just means we won't load
-           any certificates (and thus all checks will fail).
-          However, as that is probably the result of a system
-           mis-configuration, assert here to make it easier to identify.*/
-        OP_ALWAYS_TRUE(SSL_CTX_set_default_verify_paths(ssl_ctx));
-        SSL_CTX_set_verify(ssl_ctx,SSL_VERIFY_PEER,NULL);
+      /*Streams that check certificates can share the configuration (and the
+         certificates it loaded) through the shared context.
+        Loading the system certificate store is not cheap.*/
+      ssl_ctx=NULL;
+      if(_stream->ctx!=NULL&&!_skip_certificate_check){
+        ssl_ctx=op_http_context_share_ssl_ctx(_stream->ctx,NULL);
+        _stream->ssl_ctx_shared=ssl_ctx!=NULL;
+      }
+      if(ssl_ctx==NULL){
+        ssl_ctx=SSL_CTX_new(SSLv23_client_method());
+        if(ssl_ctx==NULL)return OP_EFAULT;
+        if(!_skip_certificate_check){
+          /*We don't do anything if this fails, since it just means we won't
+             load any certificates (and thus all checks will fail).
+            However, as that is probably the result of a system
+             mis-configuration, assert here to make it easier to identify.*/
+          OP_ALWAYS_TRUE(SSL_CTX_set_default_verify_paths(ssl_ctx));
+          SSL_CTX_set_verify(ssl_ctx,SSL_VERIFY_PEER,NULL);
+          if(_stream->ctx!=NULL){
+            ssl_ctx=op_http_context_share_ssl_ctx(_stream->ctx,ssl_ctx);
+            _stream->ssl_ctx_shared=1;
+          }
+        }
       }
       _stream->ssl_ctx=ssl_ctx;
       _stream->skip_certificate_check=_skip_certificate_check;
@@ -2419,9 +3509,8 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
         if(OP_UNLIKELY(ret<0))return ret;
       }
     }
-    /*Actually make the connection.*/
-    ret=op_http_connect(_stream,_stream->conns+0,addrs,&start_time);
-    if(OP_UNLIKELY(ret<0))return ret;
+    /*Use whatever the shared context knows about the host.*/
+    addrs=op_http_context_load(_stream,addrs,&pipeline_known);
     /*Build the request to send.*/
     _stream->request.nbuf=0;
     ret=op_sb_append(&_stream->request,"GET ",4);
@@ -2468,6 +3557,18 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
        way to know.*/
     /*TODO: Should we update this on redirects?*/
     ret|=op_sb_append(&_stream->request,"Referer: /\r\n",12);
+    /*If we have a copy of this resource on disk, ask the server to send the
+       range only if the resource hasn't changed (RFC 7233, Section 3.2).
+      Later requests won't need this, so remember where it is so we can take
+       it back out.*/
+    if_range_pos=_stream->request.nbuf;
+    if(_stream->disk_cache_if_range!=NULL){
+      ret|=op_sb_append(&_stream->request,"If-Range: ",10);
+      ret|=op_sb_append_string(&_stream->request,
+       _stream->disk_cache_if_range);
+      ret|=op_sb_append(&_stream->request,"\r\n",2);
+    }
+    if_range_end=_stream->request.nbuf;
     /*Always send a Range request header to find out if we're seekable.
       This requires an HTTP/1.1 server to succeed, but we'll still get what we
        want with an HTTP/1.0 server that ignores this request header.*/
@@ -2476,11 +3577,34 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
     _stream->request_tail=_stream->request.nbuf-4;
     ret|=op_sb_append(&_stream->request,"\r\n",2);
     if(OP_UNLIKELY(ret<0))return ret;
-    ret=op_http_conn_write_fully(_stream->conns+0,
-     _stream->request.buf,_stream->request.nbuf);
-    if(OP_UNLIKELY(ret<0))return ret;
-    ret=op_http_conn_read_response(_stream->conns+0,&_stream->response);
-    if(OP_UNLIKELY(ret<0))return ret;
+    /*If we know the server supports persistent connections, ask for one right
+       away, so this connection can be re-used by later streams.*/
+    if(pipeline_known)_stream->request.buf[minor_version_pos]='1';
+    for(;;){
+      int reused;
+      /*Actually make the connection.*/
+      reused=op_http_conn_reuse(_stream,_stream->conns+0,&start_time)>=0;
+      if(!reused){
+        ret=op_http_connect(_stream,_stream->conns+0,addrs,&start_time);
+        if(OP_UNLIKELY(ret<0))return ret;
+      }
+      /*Idle connections only come from servers that support persistent
+         connections.*/
+      else _stream->request.buf[minor_version_pos]='1';
+      ret=op_http_conn_write_fully(_stream->conns+0,
+       _stream->request.buf,_stream->request.nbuf);
+      if(OP_LIKELY(ret>=0)){
+        _stream->nrequests++;
+        _stream->response.nbuf=0;
+        ret=op_http_conn_read_response(_stream->conns+0,
+         &_stream->response,1);
+      }
+      if(OP_LIKELY(ret>=0))break;
+      if(!reused)return ret;
+      /*The server closed the idle connection before we got to use it.
+        Try again.*/
+      op_http_conn_close(_stream,_stream->conns+0,&_stream->lru_head,0);
+    }
     op_time_get(&end_time);
     next=op_http_parse_status_line(&v1_1_compat,&status_code,
      _stream->response.buf);
@@ -2490,10 +3614,14 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
       opus_int64 range_length;
       int        pipeline_supported;
       int        pipeline_disabled;
+      int        chunked;
+      int        accept_ranges;
       /*We only understand 20x codes.*/
       if(status_code[1]!='0')return OP_FALSE;
       content_length=-1;
       range_length=-1;
+      chunked=0;
+      accept_ranges=0;
       /*Pipelining must be explicitly enabled.*/
       pipeline_supported=0;
       pipeline_disabled=0;
@@ -2508,10 +3636,12 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
           if(OP_UNLIKELY(content_length>=0))return OP_FALSE;
           content_length=op_http_parse_content_length(cdr);
           if(OP_UNLIKELY(content_length<0))return (int)content_length;
-          /*Make sure the Content-Length and Content-Range headers match.*/
-          if(range_length>=0&&OP_UNLIKELY(content_length!=range_length)){
-            return OP_FALSE;
-          }
+        }
+        else if(strcmp(header,"transfer-encoding")==0){
+          /*Live streams are often sent with the chunked transfer-coding.*/
+          ret=op_http_parse_transfer_encoding(cdr);
+          if(OP_UNLIKELY(ret<0))return ret;
+          chunked|=ret;
         }
         else if(strcmp(header,"content-range")==0){
           opus_int64 range_first;
@@ -2537,10 +3667,11 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
           }
           /*If there was no length, use the end of the range.*/
           else if(range_last>=0)range_length=range_last+1;
-          /*Make sure the Content-Length and Content-Range headers match.*/
-          if(content_length>=0&&OP_UNLIKELY(content_length!=range_length)){
-            return OP_FALSE;
-          }
+        }
+        else if(strcmp(header,"accept-ranges")==0){
+          ret=op_http_parse_accept_ranges(cdr);
+          if(OP_UNLIKELY(ret<0))return ret;
+          accept_ranges|=ret;
         }
         else if(strcmp(header,"connection")==0){
           /*According to RFC 2616, if an HTTP/1.1 application does not support
@@ -2556,6 +3687,19 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
           if(OP_UNLIKELY(ret<0))return ret;
           pipeline_disabled|=ret;
         }
+        /*Remember the validators for the disk cache.
+          A weak entity tag can't be used to combine ranges from different
+           responses, so we ignore those.*/
+        else if(strcmp(header,"etag")==0){
+          if(_stream->etag==NULL&&strncmp(cdr,"W/",2)!=0){
+            _stream->etag=op_string_dup(cdr);
+          }
+        }
+        else if(strcmp(header,"last-modified")==0){
+          if(_stream->last_modified==NULL){
+            _stream->last_modified=op_string_dup(cdr);
+          }
+        }
         else if(strcmp(header,"server")==0){
           /*If we got a Server response header, and it wasn't from a known-bad
              server, enable pipelining, as long as it's at least HTTP/1.1.
@@ -2611,6 +3755,33 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
           }
         }
       }
+      /*A chunked response body has no Content-Length, and any such header must
+         be ignored (RFC 7230, Section 3.3.3).*/
+      if(chunked)content_length=-1;
+      /*Make sure the Content-Length and Content-Range headers match.*/
+      else if(content_length>=0&&range_length>=0
+       &&OP_UNLIKELY(content_length!=range_length)){
+        return OP_FALSE;
+      }
+      /*If we sent an If-Range header and got the whole resource back, then
+         our copy on disk is stale, or the server doesn't support range
+         requests at all.
+        Either way we forget our copy.
+        If the server told us it accepts byte ranges, this response is as good
+         as the 206 we asked for.
+        Otherwise, ask again without the If-Range header to find out which.*/
+      if(_stream->disk_cache_if_range!=NULL&&status_code[2]=='0'){
+        _ogg_free(_stream->disk_cache_if_range);
+        _stream->disk_cache_if_range=NULL;
+        if(accept_ranges&&content_length>=0)_stream->seekable=1;
+        else{
+          op_http_conn_close(_stream,_stream->conns+0,&_stream->lru_head,1);
+          addrs=&_stream->addr_info;
+          /*This doesn't count against the redirect limit.*/
+          nredirs--;
+          continue;
+        }
+      }
       switch(status_code[2]){
         /*200 OK*/
         case '0':break;
@@ -2649,10 +3820,20 @@ static int op_http_stream_open(OpusHTTPStream *_stream,const char *_url,
       _stream->conns[0].pos=0;
       _stream->conns[0].end_pos=_stream->seekable?content_length:-1;
       _stream->conns[0].chunk_size=-1;
+      _stream->conns[0].chunk_state=chunked?OP_CHUNK_DATA:OP_CHUNK_NONE;
+      _stream->conns[0].chunk_left=0;
       _stream->cur_conni=0;
       _stream->connect_rate=op_time_diff_ms(&end_time,&start_time);
       _stream->connect_rate=OP_MAX(_stream->connect_rate,1);
       if(_info!=NULL)_info->is_ssl=OP_URL_IS_SSL(&_stream->url);
+      if(if_range_end>if_range_pos){
+        memmove(_stream->request.buf+if_range_pos,
+         _stream->request.buf+if_range_end,
+         _stream->request.nbuf-if_range_end+1);
+        _stream->request.nbuf-=if_range_end-if_range_pos;
+        _stream->request_tail-=if_range_end-if_range_pos;
+      }
+      op_http_context_save(_stream);
       /*The URL has been successfully opened.*/
       return 0;
     }
@@ -2732,6 +3913,7 @@ static int op_http_conn_send_request(OpusHTTPStream *_stream,
  OpusHTTPConn *_conn,opus_int64 _pos,opus_int32 _chunk_size,
  int _try_not_to_block){
   opus_int64 next_end;
+  opus_int64 next_chunk_size;
   int        ret;
   /*We shouldn't have another request outstanding.*/
   OP_ASSERT(_conn->next_pos<0);
@@ -2745,10 +3927,22 @@ static int op_http_conn_send_request(OpusHTTPStream *_stream,
     OP_ASSERT(_stream->pipeline);
     next_end=_pos+_chunk_size;
     ret|=op_sb_append_nonnegative_int64(&_stream->request,next_end-1);
-    /*Use a larger chunk size for our next request.*/
-    _chunk_size<<=1;
+    /*Use a larger chunk size for our next request.
+      On links where a request takes a long time to answer relative to how
+       quickly the data arrives, grow it faster, to reach a size that keeps us
+       from waiting on the next one sooner.
+      We don't do this until we've read past the first chunk after a seek,
+       and still don't grow it too quickly, since we may be about to seek
+       again, in which case the rest of the chunk is wasted.*/
+    next_chunk_size=(opus_int64)_chunk_size<<1;
+    if(_chunk_size>OP_PIPELINE_CHUNK_SIZE){
+      next_chunk_size=OP_MAX(next_chunk_size,OP_MIN(
+       (opus_int64)_chunk_size<<OP_PIPELINE_CHUNK_GROWTH_MAX,
+       op_http_conn_bdp(_stream,_conn,_stream->chunk_bdp_pct)));
+    }
     /*But after a while, just request the rest of the resource.*/
-    if(_chunk_size>OP_PIPELINE_CHUNK_SIZE_MAX)_chunk_size=-1;
+    _chunk_size=next_chunk_size>OP_PIPELINE_CHUNK_SIZE_MAX?
+     -1:(opus_int32)next_chunk_size;
   }
   else{
     /*Either this was a non-pipelined request or we were close enough to the
@@ -2775,6 +3969,7 @@ static int op_http_conn_send_request(OpusHTTPStream *_stream,
   ret=op_http_conn_write_fully(_conn,
    _stream->request.buf,_stream->request.nbuf);
   if(OP_UNLIKELY(ret<0))return ret;
+  _stream->nrequests++;
   _conn->next_pos=_pos;
   _conn->next_end=next_end;
   /*Save the chunk size to use for the next request.*/
@@ -2784,17 +3979,33 @@ static int op_http_conn_send_request(OpusHTTPStream *_stream,
 }
 
 /*Handles the response to all requests after the first one.
-  Return: 1 if the connection was closed or timed out, 0 on success, or a
+  _blocking: Whether or not to block until the whole response header has
+              arrived.
+             If not, the part that has arrived is kept, and the next call
+              continues reading it.
+  Return: 1 if the connection was closed or timed out, 0 on success, OP_EAGAIN
+           if _blocking was 0 and the header has not all arrived yet, or a
            negative value on any other error.*/
 static int op_http_conn_handle_response(OpusHTTPStream *_stream,
- OpusHTTPConn *_conn){
+ OpusHTTPConn *_conn,int _blocking){
   char       *next;
   char       *status_code;
   opus_int64  range_length;
+  opus_int64  content_length;
   opus_int64  next_pos;
   opus_int64  next_end;
+  int         chunked;
   int         ret;
-  ret=op_http_conn_read_response(_conn,&_stream->response);
+  if(!_conn->reading_response){
+    /*Skip past the end of the previous response body, if it was chunked.*/
+    ret=op_http_conn_finish_body(_conn,&_stream->response);
+    if(OP_UNLIKELY(ret<0))return ret==OP_EREAD?1:ret;
+    _stream->response.nbuf=0;
+    _conn->reading_response=1;
+  }
+  ret=op_http_conn_read_response(_conn,&_stream->response,_blocking);
+  if(ret==OP_EAGAIN)return ret;
+  _conn->reading_response=0;
   /*If the server just closed the connection on us, we may have just hit a
      connection re-use limit, so we might want to retry.*/
   if(OP_UNLIKELY(ret<0))return ret==OP_EREAD?1:ret;
@@ -2809,6 +4020,8 @@ static int op_http_conn_handle_response(OpusHTTPStream *_stream,
   next_pos=_conn->next_pos;
   next_end=_conn->next_end;
   range_length=-1;
+  content_length=-1;
+  chunked=0;
   for(;;){
     char *header;
     char *cdr;
@@ -2852,20 +4065,15 @@ static int op_http_conn_handle_response(OpusHTTPStream *_stream,
       }
     }
     else if(strcmp(header,"content-length")==0){
-      opus_int64 content_length;
-      /*Validate the Content-Length header, if present, against the request we
-         made.*/
+      /*Two Content-Length headers?*/
+      if(OP_UNLIKELY(content_length>=0))return OP_FALSE;
       content_length=op_http_parse_content_length(cdr);
       if(OP_UNLIKELY(content_length<0))return (int)content_length;
-      if(next_end<0){
-        /*If we haven't seen the Content-Range header yet and we asked for the
-            rest of the resource, set next_end, so we can make sure they match
-            when we do find the Content-Range header.*/
-        if(OP_UNLIKELY(next_pos>OP_INT64_MAX-content_length))return OP_FALSE;
-        next_end=next_pos+content_length;
-      }
-      /*Otherwise, make sure they match now.*/
-      else if(OP_UNLIKELY(next_end-next_pos!=content_length))return OP_FALSE;
+    }
+    else if(strcmp(header,"transfer-encoding")==0){
+      ret=op_http_parse_transfer_encoding(cdr);
+      if(OP_UNLIKELY(ret<0))return ret;
+      chunked|=ret;
     }
     else if(strcmp(header,"connection")==0){
       ret=op_http_parse_connection(cdr);
@@ -2877,11 +4085,21 @@ static int op_http_conn_handle_response(OpusHTTPStream *_stream,
   }
   /*No Content-Range header.*/
   if(OP_UNLIKELY(range_length<0))return OP_FALSE;
+  /*Validate the Content-Length header, if present, against the request we
+     made.
+    A chunked response body has no Content-Length, and any such header must be
+     ignored (RFC 7230, Section 3.3.3).*/
+  if(!chunked&&content_length>=0
+   &&OP_UNLIKELY(next_end-next_pos!=content_length)){
+    return OP_FALSE;
+  }
   /*Update the content_length if necessary.*/
   _stream->content_length=range_length;
   _conn->pos=next_pos;
   _conn->end_pos=next_end;
   _conn->next_pos=-1;
+  _conn->chunk_state=chunked?OP_CHUNK_DATA:OP_CHUNK_NONE;
+  _conn->chunk_left=0;
   return 0;
 }
 
@@ -2902,11 +4120,11 @@ static int op_http_conn_open_pos(OpusHTTPStream *_stream,
   if(OP_UNLIKELY(ret<0))return ret;
   ret=op_http_conn_send_request(_stream,_conn,_pos,_chunk_size,0);
   if(OP_UNLIKELY(ret<0))return ret;
-  ret=op_http_conn_handle_response(_stream,_conn);
+  ret=op_http_conn_handle_response(_stream,_conn,1);
   if(OP_UNLIKELY(ret!=0))return OP_FALSE;
   op_time_get(&end_time);
   _stream->cur_conni=(int)(_conn-_stream->conns);
-  OP_ASSERT(_stream->cur_conni>=0&&_stream->cur_conni<OP_NCONNS_MAX);
+  OP_ASSERT(_stream->cur_conni>=0&&_stream->cur_conni<_stream->nconns);
   /*The connection has been successfully opened.
     Update the connection time estimate.*/
   connect_time=op_time_diff_ms(&end_time,&start_time);
@@ -2916,6 +4134,140 @@ static int op_http_conn_open_pos(OpusHTTPStream *_stream,
   return 0;
 }
 
+/*Continue opening a connection started by op_http_conn_start_open().
+  _blocking: Whether or not to block until the connection is ready.
+  Return: 0 on success, OP_EAGAIN if _blocking was 0 and we have to wait for
+           the server, or a negative value on error.*/
+static int op_http_conn_open_step(OpusHTTPStream *_stream,
+ OpusHTTPConn *_conn,int _blocking){
+  op_time    end_time;
+  opus_int32 connect_rate;
+  opus_int32 connect_time;
+  int        ret;
+  /*The connection is always the LRU head while we open it.*/
+  OP_ASSERT(_stream->lru_head==_conn);
+  if(_conn->state==OP_CONN_CONNECTING){
+    struct pollfd fd;
+    socklen_t     errlen;
+    int           err;
+    fd.fd=_conn->fd;
+    fd.events=POLLOUT;
+    ret=poll(&fd,1,_blocking?OP_POLL_TIMEOUT_MS:0);
+    if(ret==0&&!_blocking)return OP_EAGAIN;
+    err=-1;
+    if(ret>0){
+      errlen=sizeof(err);
+      /*Some platforms will return the pending error in &err and return 0.
+        Others will put it in errno and return -1.*/
+      if(getsockopt(fd.fd,SOL_SOCKET,SO_ERROR,&err,&errlen)<0)err=op_errno();
+    }
+    if(err!=0&&err!=EISCONN){
+      opus_int64 pos;
+      opus_int32 chunk_size;
+      /*The address that worked last time didn't.
+        Fall back to resolving the host again and trying every address, which
+         blocks.*/
+      pos=_conn->open_pos;
+      chunk_size=_conn->open_chunk_size;
+      op_http_conn_close(_stream,_conn,&_stream->lru_head,0);
+      return op_http_conn_open_pos(_stream,_conn,pos,chunk_size);
+    }
+    if(OP_URL_IS_SSL(&_stream->url)){
+      SSL *ssl_conn;
+      OP_ASSERT(_stream->ssl_ctx!=NULL);
+      ssl_conn=SSL_new(_stream->ssl_ctx);
+      if(OP_UNLIKELY(ssl_conn==NULL))return OP_EFAULT;
+      ret=op_http_conn_start_tls(_stream,_conn,_conn->fd,ssl_conn,0);
+      if(OP_UNLIKELY(ret<0)&&ret!=OP_EAGAIN){
+        SSL_free(ssl_conn);
+        return ret;
+      }
+      _conn->state=OP_CONN_HANDSHAKE;
+    }
+    else{
+      op_sock_set_tcp_nodelay(_conn->fd,1);
+      _conn->state=OP_CONN_HANDSHAKE;
+    }
+  }
+  if(_conn->state==OP_CONN_HANDSHAKE){
+    if(_conn->ssl_conn!=NULL){
+      ret=op_http_conn_finish_tls(_stream,_conn->fd,_conn->ssl_conn,_blocking);
+      if(ret<0)return ret;
+    }
+    /*A new connection has plenty of room in its send buffer for one
+       request, so this won't block.*/
+    ret=op_http_conn_send_request(_stream,_conn,
+     _conn->open_pos,_conn->open_chunk_size,0);
+    if(OP_UNLIKELY(ret<0))return ret;
+    _conn->state=OP_CONN_REQUESTED;
+  }
+  OP_ASSERT(_conn->state==OP_CONN_REQUESTED);
+  ret=op_http_conn_handle_response(_stream,_conn,_blocking);
+  if(ret==OP_EAGAIN)return ret;
+  if(OP_UNLIKELY(ret!=0))return OP_FALSE;
+  _conn->state=OP_CONN_OPEN;
+  op_time_get(&end_time);
+  _stream->cur_conni=(int)(_conn-_stream->conns);
+  OP_ASSERT(_stream->cur_conni>=0&&_stream->cur_conni<_stream->nconns);
+  connect_time=op_time_diff_ms(&end_time,&_conn->open_time);
+  connect_rate=_stream->connect_rate;
+  connect_rate+=OP_MAX(connect_time,1)-connect_rate+8>>4;
+  _stream->connect_rate=connect_rate;
+  return 0;
+}
+
+/*Open a new connection that will start reading at byte offset _pos, like
+   op_http_conn_open_pos(), but without waiting for the server.
+  Only resolving the host name and setting up a tunnel through a proxy can't
+   be done without blocking, so if we'd need to do either one (or the
+   address we connected to last time fails), this blocks in
+   op_http_conn_open_pos() instead.
+  _pos:        The byte offset to start reading from.
+  _chunk_size: The number of bytes to ask for in the initial request, or -1 to
+                request the rest of the resource.
+  Return: 0 on success, OP_EAGAIN if we have to wait for the server (call
+           op_http_conn_open_step() to continue), or a negative value on
+           error.*/
+static int op_http_conn_start_open(OpusHTTPStream *_stream,
+ OpusHTTPConn *_conn,opus_int64 _pos,opus_int32 _chunk_size){
+  struct addrinfo *addr;
+  op_time          start_time;
+  op_sock          fd;
+  int              err;
+  addr=&_stream->addr_info;
+  op_time_get(&start_time);
+  if(_stream->proxy_connect.nbuf>0||op_time_diff_ms(&start_time,
+   &_stream->resolve_time)>=OP_RESOLVE_CACHE_TIMEOUT_MS){
+    return op_http_conn_open_pos(_stream,_conn,_pos,_chunk_size);
+  }
+  fd=socket(addr->ai_family,SOCK_STREAM,addr->ai_protocol);
+  if(OP_UNLIKELY(fd==OP_INVALID_SOCKET)){
+    return op_http_conn_open_pos(_stream,_conn,_pos,_chunk_size);
+  }
+  if(OP_UNLIKELY(op_sock_set_nonblocking(fd,1)<0)
+   ||connect(fd,addr->ai_addr,addr->ai_addrlen)<0
+   &&(err=op_errno(),err!=EINPROGRESS&&err!=EWOULDBLOCK)){
+    close(fd);
+    return op_http_conn_open_pos(_stream,_conn,_pos,_chunk_size);
+  }
+  /*Pop the connection off the free list and put it on the LRU list.*/
+  OP_ASSERT(_stream->free_head==_conn);
+  _stream->free_head=_conn->next;
+  _conn->next=_stream->lru_head;
+  _stream->lru_head=_conn;
+  _conn->read_time=start_time;
+  _conn->read_bytes=0;
+  _conn->read_rate=0;
+  _conn->ssl_conn=NULL;
+  _conn->fd=fd;
+  _conn->nrequests_left=OP_PIPELINE_MAX_REQUESTS;
+  _conn->open_time=start_time;
+  _conn->open_pos=_pos;
+  _conn->open_chunk_size=_chunk_size;
+  _conn->state=OP_CONN_CONNECTING;
+  return op_http_conn_open_step(_stream,_conn,0);
+}
+
 /*Read data from the current response body.
   If we're pipelining and we get close to the end of this response, queue
    another request.
@@ -2924,8 +4276,9 @@ static int op_http_conn_open_pos(OpusHTTPStream *_stream,
   [out] _buf: Returns the data read.
   _buf_size:  The size of the buffer.
   Return: A positive number of bytes read on success.
-          0:        The connection was closed.
-          OP_EREAD: There was a fatal read error.*/
+          0:         The connection was closed.
+          OP_EAGAIN: _stream->eagain_ok was set, and no data was available.
+          OP_EREAD:  There was a fatal read error.*/
 static int op_http_conn_read_body(OpusHTTPStream *_stream,
  OpusHTTPConn *_conn,unsigned char *_buf,int _buf_size){
   opus_int64 pos;
@@ -2934,6 +4287,7 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
   opus_int64 content_length;
   int        nread;
   int        pipeline;
+  int        nonblocking;
   int        ret;
   /*Currently this function can only be called on the LRU head.
     Otherwise, we'd need a _pnext pointer if we needed to close the connection,
@@ -2946,6 +4300,19 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
   next_pos=_conn->next_pos;
   pipeline=_stream->pipeline;
   content_length=_stream->content_length;
+  nonblocking=_stream->eagain_ok;
+  if(_conn->state!=OP_CONN_OPEN){
+    /*Finish opening the connection we started on last time.
+      A partially read pipelined response gets finished below, since the
+       connection's position has not moved yet.*/
+    ret=op_http_conn_open_step(_stream,_conn,!nonblocking);
+    if(ret==OP_EAGAIN)return ret;
+    if(OP_UNLIKELY(ret!=0))return OP_EREAD;
+    pos=_conn->pos;
+    end_pos=_conn->end_pos;
+    next_pos=_conn->next_pos;
+    content_length=_stream->content_length;
+  }
   if(end_pos>=0){
     /*Have we reached the end of the current response body?*/
     if(pos>=end_pos){
@@ -2971,7 +4338,10 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
           op_http_conn_close(_stream,_conn,&_stream->lru_head,1);
           /*If we're not pipelining, we should be requesting the rest.*/
           OP_ASSERT(pipeline||_conn->chunk_size==-1);
-          ret=op_http_conn_open_pos(_stream,_conn,end_pos,_conn->chunk_size);
+          ret=nonblocking?
+           op_http_conn_start_open(_stream,_conn,end_pos,_conn->chunk_size):
+           op_http_conn_open_pos(_stream,_conn,end_pos,_conn->chunk_size);
+          if(ret==OP_EAGAIN)return ret;
           if(OP_UNLIKELY(ret<0))return OP_EREAD;
         }
         else{
@@ -2986,7 +4356,8 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
         /*We shouldn't be trying to read past the current request body if we're
            seeking somewhere else.*/
         OP_ASSERT(next_pos==end_pos);
-        ret=op_http_conn_handle_response(_stream,_conn);
+        ret=op_http_conn_handle_response(_stream,_conn,!nonblocking);
+        if(ret==OP_EAGAIN)return ret;
         if(OP_UNLIKELY(ret<0))return OP_EREAD;
         if(OP_UNLIKELY(ret>0)&&pipeline){
           opus_int64 next_end;
@@ -2998,8 +4369,11 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
              (next_pos,next_end) into valid (_pos,_chunk_size) parameters.*/
           OP_ASSERT(next_end<0
            ||next_end-next_pos>=0&&next_end-next_pos<=OP_INT32_MAX);
-          ret=op_http_conn_open_pos(_stream,_conn,next_pos,
+          ret=nonblocking?op_http_conn_start_open(_stream,_conn,next_pos,
+           next_end<0?-1:(opus_int32)(next_end-next_pos)):
+           op_http_conn_open_pos(_stream,_conn,next_pos,
            next_end<0?-1:(opus_int32)(next_end-next_pos));
+          if(ret==OP_EAGAIN)return ret;
           if(OP_UNLIKELY(ret<0))return OP_EREAD;
         }
         else if(OP_UNLIKELY(ret!=0))return OP_EREAD;
@@ -3011,7 +4385,8 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
     OP_ASSERT(end_pos>pos);
     _buf_size=(int)OP_MIN(_buf_size,end_pos-pos);
   }
-  nread=op_http_conn_read(_conn,(char *)_buf,_buf_size,1);
+  nread=op_http_conn_read_data(_conn,&_stream->response,
+   (char *)_buf,_buf_size,!nonblocking);
   if(OP_UNLIKELY(nread<0))return nread;
   pos+=nread;
   _conn->pos=pos;
@@ -3030,7 +4405,7 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
     opus_int32 chunk_size;
     /*Are we getting close to the end of the current response body?
       If so, we should request more data.*/
-    request_thresh=_stream->connect_rate*_conn->read_rate>>12;
+    request_thresh=op_http_conn_bdp(_stream,_conn,_stream->request_bdp_pct);
     /*But don't commit ourselves too quickly.*/
     chunk_size=_conn->chunk_size;
     if(chunk_size>=0)request_thresh=OP_MIN(chunk_size>>2,request_thresh);
@@ -3042,34 +4417,36 @@ static int op_http_conn_read_body(OpusHTTPStream *_stream,
   return nread;
 }
 
-static int op_http_stream_read(void *_stream,
+/*Read data from the current connection at its current position.
+  Return: A positive number of bytes read on success.
+          0:         We hit EOF, there was no current connection, or the
+                      connection was closed.
+          OP_EAGAIN: Non-blocking reads are enabled, and no data was available.
+                     The connection remains open.
+          OP_EREAD:  There was a fatal read error.*/
+static int op_http_stream_read_conn(OpusHTTPStream *_stream,
  unsigned char *_ptr,int _buf_size){
-  OpusHTTPStream *stream;
-  int             nread;
-  opus_int64      size;
-  opus_int64      pos;
-  int             ci;
-  stream=(OpusHTTPStream *)_stream;
-  /*Check for an empty read.*/
-  if(_buf_size<=0)return 0;
-  ci=stream->cur_conni;
+  int        nread;
+  opus_int64 size;
+  opus_int64 pos;
+  int        ci;
+  ci=_stream->cur_conni;
   /*No current connection => EOF.*/
   if(ci<0)return 0;
-  pos=stream->conns[ci].pos;
-  size=stream->content_length;
+  pos=_stream->conns[ci].pos;
+  size=_stream->content_length;
   /*Check for EOF.*/
   if(size>=0){
     if(pos>=size)return 0;
     /*Check for a short read.*/
     if(_buf_size>size-pos)_buf_size=(int)(size-pos);
   }
-  nread=op_http_conn_read_body(stream,stream->conns+ci,_ptr,_buf_size);
-  if(OP_UNLIKELY(nread<=0)){
+  nread=op_http_conn_read_body(_stream,_stream->conns+ci,_ptr,_buf_size);
+  if(OP_UNLIKELY(nread<=0)&&nread!=OP_EAGAIN){
     /*We hit an error or EOF.
       Either way, we're done with this connection.*/
-    op_http_conn_close(stream,stream->conns+ci,&stream->lru_head,1);
-    stream->cur_conni=-1;
-    stream->pos=pos;
+    op_http_conn_close(_stream,_stream->conns+ci,&_stream->lru_head,1);
+    _stream->cur_conni=-1;
   }
   return nread;
 }
@@ -3114,8 +4491,8 @@ static int op_http_conn_read_ahead(OpusHTTPStream *_stream,
     /*We already have a request outstanding.
       Finish off the current chunk.*/
     while(pos<end_pos){
-      nread=op_http_conn_read(_conn,_stream->response.buf,
-       (int)OP_MIN(end_pos-pos,_stream->response.cbuf),1);
+      nread=op_http_conn_read_data(_conn,&_stream->response,
+       _stream->response.buf,(int)OP_MIN(end_pos-pos,_stream->response.cbuf),1);
       /*We failed to read ahead.*/
       if(nread<=0)return OP_FALSE;
       pos+=nread;
@@ -3133,21 +4510,21 @@ static int op_http_conn_read_ahead(OpusHTTPStream *_stream,
       _conn->next_end=next_end;
       end_pos=next_end;
     }
-    ret=op_http_conn_handle_response(_stream,_conn);
+    ret=op_http_conn_handle_response(_stream,_conn,1);
     if(OP_UNLIKELY(ret!=0))return OP_FALSE;
     _conn->next_pos=next_next_pos;
     _conn->next_end=next_next_end;
   }
   while(pos<end_pos){
-    nread=op_http_conn_read(_conn,_stream->response.buf,
-     (int)OP_MIN(end_pos-pos,_stream->response.cbuf),1);
+    nread=op_http_conn_read_data(_conn,&_stream->response,
+     _stream->response.buf,(int)OP_MIN(end_pos-pos,_stream->response.cbuf),1);
     /*We failed to read ahead.*/
     if(nread<=0)return OP_FALSE;
     pos+=nread;
   }
   OP_ASSERT(pos==end_pos);
   if(!_just_read_ahead){
-    ret=op_http_conn_handle_response(_stream,_conn);
+    ret=op_http_conn_handle_response(_stream,_conn,1);
     if(OP_UNLIKELY(ret!=0))return OP_FALSE;
   }
   else _conn->pos=end_pos;
@@ -3155,72 +4532,49 @@ static int op_http_conn_read_ahead(OpusHTTPStream *_stream,
   return 0;
 }
 
-static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
+/*Make the current connection read from the given position.*/
+static int op_http_stream_seek_pos(OpusHTTPStream *_stream,opus_int64 _pos){
   op_time          seek_time;
-  OpusHTTPStream  *stream;
   OpusHTTPConn    *conn;
   OpusHTTPConn   **pnext;
   OpusHTTPConn    *close_conn;
   OpusHTTPConn   **close_pnext;
   opus_int64       content_length;
-  opus_int64       pos;
   int              pipeline;
   int              ci;
   int              ret;
-  stream=(OpusHTTPStream *)_stream;
-  if(!stream->seekable)return -1;
-  content_length=stream->content_length;
-  /*If we're seekable, we should have gotten a Content-Length.*/
-  OP_ASSERT(content_length>=0);
-  ci=stream->cur_conni;
-  pos=ci<0?content_length:stream->conns[ci].pos;
-  switch(_whence){
-    case SEEK_SET:{
-      /*Check for overflow:*/
-      if(_offset<0)return -1;
-      pos=_offset;
-    }break;
-    case SEEK_CUR:{
-      /*Check for overflow:*/
-      if(_offset<-pos||_offset>OP_INT64_MAX-pos)return -1;
-      pos+=_offset;
-    }break;
-    case SEEK_END:{
-      /*Check for overflow:*/
-      if(_offset<-content_length||_offset>OP_INT64_MAX-content_length){
-        return -1;
-      }
-      pos=content_length+_offset;
-    }break;
-    default:return -1;
-  }
+  content_length=_stream->content_length;
+  ci=_stream->cur_conni;
   /*Mark when we deactivated the active connection.*/
   if(ci>=0){
-    op_http_conn_read_rate_update(stream->conns+ci);
-    seek_time=stream->conns[ci].read_time;
+    op_http_conn_read_rate_update(_stream->conns+ci);
+    seek_time=_stream->conns[ci].read_time;
   }
   else op_time_get(&seek_time);
   /*If we seeked past the end of the stream, just disable the active
      connection.*/
-  if(pos>=content_length){
-    stream->cur_conni=-1;
-    stream->pos=pos;
+  if(_pos>=content_length){
+    _stream->cur_conni=-1;
+    _stream->pos=_pos;
     return 0;
   }
   /*First try to find a connection we can use without waiting.*/
-  pnext=&stream->lru_head;
-  conn=stream->lru_head;
+  pnext=&_stream->lru_head;
+  conn=_stream->lru_head;
   while(conn!=NULL){
     opus_int64 conn_pos;
     opus_int64 end_pos;
     int        available;
     /*If this connection has been dormant too long or has made too many
        requests, close it.
-      This is to prevent us from hitting server limits/firewall timeouts.*/
+      This is to prevent us from hitting server limits/firewall timeouts.
+      Also close any connection a non-blocking read left half-way through
+       opening or parsing a response, as we don't know where it will be.*/
     if(op_time_diff_ms(&seek_time,&conn->read_time)>
      OP_CONNECTION_IDLE_TIMEOUT_MS
-     ||conn->nrequests_left<OP_PIPELINE_MIN_REQUESTS){
-      op_http_conn_close(stream,conn,pnext,1);
+     ||conn->nrequests_left<OP_PIPELINE_MIN_REQUESTS
+     ||conn->state!=OP_CONN_OPEN||conn->reading_response){
+      op_http_conn_close(_stream,conn,pnext,1);
       conn=*pnext;
       continue;
     }
@@ -3238,21 +4592,21 @@ static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
       If we have an oustanding request, we'll over-estimate the amount of data
        it has available (because we'll count the response headers, too), but
        that probably doesn't matter.*/
-    if(conn_pos<=pos&&pos-conn_pos<=available&&(end_pos<0||pos<end_pos)){
+    if(conn_pos<=_pos&&_pos-conn_pos<=available&&(end_pos<0||_pos<end_pos)){
       /*Found a suitable connection to re-use.*/
-      ret=op_http_conn_read_ahead(stream,conn,1,pos);
+      ret=op_http_conn_read_ahead(_stream,conn,1,_pos);
       if(OP_UNLIKELY(ret<0)){
         /*The connection might have become stale, so close it and keep going.*/
-        op_http_conn_close(stream,conn,pnext,1);
+        op_http_conn_close(_stream,conn,pnext,1);
         conn=*pnext;
         continue;
       }
       /*Sucessfully resurrected this connection.*/
       *pnext=conn->next;
-      conn->next=stream->lru_head;
-      stream->lru_head=conn;
-      stream->cur_conni=(int)(conn-stream->conns);
-      OP_ASSERT(stream->cur_conni>=0&&stream->cur_conni<OP_NCONNS_MAX);
+      conn->next=_stream->lru_head;
+      _stream->lru_head=conn;
+      _stream->cur_conni=(int)(conn-_stream->conns);
+      OP_ASSERT(_stream->cur_conni>=0&&_stream->cur_conni<_stream->nconns);
       return 0;
     }
     pnext=&conn->next;
@@ -3262,22 +4616,17 @@ static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
      ahead a reasonable amount and/or by issuing a new request.*/
   close_pnext=NULL;
   close_conn=NULL;
-  pnext=&stream->lru_head;
-  conn=stream->lru_head;
-  pipeline=stream->pipeline;
+  pnext=&_stream->lru_head;
+  conn=_stream->lru_head;
+  pipeline=_stream->pipeline;
   while(conn!=NULL){
     opus_int64 conn_pos;
     opus_int64 end_pos;
     opus_int64 read_ahead_thresh;
     int        available;
     int        just_read_ahead;
-    /*Dividing by 2048 instead of 1000 scales this by nearly 1/2, biasing away
-       from connection re-use (and roughly compensating for the lag required to
-       reopen the TCP window of a connection that's been idle).
-      There's no overflow checking here, because it's vanishingly unlikely, and
-       all it would do is cause us to make poor decisions.*/
     read_ahead_thresh=OP_MAX(OP_READAHEAD_THRESH_MIN,
-     stream->connect_rate*conn->read_rate>>11);
+     op_http_conn_bdp(_stream,conn,_stream->readahead_bdp_pct));
     available=op_http_conn_estimate_available(conn);
     conn_pos=conn->pos;
     end_pos=conn->end_pos;
@@ -3288,24 +4637,28 @@ static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
     }
     OP_ASSERT(end_pos<0||conn_pos<=end_pos);
     /*Can we quickly read ahead without issuing a new request?*/
-    just_read_ahead=conn_pos<=pos&&pos-conn_pos-available<=read_ahead_thresh
-     &&(end_pos<0||pos<end_pos);
+    just_read_ahead=conn_pos<=_pos&&_pos-conn_pos-available<=read_ahead_thresh
+     &&(end_pos<0||_pos<end_pos);
+    /*If we have an outstanding request whose response has not started to
+       arrive yet, we would have to wait for it before we could see the
+       response to a new one, so don't issue one here.*/
     if(just_read_ahead||pipeline&&end_pos>=0
-     &&end_pos-conn_pos-available<=read_ahead_thresh){
+     &&end_pos-conn_pos-available<=read_ahead_thresh
+     &&(conn->next_pos<0||available>0)){
       /*Found a suitable connection to re-use.*/
-      ret=op_http_conn_read_ahead(stream,conn,just_read_ahead,pos);
+      ret=op_http_conn_read_ahead(_stream,conn,just_read_ahead,_pos);
       if(OP_UNLIKELY(ret<0)){
         /*The connection might have become stale, so close it and keep going.*/
-        op_http_conn_close(stream,conn,pnext,1);
+        op_http_conn_close(_stream,conn,pnext,1);
         conn=*pnext;
         continue;
       }
       /*Sucessfully resurrected this connection.*/
       *pnext=conn->next;
-      conn->next=stream->lru_head;
-      stream->lru_head=conn;
-      stream->cur_conni=(int)(conn-stream->conns);
-      OP_ASSERT(stream->cur_conni>=0&&stream->cur_conni<OP_NCONNS_MAX);
+      conn->next=_stream->lru_head;
+      _stream->lru_head=conn;
+      _stream->cur_conni=(int)(conn-_stream->conns);
+      OP_ASSERT(_stream->cur_conni>=0&&_stream->cur_conni<_stream->nconns);
       return 0;
     }
     close_pnext=pnext;
@@ -3315,16 +4668,16 @@ static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
   }
   /*No suitable connections.
     Open a new one.*/
-  if(stream->free_head==NULL){
+  if(_stream->free_head==NULL){
     /*All connections in use.
       Expire one of them (we should have already picked which one when scanning
        the list).*/
     OP_ASSERT(close_conn!=NULL);
     OP_ASSERT(close_pnext!=NULL);
-    op_http_conn_close(stream,close_conn,close_pnext,1);
+    op_http_conn_close(_stream,close_conn,close_pnext,1);
   }
-  OP_ASSERT(stream->free_head!=NULL);
-  conn=stream->free_head;
+  OP_ASSERT(_stream->free_head!=NULL);
+  conn=_stream->free_head;
   /*If we can pipeline, only request a chunk of data.
     If we're seeking now, there's a good chance we will want to seek again
      soon, and this avoids committing this connection to reading the rest of
@@ -3334,20 +4687,543 @@ static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
     This also limits the amount of data the server will blast at us on this
      connection if we later seek elsewhere and start reading from a different
      connection.*/
-  ret=op_http_conn_open_pos(stream,conn,pos,
+  ret=op_http_conn_open_pos(_stream,conn,_pos,
    pipeline?OP_PIPELINE_CHUNK_SIZE:-1);
   if(OP_UNLIKELY(ret<0)){
-    op_http_conn_close(stream,conn,&stream->lru_head,1);
+    op_http_conn_close(_stream,conn,&_stream->lru_head,1);
     return -1;
   }
   return 0;
 }
 
+/*Find the cache block containing the given position, if there is one, and
+   make it the MRU block.*/
+static OpusHTTPCacheBlock *op_http_cache_find(OpusHTTPStream *_stream,
+ opus_int64 _pos){
+  OpusHTTPCacheBlock  *block;
+  OpusHTTPCacheBlock **pnext;
+  _pos-=_pos%OP_HTTP_CACHE_BLOCK_SIZE;
+  pnext=&_stream->cache_head;
+  for(block=*pnext;block!=NULL;block=*pnext){
+    if(block->pos==_pos){
+      *pnext=block->next;
+      block->next=_stream->cache_head;
+      _stream->cache_head=block;
+      return block;
+    }
+    pnext=&block->next;
+  }
+  return NULL;
+}
+
+/*Get an empty cache block for the block-aligned position _pos and make it the
+   MRU block, evicting the LRU block if the cache is full.*/
+static OpusHTTPCacheBlock *op_http_cache_alloc(OpusHTTPStream *_stream,
+ opus_int64 _pos){
+  OpusHTTPCacheBlock *block;
+  OP_ASSERT(_pos%OP_HTTP_CACHE_BLOCK_SIZE==0);
+  if(_stream->ncache_blocks_used<_stream->ncache_blocks){
+    unsigned char *buf;
+    buf=(unsigned char *)_ogg_malloc(sizeof(*buf)*OP_HTTP_CACHE_BLOCK_SIZE);
+    if(OP_UNLIKELY(buf==NULL))return NULL;
+    block=_stream->cache_blocks+_stream->ncache_blocks_used++;
+    block->buf=buf;
+  }
+  else{
+    OpusHTTPCacheBlock **pnext;
+    pnext=&_stream->cache_head;
+    OP_ASSERT(*pnext!=NULL);
+    while((*pnext)->next!=NULL)pnext=&(*pnext)->next;
+    block=*pnext;
+    *pnext=NULL;
+  }
+  block->pos=_pos;
+  block->nbuf=0;
+  block->next=_stream->cache_head;
+  _stream->cache_head=block;
+  return block;
+}
+
+/*Enable the data cache with room for the given number of bytes.
+  The cache only helps if we can seek, so it is not enabled otherwise.*/
+static int op_http_cache_init(OpusHTTPStream *_stream,opus_int32 _cache_size){
+  int ncache_blocks;
+  ncache_blocks=(int)(_cache_size/OP_HTTP_CACHE_BLOCK_SIZE);
+  if(ncache_blocks<=0||!_stream->seekable)return 0;
+  _stream->cache_blocks=(OpusHTTPCacheBlock *)_ogg_malloc(
+   sizeof(*_stream->cache_blocks)*ncache_blocks);
+  if(OP_UNLIKELY(_stream->cache_blocks==NULL))return OP_EFAULT;
+  _stream->ncache_blocks=ncache_blocks;
+  /*From now on, this is the position indicator.*/
+  OP_ASSERT(_stream->cur_conni>=0);
+  _stream->pos=_stream->conns[_stream->cur_conni].pos;
+  return 0;
+}
+
+/*Stop using the disk cache (after an I/O error).*/
+static void op_http_disk_cache_close(OpusHTTPStream *_stream){
+  fclose(_stream->disk_cache);
+  _stream->disk_cache=NULL;
+}
+
+/*Open the disk cache file for reading and writing, creating it if needed, and
+   lock it so that no other stream (in this process or any other) can use it
+   at the same time.
+  We do not wait for the lock: a stream that finds the file in use just goes
+   without the disk cache.
+  The file is not truncated, since that would have to happen before we had the
+   lock.
+  Return: The open file, or NULL on failure.*/
+static FILE *op_http_disk_cache_fopen(const char *_path){
+  FILE *fp;
+  int   fd;
+# if defined(_WIN32)
+  OVERLAPPED overlapped;
+  fd=_open(_path,_O_RDWR|_O_CREAT|_O_BINARY,_S_IREAD|_S_IWRITE);
+  if(fd<0)return NULL;
+  memset(&overlapped,0,sizeof(overlapped));
+  if(!LockFileEx((HANDLE)_get_osfhandle(fd),
+   LOCKFILE_EXCLUSIVE_LOCK|LOCKFILE_FAIL_IMMEDIATELY,0,MAXDWORD,MAXDWORD,
+   &overlapped)){
+    _close(fd);
+    return NULL;
+  }
+  fp=_fdopen(fd,"r+b");
+  if(fp==NULL)_close(fd);
+# else
+  /*flock() locks belong to the open file, not the process, so they also keep
+     out other streams in this process, unlike fcntl() locks.*/
+  fd=open(_path,O_RDWR|O_CREAT,0666);
+  if(fd<0)return NULL;
+  if(flock(fd,LOCK_EX|LOCK_NB)<0){
+    close(fd);
+    return NULL;
+  }
+  fp=fdopen(fd,"r+b");
+  if(fp==NULL)close(fd);
+# endif
+  return fp;
+}
+
+/*Empty a locked disk cache file so we can start over.
+  Return: 0 on success, or a negative value on error.*/
+static int op_http_disk_cache_truncate(FILE *_fp){
+  if(fflush(_fp)!=0||fseek(_fp,0,SEEK_SET)!=0)return OP_FALSE;
+# if defined(_WIN32)
+  return _chsize(_fileno(_fp),0)<0?OP_FALSE:0;
+# else
+  return ftruncate(fileno(_fp),0)<0?OP_FALSE:0;
+# endif
+}
+
+/*Start using the disk cache after the initial response.
+  The file starts with a header holding the key, the length of the resource,
+   the number of slots, and the validators the server sent with it.
+  If the file we found before the initial request has the same header, the
+   resource has not changed, and we can use the blocks stored there.
+  Otherwise, we start over.
+  The header is followed by an index with an entry for each slot, holding one
+   more than the number of the block stored there, or 0 if it is free, and
+   then the slots themselves.
+  Slots are used in order, so the file never grows much larger than the size
+   limit, no matter where in the resource the stored blocks are.
+  We only store whole blocks (or the last, partial block).
+  Any failure here just leaves the disk cache disabled.*/
+static void op_http_disk_cache_open(OpusHTTPStream *_stream,
+ opus_int32 _size){
+  OpusStringBuf  header;
+  unsigned char *index;
+  int           *slots;
+  FILE          *fp;
+  const char    *etag;
+  const char    *last_modified;
+  opus_int64     nblocks;
+  long           index_size;
+  int            nslots;
+  int            nslots_used;
+  int            si;
+  int            ret;
+  /*We need something to validate the cached data with, and the memory cache
+     to move blocks through.*/
+  if(_stream->disk_cache_path==NULL||_stream->cache_blocks==NULL)return;
+  etag=_stream->etag;
+  last_modified=_stream->last_modified;
+  if(etag==NULL&&last_modified==NULL)return;
+  if(etag==NULL)etag="";
+  if(last_modified==NULL)last_modified="";
+  nslots=(int)(_size/OP_HTTP_CACHE_BLOCK_SIZE);
+  if(nslots<=0)return;
+  nblocks=(_stream->content_length+OP_HTTP_CACHE_BLOCK_SIZE-1)
+   /OP_HTTP_CACHE_BLOCK_SIZE;
+  op_sb_init(&header);
+  ret=op_sb_append(&header,OP_HTTP_DISK_CACHE_MAGIC,8);
+  ret|=op_sb_append_le(&header,_stream->content_length,8);
+  ret|=op_sb_append_le(&header,nslots,4);
+  ret|=op_sb_append_le(&header,(opus_int64)strlen(_stream->disk_cache_key),4);
+  ret|=op_sb_append_le(&header,(opus_int64)strlen(etag),4);
+  ret|=op_sb_append_le(&header,(opus_int64)strlen(last_modified),4);
+  ret|=op_sb_append_string(&header,_stream->disk_cache_key);
+  ret|=op_sb_append_string(&header,etag);
+  ret|=op_sb_append_string(&header,last_modified);
+  /*All of our file offsets have to fit in a long, so we can use fseek(), and
+     all of the block numbers have to fit in an index entry.*/
+  if(OP_UNLIKELY(ret<0)||nblocks>=INT_MAX
+   ||nslots>(LONG_MAX-header.nbuf)/(OP_HTTP_CACHE_BLOCK_SIZE+4)){
+    op_sb_clear(&header);
+    return;
+  }
+  index_size=4*(long)nslots;
+  index=(unsigned char *)_ogg_malloc(sizeof(*index)*index_size);
+  slots=(int *)_ogg_malloc(sizeof(*slots)*(size_t)OP_MAX(nblocks,1));
+  fp=NULL;
+  if(OP_LIKELY(index!=NULL)&&OP_LIKELY(slots!=NULL)){
+    fp=op_http_disk_cache_fopen(_stream->disk_cache_path);
+  }
+  if(fp!=NULL){
+    int valid;
+    valid=0;
+    /*Only trust the file if the server confirmed our copy was still good.
+      Check the header again now that we hold the lock, since another stream
+       may have rewritten the file since we looked it up.*/
+    if(_stream->disk_cache_if_range!=NULL){
+      unsigned char *file_header;
+      /*Check the header and load the index.*/
+      file_header=(unsigned char *)_ogg_malloc(
+       sizeof(*file_header)*header.nbuf);
+      if(file_header!=NULL){
+        valid=fread(file_header,1,header.nbuf,fp)==(size_t)header.nbuf
+         &&memcmp(file_header,header.buf,header.nbuf)==0
+         &&fread(index,1,index_size,fp)==(size_t)index_size;
+        _ogg_free(file_header);
+      }
+    }
+    if(!valid){
+      /*Start a new file.*/
+      memset(index,0,sizeof(*index)*index_size);
+      if(op_http_disk_cache_truncate(fp)<0
+       ||fwrite(header.buf,1,header.nbuf,fp)!=(size_t)header.nbuf
+       ||fwrite(index,1,index_size,fp)!=(size_t)index_size||fflush(fp)!=0){
+        fclose(fp);
+        fp=NULL;
+      }
+    }
+  }
+  if(fp!=NULL){
+    opus_int64 bi;
+    for(bi=0;bi<nblocks;bi++)slots[bi]=-1;
+    nslots_used=0;
+    for(si=0;si<nslots;si++){
+      bi=op_read_le(index+4*si,4)-1;
+      /*Ignore anything that isn't a block of this resource, or is a block
+         we've already seen.*/
+      if(bi<0||bi>=nblocks||slots[bi]>=0)continue;
+      slots[bi]=si;
+      nslots_used=si+1;
+    }
+    _stream->disk_cache=fp;
+    _stream->disk_cache_slots=slots;
+    _stream->disk_cache_index_pos=header.nbuf;
+    _stream->disk_cache_data_pos=header.nbuf+index_size;
+    _stream->disk_cache_nslots=nslots;
+    _stream->disk_cache_nslots_used=nslots_used;
+  }
+  else _ogg_free(slots);
+  _ogg_free(index);
+  op_sb_clear(&header);
+}
+
+/*Fill an empty block from the disk cache, if it is stored there.*/
+static void op_http_disk_cache_load(OpusHTTPStream *_stream,
+ OpusHTTPCacheBlock *_block){
+  FILE *fp;
+  long  bi;
+  int   si;
+  int   nbuf;
+  fp=_stream->disk_cache;
+  if(fp==NULL)return;
+  OP_ASSERT(_block->nbuf==0);
+  bi=(long)(_block->pos/OP_HTTP_CACHE_BLOCK_SIZE);
+  si=_stream->disk_cache_slots[bi];
+  if(si<0)return;
+  nbuf=(int)OP_MIN(OP_HTTP_CACHE_BLOCK_SIZE,
+   _stream->content_length-_block->pos);
+  if(fseek(fp,_stream->disk_cache_data_pos+si*(long)OP_HTTP_CACHE_BLOCK_SIZE,
+   SEEK_SET)!=0||fread(_block->buf,1,nbuf,fp)!=(size_t)nbuf){
+    op_http_disk_cache_close(_stream);
+    return;
+  }
+  _block->nbuf=nbuf;
+}
+
+/*Store a block in the next free slot of the disk cache, if it is complete and
+   there is room.
+  We write the data before the index entry that says it is there, so if we are
+   interrupted, the worst that happens is we lose the block.*/
+static void op_http_disk_cache_store(OpusHTTPStream *_stream,
+ OpusHTTPCacheBlock *_block){
+  unsigned char  entry[4];
+  FILE          *fp;
+  long           bi;
+  int            si;
+  int            nbuf;
+  fp=_stream->disk_cache;
+  if(fp==NULL)return;
+  bi=(long)(_block->pos/OP_HTTP_CACHE_BLOCK_SIZE);
+  nbuf=_block->nbuf;
+  si=_stream->disk_cache_nslots_used;
+  if(_stream->disk_cache_slots[bi]>=0
+   ||nbuf!=OP_MIN(OP_HTTP_CACHE_BLOCK_SIZE,_stream->content_length-_block->pos)
+   ||si>=_stream->disk_cache_nslots){
+    return;
+  }
+  entry[0]=(unsigned char)(bi+1&0xFF);
+  entry[1]=(unsigned char)(bi+1>>8&0xFF);
+  entry[2]=(unsigned char)(bi+1>>16&0xFF);
+  entry[3]=(unsigned char)(bi+1>>24&0xFF);
+  if(fseek(fp,_stream->disk_cache_data_pos+si*(long)OP_HTTP_CACHE_BLOCK_SIZE,
+   SEEK_SET)!=0||fwrite(_block->buf,1,nbuf,fp)!=(size_t)nbuf||fflush(fp)!=0
+   ||fseek(fp,_stream->disk_cache_index_pos+4*(long)si,SEEK_SET)!=0
+   ||fwrite(entry,1,4,fp)!=4||fflush(fp)!=0){
+    op_http_disk_cache_close(_stream);
+    return;
+  }
+  _stream->disk_cache_slots[bi]=si;
+  _stream->disk_cache_nslots_used=si+1;
+}
+
+/*Ask an idle connection for the data at the given position now, so that the
+   round trip overlaps with whatever we read next from the current one.
+  We only re-use connections that are already open and whose outstanding
+   responses have already arrived in full, so that we can discard them without
+   blocking.
+  We never open a new connection here, as that would block the seek that
+   triggered the prefetch for a full round trip (or several, with TLS).
+  Connections opened by earlier seeks become available as they go idle.*/
+static int op_http_conn_prefetch(OpusHTTPStream *_stream,opus_int64 _pos){
+  op_time        now;
+  OpusHTTPConn  *conn;
+  OpusHTTPConn **pnext;
+  opus_int64     drain_pos;
+  int            ret;
+  /*Don't bother if some connection will reach this position soon anyway.*/
+  for(conn=_stream->lru_head;conn!=NULL;conn=conn->next){
+    opus_int64 end_pos;
+    end_pos=conn->next_pos>=0?conn->next_end:conn->end_pos;
+    if(conn->pos<=_pos&&_pos-conn->pos<=OP_READAHEAD_THRESH_MIN
+     &&(end_pos<0||_pos<end_pos)){
+      return 0;
+    }
+  }
+  op_time_get(&now);
+  drain_pos=-1;
+  pnext=&_stream->lru_head;
+  conn=*pnext;
+  while(conn!=NULL){
+    if(conn-_stream->conns!=_stream->cur_conni&&conn->end_pos>=0
+     &&conn->nrequests_left>OP_PIPELINE_MIN_REQUESTS
+     &&op_time_diff_ms(&now,&conn->read_time)<=OP_CONNECTION_IDLE_TIMEOUT_MS){
+      opus_int64 queued;
+      drain_pos=conn->end_pos;
+      queued=drain_pos-conn->pos;
+      if(conn->next_pos>=0){
+        /*This is most likely an earlier prefetch that we guessed wrong.
+          We ignore the size of the response headers here.*/
+        drain_pos=conn->next_end>=0?conn->next_end:_stream->content_length;
+        queued+=drain_pos-conn->next_pos;
+      }
+      if(queued<=op_http_conn_estimate_available(conn))break;
+    }
+    pnext=&conn->next;
+    conn=*pnext;
+  }
+  if(conn==NULL)return OP_FALSE;
+  if(conn->pos<drain_pos){
+    ret=op_http_conn_read_ahead(_stream,conn,1,drain_pos);
+    if(OP_UNLIKELY(ret<0)){
+      op_http_conn_close(_stream,conn,pnext,1);
+      return OP_FALSE;
+    }
+  }
+  /*Pretend the current response body ended where the new one starts, so that
+     this looks like any other pipelined request to the rest of the code.*/
+  conn->pos=conn->end_pos=_pos;
+  ret=op_http_conn_send_request(_stream,conn,_pos,OP_PIPELINE_CHUNK_SIZE,1);
+  if(OP_UNLIKELY(ret<0)){
+    op_http_conn_close(_stream,conn,pnext,1);
+    return OP_FALSE;
+  }
+  /*Sending a request keeps the connection alive, so reset the idle timer.*/
+  op_http_conn_read_rate_update(conn);
+  conn->read_time=now;
+  return 0;
+}
+
+/*The offsets of the positions to prefetch after a seek, in units of a quarter
+   of the distance from the previous one.
+  The first two are the candidates for the next step of a bisection search,
+   and the rest are the candidates for the step after that.*/
+static const signed char OP_PREFETCH_OFFSETS[6]={-2,2,-3,-1,1,3};
+
+/*Guess where the next seeks will go after one to _pos, and prefetch the data
+   there on idle connections.
+  The bisection searches used to enumerate the links when opening a stream and
+   to seek within it halve the distance between successive seeks.
+  Each one goes in whichever direction the data at the previous one says to,
+   so we fetch the candidates for both.
+  There is little time between successive steps, so fetching only the next
+   step would hide very little of the round trip.
+  We also fetch the candidates for the step after that, as long as there are
+   enough idle connections.*/
+static void op_http_stream_prefetch(OpusHTTPStream *_stream,opus_int64 _pos){
+  opus_int64 prev_pos;
+  opus_int64 dist;
+  int        oi;
+  prev_pos=_stream->prefetch_pos;
+  _stream->prefetch_pos=_pos;
+  if(!_stream->prefetch||prev_pos<0)return;
+  dist=(_pos>prev_pos?_pos-prev_pos:prev_pos-_pos)>>2;
+  for(oi=0;oi<(int)(sizeof(OP_PREFETCH_OFFSETS)/sizeof(*OP_PREFETCH_OFFSETS));
+   oi++){
+    OpusHTTPCacheBlock *block;
+    opus_int64          target;
+    /*If the candidates are within a couple of chunks of the seek before
+       them, reading ahead on that connection will reach them about as
+       quickly.*/
+    if(dist<<(oi<2)<2*OP_PIPELINE_CHUNK_SIZE)break;
+    target=_pos+OP_PREFETCH_OFFSETS[oi]*dist;
+    if(target<0||target>=_stream->content_length)continue;
+    if(_stream->cache_blocks!=NULL){
+      /*Skip blocks we already have.
+        Don't use op_http_cache_find() here, as that would make this block the
+         MRU one.*/
+      target-=target%OP_HTTP_CACHE_BLOCK_SIZE;
+      for(block=_stream->cache_head;block!=NULL;block=block->next){
+        if(block->pos==target)break;
+      }
+      if(block!=NULL&&block->nbuf>=OP_MIN(OP_HTTP_CACHE_BLOCK_SIZE,
+       _stream->content_length-target)){
+        continue;
+      }
+      if(_stream->disk_cache!=NULL
+       &&_stream->disk_cache_slots[target/OP_HTTP_CACHE_BLOCK_SIZE]>=0){
+        continue;
+      }
+    }
+    /*Stop when we run out of connections.*/
+    if(op_http_conn_prefetch(_stream,target)<0)break;
+  }
+}
+
+/*Read data through the cache.
+  On a miss, this fills the block containing the current position from the
+   point where its valid data ends, seeking the connections there if needed.*/
+static int op_http_cache_read(OpusHTTPStream *_stream,
+ unsigned char *_ptr,int _buf_size){
+  OpusHTTPCacheBlock *block;
+  opus_int64          content_length;
+  opus_int64          pos;
+  pos=_stream->pos;
+  content_length=_stream->content_length;
+  if(pos>=content_length)return 0;
+  if(_buf_size>content_length-pos)_buf_size=(int)(content_length-pos);
+  block=op_http_cache_find(_stream,pos);
+  if(block==NULL){
+    block=op_http_cache_alloc(_stream,pos-pos%OP_HTTP_CACHE_BLOCK_SIZE);
+    if(OP_UNLIKELY(block==NULL))return OP_EFAULT;
+    op_http_disk_cache_load(_stream,block);
+  }
+  while(pos-block->pos>=block->nbuf){
+    opus_int64 fill_pos;
+    int        nread;
+    int        ci;
+    fill_pos=block->pos+block->nbuf;
+    ci=_stream->cur_conni;
+    if(ci<0||_stream->conns[ci].pos!=fill_pos){
+      if(OP_UNLIKELY(op_http_stream_seek_pos(_stream,fill_pos)<0)){
+        return OP_EREAD;
+      }
+      op_http_stream_prefetch(_stream,fill_pos);
+    }
+    nread=op_http_stream_read_conn(_stream,block->buf+block->nbuf,
+     OP_HTTP_CACHE_BLOCK_SIZE-block->nbuf);
+    if(OP_UNLIKELY(nread<=0))return nread;
+    block->nbuf+=nread;
+    op_http_disk_cache_store(_stream,block);
+  }
+  _buf_size=OP_MIN(_buf_size,block->nbuf-(int)(pos-block->pos));
+  memcpy(_ptr,block->buf+(pos-block->pos),_buf_size);
+  _stream->pos=pos+_buf_size;
+  return _buf_size;
+}
+
+static int op_http_stream_read(void *_stream,
+ unsigned char *_ptr,int _buf_size){
+  OpusHTTPStream *stream;
+  int             ci;
+  stream=(OpusHTTPStream *)_stream;
+  /*Check for an empty read.*/
+  if(_buf_size<=0)return 0;
+  if(stream->cache_blocks!=NULL){
+    return op_http_cache_read(stream,_ptr,_buf_size);
+  }
+  ci=stream->cur_conni;
+  /*No current connection => EOF.*/
+  if(ci<0)return 0;
+  /*Remember where we were in case we lose the connection.*/
+  stream->pos=stream->conns[ci].pos;
+  return op_http_stream_read_conn(stream,_ptr,_buf_size);
+}
+
+static int op_http_stream_seek(void *_stream,opus_int64 _offset,int _whence){
+  OpusHTTPStream *stream;
+  opus_int64      content_length;
+  opus_int64      pos;
+  int             ci;
+  stream=(OpusHTTPStream *)_stream;
+  if(!stream->seekable)return -1;
+  content_length=stream->content_length;
+  /*If we're seekable, we should have gotten a Content-Length.*/
+  OP_ASSERT(content_length>=0);
+  ci=stream->cur_conni;
+  if(stream->cache_blocks!=NULL)pos=stream->pos;
+  else pos=ci<0?content_length:stream->conns[ci].pos;
+  switch(_whence){
+    case SEEK_SET:{
+      /*Check for overflow:*/
+      if(_offset<0)return -1;
+      pos=_offset;
+    }break;
+    case SEEK_CUR:{
+      /*Check for overflow:*/
+      if(_offset<-pos||_offset>OP_INT64_MAX-pos)return -1;
+      pos+=_offset;
+    }break;
+    case SEEK_END:{
+      /*Check for overflow:*/
+      if(_offset<-content_length||_offset>OP_INT64_MAX-content_length){
+        return -1;
+      }
+      pos=content_length+_offset;
+    }break;
+    default:return -1;
+  }
+  /*With the cache, we don't touch the connections until we read something
+     that isn't in it.*/
+  if(stream->cache_blocks!=NULL){
+    stream->pos=pos;
+    return 0;
+  }
+  if(OP_UNLIKELY(op_http_stream_seek_pos(stream,pos)<0))return -1;
+  op_http_stream_prefetch(stream,pos);
+  return 0;
+}
+
 static opus_int64 op_http_stream_tell(void *_stream){
   OpusHTTPStream *stream;
   int             ci;
   stream=(OpusHTTPStream *)_stream;
   ci=stream->cur_conni;
+  if(stream->cache_blocks!=NULL)return stream->pos;
   return ci<0?stream->pos:stream->conns[ci].pos;
 }
 
@@ -3355,6 +5231,7 @@ static int op_http_stream_close(void *_stream){
   OpusHTTPStream *stream;
   stream=(OpusHTTPStream *)_stream;
   if(OP_LIKELY(stream!=NULL)){
+    op_http_context_pool_conns(stream);
     op_http_stream_clear(stream);
     _ogg_free(stream);
   }
@@ -3369,6 +5246,43 @@ static const OpusFileCallbacks OP_HTTP_CALLBACKS={
 };
 #endif
 
+OpusHTTPContext *op_http_context_create(op_lock_func _lock,
+ op_lock_func _unlock,void *_lock_ctx){
+#if defined(OP_ENABLE_HTTP)
+  OpusHTTPContext *ctx;
+  int              i;
+  /*Both or neither.*/
+  if(OP_UNLIKELY((_lock==NULL)!=(_unlock==NULL)))return NULL;
+  ctx=(OpusHTTPContext *)_ogg_malloc(sizeof(*ctx));
+  if(OP_UNLIKELY(ctx==NULL))return NULL;
+  for(i=0;i<OP_HTTP_CONTEXT_NHOSTS;i++){
+    ctx->hosts[i].host=NULL;
+    ctx->hosts[i].ssl_session=NULL;
+  }
+  for(i=0;i<OP_HTTP_CONTEXT_NCONNS;i++)ctx->conns[i].host=NULL;
+  ctx->ssl_ctx=NULL;
+  ctx->lock=_lock;
+  ctx->unlock=_unlock;
+  ctx->lock_ctx=_lock_ctx;
+  /*This is the application's reference.*/
+  ctx->nrefs=1;
+  return ctx;
+#else
+  (void)_lock;
+  (void)_unlock;
+  (void)_lock_ctx;
+  return NULL;
+#endif
+}
+
+void op_http_context_free(OpusHTTPContext *_ctx){
+#if defined(OP_ENABLE_HTTP)
+  if(_ctx!=NULL)op_http_context_unref(_ctx);
+#else
+  (void)_ctx;
+#endif
+}
+
 void opus_server_info_init(OpusServerInfo *_info){
   _info->name=NULL;
   _info->description=NULL;
@@ -3395,7 +5309,10 @@ void opus_server_info_clear(OpusServerInfo *_info){
    it isn't public, we're free to change it in the future.*/
 static void *op_url_stream_create_impl(OpusFileCallbacks *_cb,const char *_url,
  int _skip_certificate_check,const char *_proxy_host,unsigned _proxy_port,
- const char *_proxy_user,const char *_proxy_pass,OpusServerInfo *_info){
+ const char *_proxy_user,const char *_proxy_pass,opus_int32 _cache_size,
+ const char *_disk_cache_dir,opus_int32 _disk_cache_size,int _nconns,
+ int _prefetch,const int *_bdp_pcts,OpusHTTPContext *_ctx,
+ OpusServerInfo *_info){
   const char *path;
   /*Check to see if this is a valid file: URL.*/
   path=op_parse_file_url(_url);
@@ -3415,9 +5332,35 @@ static void *op_url_stream_create_impl(OpusFileCallbacks *_cb,const char *_url,
     int             ret;
     stream=(OpusHTTPStream *)_ogg_malloc(sizeof(*stream));
     if(OP_UNLIKELY(stream==NULL))return NULL;
-    op_http_stream_init(stream);
+    /*If the application asked for more connections than we support, just use
+       as many as we can.*/
+    ret=op_http_stream_init(stream,
+     _nconns>0?OP_MIN(_nconns,OP_NCONNS_MAX):OP_NCONNS_DEFAULT);
+    if(OP_UNLIKELY(ret<0)){
+      _ogg_free(stream);
+      return NULL;
+    }
+    /*Negative values mean to use the default.*/
+    if(_bdp_pcts[0]>=0)stream->readahead_bdp_pct=_bdp_pcts[0];
+    if(_bdp_pcts[1]>=0)stream->request_bdp_pct=_bdp_pcts[1];
+    if(_bdp_pcts[2]>=0)stream->chunk_bdp_pct=_bdp_pcts[2];
+    if(_ctx!=NULL){
+      op_http_context_ref(_ctx);
+      stream->ctx=_ctx;
+    }
     ret=op_http_stream_open(stream,_url,_skip_certificate_check,
-     _proxy_host,_proxy_port,_proxy_user,_proxy_pass,_info);
+     _proxy_host,_proxy_port,_proxy_user,_proxy_pass,_disk_cache_dir,_info);
+    if(OP_LIKELY(ret>=0)){
+      if(_disk_cache_dir!=NULL){
+        _cache_size=OP_MAX(_cache_size,OP_HTTP_DISK_CACHE_MEMORY_MIN);
+      }
+      ret=op_http_cache_init(stream,_cache_size);
+    }
+    if(OP_LIKELY(ret>=0)&&_disk_cache_dir!=NULL){
+      op_http_disk_cache_open(stream,_disk_cache_size);
+    }
+    /*Prefetching relies on pipelining requests.*/
+    stream->prefetch=_prefetch&&stream->pipeline;
     if(OP_UNLIKELY(ret<0)){
       op_http_stream_clear(stream);
       _ogg_free(stream);
@@ -3432,6 +5375,13 @@ static void *op_url_stream_create_impl(OpusFileCallbacks *_cb,const char *_url,
   (void)_proxy_port;
   (void)_proxy_user;
   (void)_proxy_pass;
+  (void)_cache_size;
+  (void)_disk_cache_dir;
+  (void)_disk_cache_size;
+  (void)_nconns;
+  (void)_prefetch;
+  (void)_bdp_pcts;
+  (void)_ctx;
   (void)_info;
   return NULL;
 #endif
@@ -3453,17 +5403,32 @@ static void *op_url_stream_create_impl(OpusFileCallbacks *_cb,const char *_url,
    succeeds, or for clearing *_info if it ultimately fails.*/
 static void *op_url_stream_vcreate_impl(OpusFileCallbacks *_cb,
  const char *_url,OpusServerInfo *_info,OpusServerInfo **_pinfo,va_list _ap){
-  int             skip_certificate_check;
-  const char     *proxy_host;
-  opus_int32      proxy_port;
-  const char     *proxy_user;
-  const char     *proxy_pass;
-  OpusServerInfo *pinfo;
+  int              skip_certificate_check;
+  const char      *proxy_host;
+  opus_int32       proxy_port;
+  const char      *proxy_user;
+  const char      *proxy_pass;
+  opus_int32       cache_size;
+  const char      *disk_cache_dir;
+  opus_int32       disk_cache_size;
+  opus_int32       nconns;
+  int              prefetch;
+  int              bdp_pcts[3];
+  OpusHTTPContext *ctx;
+  OpusServerInfo  *pinfo;
   skip_certificate_check=0;
   proxy_host=NULL;
   proxy_port=8080;
   proxy_user=NULL;
   proxy_pass=NULL;
+  cache_size=0;
+  disk_cache_dir=NULL;
+  disk_cache_size=OP_HTTP_DISK_CACHE_SIZE_DEFAULT;
+  /*0 means to use the default.*/
+  nconns=0;
+  prefetch=0;
+  bdp_pcts[0]=bdp_pcts[1]=bdp_pcts[2]=-1;
+  ctx=NULL;
   pinfo=NULL;
   *_pinfo=NULL;
   for(;;){
@@ -3491,6 +5456,45 @@ static void *op_url_stream_vcreate_impl(OpusFileCallbacks *_cb,
       case OP_GET_SERVER_INFO_REQUEST:{
         pinfo=va_arg(_ap,OpusServerInfo *);
       }break;
+      case OP_HTTP_CACHE_SIZE_REQUEST:{
+        cache_size=va_arg(_ap,opus_int32);
+        if(cache_size<0)return NULL;
+      }break;
+      case OP_HTTP_DISK_CACHE_DIR_REQUEST:{
+        disk_cache_dir=va_arg(_ap,const char *);
+      }break;
+      case OP_HTTP_DISK_CACHE_SIZE_REQUEST:{
+        disk_cache_size=va_arg(_ap,opus_int32);
+        if(disk_cache_size<0)return NULL;
+      }break;
+      case OP_HTTP_CONNECTIONS_MAX_REQUEST:{
+        nconns=va_arg(_ap,opus_int32);
+        if(nconns<1)return NULL;
+      }break;
+      case OP_HTTP_PREFETCH_REQUEST:{
+        prefetch=!!va_arg(_ap,opus_int32);
+      }break;
+      case OP_HTTP_READAHEAD_BDP_PCT_REQUEST:{
+        opus_int32 pct;
+        pct=va_arg(_ap,opus_int32);
+        if(pct<0)return NULL;
+        bdp_pcts[0]=(int)OP_MIN(pct,OP_BDP_PCT_MAX);
+      }break;
+      case OP_HTTP_PIPELINE_REQUEST_BDP_PCT_REQUEST:{
+        opus_int32 pct;
+        pct=va_arg(_ap,opus_int32);
+        if(pct<0)return NULL;
+        bdp_pcts[1]=(int)OP_MIN(pct,OP_BDP_PCT_MAX);
+      }break;
+      case OP_HTTP_PIPELINE_CHUNK_BDP_PCT_REQUEST:{
+        opus_int32 pct;
+        pct=va_arg(_ap,opus_int32);
+        if(pct<0)return NULL;
+        bdp_pcts[2]=(int)OP_MIN(pct,OP_BDP_PCT_MAX);
+      }break;
+      case OP_HTTP_CONTEXT_REQUEST:{
+        ctx=va_arg(_ap,OpusHTTPContext *);
+      }break;
       /*Some unknown option.*/
       default:return NULL;
     }
@@ -3501,13 +5505,15 @@ static void *op_url_stream_vcreate_impl(OpusFileCallbacks *_cb,
     void *ret;
     opus_server_info_init(_info);
     ret=op_url_stream_create_impl(_cb,_url,skip_certificate_check,
-     proxy_host,proxy_port,proxy_user,proxy_pass,_info);
+     proxy_host,proxy_port,proxy_user,proxy_pass,cache_size,
+     disk_cache_dir,disk_cache_size,(int)nconns,prefetch,bdp_pcts,ctx,_info);
     if(ret!=NULL)*_pinfo=pinfo;
     else opus_server_info_clear(_info);
     return ret;
   }
   return op_url_stream_create_impl(_cb,_url,skip_certificate_check,
-   proxy_host,proxy_port,proxy_user,proxy_pass,NULL);
+   proxy_host,proxy_port,proxy_user,proxy_pass,cache_size,
+   disk_cache_dir,disk_cache_size,(int)nconns,prefetch,bdp_pcts,ctx,NULL);
 }
 
 void *op_url_stream_vcreate(OpusFileCallbacks *_cb,
@@ -3591,3 +5597,68 @@ OggOpusFile *op_test_url(const char *_url,int *_error,...){
   va_end(ap);
   return ret;
 }
+
+#if defined(OP_ENABLE_HTTP)
+/*Get the HTTP stream an OggOpusFile is reading from.
+  Return: The stream, or NULL if this is not an HTTP stream.*/
+static OpusHTTPStream *op_url_get_http_stream(const OggOpusFile *_of){
+  OpusFileCallbacks  cb;
+  void              *stream;
+  stream=op_get_stream(_of,&cb);
+  return cb.read==op_http_stream_read?(OpusHTTPStream *)stream:NULL;
+}
+#endif
+
+int op_url_set_nonblocking(OggOpusFile *_of,int _nonblocking){
+#if defined(OP_ENABLE_HTTP)
+  OpusHTTPStream *stream;
+  stream=op_url_get_http_stream(_of);
+  if(OP_UNLIKELY(stream==NULL))return OP_EINVAL;
+  return op_set_nonblocking_flag(_of,_nonblocking?&stream->eagain_ok:NULL);
+#else
+  (void)_of;
+  (void)_nonblocking;
+  return OP_EINVAL;
+#endif
+}
+
+int op_url_poll_fd(const OggOpusFile *_of,op_socket *_fd,int *_events){
+#if defined(OP_ENABLE_HTTP)
+  OpusHTTPStream *stream;
+  OpusHTTPConn   *conn;
+  int             ci;
+  stream=op_url_get_http_stream(_of);
+  if(OP_UNLIKELY(stream==NULL))return OP_EINVAL;
+  ci=stream->cur_conni;
+  /*No current connection => the next read either hits EOF or has to open a
+     new connection, neither of which is something to wait for.*/
+  if(ci<0)return OP_FALSE;
+  conn=stream->conns+ci;
+  /*A non-blocking connect() finishes when the socket becomes writable.
+    Yes, renegotiations can also cause SSL_read() to block for writing.*/
+  if(conn->state==OP_CONN_CONNECTING
+   ||conn->ssl_conn!=NULL&&SSL_want_write(conn->ssl_conn)){
+    *_events=OP_POLL_OUT;
+  }
+  else *_events=OP_POLL_IN;
+  *_fd=(op_socket)conn->fd;
+  return 0;
+#else
+  (void)_of;
+  (void)_fd;
+  (void)_events;
+  return OP_EINVAL;
+#endif
+}
+
+opus_int64 op_url_request_count(const OggOpusFile *_of){
+#if defined(OP_ENABLE_HTTP)
+  OpusHTTPStream *stream;
+  stream=op_url_get_http_stream(_of);
+  if(OP_UNLIKELY(stream==NULL))return OP_EINVAL;
+  return stream->nrequests;
+#else
+  (void)_of;
+  return OP_EINVAL;
+#endif
+}
@@ -31,7 +31,15 @@
 # include <stdlib.h>
 # include <opusfile.h>
 
-typedef struct OggOpusLink OggOpusLink;
+typedef struct OggOpusLink  OggOpusLink;
+typedef struct OpusSeekPoint OpusSeekPoint;
+typedef struct OpusSeekRecord OpusSeekRecord;
+typedef struct OpusLinkRange  OpusLinkRange;
+typedef struct OpusRangeScan  OpusRangeScan;
+typedef struct OpusLinkShare  OpusLinkShare;
+typedef struct OpusAheadRun   OpusAheadRun;
+typedef struct OpusDecodeSegment OpusDecodeSegment;
+typedef struct OpusParallelDecode OpusParallelDecode;
 
 # if defined(OP_FIXED_POINT)
 
@@ -122,6 +130,17 @@ void op_fatal_impl(const char *_str,const char *_file,int _line);
    link.*/
 # define  OP_INITSET   (4)
 
+/*The reference count for links shared between handles.*/
+struct OpusLinkShare{
+  /*The number of handles sharing the links.*/
+  int           refs;
+  /*The functions used to protect refs, or NULL if the handles are only used
+     from a single thread.*/
+  op_lock_func  lock;
+  op_lock_func  unlock;
+  void         *lock_ctx;
+};
+
 /*Information cached for a single link in a chained Ogg Opus file.
   We choose the first Opus stream encountered in each link to play back (and
    require at least one).*/
@@ -152,6 +171,42 @@ struct OggOpusLink{
   OpusTags     tags;
 };
 
+/*The location of a page with a valid granule position, remembered so that
+   later seeks can start with a narrower search range.*/
+struct OpusSeekPoint{
+  /*The byte offset of the start of the page.*/
+  opus_int64   offset;
+  /*The granule position of the page.*/
+  ogg_int64_t  gp;
+  /*The size of the page, including the page header.*/
+  opus_int32   size;
+  /*Whether or not the last packet on the page continues onto the next page.*/
+  int          continued;
+};
+
+/*The maximum number of runs of samples in the decode-ahead buffer.*/
+# define OP_AHEAD_NRUNS_MAX (8)
+
+/*A run of samples in the decode-ahead buffer.
+  The samples in a run are stored contiguously, and all come from the same link
+   with no holes in between.*/
+struct OpusAheadRun{
+  /*The PCM offset of the first sample, as returned by op_pcm_tell().*/
+  ogg_int64_t  pcm_offset;
+  /*The position of the first sample in the buffer, in values (not samples).*/
+  int          off;
+  /*The number of samples per channel.*/
+  int          nsamples;
+  /*The channel count of the samples.*/
+  int          nchannels;
+  /*The number of samples at 48 kHz for each sample in the run.*/
+  int          rate_div;
+  /*The link the samples came from.*/
+  int          li;
+  /*The serial number of the Opus stream in that link.*/
+  ogg_uint32_t serialno;
+};
+
 struct OggOpusFile{
   /*The callbacks used to access the stream.*/
   OpusFileCallbacks  callbacks;
@@ -165,6 +220,10 @@ struct OggOpusFile{
     If stream isn't seekable (e.g., it's a pipe), only the current link
      appears.*/
   OggOpusLink       *links;
+  /*The reference count for links shared with other handles (see
+     op_open_shared()), or NULL if they have never been shared.
+    The links cannot change while they are shared.*/
+  OpusLinkShare     *links_share;
   /*The number of serial numbers from a single link.*/
   int                nserialnos;
   /*The capacity of the list of serial numbers from a single link.*/
@@ -173,6 +232,24 @@ struct OggOpusFile{
     This is a scratch buffer used when scanning the BOS pages at the start of
      each link.*/
   ogg_uint32_t      *serialnos;
+  /*The capacity of the links array.
+    This is only kept up to date while links are still being enumerated.*/
+  int                clinks;
+  /*The seek records from an unfinished link enumeration, after a lazy open
+     (see op_test_open_lazy()), or NULL once all the links have been found.
+    The serial numbers above are those of the last link found.*/
+  OpusSeekRecord    *enum_sr;
+  /*The number of valid seek records in enum_sr.*/
+  int                enum_nsr;
+  /*The offset from which to continue searching for the start of the next
+     link.*/
+  opus_int64         enum_searched;
+  /*The error that stopped an unfinished link enumeration, or 0.*/
+  int                enum_error;
+  /*The application's functions for scanning ranges of the stream on other
+     handles.
+    This is only set while op_test_open_parallel() is enumerating links.*/
+  OpusRangeScan     *range_scan;
   /*This is the current offset of the data processed by the ogg_sync_state.
     After a seek, this should be set to the target offset so that we can track
      the byte offsets of subsequent pages.
@@ -181,8 +258,23 @@ struct OggOpusFile{
   opus_int64         offset;
   /*The total size of this stream, or -1 if it's unseekable.*/
   opus_int64         end;
+  /*The size of this stream as reported by the seek callback, including any
+     trailing data after the last page.
+    This is only valid for seekable sources.*/
+  opus_int64         stream_size;
   /*Used to locate pages in the stream.*/
   ogg_sync_state     oy;
+  /*The complete contents of the stream, if they are already resident in memory
+     (e.g., a memory-mapped file), or NULL.
+    When this is set, pages are framed directly out of this buffer instead of
+     being copied through oy, which is left empty.*/
+  const unsigned char *map_data;
+  /*The number of bytes in map_data.*/
+  opus_int64         map_size;
+  /*Scratch space for a copy of a page header from map_data.
+    The mapping is read-only, but computing the page checksum requires
+     modifying the header.*/
+  unsigned char      map_header[282];
   /*One of OP_NOTOPEN, OP_PARTOPEN, OP_OPENED, OP_STREAMSET, OP_INITSET.*/
   int                ready_state;
   /*The current link being played back.*/
@@ -196,10 +288,20 @@ struct OggOpusFile{
      when we use the current position as one of our bounds, only to later
      discover it was the correct starting point.*/
   opus_int64         prev_page_offset;
+  /*A flag owned by the stream that tells it whether or not it may currently
+     fail a read with OP_EAGAIN instead of blocking, or NULL if the stream has
+     not enabled non-blocking reads.
+    We only set the flag while fetching a page for the read functions at a
+     point where they can be restarted.*/
+  int               *eagain_ok;
   /*The number of bytes read since the last bitrate query, including framing.*/
   opus_int64         bytes_tracked;
   /*The number of samples decoded since the last bitrate query.*/
   ogg_int64_t        samples_tracked;
+  /*Cumulative I/O and decoding statistics.*/
+  OpusFileStats      stats;
+  /*Whether or not to measure decode_time_us in the statistics.*/
+  int                decode_timing;
   /*Takes physical pages and welds them into a logical stream of packets.*/
   ogg_stream_state   os;
   /*Re-timestamped packets from a single page.
@@ -225,17 +327,69 @@ struct OggOpusFile{
   int                od_channel_count;
   /*The channel mapping used to initialize the decoder.*/
   unsigned char      od_mapping[OP_NCHANNELS_MAX];
+  /*The sampling rate used to initialize the decoder.
+    The decoded buffer and the output of the read functions are at this rate,
+     but all timestamps and sample counts used for seeking and trimming remain
+     at 48 kHz.*/
+  opus_int32         od_rate;
+  /*The sampling rate to use the next time the decoder is initialized.*/
+  opus_int32         decode_rate;
   /*The buffered data for one decoded packet.*/
   op_sample         *od_buffer;
   /*The current position in the decoded buffer.*/
   int                od_buffer_pos;
   /*The number of valid samples in the decoded buffer.*/
   int                od_buffer_size;
+  /*Samples decoded ahead of the application by op_decode_ahead().
+    This is a ring buffer of runs, each of which may come from a different
+     link.*/
+  op_sample         *da_buffer;
+  /*The capacity of the decode-ahead buffer, in samples per channel at the
+     largest channel count of any link, or 0 if decoding ahead is disabled.*/
+  int                da_depth;
+  /*The capacity of the decode-ahead buffer, in values.*/
+  int                da_size;
+  /*The runs of samples in the decode-ahead buffer.*/
+  OpusAheadRun       da_runs[OP_AHEAD_NRUNS_MAX];
+  /*The index of the first run in the decode-ahead buffer.*/
+  int                da_start;
+  /*The number of runs in the decode-ahead buffer.*/
+  int                da_nruns;
+  /*The PCM offset of the next sample the application will read, if the
+     buffer is empty and da_pcm_offset_valid is set.*/
+  ogg_int64_t        da_pcm_offset;
+  int                da_pcm_offset_valid;
+  /*Whether or not op_decode_ahead() reached the end of the stream.*/
+  int                da_eof;
+  /*Whether or not op_decode_ahead() is decoding.
+    The read functions may be using the output filter state concurrently, so
+     it isn't reset when a new decoder is initialized.*/
+  int                da_filling;
+  /*The link of the last run the application read from, or -1 if none.
+    The output filter state is reset when this changes.*/
+  int                da_read_li;
+  /*The functions used to protect the decode-ahead indices (da_runs,
+     da_start, da_nruns, da_pcm_offset, da_pcm_offset_valid, and da_eof), or
+     NULL if op_decode_ahead() is only called from the same thread as the
+     read functions.*/
+  op_lock_func       da_lock;
+  op_lock_func       da_unlock;
+  void              *da_lock_ctx;
   /*The type of gain offset to apply.
     One of OP_HEADER_GAIN, OP_ALBUM_GAIN, OP_TRACK_GAIN, or OP_ABSOLUTE_GAIN.*/
   int                gain_type;
   /*The offset to apply to the gain.*/
   opus_int32         gain_offset_q8;
+  /*Pages we've seen with valid granule positions, sorted by offset.
+    The granule positions are also monotonic within each link.*/
+  OpusSeekPoint     *seek_points;
+  /*The number of seek points.*/
+  int                nseek_points;
+  /*The capacity of the list of seek points.*/
+  int                cseek_points;
+  /*The minimum spacing between seek points in the same link, in samples, or 0
+     if we're not recording them.*/
+  opus_int32         seek_point_spacing;
   /*Internal state for soft clipping and dithering float->short output.*/
 #if !defined(OP_FIXED_POINT)
 # if defined(OP_SOFT_CLIP)
@@ -256,4 +410,9 @@ struct OggOpusFile{
 
 int op_strncasecmp(const char *_a,const char *_b,int _n);
 
+/*Returns the buffer backing a stream created by op_mem_stream_create() or
+   op_mmap_open(), or NULL for any other kind of stream.*/
+const unsigned char *op_mem_stream_data(const OpusFileCallbacks *_cb,
+ void *_stream,opus_int64 *_size);
+
 #endif
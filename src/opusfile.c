@@ -25,6 +25,7 @@
 #include <limits.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "opusfile.h"
 
@@ -151,17 +152,27 @@ static int op_get_data(OggOpusFile *_of,int _nbytes){
   if(OP_UNLIKELY(buffer==NULL))return OP_EFAULT;
   nbytes=(int)(*_of->callbacks.read)(_of->stream,buffer,_nbytes);
   OP_ASSERT(nbytes<=_nbytes);
-  if(OP_LIKELY(nbytes>0))ogg_sync_wrote(&_of->oy,nbytes);
+  _of->stats.nreads++;
+  if(OP_LIKELY(nbytes>0)){
+    ogg_sync_wrote(&_of->oy,nbytes);
+    _of->stats.bytes_read+=nbytes;
+  }
   return nbytes;
 }
 
 /*Save a tiny smidge of verbosity to make the code more readable.*/
 static int op_seek_helper(OggOpusFile *_of,opus_int64 _offset){
   if(_offset==_of->offset)return 0;
-  if(_of->callbacks.seek==NULL
-   ||(*_of->callbacks.seek)(_of->stream,_offset,SEEK_SET)){
-    return OP_EREAD;
+  /*Resident data needs no I/O at all: the next page will be framed directly
+     from the new offset.*/
+  if(_of->map_data!=NULL){
+    if(OP_UNLIKELY(_offset<0))return OP_EREAD;
+    _of->offset=_offset;
+    return 0;
   }
+  if(_of->callbacks.seek==NULL)return OP_EREAD;
+  _of->stats.nseeks++;
+  if((*_of->callbacks.seek)(_of->stream,_offset,SEEK_SET))return OP_EREAD;
   _of->offset=_offset;
   ogg_sync_reset(&_of->oy);
   return 0;
@@ -175,6 +186,80 @@ static opus_int64 op_position(const OggOpusFile *_of){
   return _of->offset+_of->oy.fill-_of->oy.returned;
 }
 
+/*Frame a page directly out of the resident stream contents.
+  This is the equivalent of ogg_sync_pageseek(), but without copying any data.
+  _limit: The end of the data that may be examined.
+  Return: n>0: The page starting at the current offset is n bytes long.
+          0:   There is not a complete page before _limit.
+          n<0: The current offset is not the start of a page, and -n bytes
+                should be skipped to reach the next candidate.*/
+static opus_int64 op_map_pageseek(OggOpusFile *_of,ogg_page *_og,
+ opus_int64 _limit){
+  const unsigned char *page;
+  const unsigned char *next;
+  opus_int64           avail;
+  avail=_limit-_of->offset;
+  if(avail<27)return 0;
+  page=_of->map_data+_of->offset;
+  if(memcmp(page,"OggS",4)==0){
+    long header_len;
+    long body_len;
+    int  nsegs;
+    int  si;
+    nsegs=page[26];
+    header_len=27+nsegs;
+    if(avail<header_len)return 0;
+    body_len=0;
+    for(si=0;si<nsegs;si++)body_len+=page[27+si];
+    if(avail<header_len+body_len)return 0;
+    /*Verify the checksum on a copy of the header, so the mapping itself can
+       stay read-only.*/
+    memcpy(_of->map_header,page,header_len);
+    _og->header=_of->map_header;
+    _og->header_len=header_len;
+    _og->body=(unsigned char *)page+header_len;
+    _og->body_len=body_len;
+    ogg_page_checksum_set(_og);
+    if(OP_LIKELY(memcmp(_of->map_header+22,page+22,4)==0)){
+      _og->header=(unsigned char *)page;
+      return header_len+body_len;
+    }
+  }
+  /*Lost sync: skip to the next possible capture pattern.*/
+  next=(const unsigned char *)memchr(page+1,'O',(size_t)(avail-1));
+  return next==NULL?-avail:-(opus_int64)(next-page);
+}
+
+/*From the head of the stream, get the next page out of the resident stream
+   contents.
+  This takes the same arguments and returns the same values as
+   op_get_next_page(), except that since all of the data is already available,
+   a _boundary of 0 behaves the same as an unbounded search.*/
+static opus_int64 op_get_next_map_page(OggOpusFile *_of,ogg_page *_og,
+ opus_int64 _boundary){
+  opus_int64 limit;
+  limit=_of->map_size;
+  if(_boundary>0)limit=OP_MIN(limit,_boundary);
+  while(_of->offset<limit){
+    opus_int64 more;
+    more=op_map_pageseek(_of,_og,limit);
+    /*Skipped (-more) bytes.*/
+    if(OP_UNLIKELY(more<0))_of->offset-=more;
+    else if(more==0)break;
+    else{
+      opus_int64 page_offset;
+      page_offset=_of->offset;
+      _of->offset+=more;
+      _of->stats.pages_synced++;
+      return page_offset;
+    }
+  }
+  /*As with a real read, running out of data before a known boundary is a
+     fatal error.*/
+  return _boundary>_of->map_size&&_of->offset<_boundary?
+   OP_EBADLINK:OP_FALSE;
+}
+
 /*From the head of the stream, get the next page.
   _boundary specifies if the function is allowed to fetch more data from the
    stream (and how much) or only use internally buffered data.
@@ -185,9 +270,12 @@ static opus_int64 op_position(const OggOpusFile *_of){
   Return: n>=0:       Found a page at absolute offset n.
           OP_FALSE:   Hit the _boundary limit.
           OP_EREAD:   An underlying read operation failed.
+          OP_EAGAIN:  The stream would have blocked (only when the flag pointed
+                       to by _of->eagain_ok is set).
           OP_BADLINK: We hit end-of-file before reaching _boundary.*/
 static opus_int64 op_get_next_page(OggOpusFile *_of,ogg_page *_og,
  opus_int64 _boundary){
+  if(_of->map_data!=NULL)return op_get_next_map_page(_of,_og,_boundary);
   while(_boundary<=0||_of->offset<_boundary){
     int more;
     more=ogg_sync_pageseek(&_of->oy,_og);
@@ -206,7 +294,12 @@ static opus_int64 op_get_next_page(OggOpusFile *_of,ogg_page *_og,
         read_nbytes=(int)OP_MIN(_boundary-position,OP_READ_SIZE);
       }
       ret=op_get_data(_of,read_nbytes);
-      if(OP_UNLIKELY(ret<0))return OP_EREAD;
+      if(OP_UNLIKELY(ret<0)){
+        /*Any partial page we already have stays buffered in oy, so we can
+           pick up where we left off when the stream is ready again.*/
+        return ret==OP_EAGAIN&&_of->eagain_ok!=NULL&&*_of->eagain_ok?
+         OP_EAGAIN:OP_EREAD;
+      }
       if(OP_UNLIKELY(ret==0)){
         /*Only fail cleanly on EOF if we didn't have a known boundary.
           Otherwise, we should have been able to reach that boundary, and this
@@ -222,6 +315,7 @@ static opus_int64 op_get_next_page(OggOpusFile *_of,ogg_page *_og,
       page_offset=_of->offset;
       _of->offset+=more;
       OP_ASSERT(page_offset>=0);
+      _of->stats.pages_synced++;
       return page_offset;
     }
   }
@@ -268,8 +362,6 @@ static int op_lookup_page_serialno(const ogg_page *_og,
   return op_lookup_serialno(ogg_page_serialno(_og),_serialnos,_nserialnos);
 }
 
-typedef struct OpusSeekRecord OpusSeekRecord;
-
 /*We use this to remember the pages we found while enumerating the links of a
    chained stream.
   We keep track of the starting and ending offsets, as well as the point we
@@ -1038,6 +1130,12 @@ static opus_int64 op_rescale64(opus_int64 _x,opus_int64 _from,opus_int64 _to){
    of 256.*/
 #define OP_GP_SPACING_MIN (48000)
 
+/*The number of seek records to keep during link enumeration.
+  64 seek records should be enough for anybody.
+  Actually, with a bisection search in a 63-bit range down to OP_CHUNK_SIZE
+   granularity, much more than enough.*/
+#define OP_NSEEK_RECORDS (64)
+
 /*Try to estimate the location of the next link using the current seek
    records, assuming the initial granule position of any streams we've found is
    0.*/
@@ -1102,10 +1200,17 @@ static opus_int64 op_predict_link_start(const OpusSeekRecord *_sr,int _nsr,
 }
 
 /*Finds each bitstream link, one at a time, using a bisection search.
-  This has to begin by knowing the offset of the first link's initial page.*/
+  This has to begin by knowing the offset of the first link's initial page.
+  _nsr:        The number of valid seek records in _sr.
+  _nlinks_max: Stop once this many links have been found, leaving the end of
+                the last one undetermined.
+               The state needed to continue the search from there is saved in
+                _of.
+  Return: 0 if all the links were found, 1 if we stopped early, or a negative
+           value on error.*/
 static int op_bisect_forward_serialno(OggOpusFile *_of,
- opus_int64 _searched,OpusSeekRecord *_sr,int _csr,
- ogg_uint32_t **_serialnos,int *_nserialnos,int *_cserialnos){
+ opus_int64 _searched,OpusSeekRecord *_sr,int _csr,int _nsr,
+ ogg_uint32_t **_serialnos,int *_nserialnos,int *_cserialnos,int _nlinks_max){
   ogg_page      og;
   OggOpusLink  *links;
   int           nlinks;
@@ -1116,8 +1221,10 @@ static int op_bisect_forward_serialno(OggOpusFile *_of,
   int           nsr;
   int           ret;
   links=_of->links;
-  nlinks=clinks=_of->nlinks;
-  total_duration=0;
+  nlinks=_of->nlinks;
+  clinks=OP_MAX(_of->clinks,nlinks);
+  /*The duration of the last link found is only added once we find its end.*/
+  total_duration=links[nlinks-1].pcm_file_offset;
   /*We start with one seek record, for the last page in the file.
     We build up a list of records for places we seek to during link
      enumeration.
@@ -1125,7 +1232,7 @@ static int op_bisect_forward_serialno(OggOpusFile *_of,
     We only care about seek locations that were _not_ in the current link,
      therefore we can add them one at a time to the end of the list as we
      improve the lower bound on the location where the next link starts.*/
-  nsr=1;
+  nsr=_nsr;
   for(;;){
     opus_int64  end_searched;
     opus_int64  bisect;
@@ -1154,6 +1261,14 @@ static int op_bisect_forward_serialno(OggOpusFile *_of,
     }
     /*Is the last page in our current list of serial numbers?*/
     if(sri<=0)break;
+    /*If we're enumerating lazily, stop once we've found enough links, and
+       remember where we were so we can pick up from here later.*/
+    if(nlinks>=_nlinks_max){
+      _of->clinks=clinks;
+      _of->enum_nsr=nsr;
+      _of->enum_searched=_searched;
+      return 1;
+    }
     /*Last page wasn't found.
       We have at least one more link.*/
     last=-1;
@@ -1178,7 +1293,9 @@ static int op_bisect_forward_serialno(OggOpusFile *_of,
       opus_int64 avg_link_size;
       opus_int64 upper_limit;
       last_offset=links[nlinks-1].offset;
-      avg_link_size=last_offset/(nlinks-1);
+      /*When scanning a range of the stream, the first link need not be at the
+         start.*/
+      avg_link_size=(last_offset-links[0].offset)/(nlinks-1);
       upper_limit=end_searched-OP_CHUNK_SIZE-avg_link_size;
       if(OP_LIKELY(last_offset>_searched-avg_link_size)
        &&OP_LIKELY(last_offset<upper_limit)){
@@ -1193,6 +1310,7 @@ static int op_bisect_forward_serialno(OggOpusFile *_of,
       opus_int32 next_bias;
       /*If we don't have a better estimate, use simple bisection.*/
       if(bisect==-1)bisect=_searched+(end_searched-_searched>>1);
+      _of->stats.link_bisections++;
       /*If we're within OP_CHUNK_SIZE of the start, scan forward.*/
       if(bisect-_searched<OP_CHUNK_SIZE)bisect=_searched;
       /*Otherwise we're skipping data.
@@ -1352,6 +1470,19 @@ static void op_update_gain(OggOpusFile *_of){
 #endif
 }
 
+/*Reset the state of the output filters at the start of a link.*/
+static void op_reset_filter_state(OggOpusFile *_of,ogg_uint32_t _serialno){
+#if !defined(OP_FIXED_POINT)
+  _of->state_channel_count=0;
+  /*Use the serial number for the PRNG seed to get repeatable output for
+     straight play-throughs.*/
+  _of->dither_seed=_serialno;
+#else
+  (void)_of;
+  (void)_serialno;
+#endif
+}
+
 static int op_make_decode_ready(OggOpusFile *_of){
   const OpusHead *head;
   int             li;
@@ -1368,6 +1499,7 @@ static int op_make_decode_ready(OggOpusFile *_of){
   /*Check to see if the current decoder is compatible with the current link.*/
   if(_of->od!=NULL&&_of->od_stream_count==stream_count
    &&_of->od_coupled_count==coupled_count&&_of->od_channel_count==channel_count
+   &&_of->od_rate==_of->decode_rate
    &&memcmp(_of->od_mapping,head->mapping,
    sizeof(*head->mapping)*channel_count)==0){
     opus_multistream_decoder_ctl(_of->od,OPUS_RESET_STATE);
@@ -1375,40 +1507,373 @@ static int op_make_decode_ready(OggOpusFile *_of){
   else{
     int err;
     opus_multistream_decoder_destroy(_of->od);
-    _of->od=opus_multistream_decoder_create(48000,channel_count,
+    _of->od=opus_multistream_decoder_create(_of->decode_rate,channel_count,
      stream_count,coupled_count,head->mapping,&err);
     if(_of->od==NULL)return OP_EFAULT;
     _of->od_stream_count=stream_count;
     _of->od_coupled_count=coupled_count;
     _of->od_channel_count=channel_count;
+    _of->od_rate=_of->decode_rate;
     memcpy(_of->od_mapping,head->mapping,sizeof(*head->mapping)*channel_count);
   }
   _of->ready_state=OP_INITSET;
   _of->bytes_tracked=0;
   _of->samples_tracked=0;
-#if !defined(OP_FIXED_POINT)
-  _of->state_channel_count=0;
-  /*Use the serial number for the PRNG seed to get repeatable output for
-     straight play-throughs.*/
-  _of->dither_seed=_of->links[li].serialno;
-#endif
+  /*When decoding ahead, the read functions reset this state themselves once
+     they reach the new link.*/
+  if(!_of->da_filling)op_reset_filter_state(_of,_of->links[li].serialno);
   op_update_gain(_of);
   return 0;
 }
 
-static int op_open_seekable2_impl(OggOpusFile *_of){
-  /*64 seek records should be enough for anybody.
-    Actually, with a bisection search in a 63-bit range down to OP_CHUNK_SIZE
-     granularity, much more than enough.*/
-  OpusSeekRecord sr[64];
+/*Don't split a stream into ranges smaller than this for scanning in parallel.
+  Each one costs a new handle and a few reads before it finds anything.*/
+#define OP_RANGE_SIZE_MIN (4*OP_CHUNK_SIZE)
+
+/*The state for scanning one byte range of a stream for links.*/
+struct OpusLinkRange{
+  /*The state used to scan this range through its own stream handle.
+    Only the parts needed to enumerate links are set up.*/
+  OggOpusFile of;
+  /*The offset of the start of the range.*/
+  opus_int64  begin;
+  /*The offset of the end of the range.*/
+  opus_int64  end;
+  /*The offset of the first link that starts after the end of the range, or
+     -1 if the links in this range run to the end of the stream.*/
+  opus_int64  next_offset;
+  /*0 on success, or a negative value if the scan failed.*/
+  int         ret;
+};
+
+struct OpusRangeScan{
+  /*The application's function to open another handle to the stream.*/
+  op_open_stream_func  open_stream;
+  void                *open_ctx;
+  /*The application's function to run the scan of each range, or NULL.*/
+  op_run_func          run;
+  void                *run_ctx;
+  /*The maximum number of ranges to scan.*/
+  int                  nranges;
+  /*The seek record for the last page in the stream.*/
+  OpusSeekRecord       last_sr;
+  /*The ranges being scanned.*/
+  OpusLinkRange       *ranges;
+};
+
+/*Find the first page that begins a link at or after _begin, but before _end.
+  Return: The offset of that page, which is returned in _og, OP_FALSE if there
+           is none, or a negative value on error.*/
+static opus_int64 op_find_link_start(OggOpusFile *_of,ogg_page *_og,
+ opus_int64 _begin,opus_int64 _end){
+  opus_int64   page_offset;
+  opus_int64   boundary;
+  opus_int64   lo;
+  opus_int64   hi;
+  ogg_uint32_t serialno;
+  int          ret;
+  boundary=OP_MIN(OP_ADV_OFFSET(_end,OP_PAGE_SIZE_MAX-1),_of->end);
+  ret=op_seek_helper(_of,_begin);
+  if(OP_UNLIKELY(ret<0))return ret;
+  page_offset=op_get_next_page(_of,_og,boundary);
+  if(page_offset<0||page_offset>=_end)return OP_MIN(page_offset,OP_FALSE);
+  if(ogg_page_bos(_og))return page_offset;
+  /*Every page up to the last one from this stream belongs to a link that
+     started before _begin (assuming serial numbers aren't re-used), so skip
+     as many of them as we can with a bisection search.
+    If the link has other streams multiplexed with it, we may stop short of the
+     next link, but the scan below will still find it.*/
+  serialno=ogg_page_serialno(_og);
+  lo=_of->offset;
+  hi=_end;
+  while(hi-lo>=OP_CHUNK_SIZE){
+    opus_int64 bisect;
+    bisect=lo+(hi-lo>>1);
+    _of->stats.link_bisections++;
+    ret=op_seek_helper(_of,bisect);
+    if(OP_UNLIKELY(ret<0))return ret;
+    page_offset=op_get_next_page(_of,_og,hi);
+    if(OP_UNLIKELY(page_offset<OP_FALSE))return page_offset;
+    if(page_offset==OP_FALSE||(ogg_uint32_t)ogg_page_serialno(_og)!=serialno){
+      hi=bisect;
+    }
+    else lo=_of->offset;
+  }
+  ret=op_seek_helper(_of,lo);
+  if(OP_UNLIKELY(ret<0))return ret;
+  do{
+    page_offset=op_get_next_page(_of,_og,boundary);
+    if(page_offset<0||page_offset>=_end)return OP_MIN(page_offset,OP_FALSE);
+  }
+  while(!ogg_page_bos(_og));
+  return page_offset;
+}
+
+/*Find the links that start in one range of the stream.
+  The PCM offsets of the links are relative to the first one found.*/
+static int op_scan_link_range_impl(const OpusRangeScan *_scan,
+ OpusLinkRange *_range){
+  OpusSeekRecord     sr[OP_NSEEK_RECORDS];
+  OpusFileCallbacks  cb;
+  ogg_page           og;
+  OggOpusFile       *of;
+  OggOpusLink       *links;
+  opus_int64         start;
+  opus_int64         searched;
+  int                nsr;
+  int                ret;
+  of=&_range->of;
+  memset(&cb,0,sizeof(cb));
+  of->stream=(*_scan->open_stream)(_scan->open_ctx,&cb);
+  if(OP_UNLIKELY(of->stream==NULL))return OP_EREAD;
+  of->callbacks=cb;
+  if(OP_UNLIKELY(cb.read==NULL)||OP_UNLIKELY(cb.seek==NULL)
+   ||OP_UNLIKELY(cb.tell==NULL)){
+    return OP_EINVAL;
+  }
+  of->map_data=op_mem_stream_data(&cb,of->stream,&of->map_size);
+  start=op_find_link_start(of,&og,_range->begin,_range->end);
+  /*If no link starts in this range, then there's nothing to do.*/
+  if(start==OP_FALSE)return 0;
+  if(OP_UNLIKELY(start<0))return (int)start;
+  links=of->links=(OggOpusLink *)_ogg_malloc(sizeof(*of->links));
+  if(OP_UNLIKELY(links==NULL))return OP_EFAULT;
+  ret=op_fetch_headers(of,&links[0].head,&links[0].tags,
+   &of->serialnos,&of->nserialnos,&of->cserialnos,&og);
+  if(OP_UNLIKELY(ret<0))return ret;
+  of->nlinks=1;
+  links[0].offset=start;
+  links[0].data_offset=of->offset;
+  links[0].serialno=of->os.serialno;
+  links[0].pcm_end=-1;
+  ret=op_find_initial_pcm_offset(of,links,NULL);
+  if(OP_UNLIKELY(ret<0))return ret;
+  /*Find one link at a time until we reach one that starts in the next range.
+    The bisection search uses the last page in the stream as its upper bound,
+     just like a serial scan, so it finds the same links.*/
+  sr[0]=_scan->last_sr;
+  nsr=1;
+  searched=of->offset;
+  for(;;){
+    OggOpusLink *last_link;
+    ret=op_bisect_forward_serialno(of,searched,sr,OP_NSEEK_RECORDS,nsr,
+     &of->serialnos,&of->nserialnos,&of->cserialnos,of->nlinks+1);
+    if(OP_UNLIKELY(ret<0))return ret;
+    last_link=of->links+of->nlinks-1;
+    if(last_link->offset>=_range->end){
+      /*That link belongs to the next range, which will find it on its own.*/
+      _range->next_offset=last_link->offset;
+      opus_tags_clear(&last_link->tags);
+      of->nlinks--;
+      return 0;
+    }
+    if(ret==0)break;
+    searched=of->enum_searched;
+    nsr=of->enum_nsr;
+  }
+  _range->next_offset=-1;
+  return 0;
+}
+
+static void op_scan_link_range(void *_ctx,int _ri){
+  OpusRangeScan *scan;
+  OpusLinkRange *range;
+  scan=(OpusRangeScan *)_ctx;
+  range=scan->ranges+_ri;
+  range->ret=op_scan_link_range_impl(scan,range);
+}
+
+/*Free everything used to scan a range, except any links already moved out of
+   it, and close its stream handle.*/
+static void op_link_range_clear(OpusLinkRange *_range){
+  OggOpusFile *of;
+  int          li;
+  of=&_range->of;
+  for(li=0;li<of->nlinks;li++)opus_tags_clear(&of->links[li].tags);
+  _ogg_free(of->links);
+  _ogg_free(of->serialnos);
+  ogg_stream_clear(&of->os);
+  ogg_sync_clear(&of->oy);
+  if(of->stream!=NULL&&of->callbacks.close!=NULL){
+    (*of->callbacks.close)(of->stream);
+  }
+}
+
+/*Add the statistics from another handle used on behalf of this one (e.g., to
+   scan a range of the stream).*/
+static void op_add_stats(OggOpusFile *_of,const OpusFileStats *_stats){
+  _of->stats.nreads+=_stats->nreads;
+  _of->stats.bytes_read+=_stats->bytes_read;
+  _of->stats.nseeks+=_stats->nseeks;
+  _of->stats.pages_synced+=_stats->pages_synced;
+  _of->stats.pages_skipped+=_stats->pages_skipped;
+  _of->stats.seek_bisections+=_stats->seek_bisections;
+  _of->stats.link_bisections+=_stats->link_bisections;
+  _of->stats.packets_decoded+=_stats->packets_decoded;
+  _of->stats.samples_discarded+=_stats->samples_discarded;
+  _of->stats.decode_time_us+=_stats->decode_time_us;
+}
+
+/*Merge the links found in each range into a single table.
+  Return: 0 on success, 1 if the ranges did not fit together, or a negative
+           value on error.*/
+static int op_merge_link_ranges(OggOpusFile *_of,
+ OpusLinkRange *_ranges,int _nranges){
+  OggOpusLink *links;
+  opus_int64   next_offset;
+  ogg_int64_t  total_duration;
+  int          nlinks;
+  int          ri;
+  int          li;
+  /*Each range must start with the link the previous one stopped at, and the
+     last one must run to the end of the stream.
+    A range with no links stops wherever the previous one did.*/
+  next_offset=_of->links[0].offset;
+  nlinks=0;
+  for(ri=0;ri<_nranges;ri++){
+    const OggOpusFile *of;
+    if(_ranges[ri].ret<0)return 1;
+    of=&_ranges[ri].of;
+    if(of->nlinks<=0)continue;
+    if(of->links[0].offset!=next_offset)return 1;
+    next_offset=_ranges[ri].next_offset;
+    if(OP_UNLIKELY(nlinks>INT_MAX-of->nlinks))return OP_EFAULT;
+    nlinks+=of->nlinks;
+  }
+  if(next_offset!=-1)return 1;
+  links=(OggOpusLink *)_ogg_malloc(sizeof(*links)*nlinks);
+  if(OP_UNLIKELY(links==NULL))return OP_EFAULT;
+  total_duration=0;
+  nlinks=0;
+  for(ri=0;ri<_nranges;ri++){
+    OggOpusFile *of;
+    ogg_int64_t  duration;
+    of=&_ranges[ri].of;
+    if(of->nlinks<=0)continue;
+    /*The duration of this range, from the offsets relative to its start.
+      The bisection search validated the duration of each link, so only the
+       running total can overflow.*/
+    OP_ALWAYS_TRUE(!op_granpos_diff(&duration,of->links[of->nlinks-1].pcm_end,
+     of->links[of->nlinks-1].pcm_start));
+    duration+=of->links[of->nlinks-1].pcm_file_offset
+     -of->links[of->nlinks-1].head.pre_skip;
+    if(OP_UNLIKELY(OP_INT64_MAX-duration<total_duration)){
+      /*Let op_clear() free the tags we've already taken, and the ones left in
+         this range.*/
+      opus_tags_clear(&_of->links[0].tags);
+      _ogg_free(_of->links);
+      _of->links=links;
+      _of->nlinks=nlinks;
+      return OP_EBADTIMESTAMP;
+    }
+    for(li=0;li<of->nlinks;li++){
+      links[nlinks+li]=of->links[li];
+      links[nlinks+li].pcm_file_offset+=total_duration;
+    }
+    nlinks+=of->nlinks;
+    /*The tags now belong to the merged table.*/
+    of->nlinks=0;
+    total_duration+=duration;
+  }
+  /*The first range re-read the headers of the first link, so we can replace
+     ours.*/
+  opus_tags_clear(&_of->links[0].tags);
+  _ogg_free(_of->links);
+  _of->links=links;
+  _of->nlinks=nlinks;
+  /*We don't need these anymore, just as after a serial scan.*/
+  _ogg_free(_of->serialnos);
+  _of->serialnos=NULL;
+  _of->cserialnos=_of->nserialnos=0;
+  return 0;
+}
+
+/*Enumerate the links of a seekable stream by splitting it into ranges and
+   scanning each one through a separate handle using the application's
+   functions.
+  _sr: The seek record for the last page in the stream.
+  Return: 0 if all the links were found, 1 if we need to fall back to scanning
+           the stream serially, or a negative value on error.*/
+static int op_scan_link_ranges(OggOpusFile *_of,const OpusSeekRecord *_sr){
+  OpusRangeScan *scan;
+  OpusLinkRange *ranges;
+  opus_int64     begin;
+  opus_int64     size;
+  int            nranges;
+  int            ri;
+  int            ret;
+  scan=_of->range_scan;
+  begin=_of->links[0].data_offset;
+  size=_of->end-begin;
+  nranges=(int)OP_MIN(scan->nranges,size/OP_RANGE_SIZE_MIN);
+  if(nranges<2)return 1;
+  ranges=(OpusLinkRange *)_ogg_malloc(sizeof(*ranges)*nranges);
+  if(OP_UNLIKELY(ranges==NULL))return OP_EFAULT;
+  for(ri=0;ri<nranges;ri++){
+    OggOpusFile *of;
+    memset(ranges+ri,0,sizeof(*ranges));
+    of=&ranges[ri].of;
+    of->seekable=1;
+    of->end=_of->end;
+    of->stream_size=_of->stream_size;
+    of->ready_state=OP_OPENED;
+    ogg_sync_init(&of->oy);
+    ogg_stream_init(&of->os,-1);
+    /*The first range starts with the first link, so it can find it the same
+       way as all the others.*/
+    ranges[ri].begin=ri>0?begin+size/nranges*ri:_of->links[0].offset;
+    ranges[ri].end=ri+1<nranges?begin+size/nranges*(ri+1):_of->end;
+  }
+  scan->last_sr=*_sr;
+  scan->ranges=ranges;
+  if(scan->run!=NULL)(*scan->run)(scan->run_ctx,op_scan_link_range,scan,nranges);
+  else for(ri=0;ri<nranges;ri++)op_scan_link_range(scan,ri);
+  scan->ranges=NULL;
+  ret=op_merge_link_ranges(_of,ranges,nranges);
+  for(ri=0;ri<nranges;ri++){
+    op_add_stats(_of,&ranges[ri].of.stats);
+    op_link_range_clear(ranges+ri);
+  }
+  _ogg_free(ranges);
+  return ret;
+}
+
+/*Enumerate the links of a seekable stream.
+  _read_tail: Whether or not to fetch the entire window at the end of the
+               stream that we scan for the last page with a single read.
+              This makes the tail cost one request on storage where each read
+               is expensive, but leaves a large buffer allocated in the sync
+               state, so it is only worth doing when we're about to throw the
+               OggOpusFile away.
+  _nlinks:    Stop once this many links have been found, or INT_MAX to find
+               them all.
+  Return: 0 if all the links were found, 1 if there are more, or a negative
+           value on error.*/
+static int op_open_seekable2_impl(OggOpusFile *_of,int _read_tail,
+ int _nlinks){
+  OpusSeekRecord sr[OP_NSEEK_RECORDS];
   opus_int64     data_offset;
   int            ret;
   /*We can seek, so set out learning all about this file.*/
+  _of->stats.nseeks++;
   (*_of->callbacks.seek)(_of->stream,0,SEEK_END);
   _of->offset=_of->end=(*_of->callbacks.tell)(_of->stream);
   if(OP_UNLIKELY(_of->end<0))return OP_EREAD;
+  _of->stream_size=_of->end;
   data_offset=_of->links[0].data_offset;
   if(OP_UNLIKELY(_of->end<data_offset))return OP_EBADLINK;
+  if(_read_tail&&_of->map_data==NULL){
+    opus_int64 begin;
+    /*This is the same window op_get_prev_page_serial() starts with, so its
+       seek to the start of it won't discard what we read.*/
+    begin=OP_MAX(_of->end-OP_CHUNK_SIZE,0);
+    ret=op_seek_helper(_of,begin);
+    if(OP_UNLIKELY(ret<0))return ret;
+    /*A short read is fine: op_get_next_page() will read the rest.*/
+    if(_of->end>begin&&OP_UNLIKELY(op_get_data(_of,(int)(_of->end-begin))<0)){
+      return OP_EREAD;
+    }
+  }
   /*Get the offset of the last page of the physical bitstream, or, if we're
      lucky, the last Opus page of the first link, as most Ogg Opus files will
      contain a single logical bitstream.*/
@@ -1418,17 +1883,432 @@ static int op_open_seekable2_impl(OggOpusFile *_of){
   /*If there's any trailing junk, forget about it.*/
   _of->end=sr[0].offset+sr[0].size;
   if(OP_UNLIKELY(_of->end<data_offset))return OP_EBADLINK;
+  /*If there's more than one link and the application gave us a way to scan
+     the stream in pieces, try that first.*/
+  if(_of->range_scan!=NULL&&!op_lookup_serialno(sr[0].serialno,
+   _of->serialnos,_of->nserialnos)){
+    ret=op_scan_link_ranges(_of,sr);
+    if(ret<=0)return ret;
+  }
   /*Now enumerate the bitstream structure.*/
-  return op_bisect_forward_serialno(_of,data_offset,sr,sizeof(sr)/sizeof(*sr),
-   &_of->serialnos,&_of->nserialnos,&_of->cserialnos);
+  ret=op_bisect_forward_serialno(_of,data_offset,sr,OP_NSEEK_RECORDS,1,
+   &_of->serialnos,&_of->nserialnos,&_of->cserialnos,_nlinks);
+  if(ret>0){
+    /*Keep the seek records around so we can continue where we left off.*/
+    _of->enum_sr=(OpusSeekRecord *)_ogg_malloc(sizeof(sr));
+    if(OP_UNLIKELY(_of->enum_sr==NULL))return OP_EFAULT;
+    memcpy(_of->enum_sr,sr,sizeof(sr));
+  }
+  return ret;
+}
+
+/*The link table format written by op_export_links().
+  All integers are little-endian.
+  The header is
+     8 bytes: The magic signature "OpusLink".
+     1 byte:  The format version (OP_LINKS_VERSION).
+     8 bytes: The size of the stream, including any trailing junk.
+     8 bytes: The end of the last page in the stream.
+     4 bytes: The number of links.
+  This is followed by one record per link:
+     8 bytes: offset.
+     8 bytes: data_offset.
+     8 bytes: end_offset.
+     8 bytes: pcm_end.
+     8 bytes: pcm_start.
+     4 bytes: serialno.
+     4 bytes: The size of the ID header packet, followed by the packet.
+     4 bytes: The size of the comment header packet, followed by the packet.
+  The table ends with a 4-byte Adler-32 checksum of everything before it.
+  The headers are stored as re-serialized packets, so that they can be
+   validated by the same code that parses them out of the stream.*/
+#define OP_LINKS_VERSION     (1)
+#define OP_LINKS_HEADER_SIZE (29)
+#define OP_LINKS_RECORD_SIZE (52)
+/*The number of links between the first and the last whose pages get checked
+   against the stream when importing a link table.*/
+#define OP_LINKS_NSPOT_CHECKS (6)
+
+/*A checksum to catch accidental damage to a saved link table.
+  This does not need to be strong, since the table is also checked against the
+   stream itself.*/
+static opus_uint32 op_adler32(const unsigned char *_data,size_t _size){
+  opus_uint32 a;
+  opus_uint32 b;
+  size_t      i;
+  a=1;
+  b=0;
+  for(i=0;i<_size;i++){
+    a=(a+_data[i])%65521;
+    b=(b+a)%65521;
+  }
+  return b<<16|a;
+}
+
+static unsigned char *op_put_uint32le(unsigned char *_data,opus_uint32 _v){
+  _data[0]=(unsigned char)(_v&0xFF);
+  _data[1]=(unsigned char)(_v>>8&0xFF);
+  _data[2]=(unsigned char)(_v>>16&0xFF);
+  _data[3]=(unsigned char)(_v>>24&0xFF);
+  return _data+4;
+}
+
+static unsigned char *op_put_int64le(unsigned char *_data,opus_int64 _v){
+  _data=op_put_uint32le(_data,(opus_uint32)(_v&0xFFFFFFFF));
+  return op_put_uint32le(_data,(opus_uint32)((ogg_uint64_t)_v>>32));
+}
+
+static opus_uint32 op_get_uint32le(const unsigned char *_data){
+  return _data[0]|(opus_uint32)_data[1]<<8|
+   (opus_uint32)_data[2]<<16|(opus_uint32)_data[3]<<24;
+}
+
+static opus_int64 op_get_int64le(const unsigned char *_data){
+  return (opus_int64)(op_get_uint32le(_data)
+   |(ogg_uint64_t)op_get_uint32le(_data+4)<<32);
+}
+
+/*The size of an ID header packet re-serialized by op_put_head().*/
+static size_t op_head_packet_size(const OpusHead *_head){
+  return _head->mapping_family==0?19:21+_head->channel_count;
+}
+
+static unsigned char *op_put_head(unsigned char *_data,const OpusHead *_head){
+  memcpy(_data,"OpusHead",8);
+  _data[8]=(unsigned char)_head->version;
+  _data[9]=(unsigned char)_head->channel_count;
+  _data[10]=(unsigned char)(_head->pre_skip&0xFF);
+  _data[11]=(unsigned char)(_head->pre_skip>>8&0xFF);
+  op_put_uint32le(_data+12,_head->input_sample_rate);
+  _data[16]=(unsigned char)(_head->output_gain&0xFF);
+  _data[17]=(unsigned char)(_head->output_gain>>8&0xFF);
+  _data[18]=(unsigned char)_head->mapping_family;
+  if(_head->mapping_family==0)return _data+19;
+  _data[19]=(unsigned char)_head->stream_count;
+  _data[20]=(unsigned char)_head->coupled_count;
+  memcpy(_data+21,_head->mapping,_head->channel_count);
+  return _data+21+_head->channel_count;
 }
 
-static int op_open_seekable2(OggOpusFile *_of){
+/*The size of a comment header packet re-serialized by op_put_tags().*/
+static size_t op_tags_packet_size(const OpusTags *_tags){
+  size_t size;
+  int    ncomments;
+  int    ci;
+  ncomments=_tags->comments;
+  size=16+(_tags->vendor!=NULL?strlen(_tags->vendor):0);
+  for(ci=0;ci<ncomments;ci++)size+=4+(size_t)_tags->comment_lengths[ci];
+  if(_tags->user_comments[ncomments]!=NULL){
+    size+=(size_t)_tags->comment_lengths[ncomments];
+  }
+  return size;
+}
+
+static unsigned char *op_put_tags(unsigned char *_data,const OpusTags *_tags){
+  size_t vendor_len;
+  int    ncomments;
+  int    ci;
+  ncomments=_tags->comments;
+  vendor_len=_tags->vendor!=NULL?strlen(_tags->vendor):0;
+  memcpy(_data,"OpusTags",8);
+  _data=op_put_uint32le(_data+8,(opus_uint32)vendor_len);
+  memcpy(_data,_tags->vendor,vendor_len);
+  _data=op_put_uint32le(_data+vendor_len,(opus_uint32)ncomments);
+  for(ci=0;ci<ncomments;ci++){
+    _data=op_put_uint32le(_data,(opus_uint32)_tags->comment_lengths[ci]);
+    memcpy(_data,_tags->user_comments[ci],_tags->comment_lengths[ci]);
+    _data+=_tags->comment_lengths[ci];
+  }
+  /*The binary suffix, if any, is just appended as-is.*/
+  if(_tags->user_comments[ncomments]!=NULL){
+    memcpy(_data,_tags->user_comments[ncomments],
+     _tags->comment_lengths[ncomments]);
+    _data+=_tags->comment_lengths[ncomments];
+  }
+  return _data;
+}
+
+/*Whether or not we know where link _li (or the whole stream, if _li is
+   negative) ends.
+  Only the last link found so far may be incomplete, and only after a lazy
+   open.*/
+static int op_link_is_complete(const OggOpusFile *_of,int _li){
+  return _of->enum_sr==NULL||(_li>=0&&_li<_of->nlinks-1);
+}
+
+opus_int64 op_export_links(const OggOpusFile *_of,
+ unsigned char *_data,size_t _size){
+  const OggOpusLink *links;
+  opus_int64         total_size;
+  int                nlinks;
+  int                li;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
+   ||OP_UNLIKELY(!_of->seekable)
+   ||OP_UNLIKELY(!op_link_is_complete(_of,-1))){
+    return OP_EINVAL;
+  }
+  links=_of->links;
+  nlinks=_of->nlinks;
+  total_size=OP_LINKS_HEADER_SIZE+4;
+  for(li=0;li<nlinks;li++){
+    total_size+=OP_LINKS_RECORD_SIZE+op_head_packet_size(&links[li].head)
+     +op_tags_packet_size(&links[li].tags);
+  }
+  if(_data!=NULL&&(opus_int64)_size>=total_size){
+    unsigned char *start;
+    start=_data;
+    memcpy(_data,"OpusLink",8);
+    _data[8]=OP_LINKS_VERSION;
+    _data=op_put_int64le(_data+9,_of->stream_size);
+    _data=op_put_int64le(_data,_of->end);
+    _data=op_put_uint32le(_data,(opus_uint32)nlinks);
+    for(li=0;li<nlinks;li++){
+      _data=op_put_int64le(_data,links[li].offset);
+      _data=op_put_int64le(_data,links[li].data_offset);
+      _data=op_put_int64le(_data,links[li].end_offset);
+      _data=op_put_int64le(_data,links[li].pcm_end);
+      _data=op_put_int64le(_data,links[li].pcm_start);
+      _data=op_put_uint32le(_data,links[li].serialno);
+      _data=op_put_uint32le(_data,
+       (opus_uint32)op_head_packet_size(&links[li].head));
+      _data=op_put_head(_data,&links[li].head);
+      _data=op_put_uint32le(_data,
+       (opus_uint32)op_tags_packet_size(&links[li].tags));
+      _data=op_put_tags(_data,&links[li].tags);
+    }
+    op_put_uint32le(_data,op_adler32(start,_data-start));
+  }
+  return total_size;
+}
+
+/*Returns nonzero if op_find_initial_pcm_offset() found no audio data in the
+   given link.*/
+static int op_link_is_empty(const OggOpusLink *_link){
+  return _link->pcm_start==0&&_link->pcm_end==0
+   &&_link->end_offset==_link->data_offset;
+}
+
+/*Read the page that the link table says starts at the given offset.
+  Return: 0 if there was a valid page there, OP_EBADLINK if there was not, or
+           another negative value on a read error.*/
+static int op_get_page_at(OggOpusFile *_of,ogg_page *_og,opus_int64 _offset){
+  opus_int64 page_offset;
+  int        ret;
+  ret=op_seek_helper(_of,_offset);
+  if(OP_UNLIKELY(ret<0))return ret;
+  page_offset=op_get_next_page(_of,_og,
+   OP_ADV_OFFSET(_offset,OP_PAGE_SIZE_MAX));
+  if(OP_UNLIKELY(page_offset<OP_FALSE))return (int)page_offset;
+  return OP_LIKELY(page_offset==_offset)?0:OP_EBADLINK;
+}
+
+/*Load the link table from a buffer created by op_export_links() instead of
+   enumerating the links ourselves.
+  The headers of the first link have already been read from the stream, so
+   they are used to verify the table instead.
+  Every record is checked for consistency, but only the size of the stream and
+   the first and last pages of a bounded sample of links are checked against
+   the stream itself, so the cost does not grow with the number of links.*/
+static int op_open_seekable2_import_impl(OggOpusFile *_of,
+ const unsigned char *_data,size_t _size){
+  OggOpusLink *links;
+  ogg_int64_t  total_duration;
+  opus_int64   stream_size;
+  opus_int64   end;
+  opus_int64   prev_end_offset;
+  opus_uint32  nlinks;
+  int          prev_li;
+  int          li;
+  int          si;
+  int          ret;
+  if(_size<OP_LINKS_HEADER_SIZE+4||memcmp(_data,"OpusLink",8)!=0){
+    return OP_EINVAL;
+  }
+  if(_data[8]!=OP_LINKS_VERSION)return OP_EVERSION;
+  _size-=4;
+  if(op_get_uint32le(_data+_size)!=op_adler32(_data,_size))return OP_EINVAL;
+  stream_size=op_get_int64le(_data+9);
+  end=op_get_int64le(_data+17);
+  nlinks=op_get_uint32le(_data+25);
+  _data+=OP_LINKS_HEADER_SIZE;
+  _size-=OP_LINKS_HEADER_SIZE;
+  if(OP_UNLIKELY(nlinks<1)||OP_UNLIKELY(end<0)||OP_UNLIKELY(end>stream_size)
+   ||OP_UNLIKELY(nlinks>_size/OP_LINKS_RECORD_SIZE)){
+    return OP_EINVAL;
+  }
+  if(OP_UNLIKELY(nlinks>INT_MAX/sizeof(*links)))return OP_EFAULT;
+  /*If the stream has changed size, then there's no point in looking any
+     further.*/
+  _of->stats.nseeks++;
+  (*_of->callbacks.seek)(_of->stream,0,SEEK_END);
+  _of->offset=(*_of->callbacks.tell)(_of->stream);
+  if(OP_UNLIKELY(_of->offset<0))return OP_EREAD;
+  if(_of->offset!=stream_size)return OP_EBADLINK;
+  links=(OggOpusLink *)_ogg_realloc(_of->links,sizeof(*links)*nlinks);
+  if(OP_UNLIKELY(links==NULL))return OP_EFAULT;
+  _of->links=links;
+  total_duration=0;
+  prev_end_offset=-1;
+  for(li=0;li<(int)nlinks;li++){
+    OggOpusLink  link;
+    ogg_int64_t  duration;
+    opus_uint32  len;
+    if(OP_UNLIKELY(_size<OP_LINKS_RECORD_SIZE))return OP_EINVAL;
+    link.offset=op_get_int64le(_data);
+    link.data_offset=op_get_int64le(_data+8);
+    link.end_offset=op_get_int64le(_data+16);
+    link.pcm_end=op_get_int64le(_data+24);
+    link.pcm_start=op_get_int64le(_data+32);
+    link.serialno=op_get_uint32le(_data+40);
+    len=op_get_uint32le(_data+44);
+    _data+=48;
+    _size-=48;
+    if(OP_UNLIKELY(len>_size))return OP_EINVAL;
+    ret=opus_head_parse(&link.head,_data,len);
+    if(OP_UNLIKELY(ret<0))return OP_EINVAL;
+    _data+=len;
+    _size-=len;
+    if(OP_UNLIKELY(_size<4))return OP_EINVAL;
+    len=op_get_uint32le(_data);
+    _data+=4;
+    _size-=4;
+    if(OP_UNLIKELY(len>_size))return OP_EINVAL;
+    /*The links must be in order, and each one must be laid out the way
+       op_bisect_forward_serialno() would have found it.*/
+    if(OP_UNLIKELY(link.offset<=prev_end_offset)
+     ||OP_UNLIKELY(link.data_offset<=link.offset)
+     ||OP_UNLIKELY(link.end_offset<link.data_offset)
+     ||OP_UNLIKELY(link.end_offset>=end)){
+      return OP_EBADLINK;
+    }
+    /*Links with no audio data are marked the same way
+       op_find_initial_pcm_offset() marks them, and have no timing to check.*/
+    if(op_link_is_empty(&link))duration=0;
+    /*Otherwise apply the same checks as op_find_final_pcm_offset().*/
+    else{
+      if(OP_UNLIKELY(op_granpos_diff(&duration,
+       link.pcm_end,link.pcm_start)<0)
+       ||OP_UNLIKELY(duration<link.head.pre_skip)){
+        return OP_EBADTIMESTAMP;
+      }
+      duration-=link.head.pre_skip;
+      if(OP_UNLIKELY(OP_INT64_MAX-duration<total_duration)){
+        return OP_EBADTIMESTAMP;
+      }
+    }
+    link.pcm_file_offset=total_duration;
+    total_duration+=duration;
+    /*An empty link has no last page, and the next link may start right where
+       its data would have.*/
+    prev_end_offset=link.end_offset-op_link_is_empty(&link);
+    if(li==0){
+      /*We already read the first link's headers from the stream itself.
+        Make sure they agree, and keep the copies we have.*/
+      if(OP_UNLIKELY(link.offset!=links[0].offset)
+       ||OP_UNLIKELY(link.data_offset!=links[0].data_offset)
+       ||OP_UNLIKELY(link.serialno!=links[0].serialno)
+       ||OP_UNLIKELY(link.pcm_start!=links[0].pcm_start)
+       ||OP_UNLIKELY(link.head.pre_skip!=links[0].head.pre_skip)
+       ||OP_UNLIKELY(link.head.channel_count!=links[0].head.channel_count)){
+        return OP_EBADLINK;
+      }
+      links[0].pcm_end=link.pcm_end;
+      links[0].end_offset=link.end_offset;
+      links[0].pcm_file_offset=0;
+    }
+    else{
+      ret=opus_tags_parse(&link.tags,_data,len);
+      if(OP_UNLIKELY(ret<0))return ret==OP_EFAULT?ret:OP_EINVAL;
+      links[li]=*&link;
+      /*Mark the current link count so it can be cleaned up on error.*/
+      _of->nlinks=li+1;
+    }
+    _data+=len;
+    _size-=len;
+  }
+  if(OP_UNLIKELY(_size>0))return OP_EINVAL;
+  /*Now spot-check the stream itself.
+    A checked link must start with a BOS page, and end with a page with the
+     granule position we expect.
+    We check the first and last links, which pin down both ends of the table
+     (the first link's BOS page was read when we opened the stream), and a few
+     more spread evenly between them, in stream order.*/
+  prev_li=-1;
+  for(si=0;si<=OP_LINKS_NSPOT_CHECKS+1;si++){
+    ogg_page og;
+    li=(int)((opus_int64)(nlinks-1)*si/(OP_LINKS_NSPOT_CHECKS+1));
+    if(li<=prev_li)continue;
+    prev_li=li;
+    if(li>0){
+      ret=op_get_page_at(_of,&og,links[li].offset);
+      if(OP_UNLIKELY(ret<0))return ret;
+      if(OP_UNLIKELY(!ogg_page_bos(&og)))return OP_EBADLINK;
+    }
+    if(op_link_is_empty(links+li))continue;
+    ret=op_get_page_at(_of,&og,links[li].end_offset);
+    if(OP_UNLIKELY(ret<0))return ret;
+    if(OP_UNLIKELY((ogg_uint32_t)ogg_page_serialno(&og)!=links[li].serialno)
+     ||OP_UNLIKELY(ogg_page_granulepos(&og)!=links[li].pcm_end)){
+      return OP_EBADLINK;
+    }
+  }
+  /*The last page must end exactly where we thought the stream did.*/
+  if(OP_UNLIKELY(_of->offset!=end))return OP_EBADLINK;
+  _of->end=end;
+  _of->stream_size=stream_size;
+  /*We don't need these anymore (see op_bisect_forward_serialno()).*/
+  _ogg_free(_of->serialnos);
+  _of->serialnos=NULL;
+  _of->cserialnos=_of->nserialnos=0;
+  return 0;
+}
+
+static int op_open_seekable2_import(OggOpusFile *_of,
+ const unsigned char *_data,size_t _size){
+  opus_int64  end_offset;
+  ogg_int64_t pcm_end;
+  int         ret;
+  end_offset=_of->links[0].end_offset;
+  pcm_end=_of->links[0].pcm_end;
+  ret=op_open_seekable2_import_impl(_of,_data,_size);
+  if(OP_UNLIKELY(ret<0)){
+    int li;
+    /*Throw away any links we did load, so we're left in the same state as we
+       started in, and the caller can still enumerate the links normally.*/
+    for(li=1;li<_of->nlinks;li++)opus_tags_clear(&_of->links[li].tags);
+    _of->nlinks=1;
+    _of->links[0].end_offset=end_offset;
+    _of->links[0].pcm_end=pcm_end;
+    _of->end=-1;
+  }
+  return ret;
+}
+
+/*Enumerate the links of a seekable stream, or continue enumerating them after
+   a lazy open, without disturbing the current decoding state.
+  _links:      A link table from op_export_links() to load instead of scanning
+                the stream, or NULL.
+  _links_size: The size of the link table.
+  _nlinks:     Stop once this many links have been found, or INT_MAX to find
+                them all.
+  _offset:     Also stop once we find a link that starts after this offset.
+  _pcm_offset: Also stop once we find a link that starts after this PCM
+                offset.
+  Return: 0 if all the links have been found, 1 if there are more, or a
+           negative value on error.*/
+static int op_scan_links(OggOpusFile *_of,
+ const unsigned char *_links,size_t _links_size,int _nlinks,
+ opus_int64 _offset,ogg_int64_t _pcm_offset){
   ogg_sync_state    oy_start;
   ogg_stream_state  os_start;
   ogg_packet       *op_start;
+  ogg_int64_t       prev_packet_gp;
   opus_int64        prev_page_offset;
   opus_int64        start_offset;
+  opus_int64        bytes_tracked;
+  opus_int32        cur_discard_count;
+  int               ready_state;
+  int               start_op_pos;
   int               start_op_count;
   int               ret;
   /*We're partially open and have a first link header state in storage in _of.
@@ -1440,20 +2320,61 @@ static int op_open_seekable2(OggOpusFile *_of){
     This allows, e.g., the HTTP backend to continue reading from the original
      connection (if it's still available), instead of opening a new one.
     This means we can open and start playing a normal Opus file with a single
-     link and reasonable packet sizes using only two HTTP requests.*/
+     link and reasonable packet sizes using only two HTTP requests.
+    After a lazy open, this also lets us find more links in the middle of
+     playback, and carry on decoding afterwards.*/
   start_op_count=_of->op_count;
-  /*This is a bit too large to put on the stack unconditionally.*/
-  op_start=(ogg_packet *)_ogg_malloc(sizeof(*op_start)*start_op_count);
+  /*This is a bit too large to put on the stack unconditionally.
+    In the middle of playback, there may be no packets buffered at all, so
+     allocate at least one, so that failure can't be confused with a
+     zero-sized allocation.*/
+  op_start=(ogg_packet *)_ogg_malloc(sizeof(*op_start)
+   *OP_MAX(start_op_count,1));
   if(op_start==NULL)return OP_EFAULT;
   oy_start=_of->oy;
   os_start=_of->os;
+  prev_packet_gp=_of->prev_packet_gp;
   prev_page_offset=_of->prev_page_offset;
   start_offset=_of->offset;
+  bytes_tracked=_of->bytes_tracked;
+  cur_discard_count=_of->cur_discard_count;
+  ready_state=_of->ready_state;
+  start_op_pos=_of->op_pos;
   memcpy(op_start,_of->op,sizeof(*op_start)*start_op_count);
-  OP_ASSERT((*_of->callbacks.tell)(_of->stream)==op_position(_of));
+  /*Resident data is never read through the callbacks, so the stream position
+     is not kept up to date.*/
+  OP_ASSERT(_of->map_data!=NULL
+   ||(*_of->callbacks.tell)(_of->stream)==op_position(_of));
+  /*The new sync state starts out empty, so our position is just past whatever
+     the old one had buffered.
+    Otherwise op_seek_helper() might skip a seek it needs to do.*/
+  _of->offset=op_position(_of);
   ogg_sync_init(&_of->oy);
   ogg_stream_init(&_of->os,-1);
-  ret=op_open_seekable2_impl(_of);
+  /*op_fetch_headers() expects not to have a stream set up yet.*/
+  _of->ready_state=OP_OPENED;
+  if(_links!=NULL)ret=op_open_seekable2_import(_of,_links,_links_size);
+  else if(_of->enum_sr!=NULL){
+    /*Find one link at a time until we reach one of our targets.*/
+    for(;;){
+      const OggOpusLink *last_link;
+      ret=op_bisect_forward_serialno(_of,_of->enum_searched,_of->enum_sr,
+       OP_NSEEK_RECORDS,_of->enum_nsr,&_of->serialnos,&_of->nserialnos,
+       &_of->cserialnos,_of->nlinks+1);
+      if(ret<=0)break;
+      last_link=_of->links+_of->nlinks-1;
+      if(_of->nlinks>=_nlinks||last_link->offset>_offset
+       ||last_link->pcm_file_offset>_pcm_offset){
+        break;
+      }
+    }
+  }
+  else ret=op_open_seekable2_impl(_of,0,_nlinks);
+  if(ret==0){
+    /*We've found every link, so we won't need the seek records again.*/
+    _ogg_free(_of->enum_sr);
+    _of->enum_sr=NULL;
+  }
   /*Restore the old stream state.*/
   ogg_stream_clear(&_of->os);
   ogg_sync_clear(&_of->oy);
@@ -1461,15 +2382,69 @@ static int op_open_seekable2(OggOpusFile *_of){
   _of->os=os_start;
   _of->offset=start_offset;
   _of->op_count=start_op_count;
+  _of->op_pos=start_op_pos;
   memcpy(_of->op,op_start,sizeof(*_of->op)*start_op_count);
   _ogg_free(op_start);
-  _of->prev_packet_gp=_of->links[0].pcm_start;
+  _of->prev_packet_gp=prev_packet_gp;
   _of->prev_page_offset=prev_page_offset;
-  _of->cur_discard_count=_of->links[0].head.pre_skip;
-  if(OP_UNLIKELY(ret<0))return ret;
-  /*And restore the position indicator.*/
-  ret=(*_of->callbacks.seek)(_of->stream,op_position(_of),SEEK_SET);
-  return OP_UNLIKELY(ret<0)?OP_EREAD:0;
+  _of->cur_discard_count=cur_discard_count;
+  _of->bytes_tracked=bytes_tracked;
+  _of->ready_state=ready_state;
+  /*And restore the position indicator.
+    We do this even on failure, since op_test_open_links() leaves the stream
+     partially open if the link table was rejected.*/
+  _of->stats.nseeks++;
+  if(OP_UNLIKELY((*_of->callbacks.seek)(_of->stream,
+   op_position(_of),SEEK_SET)<0)&&OP_LIKELY(ret>=0)){
+    ret=OP_EREAD;
+  }
+  return ret;
+}
+
+static int op_open_seekable2(OggOpusFile *_of,
+ const unsigned char *_links,size_t _links_size,int _nlinks){
+  return op_scan_links(_of,_links,_links_size,_nlinks,
+   OP_INT64_MAX,OP_INT64_MAX);
+}
+
+/*Continue a lazy link enumeration until we have found at least _nlinks links,
+   or a link that starts after the given byte or PCM offset, or we run out of
+   links.
+  Every link except the last one found is then complete.
+  Return: 0 if all the links have been found, 1 if there are more, or a
+           negative value on error.*/
+static int op_find_links(OggOpusFile *_of,int _nlinks,
+ opus_int64 _offset,ogg_int64_t _pcm_offset){
+  const OggOpusLink *last_link;
+  int                ret;
+  if(OP_LIKELY(_of->enum_sr==NULL))return 0;
+  /*Don't keep trying if the last attempt failed.*/
+  if(OP_UNLIKELY(_of->enum_error<0))return _of->enum_error;
+  last_link=_of->links+_of->nlinks-1;
+  if(_of->nlinks>=_nlinks||last_link->offset>_offset
+   ||last_link->pcm_file_offset>_pcm_offset){
+    return 1;
+  }
+  ret=op_scan_links(_of,NULL,0,_nlinks,_offset,_pcm_offset);
+  if(OP_UNLIKELY(ret<0))_of->enum_error=ret;
+  return ret;
+}
+
+/*Discard the contents of the decode-ahead buffer.
+  The caller must ensure op_decode_ahead() is not running on another thread.*/
+static void op_decode_ahead_clear(OggOpusFile *_of){
+  _of->da_start=_of->da_nruns=0;
+  _of->da_pcm_offset_valid=0;
+  _of->da_eof=0;
+  _of->da_read_li=-1;
+}
+
+static void op_decode_ahead_lock(const OggOpusFile *_of){
+  if(_of->da_lock!=NULL)(*_of->da_lock)(_of->da_lock_ctx);
+}
+
+static void op_decode_ahead_unlock(const OggOpusFile *_of){
+  if(_of->da_unlock!=NULL)(*_of->da_unlock)(_of->da_lock_ctx);
 }
 
 /*Clear out the current logical bitstream decoder.*/
@@ -1487,9 +2462,20 @@ static void op_decode_clear(OggOpusFile *_of){
   _of->ready_state=OP_OPENED;
 }
 
+/*Drop one reference to shared links.
+  Return: The number of handles still sharing them.*/
+static int op_link_share_unref(OpusLinkShare *_share){
+  int refs;
+  if(_share->lock!=NULL)(*_share->lock)(_share->lock_ctx);
+  refs=--_share->refs;
+  if(_share->unlock!=NULL)(*_share->unlock)(_share->lock_ctx);
+  return refs;
+}
+
 static void op_clear(OggOpusFile *_of){
   OggOpusLink *links;
   _ogg_free(_of->od_buffer);
+  _ogg_free(_of->da_buffer);
   if(_of->od!=NULL)opus_multistream_decoder_destroy(_of->od);
   links=_of->links;
   if(!_of->seekable){
@@ -1497,6 +2483,10 @@ static void op_clear(OggOpusFile *_of){
       opus_tags_clear(&links[0].tags);
     }
   }
+  /*If other handles still share the links, leave them alone.*/
+  else if(_of->links_share!=NULL&&op_link_share_unref(_of->links_share)>0){
+    links=NULL;
+  }
   else if(OP_LIKELY(links!=NULL)){
     int nlinks;
     int link;
@@ -1504,7 +2494,10 @@ static void op_clear(OggOpusFile *_of){
     for(link=0;link<nlinks;link++)opus_tags_clear(&links[link].tags);
   }
   _ogg_free(links);
+  if(links!=NULL)_ogg_free(_of->links_share);
   _ogg_free(_of->serialnos);
+  _ogg_free(_of->enum_sr);
+  _ogg_free(_of->seek_points);
   ogg_stream_clear(&_of->os);
   ogg_sync_clear(&_of->oy);
   if(_of->callbacks.close!=NULL)(*_of->callbacks.close)(_of->stream);
@@ -1520,6 +2513,7 @@ static int op_open1(OggOpusFile *_of,
   memset(_of,0,sizeof(*_of));
   if(OP_UNLIKELY(_initial_bytes>(size_t)LONG_MAX))return OP_EFAULT;
   _of->end=-1;
+  _of->od_rate=_of->decode_rate=48000;
   _of->stream=_stream;
   _of->callbacks=*_cb;
   /*At a minimum, we need to be able to read data.*/
@@ -1540,6 +2534,9 @@ static int op_open1(OggOpusFile *_of,
     memcpy(buffer,_initial_data,_initial_bytes*sizeof(*buffer));
     ogg_sync_wrote(&_of->oy,(long)_initial_bytes);
   }
+  /*If the whole stream is already in memory, we can frame pages directly out
+     of it instead.*/
+  else _of->map_data=op_mem_stream_data(_cb,_stream,&_of->map_size);
   /*Can we seek?
     Stevens suggests the seek test is portable.
     It's actually not for files on win32, but we address that by fixing it in
@@ -1588,12 +2585,15 @@ static int op_open1(OggOpusFile *_of,
   return ret;
 }
 
-static int op_open2(OggOpusFile *_of){
+/*Finish opening a partially open stream.
+  _nlinks: The number of links to find before returning (see op_scan_links()),
+            or INT_MAX to find them all.*/
+static int op_open2(OggOpusFile *_of,int _nlinks){
   int ret;
   OP_ASSERT(_of->ready_state==OP_PARTOPEN);
   if(_of->seekable){
     _of->ready_state=OP_OPENED;
-    ret=op_open_seekable2(_of);
+    ret=op_open_seekable2(_of,NULL,0,_nlinks);
   }
   else ret=0;
   if(OP_LIKELY(ret>=0)){
@@ -1636,7 +2636,7 @@ OggOpusFile *op_open_callbacks(void *_stream,const OpusFileCallbacks *_cb,
   of=op_test_callbacks(_stream,_cb,_initial_data,_initial_bytes,_error);
   if(OP_LIKELY(of!=NULL)){
     int ret;
-    ret=op_open2(of);
+    ret=op_open2(of,INT_MAX);
     if(OP_LIKELY(ret>=0))return of;
     if(_error!=NULL)*_error=ret;
     _ogg_free(of);
@@ -1670,6 +2670,11 @@ OggOpusFile *op_open_memory(const unsigned char *_data,size_t _size,
    _error);
 }
 
+OggOpusFile *op_open_mmap(const char *_path,int *_error){
+  OpusFileCallbacks cb;
+  return op_open_close_on_failure(op_mmap_open(&cb,_path),&cb,_error);
+}
+
 /*Convenience routine to clean up from failure for the open functions that
    create their own streams.*/
 static OggOpusFile *op_test_close_on_failure(void *_stream,
@@ -1696,33 +2701,388 @@ OggOpusFile *op_test_memory(const unsigned char *_data,size_t _size,
    _error);
 }
 
+OggOpusFile *op_test_mmap(const char *_path,int *_error){
+  OpusFileCallbacks cb;
+  return op_test_close_on_failure(op_mmap_open(&cb,_path),&cb,_error);
+}
+
 int op_test_open(OggOpusFile *_of){
   int ret;
   if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
-  ret=op_open2(_of);
+  ret=op_open2(_of,INT_MAX);
   /*op_open2() will clear this structure on failure.
     Reset its contents to prevent double-frees in op_free().*/
   if(OP_UNLIKELY(ret<0))memset(_of,0,sizeof(*_of));
   return ret;
 }
 
-void op_free(OggOpusFile *_of){
-  if(OP_LIKELY(_of!=NULL)){
+int op_test_open_links(OggOpusFile *_of,
+ const unsigned char *_links,size_t _links_size){
+  int ret;
+  if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  ret=op_open_seekable2(_of,_links,_links_size,INT_MAX);
+  /*If the link table was no good, we're still partially open, and the caller
+     can fall back to op_test_open().*/
+  if(OP_UNLIKELY(ret<0))return ret;
+  _of->ready_state=OP_STREAMSET;
+  ret=op_make_decode_ready(_of);
+  if(OP_UNLIKELY(ret<0)){
+    /*Don't auto-close the stream on failure.*/
+    _of->callbacks.close=NULL;
     op_clear(_of);
-    _ogg_free(_of);
+    memset(_of,0,sizeof(*_of));
   }
+  return ret;
 }
 
-int op_seekable(const OggOpusFile *_of){
-  return _of->seekable;
+int op_test_open_lazy(OggOpusFile *_of){
+  int ret;
+  if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
+  /*Find the start of the second link, if there is one, so that we know where
+     the first one ends and can play it back normally.*/
+  ret=op_open2(_of,2);
+  /*op_open2() will clear this structure on failure.
+    Reset its contents to prevent double-frees in op_free().*/
+  if(OP_UNLIKELY(ret<0))memset(_of,0,sizeof(*_of));
+  return ret;
 }
 
-int op_link_count(const OggOpusFile *_of){
-  return _of->nlinks;
+int op_test_open_parallel(OggOpusFile *_of,int _nranges,
+ op_open_stream_func _open_stream,void *_open_ctx,
+ op_run_func _run,void *_run_ctx){
+  OpusRangeScan scan;
+  int           ret;
+  if(OP_UNLIKELY(_of->ready_state!=OP_PARTOPEN))return OP_EINVAL;
+  scan.open_stream=_open_stream;
+  scan.open_ctx=_open_ctx;
+  scan.run=_run;
+  scan.run_ctx=_run_ctx;
+  scan.nranges=_nranges;
+  scan.ranges=NULL;
+  _of->range_scan=&scan;
+  ret=op_open2(_of,INT_MAX);
+  /*op_open2() will clear this structure on failure.
+    Reset its contents to prevent double-frees in op_free().*/
+  if(OP_UNLIKELY(ret<0))memset(_of,0,sizeof(*_of));
+  else _of->range_scan=NULL;
+  return ret;
 }
 
-opus_uint32 op_serialno(const OggOpusFile *_of,int _li){
-  if(OP_UNLIKELY(_li>=_of->nlinks))_li=_of->nlinks-1;
+int op_enumerate_links(OggOpusFile *_of,int _li){
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  /*Link _li is complete once we've found the start of the one after it.*/
+  return op_find_links(_of,_li<0||_li>INT_MAX-2?INT_MAX:_li+2,
+   OP_INT64_MAX,OP_INT64_MAX);
+}
+
+static int op_share_links_impl(OggOpusFile *_of,op_lock_func _lock,
+ op_lock_func _unlock,void *_lock_ctx){
+  OpusLinkShare *share;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  /*The links don't change once we've found all of them, so only then can they
+     be shared.*/
+  if(OP_UNLIKELY(_of->enum_sr!=NULL))return OP_EINVAL;
+  if(OP_UNLIKELY(_of->links_share!=NULL))return OP_EINVAL;
+  share=(OpusLinkShare *)_ogg_malloc(sizeof(*share));
+  if(OP_UNLIKELY(share==NULL))return OP_EFAULT;
+  share->refs=1;
+  share->lock=_lock;
+  share->unlock=_unlock;
+  share->lock_ctx=_lock_ctx;
+  _of->links_share=share;
+  return 0;
+}
+
+int op_share_links(OggOpusFile *_of,op_lock_func _lock,op_lock_func _unlock,
+ void *_lock_ctx){
+  return op_share_links_impl(_of,_lock,_unlock,_lock_ctx);
+}
+
+/*Finish opening a handle that reads the links of another through its own
+   stream, starting at the given link.
+  The stream, callbacks, and decode rate must already be set, and the caller
+   is responsible for the lifetime of the links.*/
+static int op_open_borrowed_links(OggOpusFile *_of,const OggOpusFile *_src,
+ int _li){
+  _of->links=_src->links;
+  _of->nlinks=_src->nlinks;
+  _of->seekable=1;
+  _of->map_data=op_mem_stream_data(&_of->callbacks,_of->stream,
+   &_of->map_size);
+  _of->end=_src->end;
+  _of->stream_size=_src->stream_size;
+  _of->od_rate=48000;
+  _of->ready_state=OP_OPENED;
+  return op_raw_seek(_of,_of->links[_li].data_offset);
+}
+
+/*Add one reference to shared links.
+  Return: 0 on success, or a negative value on error.*/
+static int op_link_share_ref(OpusLinkShare *_share){
+  int ret;
+  if(_share->lock!=NULL)(*_share->lock)(_share->lock_ctx);
+  ret=OP_EFAULT;
+  if(OP_LIKELY(_share->refs<INT_MAX)){
+    _share->refs++;
+    ret=0;
+  }
+  if(_share->unlock!=NULL)(*_share->unlock)(_share->lock_ctx);
+  return ret;
+}
+
+static int op_open_shared_impl(OggOpusFile *_of,OggOpusFile *_src,
+ void *_stream,const OpusFileCallbacks *_cb){
+  int ret;
+  memset(_of,0,sizeof(*_of));
+  /*Set up enough that op_clear() can clean up after us.*/
+  ogg_sync_init(&_of->oy);
+  ogg_stream_init(&_of->os,-1);
+  if(OP_UNLIKELY(_cb->read==NULL)||OP_UNLIKELY(_cb->seek==NULL)
+   ||OP_UNLIKELY(_cb->tell==NULL)){
+    return OP_EREAD;
+  }
+  /*Once the links are shared, they were checked when sharing began, and _src
+     may be in use by another thread, so only touch the fields that can no
+     longer change.*/
+  if(_src->links_share==NULL){
+    ret=op_share_links_impl(_src,NULL,NULL,NULL);
+    if(OP_UNLIKELY(ret<0))return ret;
+  }
+  ret=op_link_share_ref(_src->links_share);
+  if(OP_UNLIKELY(ret<0))return ret;
+  _of->links_share=_src->links_share;
+  _of->stream=_stream;
+  _of->callbacks=*_cb;
+  _of->decode_rate=48000;
+  /*Start from the beginning of the audio data in the first link, just like a
+     freshly opened stream.*/
+  return op_open_borrowed_links(_of,_src,0);
+}
+
+OggOpusFile *op_open_shared(OggOpusFile *_of,
+ void *_stream,const OpusFileCallbacks *_cb,int *_error){
+  OggOpusFile *of;
+  int          ret;
+  of=(OggOpusFile *)_ogg_malloc(sizeof(*of));
+  ret=OP_EFAULT;
+  if(OP_LIKELY(of!=NULL)){
+    ret=op_open_shared_impl(of,_of,_stream,_cb);
+    if(OP_LIKELY(ret>=0)){
+      if(_error!=NULL)*_error=0;
+      return of;
+    }
+    /*Don't auto-close the stream on failure.*/
+    of->callbacks.close=NULL;
+    op_clear(of);
+    _ogg_free(of);
+  }
+  if(_error!=NULL)*_error=ret;
+  return NULL;
+}
+
+OggOpusFile *op_open_shared_file(OggOpusFile *_of,
+ const char *_path,int *_error){
+  OpusFileCallbacks  cb;
+  OggOpusFile       *of;
+  void              *stream;
+  stream=op_fopen(&cb,_path,"rb");
+  if(OP_UNLIKELY(stream==NULL)){
+    if(_error!=NULL)*_error=OP_EFAULT;
+    return NULL;
+  }
+  of=op_open_shared(_of,stream,&cb,_error);
+  if(OP_UNLIKELY(of==NULL))(*cb.close)(stream);
+  return of;
+}
+
+void op_free(OggOpusFile *_of){
+  if(OP_LIKELY(_of!=NULL)){
+    op_clear(_of);
+    _ogg_free(_of);
+  }
+}
+
+void *op_get_stream(const OggOpusFile *_of,OpusFileCallbacks *_cb){
+  if(_cb!=NULL)*_cb=_of->callbacks;
+  return _of->stream;
+}
+
+int op_set_nonblocking_flag(OggOpusFile *_of,int *_flag){
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(_flag!=NULL)*_flag=0;
+  _of->eagain_ok=_flag;
+  return 0;
+}
+
+/*Move the information about each link out of a (partially) opened
+   OggOpusFile into a newly allocated OpusProbeInfo.
+  The tags are taken, not copied, and are left empty in _of.*/
+static OpusProbeInfo *op_probe_info_create(OggOpusFile *_of){
+  OpusProbeInfo *info;
+  OpusProbeLink *links;
+  int            nlinks;
+  int            li;
+  info=(OpusProbeInfo *)_ogg_malloc(sizeof(*info));
+  if(OP_UNLIKELY(info==NULL))return NULL;
+  nlinks=_of->seekable?_of->nlinks:1;
+  links=(OpusProbeLink *)_ogg_malloc(sizeof(*links)*nlinks);
+  if(OP_UNLIKELY(links==NULL)){
+    _ogg_free(info);
+    return NULL;
+  }
+  for(li=0;li<nlinks;li++){
+    links[li].head=_of->links[li].head;
+    links[li].tags=_of->links[li].tags;
+    opus_tags_init(&_of->links[li].tags);
+    links[li].serialno=_of->links[li].serialno;
+    if(_of->seekable){
+      links[li].offset=_of->links[li].offset;
+      links[li].size=op_raw_total(_of,li);
+      links[li].pcm_total=op_pcm_total(_of,li);
+      links[li].bitrate=op_bitrate(_of,li);
+    }
+    else{
+      links[li].offset=links[li].size=links[li].pcm_total=-1;
+      links[li].bitrate=-1;
+    }
+  }
+  info->seekable=_of->seekable;
+  info->nlinks=nlinks;
+  info->links=links;
+  if(_of->seekable){
+    info->size=op_raw_total(_of,-1);
+    info->pcm_total=op_pcm_total(_of,-1);
+    info->bitrate=op_bitrate(_of,-1);
+  }
+  else{
+    info->size=info->pcm_total=-1;
+    info->bitrate=-1;
+  }
+  return info;
+}
+
+/*Read the headers and (if the stream is seekable) enumerate the links of a
+   stream, without preparing it for decoding.
+  The caller must clear _of with op_clear() afterwards, even on failure.*/
+static int op_probe_open(OggOpusFile *_of,
+ void *_stream,const OpusFileCallbacks *_cb,
+ const unsigned char *_initial_data,size_t _initial_bytes){
+  int ret;
+  ret=op_open1(_of,_stream,_cb,_initial_data,_initial_bytes);
+  /*We never take ownership of the stream.*/
+  _of->callbacks.close=NULL;
+  if(OP_LIKELY(ret>=0)&&_of->seekable){
+    /*Unlike op_open_seekable2(), we don't need to come back to the current
+       position afterwards, so just drop the buffered data.*/
+    ogg_sync_reset(&_of->oy);
+    _of->op_count=0;
+    _of->ready_state=OP_OPENED;
+    ret=op_open_seekable2_impl(_of,1,INT_MAX);
+  }
+  return ret;
+}
+
+OpusProbeInfo *op_probe_callbacks(void *_stream,const OpusFileCallbacks *_cb,
+ const unsigned char *_initial_data,size_t _initial_bytes,int *_error){
+  OggOpusFile   *of;
+  OpusProbeInfo *info;
+  int            ret;
+  info=NULL;
+  of=(OggOpusFile *)_ogg_malloc(sizeof(*of));
+  ret=OP_EFAULT;
+  if(OP_LIKELY(of!=NULL)){
+    ret=op_probe_open(of,_stream,_cb,_initial_data,_initial_bytes);
+    if(OP_LIKELY(ret>=0)){
+      info=op_probe_info_create(of);
+      if(OP_UNLIKELY(info==NULL))ret=OP_EFAULT;
+    }
+    op_clear(of);
+    _ogg_free(of);
+  }
+  if(_error!=NULL)*_error=ret;
+  return info;
+}
+
+OpusProbeInfo *op_probe_file(const char *_path,int *_error){
+  OpusFileCallbacks  cb;
+  OpusProbeInfo     *info;
+  void              *stream;
+  stream=op_fopen(&cb,_path,"rb");
+  if(OP_UNLIKELY(stream==NULL)){
+    if(_error!=NULL)*_error=OP_EFAULT;
+    return NULL;
+  }
+  info=op_probe_callbacks(stream,&cb,NULL,0,_error);
+  (*cb.close)(stream);
+  return info;
+}
+
+OpusProbeInfo *op_probe_memory(const unsigned char *_data,size_t _size,
+ int *_error){
+  OpusFileCallbacks  cb;
+  OpusProbeInfo     *info;
+  void              *stream;
+  stream=op_mem_stream_create(&cb,_data,_size);
+  if(OP_UNLIKELY(stream==NULL)){
+    if(_error!=NULL)*_error=OP_EFAULT;
+    return NULL;
+  }
+  info=op_probe_callbacks(stream,&cb,NULL,0,_error);
+  (*cb.close)(stream);
+  return info;
+}
+
+ogg_int64_t op_probe_duration_callbacks(void *_stream,
+ const OpusFileCallbacks *_cb,
+ const unsigned char *_initial_data,size_t _initial_bytes){
+  OggOpusFile *of;
+  ogg_int64_t  ret;
+  of=(OggOpusFile *)_ogg_malloc(sizeof(*of));
+  if(OP_UNLIKELY(of==NULL))return OP_EFAULT;
+  /*In the common case of a single link, this reads the headers and the last
+     page, and nothing else: op_bisect_forward_serialno() returns right away
+     when the last page belongs to the first link.
+    Only if it doesn't do we have to go looking for the other links.*/
+  ret=op_probe_open(of,_stream,_cb,_initial_data,_initial_bytes);
+  if(OP_LIKELY(ret>=0))ret=of->seekable?op_pcm_total(of,-1):OP_ENOSEEK;
+  op_clear(of);
+  _ogg_free(of);
+  return ret;
+}
+
+ogg_int64_t op_probe_duration_file(const char *_path){
+  OpusFileCallbacks  cb;
+  void              *stream;
+  ogg_int64_t        ret;
+  stream=op_fopen(&cb,_path,"rb");
+  if(OP_UNLIKELY(stream==NULL))return OP_EFAULT;
+  ret=op_probe_duration_callbacks(stream,&cb,NULL,0);
+  (*cb.close)(stream);
+  return ret;
+}
+
+void op_probe_free(OpusProbeInfo *_info){
+  if(OP_LIKELY(_info!=NULL)){
+    int li;
+    for(li=0;li<_info->nlinks;li++)opus_tags_clear(&_info->links[li].tags);
+    _ogg_free(_info->links);
+    _ogg_free(_info);
+  }
+}
+
+int op_seekable(const OggOpusFile *_of){
+  return _of->seekable;
+}
+
+int op_link_count(const OggOpusFile *_of){
+  return _of->nlinks;
+}
+
+opus_uint32 op_serialno(const OggOpusFile *_of,int _li){
+  if(OP_UNLIKELY(_li>=_of->nlinks))_li=_of->nlinks-1;
   if(!_of->seekable)_li=0;
   return _of->links[_li<0?_of->cur_link:_li].serialno;
 }
@@ -1737,7 +3097,9 @@ opus_int64 op_raw_total(const OggOpusFile *_of,int _li){
    ||OP_UNLIKELY(_li>=_of->nlinks)){
     return OP_EINVAL;
   }
+  /*We know where the stream ends even if we haven't found all its links.*/
   if(_li<0)return _of->end;
+  if(OP_UNLIKELY(!op_link_is_complete(_of,_li)))return OP_EINVAL;
   return (_li+1>=_of->nlinks?_of->end:_of->links[_li+1].offset)
    -(_li>0?_of->links[_li].offset:0);
 }
@@ -1750,7 +3112,8 @@ ogg_int64_t op_pcm_total(const OggOpusFile *_of,int _li){
   nlinks=_of->nlinks;
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
    ||OP_UNLIKELY(!_of->seekable)
-   ||OP_UNLIKELY(_li>=nlinks)){
+   ||OP_UNLIKELY(_li>=nlinks)
+   ||OP_UNLIKELY(!op_link_is_complete(_of,_li))){
     return OP_EINVAL;
   }
   links=_of->links;
@@ -1816,7 +3179,8 @@ static opus_int32 op_calc_bitrate(opus_int64 _bytes,ogg_int64_t _samples){
 
 opus_int32 op_bitrate(const OggOpusFile *_of,int _li){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED)||OP_UNLIKELY(!_of->seekable)
-   ||OP_UNLIKELY(_li>=_of->nlinks)){
+   ||OP_UNLIKELY(_li>=_of->nlinks)
+   ||OP_UNLIKELY(!op_link_is_complete(_of,_li))){
     return OP_EINVAL;
   }
   return op_calc_bitrate(op_raw_total(_of,_li),op_pcm_total(_of,_li));
@@ -1862,15 +3226,122 @@ static int op_get_link_from_serialno(const OggOpusFile *_of,int _cur_link,
   return _cur_link;
 }
 
+/*A small helper to determine if an Ogg page contains data that continues onto
+   a subsequent page.*/
+static int op_page_continues(const ogg_page *_og){
+  int nlacing;
+  OP_ASSERT(_og->header_len>=27);
+  nlacing=_og->header[26];
+  OP_ASSERT(_og->header_len>=27+nlacing);
+  /*This also correctly handles the (unlikely) case of nlacing==0, because
+     0!=255.*/
+  return _og->header[27+nlacing-1]==255;
+}
+
+/*Find the range of seek points that lie in the given link.
+  [out] _lo: Returns the index of the first seek point in the link.
+  Return: The index one past the last seek point in the link.*/
+static int op_seek_points_in_link(const OggOpusFile *_of,
+ const OggOpusLink *_link,int *_lo){
+  const OpusSeekPoint *points;
+  int                  lo;
+  int                  hi;
+  int                  mid;
+  points=_of->seek_points;
+  lo=0;
+  hi=_of->nseek_points;
+  while(lo<hi){
+    mid=lo+(hi-lo>>1);
+    if(points[mid].offset<_link->data_offset)lo=mid+1;
+    else hi=mid;
+  }
+  *_lo=lo;
+  hi=_of->nseek_points;
+  while(lo<hi){
+    mid=lo+(hi-lo>>1);
+    if(points[mid].offset<=_link->end_offset)lo=mid+1;
+    else hi=mid;
+  }
+  return lo;
+}
+
+/*Remember the location of a page with a valid granule position from the
+   given link, if it isn't too close to one we already know about.
+  Return: 0 on success (including if the page was not added), or OP_EFAULT if
+           we ran out of memory.*/
+static int op_add_seek_point(OggOpusFile *_of,const OggOpusLink *_link,
+ const ogg_page *_og,opus_int64 _page_offset){
+  OpusSeekPoint *points;
+  ogg_int64_t    gp;
+  ogg_int64_t    diff;
+  int            npoints;
+  int            lo;
+  int            hi;
+  int            pi;
+  gp=ogg_page_granulepos(_og);
+  /*Ignore anything that lies outside the range of the link (this includes
+     pages without a granule position).*/
+  if(OP_UNLIKELY(_page_offset<_link->data_offset)
+   ||OP_UNLIKELY(_page_offset>_link->end_offset)
+   ||OP_UNLIKELY(op_granpos_cmp(gp,_link->pcm_start)<=0)
+   ||OP_UNLIKELY(op_granpos_cmp(gp,_link->pcm_end)>0)){
+    return 0;
+  }
+  points=_of->seek_points;
+  hi=op_seek_points_in_link(_of,_link,&lo);
+  /*Find where this page goes.*/
+  for(pi=hi;pi>lo&&points[pi-1].offset>=_page_offset;pi--);
+  if(pi<hi&&points[pi].offset==_page_offset)return 0;
+  /*Keep the granule positions monotonic, so we can search them, and keep the
+     points spaced out, so the list doesn't grow too large.*/
+  if(pi>lo){
+    if(OP_UNLIKELY(op_granpos_diff(&diff,gp,points[pi-1].gp)<0)
+     ||diff<_of->seek_point_spacing){
+      return 0;
+    }
+  }
+  if(pi<hi){
+    if(OP_UNLIKELY(op_granpos_diff(&diff,points[pi].gp,gp)<0)
+     ||diff<_of->seek_point_spacing){
+      return 0;
+    }
+  }
+  npoints=_of->nseek_points;
+  if(npoints>=_of->cseek_points){
+    int cpoints;
+    cpoints=_of->cseek_points;
+    if(OP_UNLIKELY(cpoints>INT_MAX/(int)sizeof(*points)-1>>1)){
+      return OP_EFAULT;
+    }
+    cpoints=2*cpoints+1;
+    points=(OpusSeekPoint *)_ogg_realloc(points,sizeof(*points)*cpoints);
+    if(OP_UNLIKELY(points==NULL))return OP_EFAULT;
+    _of->seek_points=points;
+    _of->cseek_points=cpoints;
+  }
+  memmove(points+pi+1,points+pi,sizeof(*points)*(npoints-pi));
+  points[pi].offset=_page_offset;
+  points[pi].gp=gp;
+  points[pi].size=(opus_int32)(_og->header_len+_og->body_len);
+  points[pi].continued=op_page_continues(_og);
+  _of->nseek_points=npoints+1;
+  return 0;
+}
+
 /*Fetch and process a page.
   This handles the case where we're at a bitstream boundary and dumps the
    decoding machine.
   If the decoding machine is unloaded, it loads it.
   It also keeps prev_packet_gp up to date (seek and read both use this).
-  Return: <0) Error, OP_HOLE (lost packet), or OP_EOF.
+  _nonblocking: Whether or not a non-blocking stream may stop us with
+                 OP_EAGAIN while we wait for the next page.
+                This is only safe when the caller can simply call us again
+                 later, i.e., when reading, not seeking.
+  Return: <0) Error, OP_HOLE (lost packet), OP_EAGAIN, or OP_EOF.
            0) Got at least one audio data packet.*/
 static int op_fetch_and_process_page(OggOpusFile *_of,
- ogg_page *_og,opus_int64 _page_offset,int _spanp,int _ignore_holes){
+ ogg_page *_og,opus_int64 _page_offset,int _spanp,int _ignore_holes,
+ int _nonblocking){
   OggOpusLink  *links;
   ogg_uint32_t  cur_serialno;
   int           seekable;
@@ -1892,14 +3363,25 @@ static int op_fetch_and_process_page(OggOpusFile *_of,
       _og=NULL;
     }
     /*Keep reading until we get a page with the correct serialno.*/
-    else _page_offset=op_get_next_page(_of,&og,_of->end);
+    else{
+      /*Everything we've done so far would be done the same way on the next
+         call, so we can stop here if the stream isn't ready.
+        The exception is _ignore_holes, which we'd lose.
+        Waits anywhere else (e.g., in op_fetch_headers()) block as usual.*/
+      if(_of->eagain_ok!=NULL)*_of->eagain_ok=_nonblocking&&!_ignore_holes;
+      _page_offset=op_get_next_page(_of,&og,_of->end);
+      if(_of->eagain_ok!=NULL)*_of->eagain_ok=0;
+    }
     /*EOF: Leave uninitialized.*/
     if(_page_offset<0)return _page_offset<OP_FALSE?(int)_page_offset:OP_EOF;
     if(OP_LIKELY(_of->ready_state>=OP_STREAMSET)
      &&cur_serialno!=(ogg_uint32_t)ogg_page_serialno(&og)){
       /*Two possibilities:
          1) Another stream is multiplexed into this logical section, or*/
-      if(OP_LIKELY(!ogg_page_bos(&og)))continue;
+      if(OP_LIKELY(!ogg_page_bos(&og))){
+        _of->stats.pages_skipped++;
+        continue;
+      }
       /* 2) Our decoding just traversed a bitstream boundary.*/
       if(!_spanp)return OP_EOF;
       if(OP_LIKELY(_of->ready_state>=OP_INITSET))op_decode_clear(_of);
@@ -1919,6 +3401,15 @@ static int op_fetch_and_process_page(OggOpusFile *_of,
       if(seekable){
         ogg_uint32_t serialno;
         serialno=ogg_page_serialno(&og);
+        /*After a lazy open, this page might come from a link we haven't
+           found yet, or from the last one we found, whose end we don't know.
+          Find the link after it, so we can play this one back normally.*/
+        if(OP_UNLIKELY(!op_link_is_complete(_of,_of->nlinks-1))
+         &&_page_offset>=links[_of->nlinks-1].offset){
+          ret=op_find_links(_of,INT_MAX,_page_offset,OP_INT64_MAX);
+          if(OP_UNLIKELY(ret<0))return ret;
+          links=_of->links;
+        }
         /*Match the serialno to bitstream section.*/
         OP_ASSERT(cur_link>=0&&cur_link<_of->nlinks);
         if(links[cur_link].serialno!=serialno){
@@ -2155,6 +3646,10 @@ static int op_fetch_and_process_page(OggOpusFile *_of,
         _of->prev_packet_gp=prev_packet_gp;
         _of->prev_page_offset=_page_offset;
         _of->op_count=op_count=pi;
+        if(_of->seek_point_spacing>0&&seekable&&_page_offset>=0){
+          /*Failing to remember a seek point is not an error.*/
+          op_add_seek_point(_of,_of->links+_of->cur_link,&og,_page_offset);
+        }
       }
       if(report_hole)return OP_HOLE;
       /*If end-trimming didn't trim all the packets, we're done.*/
@@ -2170,17 +3665,21 @@ int op_raw_seek(OggOpusFile *_of,opus_int64 _pos){
   if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
   if(OP_UNLIKELY(_pos<0)||OP_UNLIKELY(_pos>_of->end))return OP_EINVAL;
   /*Clear out any buffered, decoded data.*/
+  op_decode_ahead_clear(_of);
   op_decode_clear(_of);
   _of->bytes_tracked=0;
   _of->samples_tracked=0;
   ret=op_seek_helper(_of,_pos);
   if(OP_UNLIKELY(ret<0))return OP_EREAD;
-  ret=op_fetch_and_process_page(_of,NULL,-1,1,1);
+  ret=op_fetch_and_process_page(_of,NULL,-1,1,1,0);
   /*If we hit EOF, op_fetch_and_process_page() leaves us uninitialized.
     Instead, jump to the end.*/
   if(ret==OP_EOF){
     int cur_link;
     op_decode_clear(_of);
+    /*We need to know where the last link ends.*/
+    ret=op_find_links(_of,INT_MAX,OP_INT64_MAX,OP_INT64_MAX);
+    if(OP_UNLIKELY(ret<0))return ret;
     cur_link=_of->nlinks-1;
     _of->cur_link=cur_link;
     _of->prev_packet_gp=_of->links[cur_link].pcm_end;
@@ -2233,18 +3732,6 @@ static ogg_int64_t op_get_granulepos(const OggOpusFile *_of,
   return pcm_start;
 }
 
-/*A small helper to determine if an Ogg page contains data that continues onto
-   a subsequent page.*/
-static int op_page_continues(const ogg_page *_og){
-  int nlacing;
-  OP_ASSERT(_og->header_len>=27);
-  nlacing=_og->header[26];
-  OP_ASSERT(_og->header_len>=27+nlacing);
-  /*This also correctly handles the (unlikely) case of nlacing==0, because
-     0!=255.*/
-  return _og->header[27+nlacing-1]==255;
-}
-
 /*A small helper to buffer the continued packet data from a page.*/
 static void op_buffer_continued_data(OggOpusFile *_of,ogg_page *_og){
   ogg_packet op;
@@ -2408,6 +3895,43 @@ static int op_pcm_seek_page(OggOpusFile *_of,
       }
     }
 #endif
+    /*If we've seen pages close to the target before, use them to narrow the
+       range even further.*/
+    if(_of->nseek_points>0){
+      const OpusSeekPoint *points;
+      int                  lo;
+      int                  hi;
+      int                  mid;
+      points=_of->seek_points;
+      hi=op_seek_points_in_link(_of,link,&lo);
+      /*Find the first page that ends at or after our target.*/
+      while(lo<hi){
+        mid=lo+(hi-lo>>1);
+        if(op_granpos_cmp(points[mid].gp,_target_gp)<0)lo=mid+1;
+        else hi=mid;
+      }
+      if(lo<hi&&points[lo].offset<end
+       &&OP_LIKELY(op_granpos_cmp(points[lo].gp,pcm_start)>0)){
+        end=boundary=points[lo].offset;
+        pcm_end=points[lo].gp;
+      }
+      /*And the last page that ends before it.*/
+      if(lo-->0&&points[lo].offset>=link->data_offset){
+        opus_int64 offset;
+        offset=points[lo].offset+points[lo].size;
+        if(offset>begin&&offset<=end
+         &&OP_LIKELY(op_granpos_cmp(points[lo].gp,pcm_end)<0)){
+          best=begin=offset;
+          best_gp=pcm_start=points[lo].gp;
+          /*As above, if there's a continued packet, we'll need to start from
+             the beginning of the page to prime the stream with its data.*/
+          best_start=points[lo].continued?points[lo].offset:offset;
+          /*Any data from a continued packet we buffered from the current
+             position is no longer useful.*/
+          buffering=0;
+        }
+      }
+    }
   }
   /*This code was originally based on the "new search algorithm by HB (Nicholas
      Vinen)" from libvorbisfile.
@@ -2423,6 +3947,7 @@ static int op_pcm_seek_page(OggOpusFile *_of,
     opus_int64 bisect;
     opus_int64 next_boundary;
     opus_int32 chunk_size;
+    _of->stats.seek_bisections++;
     if(end-begin<OP_CHUNK_SIZE)bisect=begin;
     else{
       /*Update the interval size history.*/
@@ -2595,7 +4120,7 @@ static int op_pcm_seek_page(OggOpusFile *_of,
   /*Update prev_packet_gp to allow per-packet granule position assignment.*/
   _of->prev_packet_gp=best_gp;
   _of->prev_page_offset=best_start;
-  ret=op_fetch_and_process_page(_of,page_offset<0?NULL:&og,page_offset,0,1);
+  ret=op_fetch_and_process_page(_of,page_offset<0?NULL:&og,page_offset,0,1,0);
   if(OP_UNLIKELY(ret<0))return OP_EBADLINK;
   /*Verify result.*/
   if(OP_UNLIKELY(op_granpos_cmp(_of->prev_packet_gp,_target_gp)>0)){
@@ -2619,8 +4144,12 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
   if(OP_UNLIKELY(_pcm_offset<0))return OP_EINVAL;
+  /*Make sure we've found the link containing the target.*/
+  ret=op_find_links(_of,INT_MAX,OP_INT64_MAX,_pcm_offset);
+  if(OP_UNLIKELY(ret<0))return ret;
   target_gp=op_get_granulepos(_of,_pcm_offset,&li);
   if(OP_UNLIKELY(target_gp==-1))return OP_EINVAL;
+  op_decode_ahead_clear(_of);
   link=_of->links+li;
   pcm_start=link->pcm_start;
   OP_ALWAYS_TRUE(!op_granpos_diff(&_pcm_offset,target_gp,pcm_start));
@@ -2634,7 +4163,8 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
     if(OP_LIKELY(gp!=-1)){
       ogg_int64_t discard_count;
       int         nbuffered;
-      nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
+      nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0)
+       *(48000/_of->od_rate);
       OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
       /*We do _not_ add cur_discard_count to gp.
         Otherwise the total amount to discard could grow without bound, and it
@@ -2677,7 +4207,7 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
     if(op_pos<op_count)break;
     /*We skipped all the packets on this page.
       Fetch another.*/
-    ret=op_fetch_and_process_page(_of,NULL,-1,0,1);
+    ret=op_fetch_and_process_page(_of,NULL,-1,0,1,0);
     if(OP_UNLIKELY(ret<0))return OP_EBADLINK;
   }
   /*We skipped too far, or couldn't get within 2 billion samples of the target.
@@ -2694,6 +4224,215 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
   return 0;
 }
 
+void op_set_seek_index_enabled(OggOpusFile *_of,int _enabled){
+  if(_enabled){
+    if(_of->seek_point_spacing<=0)_of->seek_point_spacing=OP_GP_SPACING_MIN;
+  }
+  else{
+    _ogg_free(_of->seek_points);
+    _of->seek_points=NULL;
+    _of->nseek_points=_of->cseek_points=0;
+    _of->seek_point_spacing=0;
+  }
+}
+
+int op_build_seek_index(OggOpusFile *_of,opus_int32 _granularity_ms){
+  const OggOpusLink *links;
+  ogg_page           og;
+  opus_int64         offset;
+  int                nlinks;
+  int                li;
+  int                ret;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  if(OP_UNLIKELY(_granularity_ms<0)
+   ||OP_UNLIKELY(_granularity_ms>OP_INT32_MAX/48)){
+    return OP_EINVAL;
+  }
+  /*Start over, so that the old points don't keep us from adding new ones at
+     the requested spacing.*/
+  _of->nseek_points=0;
+  /*Pages can't share a granule position in the index, so a spacing of 1 is
+     the same as keeping every page.*/
+  _of->seek_point_spacing=OP_MAX(_granularity_ms*48,1);
+  /*Index every link, even if we haven't gotten to them yet.*/
+  ret=op_find_links(_of,INT_MAX,OP_INT64_MAX,OP_INT64_MAX);
+  if(OP_UNLIKELY(ret<0))return ret;
+  /*Remember where we were, so that we can continue decoding from there.
+    Walking the pages only disturbs the sync state, which we can rebuild by
+     reading from the same offset again.*/
+  offset=_of->offset;
+  links=_of->links;
+  nlinks=_of->nlinks;
+  ret=0;
+  for(li=0;li<nlinks;li++){
+    opus_int64 boundary;
+    if(op_link_is_empty(links+li))continue;
+    ret=op_seek_helper(_of,links[li].data_offset);
+    if(OP_UNLIKELY(ret<0))break;
+    boundary=OP_ADV_OFFSET(links[li].end_offset,OP_PAGE_SIZE_MAX);
+    for(;;){
+      opus_int64 page_offset;
+      page_offset=op_get_next_page(_of,&og,boundary);
+      if(OP_UNLIKELY(page_offset<0)){
+        ret=page_offset<OP_FALSE?(int)page_offset:OP_EBADLINK;
+        break;
+      }
+      if((ogg_uint32_t)ogg_page_serialno(&og)==links[li].serialno){
+        ret=op_add_seek_point(_of,links+li,&og,page_offset);
+        if(OP_UNLIKELY(ret<0))break;
+      }
+      if(page_offset>=links[li].end_offset)break;
+    }
+    if(OP_UNLIKELY(ret<0))break;
+  }
+  /*Whatever points we did manage to find are still valid, so keep them even
+     if we failed.*/
+  if(OP_UNLIKELY(op_seek_helper(_of,offset)<0))ret=OP_EREAD;
+  return ret;
+}
+
+/*The seek index format written by op_export_seek_index().
+  All integers are little-endian.
+  Header:
+     8 bytes: "OpusSeek"
+     1 byte:  The format version (OP_SEEK_INDEX_VERSION).
+     8 bytes: The total size of the stream, used to detect stale indices.
+     4 bytes: The number of seek points.
+  Each seek point, in order of increasing offset:
+     8 bytes: The offset of the page.
+     8 bytes: The granule position of the page.
+     4 bytes: The size of the page, including the header.
+     1 byte:  1 if the last packet on the page continues onto the next page,
+               or 0 otherwise.
+  Trailer:
+     4 bytes: The Adler-32 checksum of everything that precedes it.*/
+#define OP_SEEK_INDEX_VERSION     (1)
+#define OP_SEEK_INDEX_HEADER_SIZE (21)
+#define OP_SEEK_INDEX_RECORD_SIZE (21)
+
+opus_int64 op_export_seek_index(const OggOpusFile *_of,
+ unsigned char *_data,size_t _size){
+  const OpusSeekPoint *points;
+  opus_int64           total_size;
+  int                  npoints;
+  int                  pi;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
+   ||OP_UNLIKELY(!_of->seekable)){
+    return OP_EINVAL;
+  }
+  points=_of->seek_points;
+  npoints=_of->nseek_points;
+  total_size=OP_SEEK_INDEX_HEADER_SIZE
+   +OP_SEEK_INDEX_RECORD_SIZE*(opus_int64)npoints+4;
+  if(_data!=NULL&&(opus_int64)_size>=total_size){
+    unsigned char *start;
+    start=_data;
+    memcpy(_data,"OpusSeek",8);
+    _data[8]=OP_SEEK_INDEX_VERSION;
+    _data=op_put_int64le(_data+9,_of->stream_size);
+    _data=op_put_uint32le(_data,(opus_uint32)npoints);
+    for(pi=0;pi<npoints;pi++){
+      _data=op_put_int64le(_data,points[pi].offset);
+      _data=op_put_int64le(_data,points[pi].gp);
+      _data=op_put_uint32le(_data,(opus_uint32)points[pi].size);
+      *_data++=(unsigned char)points[pi].continued;
+    }
+    op_put_uint32le(_data,op_adler32(start,_data-start));
+  }
+  return total_size;
+}
+
+int op_import_seek_index(OggOpusFile *_of,
+ const unsigned char *_data,size_t _size){
+  const OggOpusLink *links;
+  OpusSeekPoint     *points;
+  opus_int64         prev_end;
+  ogg_int64_t        prev_gp;
+  opus_uint32        npoints;
+  int                nlinks;
+  int                li;
+  int                pi;
+  int                ret;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED)
+   ||OP_UNLIKELY(!_of->seekable)){
+    return OP_EINVAL;
+  }
+  /*We need the whole link table to validate the index against.*/
+  ret=op_find_links(_of,INT_MAX,OP_INT64_MAX,OP_INT64_MAX);
+  if(OP_UNLIKELY(ret<0))return ret;
+  if(OP_UNLIKELY(_size<OP_SEEK_INDEX_HEADER_SIZE+4)
+   ||OP_UNLIKELY(memcmp(_data,"OpusSeek",8)!=0)){
+    return OP_ENOTFORMAT;
+  }
+  if(OP_UNLIKELY(_data[8]!=OP_SEEK_INDEX_VERSION))return OP_EVERSION;
+  if(OP_UNLIKELY(op_get_uint32le(_data+_size-4)
+   !=op_adler32(_data,_size-4))){
+    return OP_EBADHEADER;
+  }
+  if(OP_UNLIKELY(op_get_int64le(_data+9)!=_of->stream_size))return OP_EINVAL;
+  npoints=op_get_uint32le(_data+17);
+  if(OP_UNLIKELY(npoints>(_size-OP_SEEK_INDEX_HEADER_SIZE-4)
+   /OP_SEEK_INDEX_RECORD_SIZE)
+   ||OP_UNLIKELY(npoints>(opus_uint32)(INT_MAX/(int)sizeof(*points)))){
+    return OP_EBADHEADER;
+  }
+  if(OP_UNLIKELY(_size!=OP_SEEK_INDEX_HEADER_SIZE
+   +OP_SEEK_INDEX_RECORD_SIZE*(size_t)npoints+4)){
+    return OP_EBADHEADER;
+  }
+  points=(OpusSeekPoint *)_ogg_malloc(sizeof(*points)*(npoints+1));
+  if(OP_UNLIKELY(points==NULL))return OP_EFAULT;
+  /*Verify that every point lies within the data of some link, in order, and
+     with a granule position that could have come from that link.*/
+  links=_of->links;
+  nlinks=_of->nlinks;
+  _data+=OP_SEEK_INDEX_HEADER_SIZE;
+  prev_end=0;
+  prev_gp=-1;
+  li=0;
+  for(pi=0;pi<(int)npoints;pi++){
+    opus_int64  offset;
+    ogg_int64_t gp;
+    opus_uint32 size;
+    offset=op_get_int64le(_data);
+    gp=op_get_int64le(_data+8);
+    size=op_get_uint32le(_data+16);
+    if(OP_UNLIKELY(offset<prev_end)
+     ||OP_UNLIKELY(size<27)||OP_UNLIKELY(size>OP_PAGE_SIZE_MAX)
+     ||OP_UNLIKELY(_data[20]>1)){
+      break;
+    }
+    while(li<nlinks&&offset>links[li].end_offset){
+      li++;
+      prev_gp=-1;
+    }
+    if(OP_UNLIKELY(li>=nlinks)||OP_UNLIKELY(offset<links[li].data_offset)
+     ||OP_UNLIKELY(offset+size>_of->end)
+     ||OP_UNLIKELY(op_granpos_cmp(gp,links[li].pcm_start)<=0)
+     ||OP_UNLIKELY(op_granpos_cmp(gp,links[li].pcm_end)>0)
+     ||OP_UNLIKELY(prev_gp!=-1&&op_granpos_cmp(gp,prev_gp)<=0)){
+      break;
+    }
+    points[pi].offset=offset;
+    points[pi].gp=gp;
+    points[pi].size=(opus_int32)size;
+    points[pi].continued=_data[20];
+    prev_end=offset+size;
+    prev_gp=gp;
+    _data+=OP_SEEK_INDEX_RECORD_SIZE;
+  }
+  if(OP_UNLIKELY(pi<(int)npoints)){
+    _ogg_free(points);
+    return OP_EBADHEADER;
+  }
+  _ogg_free(_of->seek_points);
+  _of->seek_points=points;
+  _of->nseek_points=(int)npoints;
+  _of->cseek_points=(int)npoints+1;
+  return 0;
+}
+
 opus_int64 op_raw_tell(const OggOpusFile *_of){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   return _of->offset;
@@ -2730,14 +4469,16 @@ static ogg_int64_t op_get_pcm_offset(const OggOpusFile *_of,
   return pcm_offset;
 }
 
-ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
+/*Compute the PCM offset of the next sample from the state of the decoder,
+   ignoring anything in the decode-ahead buffer.*/
+static ogg_int64_t op_decoder_pcm_tell(const OggOpusFile *_of){
   ogg_int64_t gp;
   int         nbuffered;
   int         li;
-  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   gp=_of->prev_packet_gp;
   if(gp==-1)return 0;
-  nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
+  nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0)
+   *(48000/_of->od_rate);
   OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
   li=_of->seekable?_of->cur_link:0;
   if(op_granpos_add(&gp,gp,_of->cur_discard_count)<0){
@@ -2746,6 +4487,38 @@ ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
   return op_get_pcm_offset(_of,gp,li);
 }
 
+ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
+  ogg_int64_t pcm_offset;
+  /*Decoding ahead can only be enabled on an open stream, so we don't need to
+     look at ready_state, which op_decode_ahead() might be changing.*/
+  if(_of->da_depth>0){
+    /*Samples we've decoded ahead come first, and might be from an earlier
+       link.
+      Once op_decode_ahead() has started, it owns the decoder state, so we
+       only look at that if it hasn't (and hold the lock so it can't).*/
+    op_decode_ahead_lock(_of);
+    if(_of->da_nruns>0)pcm_offset=_of->da_runs[_of->da_start].pcm_offset;
+    else if(_of->da_pcm_offset_valid)pcm_offset=_of->da_pcm_offset;
+    else pcm_offset=op_decoder_pcm_tell(_of);
+    op_decode_ahead_unlock(_of);
+    return pcm_offset;
+  }
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  return op_decoder_pcm_tell(_of);
+}
+
+void op_get_stats(const OggOpusFile *_of,OpusFileStats *_stats){
+  *_stats=_of->stats;
+}
+
+void op_reset_stats(OggOpusFile *_of){
+  memset(&_of->stats,0,sizeof(_of->stats));
+}
+
+void op_set_decode_timing_enabled(OggOpusFile *_of,int _enabled){
+  _of->decode_timing=!!_enabled;
+}
+
 void op_set_decode_callback(OggOpusFile *_of,
  op_decode_cb_func _decode_cb,void *_ctx){
   _of->decode_cb=_decode_cb;
@@ -2767,6 +4540,34 @@ int op_set_gain_offset(OggOpusFile *_of,
   return 0;
 }
 
+int op_set_decode_rate(OggOpusFile *_of,opus_int32 _rate){
+  if(_rate!=8000&&_rate!=12000&&_rate!=16000&&_rate!=24000&&_rate!=48000){
+    return OP_EINVAL;
+  }
+  if(_rate==_of->decode_rate)return 0;
+  _of->decode_rate=_rate;
+  /*If the decoder isn't ready yet, it will pick up the new rate when it is.*/
+  if(_of->ready_state<OP_INITSET)return 0;
+  if(_of->seekable){
+    ogg_int64_t pcm_offset;
+    /*Seek back to where we are, so that we get a new decoder at the new rate
+       with the proper amount of pre-roll, and no samples buffered at the old
+       one.
+      Dropping back to OP_STREAMSET keeps op_pcm_seek() from taking the
+       shortcut that would keep the current decoder.*/
+    pcm_offset=op_pcm_tell(_of);
+    _of->ready_state=OP_STREAMSET;
+    return op_pcm_seek(_of,pcm_offset);
+  }
+  /*We can't go back to prime a new decoder, so just start a new one from the
+     next packet, as if there were a hole in the data.
+    Samples we've already decoded at the old rate are lost.*/
+  op_decode_ahead_clear(_of);
+  _of->od_buffer_pos=_of->od_buffer_size=0;
+  _of->ready_state=OP_STREAMSET;
+  return op_make_decode_ready(_of);
+}
+
 void op_set_dither_enabled(OggOpusFile *_of,int _enabled){
 #if !defined(OP_FIXED_POINT)
   _of->dither_disabled=!_enabled;
@@ -2774,10 +4575,8 @@ void op_set_dither_enabled(OggOpusFile *_of,int _enabled){
 #endif
 }
 
-/*Allocate the decoder scratch buffer.
-  This is done lazily, since if the user provides large enough buffers, we'll
-   never need it.*/
-static int op_init_buffer(OggOpusFile *_of){
+/*Get the largest channel count of any link we might decode.*/
+static int op_get_nchannels_max(const OggOpusFile *_of){
   int nchannels_max;
   if(_of->seekable){
     const OggOpusLink *links;
@@ -2791,16 +4590,42 @@ static int op_init_buffer(OggOpusFile *_of){
     }
   }
   else nchannels_max=OP_NCHANNELS_MAX;
+  return nchannels_max;
+}
+
+/*Allocate the decoder scratch buffer.
+  This is done lazily, since if the user provides large enough buffers, we'll
+   never need it.*/
+static int op_init_buffer(OggOpusFile *_of){
   _of->od_buffer=(op_sample *)_ogg_malloc(
-   sizeof(*_of->od_buffer)*nchannels_max*120*48);
+   sizeof(*_of->od_buffer)*op_get_nchannels_max(_of)*120*48);
   if(_of->od_buffer==NULL)return OP_EFAULT;
   return 0;
 }
 
+/*Get the processor time used so far, in microseconds, for timing the decoder.
+  We prefer the time used by the calling thread, so that other threads decoding
+   at the same time don't count against this one, and fall back to the time
+   used by the whole process.
+  Either way this is processor time, never wall time, so time spent blocked
+   (e.g., in a decode callback waiting on a lock) is not counted.*/
+static opus_int64 op_decode_time_get(void){
+#if defined(OP_HAVE_CLOCK_GETTIME)&&defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec now;
+  if(OP_LIKELY(!clock_gettime(CLOCK_THREAD_CPUTIME_ID,&now))){
+    return now.tv_sec*(opus_int64)1000000+now.tv_nsec/1000;
+  }
+#endif
+  return (opus_int64)clock()*1000000/CLOCKS_PER_SEC;
+}
+
 /*Decode a single packet into the target buffer.*/
 static int op_decode(OggOpusFile *_of,op_sample *_pcm,
  const ogg_packet *_op,int _nsamples,int _nchannels){
-  int ret;
+  opus_int64 start;
+  int        ret;
+  start=_of->decode_timing?op_decode_time_get():0;
+  _of->stats.packets_decoded++;
   /*First we try using the application-provided decode callback.*/
   if(_of->decode_cb!=NULL){
 #if defined(OP_FIXED_POINT)
@@ -2825,14 +4650,40 @@ static int op_decode(OggOpusFile *_of,op_sample *_pcm,
   }
   /*If the application returned a positive value other than 0 or
      OP_DEC_USE_DEFAULT, fail.*/
-  else if(OP_UNLIKELY(ret>0))return OP_EBADPACKET;
+  else if(OP_UNLIKELY(ret>0))ret=OP_EBADPACKET;
+  if(_of->decode_timing){
+    _of->stats.decode_time_us+=op_decode_time_get()-start;
+  }
   if(OP_UNLIKELY(ret<0))return OP_EBADPACKET;
   return ret;
 }
 
-/*Read more samples from the stream, using the same API as op_read() or
-   op_read_float().*/
-static int op_read_native(OggOpusFile *_of,
+/*Perform end-trimming on the next buffered packet, and advance the current
+   granule position past it.
+  Return: The number of samples in the packet that remain after trimming.*/
+static int op_trim_packet(OggOpusFile *_of,const ogg_packet *_op,
+ int _duration){
+  ogg_int64_t diff;
+  int         trimmed_duration;
+  /*We don't buffer packets with an invalid TOC sequence.*/
+  OP_ASSERT(_duration>0);
+  trimmed_duration=_duration;
+  if(OP_UNLIKELY(_op->e_o_s)){
+    if(OP_UNLIKELY(op_granpos_cmp(_op->granulepos,_of->prev_packet_gp)<=0)){
+      trimmed_duration=0;
+    }
+    else if(OP_LIKELY(!op_granpos_diff(&diff,
+     _op->granulepos,_of->prev_packet_gp))){
+      trimmed_duration=(int)OP_MIN(diff,trimmed_duration);
+    }
+  }
+  _of->prev_packet_gp=_op->granulepos;
+  return trimmed_duration;
+}
+
+/*Decode more samples from the stream, using the same API as op_read() or
+   op_read_float(), but ignoring anything in the decode-ahead buffer.*/
+static int op_decode_native(OggOpusFile *_of,
  op_sample *_pcm,int _buf_size,int *_li){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   for(;;){
@@ -2866,30 +4717,19 @@ static int op_read_native(OggOpusFile *_of,
       op_pos=_of->op_pos;
       if(OP_LIKELY(op_pos<_of->op_count)){
         const ogg_packet *pop;
-        ogg_int64_t       diff;
         opus_int32        cur_discard_count;
         int               duration;
         int               trimmed_duration;
+        int               rate_div;
         pop=_of->op+op_pos++;
         _of->op_pos=op_pos;
         cur_discard_count=_of->cur_discard_count;
         duration=op_get_packet_duration(pop->packet,pop->bytes);
-        /*We don't buffer packets with an invalid TOC sequence.*/
-        OP_ASSERT(duration>0);
-        trimmed_duration=duration;
-        /*Perform end-trimming.*/
-        if(OP_UNLIKELY(pop->e_o_s)){
-          if(OP_UNLIKELY(op_granpos_cmp(pop->granulepos,
-           _of->prev_packet_gp)<=0)){
-            trimmed_duration=0;
-          }
-          else if(OP_LIKELY(!op_granpos_diff(&diff,
-           pop->granulepos,_of->prev_packet_gp))){
-            trimmed_duration=(int)OP_MIN(diff,trimmed_duration);
-          }
-        }
-        _of->prev_packet_gp=pop->granulepos;
-        if(OP_UNLIKELY(duration*nchannels>_buf_size)){
+        trimmed_duration=op_trim_packet(_of,pop,duration);
+        /*Packet durations are always a multiple of 2.5 ms, so this divides
+           them evenly at every rate the decoder supports.*/
+        rate_div=48000/_of->od_rate;
+        if(OP_UNLIKELY(duration/rate_div*nchannels>_buf_size)){
           op_sample *buf;
           /*If the user's buffer is too small, decode into a scratch buffer.*/
           buf=_of->od_buffer;
@@ -2898,39 +4738,45 @@ static int op_read_native(OggOpusFile *_of,
             if(OP_UNLIKELY(ret<0))return ret;
             buf=_of->od_buffer;
           }
-          ret=op_decode(_of,buf,pop,duration,nchannels);
+          ret=op_decode(_of,buf,pop,duration/rate_div,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
           /*Perform pre-skip/pre-roll.*/
           od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
           cur_discard_count-=od_buffer_pos;
           _of->cur_discard_count=cur_discard_count;
-          _of->od_buffer_pos=od_buffer_pos;
-          _of->od_buffer_size=trimmed_duration;
+          _of->stats.samples_discarded+=od_buffer_pos;
           /*Update bitrate tracking based on the actual samples we used from
              what was decoded.*/
           _of->bytes_tracked+=pop->bytes;
           _of->samples_tracked+=trimmed_duration-od_buffer_pos;
+          /*At reduced rates, keep each decoded sample that starts inside the
+             part of the packet that survives trimming.*/
+          _of->od_buffer_pos=(od_buffer_pos+rate_div-1)/rate_div;
+          _of->od_buffer_size=(trimmed_duration+rate_div-1)/rate_div;
         }
         else{
           OP_ASSERT(_pcm!=NULL);
           /*Otherwise decode directly into the user's buffer.*/
-          ret=op_decode(_of,_pcm,pop,duration,nchannels);
+          ret=op_decode(_of,_pcm,pop,duration/rate_div,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
           if(OP_LIKELY(trimmed_duration>0)){
             /*Perform pre-skip/pre-roll.*/
             od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
             cur_discard_count-=od_buffer_pos;
             _of->cur_discard_count=cur_discard_count;
-            trimmed_duration-=od_buffer_pos;
+            _of->stats.samples_discarded+=od_buffer_pos;
+            /*Update bitrate tracking based on the actual samples we used from
+               what was decoded.*/
+            _of->bytes_tracked+=pop->bytes;
+            _of->samples_tracked+=trimmed_duration-od_buffer_pos;
+            od_buffer_pos=(od_buffer_pos+rate_div-1)/rate_div;
+            trimmed_duration=(trimmed_duration+rate_div-1)/rate_div
+             -od_buffer_pos;
             if(OP_LIKELY(trimmed_duration>0)
              &&OP_UNLIKELY(od_buffer_pos>0)){
               memmove(_pcm,_pcm+od_buffer_pos*nchannels,
                sizeof(*_pcm)*trimmed_duration*nchannels);
             }
-            /*Update bitrate tracking based on the actual samples we used from
-               what was decoded.*/
-            _of->bytes_tracked+=pop->bytes;
-            _of->samples_tracked+=trimmed_duration;
             if(OP_LIKELY(trimmed_duration>0)){
               if(_li!=NULL)*_li=_of->cur_link;
               return trimmed_duration;
@@ -2943,7 +4789,135 @@ static int op_read_native(OggOpusFile *_of,
       }
     }
     /*Suck in another page.*/
-    ret=op_fetch_and_process_page(_of,NULL,-1,1,0);
+    ret=op_fetch_and_process_page(_of,NULL,-1,1,0,1);
+    if(OP_UNLIKELY(ret==OP_EOF)){
+      if(_li!=NULL)*_li=_of->cur_link;
+      return 0;
+    }
+    if(OP_UNLIKELY(ret<0))return ret;
+  }
+}
+
+/*Find the run of samples the read functions should return next from the
+   decode-ahead buffer.
+  Return: 1 if there is one, and *_run has been filled in.
+          0 if the buffer is empty, and the caller should decode more samples
+           itself.
+          OP_EAGAIN or OP_EOF if the buffer is empty, but op_decode_ahead() is
+           filling it on another thread (and has not reached the end of the
+           stream, or has).
+          In this case, only _run->li has been filled in.*/
+static int op_decode_ahead_peek(OggOpusFile *_of,OpusAheadRun *_run){
+  int ret;
+  op_decode_ahead_lock(_of);
+  if(OP_LIKELY(_of->da_nruns>0)){
+    *_run=_of->da_runs[_of->da_start];
+    ret=1;
+  }
+  else if(_of->da_lock!=NULL){
+    /*We can't touch the decoder while op_decode_ahead() might be using it.*/
+    _run->li=OP_MAX(_of->da_read_li,0);
+    ret=_of->da_eof?OP_EOF:OP_EAGAIN;
+  }
+  else{
+    /*We're about to decode past whatever we returned last.*/
+    _of->da_pcm_offset_valid=0;
+    ret=0;
+  }
+  op_decode_ahead_unlock(_of);
+  /*The output filters start over at each new link.*/
+  if(ret>0&&_run->li!=_of->da_read_li){
+    op_reset_filter_state(_of,_run->serialno);
+    _of->da_read_li=_run->li;
+  }
+  return ret;
+}
+
+/*Consume samples from the first run in the decode-ahead buffer.*/
+static void op_decode_ahead_consume(OggOpusFile *_of,int _nsamples){
+  OpusAheadRun *run;
+  op_decode_ahead_lock(_of);
+  run=_of->da_runs+_of->da_start;
+  run->off+=_nsamples*run->nchannels;
+  run->nsamples-=_nsamples;
+  run->pcm_offset+=_nsamples*run->rate_div;
+  _of->da_pcm_offset=run->pcm_offset;
+  _of->da_pcm_offset_valid=1;
+  if(run->nsamples<=0){
+    _of->da_start=(_of->da_start+1)%OP_AHEAD_NRUNS_MAX;
+    _of->da_nruns--;
+  }
+  op_decode_ahead_unlock(_of);
+}
+
+/*Read more samples from the stream, using the same API as op_read() or
+   op_read_float().*/
+static int op_read_native(OggOpusFile *_of,
+ op_sample *_pcm,int _buf_size,int *_li){
+  OpusAheadRun run;
+  int          nsamples;
+  int          ret;
+  ret=_of->da_depth>0?op_decode_ahead_peek(_of,&run):0;
+  if(OP_LIKELY(ret==0)){
+    ret=op_decode_native(_of,_pcm,_buf_size,_li);
+    _of->da_read_li=_of->cur_link;
+    return ret;
+  }
+  if(ret<0){
+    if(_li!=NULL)*_li=run.li;
+    return ret==OP_EOF?0:ret;
+  }
+  /*Return samples we've already decoded ahead first.
+    op_decode_ahead() won't touch them until we've consumed them, so we can
+     copy them out without holding the lock.*/
+  nsamples=run.nsamples;
+  if(nsamples*run.nchannels>_buf_size)nsamples=_buf_size/run.nchannels;
+  if(OP_LIKELY(nsamples>0)){
+    memcpy(_pcm,_of->da_buffer+run.off,
+     sizeof(*_pcm)*run.nchannels*nsamples);
+    op_decode_ahead_consume(_of,nsamples);
+  }
+  if(_li!=NULL)*_li=run.li;
+  return nsamples;
+}
+
+int op_read_packet(OggOpusFile *_of,ogg_packet *_op,
+ opus_int32 *_skip,opus_int32 *_trim,int *_li){
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  for(;;){
+    int ret;
+    if(OP_LIKELY(_of->ready_state>=OP_INITSET)){
+      int op_pos;
+      /*Any samples still buffered came from packets we've already consumed,
+         and can't be returned as packets.*/
+      _of->od_buffer_pos=_of->od_buffer_size=0;
+      op_decode_ahead_clear(_of);
+      op_pos=_of->op_pos;
+      if(OP_LIKELY(op_pos<_of->op_count)){
+        const ogg_packet *pop;
+        opus_int32        cur_discard_count;
+        int               duration;
+        int               trimmed_duration;
+        int               skip;
+        pop=_of->op+op_pos++;
+        _of->op_pos=op_pos;
+        duration=op_get_packet_duration(pop->packet,pop->bytes);
+        trimmed_duration=op_trim_packet(_of,pop,duration);
+        /*Account for pre-skip/pre-roll exactly as if we had decoded it.*/
+        cur_discard_count=_of->cur_discard_count;
+        skip=(int)OP_MIN(trimmed_duration,cur_discard_count);
+        _of->cur_discard_count=cur_discard_count-skip;
+        _of->bytes_tracked+=pop->bytes;
+        _of->samples_tracked+=trimmed_duration-skip;
+        *_op=*pop;
+        if(_skip!=NULL)*_skip=skip;
+        if(_trim!=NULL)*_trim=duration-trimmed_duration;
+        if(_li!=NULL)*_li=_of->cur_link;
+        return duration;
+      }
+    }
+    /*Suck in another page.*/
+    ret=op_fetch_and_process_page(_of,NULL,-1,1,0,1);
     if(OP_UNLIKELY(ret==OP_EOF)){
       if(_li!=NULL)*_li=_of->cur_link;
       return 0;
@@ -2963,8 +4937,27 @@ typedef int (*op_read_filter_func)(OggOpusFile *_of,void *_dst,int _dst_sz,
 static int op_filter_read_native(OggOpusFile *_of,void *_dst,int _dst_sz,
  op_read_filter_func _filter,int *_li){
   int ret;
+  /*Filter samples we've already decoded ahead first.*/
+  if(_of->da_depth>0){
+    OpusAheadRun run;
+    ret=op_decode_ahead_peek(_of,&run);
+    if(ret>0){
+      ret=(*_filter)(_of,_dst,_dst_sz,_of->da_buffer+run.off,run.nsamples,
+       run.nchannels);
+      OP_ASSERT(ret>=0);
+      OP_ASSERT(ret<=run.nsamples);
+      if(OP_LIKELY(ret>0))op_decode_ahead_consume(_of,ret);
+      if(_li!=NULL)*_li=run.li;
+      return ret;
+    }
+    if(ret<0){
+      if(_li!=NULL)*_li=run.li;
+      return ret==OP_EOF?0:ret;
+    }
+  }
   /*Ensure we have some decoded samples in our buffer.*/
-  ret=op_read_native(_of,NULL,0,_li);
+  ret=op_decode_native(_of,NULL,0,_li);
+  _of->da_read_li=_of->cur_link;
   /*Now apply the filter to them.*/
   if(OP_LIKELY(ret>=0)&&OP_LIKELY(_of->ready_state>=OP_INITSET)){
     int od_buffer_pos;
@@ -2984,6 +4977,165 @@ static int op_filter_read_native(OggOpusFile *_of,void *_dst,int _dst_sz,
   return ret;
 }
 
+int op_set_decode_ahead(OggOpusFile *_of,int _nsamples,
+ op_lock_func _lock,op_lock_func _unlock,void *_lock_ctx){
+  op_sample *buf;
+  int        nchannels_max;
+  int        ret;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY((_lock==NULL)!=(_unlock==NULL)))return OP_EINVAL;
+  nchannels_max=op_get_nchannels_max(_of);
+  if(OP_UNLIKELY(_nsamples<0)
+   ||OP_UNLIKELY(_nsamples>INT_MAX/(int)sizeof(*buf)/nchannels_max)){
+    return OP_EINVAL;
+  }
+  ret=0;
+  if(_of->da_nruns>0&&_of->seekable){
+    ogg_int64_t pcm_offset;
+    /*Put back anything already decoded ahead.
+      As with changing the decoding rate, a seekable stream can go back and
+       decode it again, but an unseekable one loses it.*/
+    pcm_offset=op_pcm_tell(_of);
+    op_decode_ahead_clear(_of);
+    ret=op_pcm_seek(_of,pcm_offset);
+  }
+  else op_decode_ahead_clear(_of);
+  if(_nsamples!=_of->da_depth){
+    _ogg_free(_of->da_buffer);
+    _of->da_buffer=NULL;
+    _of->da_depth=_of->da_size=0;
+    if(_nsamples>0){
+      buf=(op_sample *)_ogg_malloc(sizeof(*buf)*nchannels_max*_nsamples);
+      if(OP_UNLIKELY(buf==NULL))return OP_EFAULT;
+      _of->da_buffer=buf;
+      _of->da_depth=_nsamples;
+      _of->da_size=nchannels_max*_nsamples;
+    }
+  }
+  _of->da_lock=_lock;
+  _of->da_unlock=_unlock;
+  _of->da_lock_ctx=_lock_ctx;
+  return ret;
+}
+
+int op_decode_ahead(OggOpusFile *_of){
+  OpusAheadRun *runs;
+  int           nbuffered;
+  int           ret;
+  int           ri;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(_of->da_depth<=0))return 0;
+  runs=_of->da_runs;
+  /*Remember where the application is, so op_pcm_tell() doesn't need to look
+     at the decoder state while we change it.*/
+  op_decode_ahead_lock(_of);
+  if(_of->da_nruns<=0&&!_of->da_pcm_offset_valid){
+    _of->da_pcm_offset=op_decoder_pcm_tell(_of);
+    _of->da_pcm_offset_valid=1;
+  }
+  op_decode_ahead_unlock(_of);
+  _of->da_filling=1;
+  for(;;){
+    OpusAheadRun  last;
+    OpusAheadRun *run;
+    op_sample    *src;
+    ogg_int64_t   pcm_offset;
+    int           rate_div;
+    int           nchannels;
+    int           nsamples;
+    int           nruns;
+    int           start;
+    int           end;
+    int           avail;
+    int           extend;
+    int           li;
+    /*Ensure we have some decoded samples in the scratch buffer.
+      This is the slow part, and the read functions are free to take samples
+       out of the buffer while we do it.*/
+    ret=op_decode_native(_of,NULL,0,&li);
+    if(OP_UNLIKELY(ret<0))break;
+    nsamples=_of->od_buffer_size-_of->od_buffer_pos;
+    if(OP_UNLIKELY(_of->ready_state<OP_INITSET)||OP_UNLIKELY(nsamples<=0)){
+      /*Tell the read functions there's nothing more coming.*/
+      op_decode_ahead_lock(_of);
+      _of->da_eof=1;
+      op_decode_ahead_unlock(_of);
+      break;
+    }
+    nchannels=_of->links[_of->seekable?_of->cur_link:0].head.channel_count;
+    rate_div=48000/_of->od_rate;
+    pcm_offset=op_decoder_pcm_tell(_of);
+    /*Find room for the samples after the last run.
+      The read functions only move the start of the first run forward, which
+       can only make more room.*/
+    op_decode_ahead_lock(_of);
+    nruns=_of->da_nruns;
+    start=runs[_of->da_start].off;
+    last=runs[(_of->da_start+nruns+OP_AHEAD_NRUNS_MAX-1)%OP_AHEAD_NRUNS_MAX];
+    op_decode_ahead_unlock(_of);
+    if(nruns<=0){
+      end=0;
+      avail=_of->da_size;
+    }
+    else{
+      end=last.off+last.nchannels*last.nsamples;
+      if(end>start){
+        avail=_of->da_size-end;
+        /*Each run is contiguous, so skip the end of the buffer if a whole
+           sample won't fit there.*/
+        if(avail<nchannels){
+          end=0;
+          avail=start;
+        }
+      }
+      else avail=start-end;
+    }
+    /*We can keep adding to the last run if these samples follow it
+       directly.
+      Otherwise, they start a new run, tagged with their own link.*/
+    extend=nruns>0&&end==last.off+last.nchannels*last.nsamples
+     &&li==last.li&&nchannels==last.nchannels&&rate_div==last.rate_div
+     &&pcm_offset==last.pcm_offset+last.nsamples*rate_div;
+    if(avail<nchannels||(!extend&&nruns>=OP_AHEAD_NRUNS_MAX))break;
+    nsamples=OP_MIN(nsamples,avail/nchannels);
+    /*Nothing reads this part of the buffer until we publish it, so we can
+       fill it in without holding the lock.*/
+    src=_of->od_buffer+nchannels*_of->od_buffer_pos;
+    memcpy(_of->da_buffer+end,src,sizeof(*src)*nchannels*nsamples);
+    _of->od_buffer_pos+=nsamples;
+    op_decode_ahead_lock(_of);
+    nruns=_of->da_nruns;
+    /*If the read functions emptied the buffer in the meantime, the run we
+       wanted to extend is gone, so start a new one.*/
+    if(extend&&nruns>0){
+      run=runs+(_of->da_start+nruns-1)%OP_AHEAD_NRUNS_MAX;
+      run->nsamples+=nsamples;
+    }
+    else{
+      run=runs+(_of->da_start+nruns)%OP_AHEAD_NRUNS_MAX;
+      run->pcm_offset=pcm_offset;
+      run->off=end;
+      run->nsamples=nsamples;
+      run->nchannels=nchannels;
+      run->rate_div=rate_div;
+      run->li=li;
+      run->serialno=_of->links[_of->seekable?li:0].serialno;
+      _of->da_nruns=nruns+1;
+    }
+    op_decode_ahead_unlock(_of);
+  }
+  _of->da_filling=0;
+  op_decode_ahead_lock(_of);
+  nbuffered=0;
+  for(ri=0;ri<_of->da_nruns;ri++){
+    nbuffered+=runs[(_of->da_start+ri)%OP_AHEAD_NRUNS_MAX].nsamples;
+  }
+  op_decode_ahead_unlock(_of);
+  /*A non-blocking stream ran dry: keep what we have.*/
+  if(ret==OP_EAGAIN&&nbuffered>0)ret=0;
+  return ret<0?ret:nbuffered;
+}
+
 #if !defined(OP_FIXED_POINT)||!defined(OP_DISABLE_FLOAT_API)
 
 /*Matrices for downmixing from the supported channel counts to stereo.
@@ -3172,6 +5324,14 @@ int op_read_float_stereo(OggOpusFile *_of,float *_pcm,int _buf_size){
 # if defined(OP_HAVE_LRINTF)
 #  include <math.h>
 #  define op_float2int(_x) (lrintf(_x))
+/*SSE2 is always available on x86-64, and its conversions round the same way
+   lrintf() does, so we can use it to vectorize the conversion to 16-bit with
+   bit-identical results.*/
+#  if defined(__SSE2__)||defined(_M_X64)||defined(_M_AMD64) \
+ ||defined(_M_IX86_FP)&&_M_IX86_FP>=2
+#   include <emmintrin.h>
+#   define OP_HAVE_SSE2 (1)
+#  endif
 # else
 #  define op_float2int(_x) ((int)((_x)+((_x)<0?-0.5F:0.5F)))
 # endif
@@ -3217,6 +5377,139 @@ static const float OP_FCOEF_A[4]={
   0.9030F,0.0116F,-0.5853F,-0.2571F
 };
 
+# if defined(OP_HAVE_SSE2)
+
+/*The same quantization with dither and noise shaping as the scalar code in
+   op_float2short_filter(), vectorized across (up to 4) channels at a time.
+  Each channel's filter depends on its own output for the previous sample, so
+   we cannot vectorize across time, but every lane performs exactly the same
+   sequence of single-precision operations as the scalar code, and the dither
+   values are still drawn in the same order, so the output is bit-identical.*/
+static void op_shape_dither_sse2(OggOpusFile *_of,opus_int16 *_dst,
+ const float *_src,int _nsamples,int _nchannels){
+  __m128      fa[OP_NCHANNELS_MAX/4][4];
+  __m128      fb[OP_NCHANNELS_MAX/4][4];
+  __m128      gain;
+  __m128      lo;
+  __m128      hi;
+  __m128      elo;
+  __m128      ehi;
+  __m128      ca[4];
+  __m128      cb[4];
+  float       buf[OP_NCHANNELS_MAX];
+  opus_int32  out[4];
+  opus_uint32 seed;
+  int         ngroups;
+  int         mute;
+  int         gi;
+  int         ci;
+  int         i;
+  int         j;
+  seed=_of->dither_seed;
+  mute=_of->dither_mute;
+  if(_of->state_channel_count!=_nchannels)mute=65;
+  /*In order to avoid replacing digital silence with quiet dither noise, we
+     mute if the output has been silent for a while.*/
+  if(mute>64)memset(_of->dither_a,0,sizeof(*_of->dither_a)*4*_nchannels);
+  gain=_mm_set1_ps(OP_GAIN);
+  lo=_mm_set1_ps(-32768.0F);
+  hi=_mm_set1_ps(32767.0F);
+  elo=_mm_set1_ps(-1.5F);
+  ehi=_mm_set1_ps(1.5F);
+  for(j=0;j<4;j++){
+    ca[j]=_mm_set1_ps(OP_FCOEF_A[j]);
+    cb[j]=_mm_set1_ps(OP_FCOEF_B[j]);
+  }
+  /*Transpose the filter state so each vector holds one tap for each of 4
+     channels.
+    Lanes past the last channel are never stored back.*/
+  ngroups=_nchannels+3>>2;
+  for(gi=0;gi<ngroups;gi++){
+    for(j=0;j<4;j++){
+      float ta[4];
+      float tb[4];
+      for(ci=0;ci<4;ci++){
+        int cj;
+        cj=OP_MIN(4*gi+ci,_nchannels-1);
+        ta[ci]=_of->dither_a[cj*4+j];
+        tb[ci]=_of->dither_b[cj*4+j];
+      }
+      fa[gi][j]=_mm_loadu_ps(ta);
+      fb[gi][j]=_mm_loadu_ps(tb);
+    }
+  }
+  for(ci=_nchannels;ci<OP_NCHANNELS_MAX;ci++)buf[ci]=0;
+  for(i=0;i<_nsamples;i++){
+    float rbuf[OP_NCHANNELS_MAX];
+    int   silent;
+    silent=1;
+    for(ci=0;ci<_nchannels;ci++){
+      float s;
+      s=_src[_nchannels*i+ci];
+      silent&=s==0;
+      buf[ci]=s;
+      if(mute>16)rbuf[ci]=0;
+      else{
+        float r;
+        seed=op_rand(seed);
+        r=seed*OP_PRNG_GAIN;
+        seed=op_rand(seed);
+        r-=seed*OP_PRNG_GAIN;
+        rbuf[ci]=r;
+      }
+    }
+    for(ci=_nchannels;ci<4*ngroups;ci++)rbuf[ci]=0;
+    for(gi=0;gi<ngroups;gi++){
+      __m128 s;
+      __m128 err;
+      __m128 x;
+      __m128i si;
+      s=_mm_mul_ps(_mm_loadu_ps(buf+4*gi),gain);
+      err=_mm_setzero_ps();
+      for(j=0;j<4;j++){
+        err=_mm_add_ps(err,_mm_sub_ps(_mm_mul_ps(cb[j],fb[gi][j]),
+         _mm_mul_ps(ca[j],fa[gi][j])));
+      }
+      for(j=3;j-->0;)fa[gi][j+1]=fa[gi][j];
+      for(j=3;j-->0;)fb[gi][j+1]=fb[gi][j];
+      fa[gi][0]=err;
+      s=_mm_sub_ps(s,err);
+      /*Clamp in float out of paranoia that the input will be > 96 dBFS and
+         wrap if the integer is clamped.*/
+      x=_mm_max_ps(lo,_mm_min_ps(_mm_add_ps(s,_mm_loadu_ps(rbuf+4*gi)),hi));
+      si=_mm_cvtps_epi32(x);
+      _mm_storeu_si128((__m128i *)out,si);
+      for(ci=0;ci<OP_MIN(4,_nchannels-4*gi);ci++){
+        _dst[_nchannels*i+4*gi+ci]=(opus_int16)out[ci];
+      }
+      if(mute>16)fb[gi][0]=_mm_setzero_ps();
+      else{
+        fb[gi][0]=_mm_max_ps(elo,
+         _mm_min_ps(_mm_sub_ps(_mm_cvtepi32_ps(si),s),ehi));
+      }
+    }
+    mute++;
+    if(!silent)mute=0;
+  }
+  /*Transpose the filter state back.*/
+  for(gi=0;gi<ngroups;gi++){
+    for(j=0;j<4;j++){
+      float ta[4];
+      float tb[4];
+      _mm_storeu_ps(ta,fa[gi][j]);
+      _mm_storeu_ps(tb,fb[gi][j]);
+      for(ci=0;ci<OP_MIN(4,_nchannels-4*gi);ci++){
+        _of->dither_a[(4*gi+ci)*4+j]=ta[ci];
+        _of->dither_b[(4*gi+ci)*4+j]=tb[ci];
+      }
+    }
+  }
+  _of->dither_mute=OP_MIN(mute,65);
+  _of->dither_seed=seed;
+}
+
+# endif
+
 static int op_float2short_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
  float *_src,int _nsamples,int _nchannels){
   opus_int16 *dst;
@@ -3231,10 +5524,36 @@ static int op_float2short_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
   opus_pcm_soft_clip(_src,_nsamples,_nchannels,_of->clip_state);
 # endif
   if(_of->dither_disabled){
-    for(i=0;i<_nchannels*_nsamples;i++){
+    i=0;
+# if defined(OP_HAVE_SSE2)
+    {
+      __m128 scale;
+      __m128 lo;
+      __m128 hi;
+      scale=_mm_set1_ps(32768.0F);
+      lo=_mm_set1_ps(-32768.0F);
+      hi=_mm_set1_ps(32767.0F);
+      for(;i+8<=_nchannels*_nsamples;i+=8){
+        __m128 x0;
+        __m128 x1;
+        x0=_mm_mul_ps(scale,_mm_loadu_ps(_src+i));
+        x1=_mm_mul_ps(scale,_mm_loadu_ps(_src+i+4));
+        x0=_mm_max_ps(lo,_mm_min_ps(x0,hi));
+        x1=_mm_max_ps(lo,_mm_min_ps(x1,hi));
+        _mm_storeu_si128((__m128i *)(dst+i),
+         _mm_packs_epi32(_mm_cvtps_epi32(x0),_mm_cvtps_epi32(x1)));
+      }
+    }
+# endif
+    for(;i<_nchannels*_nsamples;i++){
       dst[i]=op_float2int(OP_CLAMP(-32768,32768.0F*_src[i],32767));
     }
   }
+# if defined(OP_HAVE_SSE2)
+  /*With only one or two channels, most of each vector would go unused, and
+     the scalar code is faster.*/
+  else if(_nchannels>2)op_shape_dither_sse2(_of,dst,_src,_nsamples,_nchannels);
+# endif
   else{
     opus_uint32 seed;
     int         mute;
@@ -3303,6 +5622,84 @@ int op_read_float(OggOpusFile *_of,float *_pcm,int _buf_size,int *_li){
   return op_read_native(_of,_pcm,_buf_size,_li);
 }
 
+# if defined(OP_HAVE_SSE2)
+
+/*Accumulate the contribution of channel 4*_k+_j of two consecutive sample
+   frames, whose channels 4*_k through 4*_k+3 are in _a and _b, respectively.*/
+#  define OP_DOWNMIX_TAP_SSE2(_acc,_cv,_a,_b,_k,_j) \
+  ((_acc)=_mm_add_ps(_acc,_mm_mul_ps((_cv)[4*(_k)+(_j)], \
+   _mm_shuffle_ps(_a,_b,_MM_SHUFFLE(_j,_j,_j,_j)))))
+
+/*Load the downmix coefficients for the given channel count, with each
+   vector holding {left,right,left,right} for one input channel.*/
+static void op_downmix_coeffs_sse2(__m128 _cv[OP_NCHANNELS_MAX],
+ int _nchannels){
+  int ci;
+  for(ci=0;ci<_nchannels;ci++){
+    _cv[ci]=_mm_setr_ps(
+     OP_STEREO_DOWNMIX[_nchannels-3][ci][0],
+     OP_STEREO_DOWNMIX[_nchannels-3][ci][1],
+     OP_STEREO_DOWNMIX[_nchannels-3][ci][0],
+     OP_STEREO_DOWNMIX[_nchannels-3][ci][1]);
+  }
+}
+
+/*Downmix two consecutive sample frames starting at _src to stereo, returning
+   {l0,r0,l1,r1}.
+  The taps are unrolled for each channel count, and are summed in the same
+   order as the scalar code in op_stereo_filter(), so the result is
+   bit-identical.
+  The channel count does not change over a call to any of the loops below, so
+   the tests on it are perfectly predicted.
+  This may read up to 3 values past the end of the second frame, so the caller
+   must ensure there is at least one more frame after it.*/
+static __m128 op_downmix2_sse2(const __m128 _cv[OP_NCHANNELS_MAX],
+ const float *_src,int _nchannels){
+  __m128 acc;
+  __m128 a;
+  __m128 b;
+  acc=_mm_setzero_ps();
+  a=_mm_loadu_ps(_src);
+  b=_mm_loadu_ps(_src+_nchannels);
+  OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,0,0);
+  OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,0,1);
+  OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,0,2);
+  if(_nchannels>3){
+    OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,0,3);
+    if(_nchannels>4){
+      a=_mm_loadu_ps(_src+4);
+      b=_mm_loadu_ps(_src+_nchannels+4);
+      OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,1,0);
+      if(_nchannels>5){
+        OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,1,1);
+        if(_nchannels>6){
+          OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,1,2);
+          if(_nchannels>7)OP_DOWNMIX_TAP_SSE2(acc,_cv,a,b,1,3);
+        }
+      }
+    }
+  }
+  return acc;
+}
+
+/*Downmix 3 or more channels to stereo two sample frames at a time.
+  _dst may alias _src, since each pair of output frames is written only after
+   the input frames it overlaps have been read.
+  Return: The number of sample frames processed.
+          The caller must finish the rest with the scalar code.*/
+static int op_stereo_downmix_sse2(float *_dst,const float *_src,
+ int _nsamples,int _nchannels){
+  __m128 cv[OP_NCHANNELS_MAX];
+  int    i;
+  op_downmix_coeffs_sse2(cv,_nchannels);
+  for(i=0;i+3<=_nsamples;i+=2){
+    _mm_storeu_ps(_dst+2*i,op_downmix2_sse2(cv,_src+_nchannels*i,_nchannels));
+  }
+  return i;
+}
+
+# endif
+
 static int op_stereo_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
  op_sample *_src,int _nsamples,int _nchannels){
   (void)_of;
@@ -3316,7 +5713,11 @@ static int op_stereo_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
       for(i=0;i<_nsamples;i++)dst[2*i+0]=dst[2*i+1]=_src[i];
     }
     else{
-      for(i=0;i<_nsamples;i++){
+      i=0;
+# if defined(OP_HAVE_SSE2)
+      i=op_stereo_downmix_sse2(dst,_src,_nsamples,_nchannels);
+# endif
+      for(;i<_nsamples;i++){
         float l;
         float r;
         int   ci;
@@ -3333,6 +5734,77 @@ static int op_stereo_filter(OggOpusFile *_of,void *_dst,int _dst_sz,
   return _nsamples;
 }
 
+
+# if defined(OP_HAVE_SSE2)
+
+/*Downmix 3 or more channels to stereo and convert the result to 16-bit
+   without dither in a single pass over the input.
+  The downmixed values are also stored in place over the front of _src, as
+   op_float2short_stereo_filter() would, because the soft clipper needs to see
+   the whole block.
+  It only changes anything if some value lies outside [-1,1] or it is still
+   releasing the clipping from the previous block, however, which is rare.
+  Return: 1 if the samples were converted, or 0 if the caller must still
+           convert the downmixed values in _src.*/
+static int op_stereo_downmix2short_sse2(OggOpusFile *_of,opus_int16 *_dst,
+ float *_src,int _nsamples,int _nchannels){
+  __m128 cv[OP_NCHANNELS_MAX];
+  __m128 scale;
+  __m128 lo;
+  __m128 hi;
+  __m128 one;
+  __m128 mone;
+  __m128 clip;
+  int    clipped;
+  int    i;
+  op_downmix_coeffs_sse2(cv,_nchannels);
+  scale=_mm_set1_ps(32768.0F);
+  lo=_mm_set1_ps(-32768.0F);
+  hi=_mm_set1_ps(32767.0F);
+  one=_mm_set1_ps(1.0F);
+  mone=_mm_set1_ps(-1.0F);
+  clip=_mm_setzero_ps();
+  for(i=0;i+5<=_nsamples;i+=4){
+    __m128 x0;
+    __m128 x1;
+    x0=op_downmix2_sse2(cv,_src+_nchannels*i,_nchannels);
+    x1=op_downmix2_sse2(cv,_src+_nchannels*(i+2),_nchannels);
+    _mm_storeu_ps(_src+2*i,x0);
+    _mm_storeu_ps(_src+2*i+4,x1);
+    /*Flag anything not in [-1,1], including NaNs.*/
+    clip=_mm_or_ps(clip,_mm_or_ps(
+     _mm_or_ps(_mm_cmpnle_ps(x0,one),_mm_cmpnge_ps(x0,mone)),
+     _mm_or_ps(_mm_cmpnle_ps(x1,one),_mm_cmpnge_ps(x1,mone))));
+    x0=_mm_max_ps(lo,_mm_min_ps(_mm_mul_ps(scale,x0),hi));
+    x1=_mm_max_ps(lo,_mm_min_ps(_mm_mul_ps(scale,x1),hi));
+    _mm_storeu_si128((__m128i *)(_dst+2*i),
+     _mm_packs_epi32(_mm_cvtps_epi32(x0),_mm_cvtps_epi32(x1)));
+  }
+  clipped=_mm_movemask_ps(clip)!=0;
+  if(i<_nsamples){
+    int j;
+    op_stereo_filter(_of,_src+2*i,2*(_nsamples-i),
+     _src+_nchannels*i,_nsamples-i,_nchannels);
+    for(j=2*i;j<2*_nsamples;j++)clipped|=!(_src[j]<=1&&_src[j]>=-1);
+  }
+#  if defined(OP_SOFT_CLIP)
+  if(_of->state_channel_count!=2)_of->clip_state[0]=_of->clip_state[1]=0;
+  clipped|=_of->clip_state[0]!=0||_of->clip_state[1]!=0;
+#  else
+  clipped=0;
+#  endif
+  if(clipped)return 0;
+  /*The soft clipper will leave the last few sample frames alone, too.*/
+  if(i<_nsamples){
+    op_float2short_filter(_of,_dst+2*i,2*(_nsamples-i),
+     _src+2*i,_nsamples-i,2);
+  }
+  _of->state_channel_count=2;
+  return 1;
+}
+
+# endif
+
 static int op_float2short_stereo_filter(OggOpusFile *_of,
  void *_dst,int _dst_sz,op_sample *_src,int _nsamples,int _nchannels){
   opus_int16 *dst;
@@ -3345,8 +5817,19 @@ static int op_float2short_stereo_filter(OggOpusFile *_of,
   else{
     if(_nchannels>2){
       _nsamples=OP_MIN(_nsamples,_dst_sz>>1);
-      _nsamples=op_stereo_filter(_of,_src,_nsamples*2,
-       _src,_nsamples,_nchannels);
+# if defined(OP_HAVE_SSE2)
+      /*Without dither, we can downmix and convert in one pass.*/
+      if(_of->dither_disabled){
+        if(op_stereo_downmix2short_sse2(_of,dst,_src,_nsamples,_nchannels)){
+          return _nsamples;
+        }
+      }
+      else
+# endif
+      {
+        _nsamples=op_stereo_filter(_of,_src,_nsamples*2,
+         _src,_nsamples,_nchannels);
+      }
     }
     _nsamples=op_float2short_filter(_of,dst,_dst_sz,_src,_nsamples,2);
   }
@@ -3364,3 +5847,176 @@ int op_read_float_stereo(OggOpusFile *_of,float *_pcm,int _buf_size){
 }
 
 #endif
+
+#if !defined(OP_FIXED_POINT)||!defined(OP_DISABLE_FLOAT_API)
+
+/*The state for decoding one group of links.*/
+struct OpusDecodeSegment{
+  /*The handle used to decode this segment through its own stream handle.
+    It borrows the links of the original.*/
+  OggOpusFile  of;
+  /*The index of the first link in this segment.*/
+  int          li_begin;
+  /*The index of the first link in the next segment.*/
+  int          li_end;
+  /*The number of values decoded, or a negative value on error.*/
+  opus_int64   ret;
+};
+
+/*The state shared by all the segments of a parallel decode.*/
+struct OpusParallelDecode{
+  /*The handle whose links are being decoded.*/
+  const OggOpusFile   *of;
+  OpusDecodeSegment   *segments;
+  /*The application's function to open another handle to the stream.*/
+  op_open_stream_func  open_stream;
+  void                *open_ctx;
+  /*The application's function to receive the decoded samples.*/
+  op_write_pcm_func    write_pcm;
+  void                *write_ctx;
+};
+
+/*Decode the links in one segment through a new stream handle.
+  The decoder is reset at the start of every link, so this produces exactly
+   the same output a sequential pass would for these links.
+  The samples are handed to the application as they are decoded, so each
+   segment only needs enough memory to hold one packet.
+  Return: The number of values decoded, or a negative value on error.*/
+static opus_int64 op_decode_segment_impl(const OpusParallelDecode *_pd,
+ OpusDecodeSegment *_seg,int _si){
+  OpusFileCallbacks  cb;
+  const OggOpusFile *src;
+  OggOpusFile       *of;
+  float             *pcm;
+  opus_int64         nvalues;
+  int                buf_size;
+  int                ret;
+  src=_pd->of;
+  of=&_seg->of;
+  memset(&cb,0,sizeof(cb));
+  of->stream=(*_pd->open_stream)(_pd->open_ctx,&cb);
+  if(OP_UNLIKELY(of->stream==NULL))return OP_EREAD;
+  of->callbacks=cb;
+  if(OP_UNLIKELY(cb.read==NULL)||OP_UNLIKELY(cb.seek==NULL)
+   ||OP_UNLIKELY(cb.tell==NULL)){
+    return OP_EREAD;
+  }
+  /*Use the same settings as the original, so the output matches.*/
+  of->decode_rate=src->decode_rate;
+  of->gain_type=src->gain_type;
+  of->gain_offset_q8=src->gain_offset_q8;
+  of->decode_cb=src->decode_cb;
+  of->decode_cb_ctx=src->decode_cb_ctx;
+  of->decode_timing=src->decode_timing;
+  ret=op_open_borrowed_links(of,src,_seg->li_begin);
+  if(OP_UNLIKELY(ret<0))return ret;
+  /*This is big enough for a whole packet at 48 kHz, so op_read_float() can
+     usually decode straight into it.*/
+  buf_size=op_get_nchannels_max(of)*120*48;
+  pcm=(float *)_ogg_malloc(sizeof(*pcm)*buf_size);
+  if(OP_UNLIKELY(pcm==NULL))return OP_EFAULT;
+  nvalues=0;
+  for(;;){
+    int nsamples;
+    int li;
+    nsamples=op_read_float(of,pcm,buf_size,&li);
+    /*A sequential pass would see the hole and keep reading.*/
+    if(nsamples==OP_HOLE)continue;
+    if(OP_UNLIKELY(nsamples<0)){
+      nvalues=nsamples;
+      break;
+    }
+    /*Stop at the end of the stream, or once we reach the next segment, which
+       decodes those samples itself.*/
+    if(nsamples==0||li>=_seg->li_end)break;
+    ret=(*_pd->write_pcm)(_pd->write_ctx,_si,li,pcm,nsamples);
+    if(OP_UNLIKELY(ret<0)){
+      nvalues=ret;
+      break;
+    }
+    nvalues+=nsamples*of->links[li].head.channel_count;
+  }
+  _ogg_free(pcm);
+  return nvalues;
+}
+
+static void op_decode_segment(void *_ctx,int _si){
+  OpusParallelDecode *pd;
+  OpusDecodeSegment  *seg;
+  pd=(OpusParallelDecode *)_ctx;
+  seg=pd->segments+_si;
+  seg->ret=op_decode_segment_impl(pd,seg,_si);
+}
+
+opus_int64 op_decode_range_parallel(OggOpusFile *_of,int _nsegments,
+ op_write_pcm_func _write_pcm,void *_write_ctx,
+ op_open_stream_func _open_stream,void *_open_ctx,
+ op_run_func _run,void *_run_ctx){
+  OpusParallelDecode  pd;
+  OpusDecodeSegment  *segments;
+  const OggOpusLink  *links;
+  ogg_int64_t         pcm_total;
+  opus_int64          ret;
+  int                 nlinks;
+  int                 si;
+  int                 li;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  if(OP_UNLIKELY(!_of->seekable))return OP_ENOSEEK;
+  /*The links must not change while the segments are using them.*/
+  if(OP_UNLIKELY(_of->enum_sr!=NULL))return OP_EINVAL;
+  if(OP_UNLIKELY(_nsegments<1))return OP_EINVAL;
+  links=_of->links;
+  nlinks=_of->nlinks;
+  /*The links are the only places we can split the stream and still get
+     exactly the same output.*/
+  _nsegments=OP_MIN(_nsegments,nlinks);
+  segments=(OpusDecodeSegment *)_ogg_malloc(sizeof(*segments)*_nsegments);
+  if(OP_UNLIKELY(segments==NULL))return OP_EFAULT;
+  /*Give each segment about the same duration, with at least one link.*/
+  pcm_total=op_pcm_total(_of,-1);
+  li=0;
+  for(si=0;si<_nsegments;si++){
+    OpusDecodeSegment *seg;
+    seg=segments+si;
+    memset(seg,0,sizeof(*seg));
+    /*Set up enough that op_clear() can clean up after it.*/
+    ogg_sync_init(&seg->of.oy);
+    ogg_stream_init(&seg->of.os,-1);
+    seg->li_begin=li;
+    if(si+1<_nsegments){
+      ogg_int64_t target;
+      target=pcm_total/_nsegments*(si+1);
+      /*Leave at least one link for each of the remaining segments.*/
+      do li++;
+      while(li<nlinks-(_nsegments-si-1)&&links[li].pcm_file_offset<target);
+    }
+    else li=nlinks;
+    seg->li_end=li;
+  }
+  pd.of=_of;
+  pd.segments=segments;
+  pd.open_stream=_open_stream;
+  pd.open_ctx=_open_ctx;
+  pd.write_pcm=_write_pcm;
+  pd.write_ctx=_write_ctx;
+  if(_run!=NULL)(*_run)(_run_ctx,op_decode_segment,&pd,_nsegments);
+  else for(si=0;si<_nsegments;si++)op_decode_segment(&pd,si);
+  ret=0;
+  for(si=0;si<_nsegments;si++){
+    OpusDecodeSegment *seg;
+    seg=segments+si;
+    if(OP_UNLIKELY(seg->ret<0)){
+      if(ret>=0)ret=seg->ret;
+    }
+    else if(OP_LIKELY(ret>=0))ret+=seg->ret;
+    op_add_stats(_of,&seg->of.stats);
+    /*The links still belong to _of.*/
+    seg->of.links=NULL;
+    seg->of.nlinks=0;
+    op_clear(&seg->of);
+  }
+  _ogg_free(segments);
+  return ret;
+}
+
+#endif
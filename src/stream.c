@@ -26,6 +26,11 @@
 #include <string.h>
 #if defined(_WIN32)
 # include <io.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
 #endif
 
 typedef struct OpusMemStream OpusMemStream;
@@ -413,3 +418,154 @@ void *op_mem_stream_create(OpusFileCallbacks *_cb,
   }
   return stream;
 }
+
+static int op_mmap_close(void *_stream){
+  OpusMemStream *stream;
+  int            ret;
+  stream=(OpusMemStream *)_stream;
+  ret=0;
+  /*Empty files are never mapped.*/
+  if(stream->data!=NULL){
+#if defined(_WIN32)
+    ret=UnmapViewOfFile(stream->data)?0:EOF;
+#else
+    ret=munmap((void *)stream->data,(size_t)stream->size);
+#endif
+  }
+  _ogg_free(stream);
+  return ret;
+}
+
+/*A mapped file is read with the same functions as any other block of memory.
+  Only closing it is different.*/
+static const OpusFileCallbacks OP_MMAP_CALLBACKS={
+  op_mem_read,
+  op_mem_seek,
+  op_mem_tell,
+  op_mmap_close
+};
+
+void *op_mmap_open(OpusFileCallbacks *_cb,const char *_path){
+  OpusMemStream *stream;
+  void          *data;
+  opus_int64     size;
+#if defined(_WIN32)
+  {
+    wchar_t       *wpath;
+    HANDLE         h_file;
+    HANDLE         h_map;
+    LARGE_INTEGER  file_size;
+    wpath=op_utf8_to_utf16(_path);
+    if(wpath==NULL){
+      errno=ENOENT;
+      return NULL;
+    }
+    h_file=CreateFileW(wpath,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,
+     FILE_ATTRIBUTE_NORMAL,NULL);
+    _ogg_free(wpath);
+    if(h_file==INVALID_HANDLE_VALUE){
+      errno=ENOENT;
+      return NULL;
+    }
+    if(!GetFileSizeEx(h_file,&file_size)){
+      CloseHandle(h_file);
+      errno=EIO;
+      return NULL;
+    }
+    size=file_size.QuadPart;
+    data=NULL;
+    if(size>0){
+      if(size>OP_MEM_DIFF_MAX){
+        CloseHandle(h_file);
+        errno=EFBIG;
+        return NULL;
+      }
+      /*The view keeps its own reference to the mapping object, so we don't
+         need to hold onto either handle once it has been created.*/
+      h_map=CreateFileMappingW(h_file,NULL,PAGE_READONLY,0,0,NULL);
+      if(h_map!=NULL){
+        data=MapViewOfFile(h_map,FILE_MAP_READ,0,0,0);
+        CloseHandle(h_map);
+      }
+      if(data==NULL){
+        CloseHandle(h_file);
+        errno=ENOMEM;
+        return NULL;
+      }
+    }
+    CloseHandle(h_file);
+  }
+#else
+  {
+    struct stat st;
+    int         fd;
+    fd=open(_path,O_RDONLY);
+    if(fd<0)return NULL;
+    if(fstat(fd,&st)<0){
+      close(fd);
+      return NULL;
+    }
+    /*Pipes, sockets, and devices can't be mapped, and don't report a useful
+       size anyway.*/
+    if(!S_ISREG(st.st_mode)){
+      close(fd);
+      errno=ENODEV;
+      return NULL;
+    }
+    size=(opus_int64)st.st_size;
+    data=NULL;
+    /*mmap() refuses zero-length mappings, but an empty file is still a valid
+       (if not very useful) stream.*/
+    if(size>0){
+      if(size>OP_MEM_DIFF_MAX){
+        close(fd);
+        errno=EFBIG;
+        return NULL;
+      }
+      data=mmap(NULL,(size_t)size,PROT_READ,MAP_PRIVATE,fd,0);
+      if(data==MAP_FAILED){
+        int err;
+        err=errno;
+        close(fd);
+        errno=err;
+        return NULL;
+      }
+    }
+    /*The mapping remains valid after the descriptor is closed.*/
+    close(fd);
+  }
+#endif
+  stream=(OpusMemStream *)_ogg_malloc(sizeof(*stream));
+  if(stream==NULL){
+    if(data!=NULL){
+#if defined(_WIN32)
+      UnmapViewOfFile(data);
+#else
+      munmap(data,(size_t)size);
+#endif
+    }
+    errno=ENOMEM;
+    return NULL;
+  }
+  *_cb=*&OP_MMAP_CALLBACKS;
+  stream->data=(const unsigned char *)data;
+  stream->size=(ptrdiff_t)size;
+  stream->pos=0;
+  return stream;
+}
+
+const unsigned char *op_mem_stream_data(const OpusFileCallbacks *_cb,
+ void *_stream,opus_int64 *_size){
+  OpusMemStream *stream;
+  /*We can only look inside streams we created ourselves.*/
+  if(_cb->read!=op_mem_read||_cb->seek!=op_mem_seek
+   ||_cb->tell!=op_mem_tell){
+    return NULL;
+  }
+  stream=(OpusMemStream *)_stream;
+  /*Offsets in the file are measured from the current position, so only hand
+     out the buffer if those will match.*/
+  if(stream->pos!=0)return NULL;
+  *_size=stream->size;
+  return stream->data;
+}
@@ -0,0 +1,423 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE libopusfile SOFTWARE CODEC SOURCE CODE. *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE libopusfile SOURCE CODE IS (C) COPYRIGHT 2012-2020           *
+ * by the Xiph.Org Foundation and contributors https://xiph.org/    *
+ *                                                                  *
+ ********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Measures the requests, bytes, and wall time libopusurl needs to open, play,
+   and seek in a stream served by a local stand-in for an HTTP server, under a
+   range of server behaviors.
+  With no arguments, it serves a generated chained stream.
+  Otherwise, it serves the Ogg Opus file named on the command line.
+  It fails if any operation fails, or if the server receives more requests
+   than libopusurl reports making.*/
+
+#if !defined(_WIN32)
+# if !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200112L
+# endif
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <sys/time.h>
+# include <opusfile.h>
+# include "http_server.h"
+
+/*The shape of the generated stream.*/
+# define OP_BENCH_NLINKS        (3)
+# define OP_BENCH_LINK_PACKETS  (1000)
+# define OP_BENCH_PACKET_SIZE   (120)
+# define OP_BENCH_PACKETS_PER_PAGE (25)
+# define OP_BENCH_PRE_SKIP      (312)
+
+/*The number of random seeks to time in each scenario.*/
+# define OP_BENCH_NSEEKS (40)
+/*The number of times to retry a seek that fails.*/
+# define OP_BENCH_SEEK_RETRIES (4)
+
+typedef struct OpusBenchBuf      OpusBenchBuf;
+typedef struct OpusBenchScenario OpusBenchScenario;
+
+struct OpusBenchBuf{
+  unsigned char *data;
+  size_t         size;
+  size_t         cdata;
+};
+
+struct OpusBenchScenario{
+  const char           *name;
+  OpusTestServerConfig  conf;
+};
+
+static const OpusBenchScenario OP_BENCH_SCENARIOS[]={
+  /*version, ranges, latency_ms, bandwidth, keep_alive_max, drop_after*/
+  {"HTTP/1.0",              {10,1, 0,      0,0,     0}},
+  {"HTTP/1.1",              {11,1, 0,      0,0,     0}},
+  {"HTTP/1.1 no ranges",    {11,0, 0,      0,0,     0}},
+  {"HTTP/1.0 slow",         {10,1,20,2000000,0,     0}},
+  {"HTTP/1.1 slow",         {11,1,20,2000000,0,     0}},
+  {"HTTP/1.1 keep-alive 3", {11,1, 5,      0,3,     0}},
+  {"HTTP/1.1 drops",        {11,1, 5,      0,0,200000}}
+};
+
+# define OP_BENCH_NSCENARIOS \
+ ((int)(sizeof(OP_BENCH_SCENARIOS)/sizeof(*OP_BENCH_SCENARIOS)))
+
+static int op_bench_append(OpusBenchBuf *_buf,
+ const unsigned char *_data,size_t _size){
+  if(_buf->size+_size>_buf->cdata){
+    unsigned char *data;
+    size_t         cdata;
+    cdata=2*_buf->cdata+_size;
+    data=(unsigned char *)realloc(_buf->data,cdata);
+    if(data==NULL)return -1;
+    _buf->data=data;
+    _buf->cdata=cdata;
+  }
+  memcpy(_buf->data+_buf->size,_data,_size);
+  _buf->size+=_size;
+  return 0;
+}
+
+static void op_bench_put_le(unsigned char *_p,ogg_int64_t _v,int _n){
+  int i;
+  for(i=0;i<_n;i++)_p[i]=(unsigned char)(_v>>8*i&0xFF);
+}
+
+/*Write one Ogg page containing the given packets, none of which may be 255
+   bytes or longer.*/
+static int op_bench_write_page(OpusBenchBuf *_buf,
+ const unsigned char *const *_packets,const int *_sizes,int _npackets,
+ ogg_uint32_t _serialno,long _pageno,ogg_int64_t _granulepos,int _flags){
+  unsigned char header[27+255];
+  unsigned char body[255*255];
+  ogg_page      og;
+  long          body_len;
+  int           pi;
+  memcpy(header,"OggS",4);
+  header[4]=0;
+  header[5]=(unsigned char)_flags;
+  op_bench_put_le(header+6,_granulepos,8);
+  op_bench_put_le(header+14,_serialno,4);
+  op_bench_put_le(header+18,_pageno,4);
+  op_bench_put_le(header+22,0,4);
+  header[26]=(unsigned char)_npackets;
+  body_len=0;
+  for(pi=0;pi<_npackets;pi++){
+    header[27+pi]=(unsigned char)_sizes[pi];
+    memcpy(body+body_len,_packets[pi],_sizes[pi]);
+    body_len+=_sizes[pi];
+  }
+  og.header=header;
+  og.header_len=27+_npackets;
+  og.body=body;
+  og.body_len=body_len;
+  ogg_page_checksum_set(&og);
+  if(op_bench_append(_buf,og.header,og.header_len)<0)return -1;
+  return op_bench_append(_buf,og.body,og.body_len);
+}
+
+/*Generate a chained stream with a few mono links.
+  The audio packets are 20 ms CELT frames with pseudo-random contents, which
+   decode to noise, but are perfectly valid.*/
+static int op_bench_generate(OpusBenchBuf *_buf,ogg_int64_t *_pcm_total){
+  static const unsigned char TAGS[]={
+    'O','p','u','s','T','a','g','s',5,0,0,0,'b','e','n','c','h',0,0,0,0
+  };
+  unsigned char        head[19];
+  unsigned char        packets[OP_BENCH_PACKETS_PER_PAGE][OP_BENCH_PACKET_SIZE];
+  const unsigned char *ptrs[OP_BENCH_PACKETS_PER_PAGE];
+  int                  sizes[OP_BENCH_PACKETS_PER_PAGE];
+  ogg_uint32_t         seed;
+  int                  li;
+  memcpy(head,"OpusHead",8);
+  head[8]=1;
+  head[9]=1;
+  op_bench_put_le(head+10,OP_BENCH_PRE_SKIP,2);
+  op_bench_put_le(head+12,48000,4);
+  op_bench_put_le(head+16,0,2);
+  head[18]=0;
+  seed=1;
+  for(li=0;li<OP_BENCH_NLINKS;li++){
+    ogg_uint32_t serialno;
+    ogg_int64_t  granulepos;
+    long         pageno;
+    int          pi;
+    serialno=0x4F707573+li;
+    ptrs[0]=head;
+    sizes[0]=sizeof(head);
+    if(op_bench_write_page(_buf,ptrs,sizes,1,serialno,0,0,0x02)<0)return -1;
+    ptrs[0]=TAGS;
+    sizes[0]=sizeof(TAGS);
+    if(op_bench_write_page(_buf,ptrs,sizes,1,serialno,1,0,0)<0)return -1;
+    pageno=2;
+    granulepos=OP_BENCH_PRE_SKIP;
+    for(pi=0;pi<OP_BENCH_LINK_PACKETS;pi+=OP_BENCH_PACKETS_PER_PAGE){
+      int npackets;
+      int pj;
+      npackets=OP_BENCH_LINK_PACKETS-pi;
+      if(npackets>OP_BENCH_PACKETS_PER_PAGE){
+        npackets=OP_BENCH_PACKETS_PER_PAGE;
+      }
+      for(pj=0;pj<npackets;pj++){
+        int bi;
+        /*CELT-only, fullband, 20 ms, mono, one frame.*/
+        packets[pj][0]=0xF8;
+        for(bi=1;bi<OP_BENCH_PACKET_SIZE;bi++){
+          seed=seed*1103515245U+12345U;
+          packets[pj][bi]=(unsigned char)(seed>>23);
+        }
+        ptrs[pj]=packets[pj];
+        sizes[pj]=OP_BENCH_PACKET_SIZE;
+      }
+      granulepos+=960*npackets;
+      if(op_bench_write_page(_buf,ptrs,sizes,npackets,serialno,pageno++,
+       granulepos,pi+npackets>=OP_BENCH_LINK_PACKETS?0x04:0)<0){
+        return -1;
+      }
+    }
+  }
+  /*The pre-skip is trimmed from the start of every link.*/
+  *_pcm_total=(ogg_int64_t)OP_BENCH_NLINKS
+   *(OP_BENCH_LINK_PACKETS*960-OP_BENCH_PRE_SKIP);
+  return 0;
+}
+
+static int op_bench_load(OpusBenchBuf *_buf,const char *_path){
+  unsigned char  data[4096];
+  FILE          *fin;
+  size_t         nread;
+  fin=fopen(_path,"rb");
+  if(fin==NULL)return -1;
+  while((nread=fread(data,1,sizeof(data),fin))>0){
+    if(op_bench_append(_buf,data,nread)<0){
+      fclose(fin);
+      return -1;
+    }
+  }
+  fclose(fin);
+  return 0;
+}
+
+static double op_bench_now_ms(void){
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0+tv.tv_usec/1000.0;
+}
+
+/*Tracks the cost of one operation.*/
+typedef struct OpusBenchMark{
+  OpusTestServerStats stats;
+  opus_int64          nrequests;
+  double              start_ms;
+}OpusBenchMark;
+
+static int op_bench_mark(OpusBenchMark *_mark,
+ OpusTestServer *_srv,const OggOpusFile *_of){
+  if(op_test_server_stats(_srv,&_mark->stats)<0)return -1;
+  _mark->nrequests=_of!=NULL?op_url_request_count(_of):0;
+  _mark->start_ms=op_bench_now_ms();
+  return 0;
+}
+
+/*Report the cost of an operation since op_bench_mark().
+  The requests are the ones libopusurl says it made.
+  The server may not receive all of them, since it can close a connection
+   with pipelined requests still unread, or receive one made during an earlier
+   operation, but it should never receive more than were made in total.
+  Return: 0 on success, or -1 if the server received more requests than
+           libopusurl counted.*/
+static int op_bench_report(const char *_scenario,const char *_op,
+ const OpusBenchMark *_mark,OpusTestServer *_srv,const OggOpusFile *_of){
+  OpusTestServerStats stats;
+  double              elapsed_ms;
+  opus_int64          nrequests;
+  elapsed_ms=op_bench_now_ms()-_mark->start_ms;
+  if(op_test_server_stats(_srv,&stats)<0)return -1;
+  nrequests=op_url_request_count(_of);
+  printf("%-22s %-5s %4li requests (%4li received) %4li connections "
+   "%9li bytes %8.1f ms\n",_scenario,_op,(long)(nrequests-_mark->nrequests),
+   stats.requests-_mark->stats.requests,
+   stats.connections-_mark->stats.connections,
+   (long)(stats.bytes-_mark->stats.bytes),elapsed_ms);
+  if(nrequests<stats.requests){
+    fprintf(stderr,"%s: %s: libopusurl counted %li requests, "
+     "but the server received %li.\n",_scenario,_op,(long)nrequests,
+     stats.requests);
+    return -1;
+  }
+  return 0;
+}
+
+/*Decode the whole stream.
+  When the server drops a connection, reading stops early, so pick up where
+   we left off by seeking, as a player would.
+  Seeking can land a little before where we stopped, so this counts the
+   position reached rather than every sample decoded.
+  Return: The number of samples decoded, or a negative value on error.*/
+static ogg_int64_t op_bench_read_all(OggOpusFile *_of){
+  float       pcm[120*48*2];
+  ogg_int64_t nsamples;
+  int         nretries;
+  nsamples=0;
+  nretries=0;
+  for(;;){
+    opus_int64 offset;
+    int        ret;
+    ret=op_read_float(_of,pcm,sizeof(pcm)/sizeof(*pcm),NULL);
+    if(ret>0){
+      nsamples+=ret;
+      continue;
+    }
+    if(ret==0&&(!op_seekable(_of)||nsamples>=op_pcm_total(_of,-1))){
+      return nsamples;
+    }
+    if(!op_seekable(_of))return ret<0?ret:OP_EREAD;
+    /*Seeking to the current sample position would just keep decoding, and
+       seeking to the current byte position would not touch the stream at all,
+       so back up one byte, which resumes from the next page.
+      The seek can itself run into a drop, so it gets retried, too.*/
+    offset=op_raw_tell(_of);
+    if(offset>0)offset--;
+    do if(++nretries>100)return ret<0?ret:OP_EREAD;
+    while(op_raw_seek(_of,offset)<0);
+    nsamples=op_pcm_tell(_of);
+  }
+}
+
+static int op_bench_run(const OpusBenchScenario *_scenario,
+ const OpusBenchBuf *_buf,ogg_int64_t _pcm_total){
+  OpusTestServer  srv;
+  OpusBenchMark   mark;
+  OggOpusFile    *of;
+  char            url[64];
+  ogg_int64_t     nsamples;
+  const char     *name;
+  int             ret;
+  int             err;
+  name=_scenario->name;
+  if(op_test_server_start(&srv,_buf->data,_buf->size,&_scenario->conf)<0){
+    fprintf(stderr,"%s: Could not start the server.\n",name);
+    return -1;
+  }
+  sprintf(url,"http://127.0.0.1:%i/bench.opus",srv.port);
+  ret=-1;
+  of=NULL;
+  if(op_bench_mark(&mark,&srv,NULL)<0)goto done;
+  of=op_open_url(url,&err,NULL);
+  if(of==NULL){
+    fprintf(stderr,"%s: Failed to open %s: %i\n",name,url,err);
+    goto done;
+  }
+  if(op_bench_report(name,"open",&mark,&srv,of)<0)goto done;
+  if(_scenario->conf.ranges){
+    if(!op_seekable(of)){
+      fprintf(stderr,"%s: The stream was not seekable.\n",name);
+      goto done;
+    }
+    if(_pcm_total>=0&&op_pcm_total(of,-1)!=_pcm_total){
+      fprintf(stderr,"%s: Expected %li samples, but the stream has %li.\n",
+       name,(long)_pcm_total,(long)op_pcm_total(of,-1));
+      goto done;
+    }
+  }
+  if(op_bench_mark(&mark,&srv,of)<0)goto done;
+  nsamples=op_bench_read_all(of);
+  if(nsamples<0||_pcm_total>=0&&nsamples!=_pcm_total){
+    fprintf(stderr,"%s: Decoded %li samples instead of %li.\n",
+     name,(long)nsamples,(long)_pcm_total);
+    goto done;
+  }
+  if(op_bench_report(name,"read",&mark,&srv,of)<0)goto done;
+  if(op_seekable(of)){
+    ogg_uint32_t seed;
+    ogg_int64_t  pcm_total;
+    int          si;
+    pcm_total=op_pcm_total(of,-1);
+    seed=7;
+    if(op_bench_mark(&mark,&srv,of)<0)goto done;
+    for(si=0;si<OP_BENCH_NSEEKS;si++){
+      float       pcm[960];
+      ogg_int64_t target;
+      int         ntries;
+      seed=seed*1103515245U+12345U;
+      target=(ogg_int64_t)((double)(seed>>8)/(1<<24)*pcm_total);
+      /*A drop part way through a seek can make it fail, so try a few more
+         times.*/
+      for(ntries=0;op_pcm_seek(of,target)<0;ntries++){
+        if(ntries>=OP_BENCH_SEEK_RETRIES){
+          fprintf(stderr,"%s: Seek to %li failed.\n",name,(long)target);
+          goto done;
+        }
+      }
+      if(op_pcm_tell(of)!=target){
+        fprintf(stderr,"%s: Seek to %li ended up at %li.\n",
+         name,(long)target,(long)op_pcm_tell(of));
+        goto done;
+      }
+      if(op_read_float(of,pcm,sizeof(pcm)/sizeof(*pcm),NULL)<0){
+        fprintf(stderr,"%s: Read after seeking to %li failed.\n",
+         name,(long)target);
+        goto done;
+      }
+    }
+    if(op_bench_report(name,"seek",&mark,&srv,of)<0)goto done;
+  }
+  ret=0;
+done:
+  op_free(of);
+  op_test_server_stop(&srv);
+  return ret;
+}
+
+int main(int _argc,const char **_argv){
+  OpusBenchBuf buf;
+  ogg_int64_t  pcm_total;
+  int          nfailures;
+  int          si;
+  memset(&buf,0,sizeof(buf));
+  pcm_total=-1;
+  if(_argc>1){
+    if(op_bench_load(&buf,_argv[1])<0){
+      fprintf(stderr,"Could not read %s.\n",_argv[1]);
+      return EXIT_FAILURE;
+    }
+  }
+  else if(op_bench_generate(&buf,&pcm_total)<0){
+    fprintf(stderr,"Out of memory.\n");
+    return EXIT_FAILURE;
+  }
+  nfailures=0;
+  for(si=0;si<OP_BENCH_NSCENARIOS;si++){
+    if(op_bench_run(OP_BENCH_SCENARIOS+si,&buf,pcm_total)<0)nfailures++;
+  }
+  free(buf.data);
+  if(nfailures>0){
+    fprintf(stderr,"%i of %i scenarios failed.\n",
+     nfailures,OP_BENCH_NSCENARIOS);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#else
+
+# include <stdio.h>
+
+int main(void){
+  /*The server stand-in needs fork().*/
+  fprintf(stderr,"Skipped: not supported on this platform.\n");
+  /*The exit code automake and CTest treat as a skipped test.*/
+  return 77;
+}
+
+#endif
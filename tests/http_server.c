@@ -0,0 +1,438 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE libopusfile SOFTWARE CODEC SOURCE CODE. *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE libopusfile SOURCE CODE IS (C) COPYRIGHT 2012-2020           *
+ * by the Xiph.Org Foundation and contributors https://xiph.org/    *
+ *                                                                  *
+ ********************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if !defined(_POSIX_C_SOURCE)
+# define _POSIX_C_SOURCE 200112L
+#endif
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "http_server.h"
+
+/*The largest request header we accept.*/
+#define OP_TEST_REQUEST_MAX (4096)
+
+/*The most response body data we send at once.
+  When the bandwidth is limited, we pace the response in pieces this large or
+   smaller.*/
+#define OP_TEST_SEND_SIZE (16384)
+
+/*The size of the send buffer for each connection.*/
+#define OP_TEST_SNDBUF_SIZE (65536)
+
+/*What a connection reports to the main server process.
+  This is small enough that writes to a pipe are atomic.*/
+typedef struct OpusTestReport{
+  long        requests;
+  ogg_int64_t bytes;
+}OpusTestReport;
+
+static const OpusTestServerConfig *op_test_conf;
+static const unsigned char        *op_test_data;
+static size_t                      op_test_size;
+/*The number of body bytes after which the current connection gets dropped.*/
+static long                        op_test_drop_after;
+
+static void op_test_sleep_ms(int _ms){
+  if(_ms>0)poll(NULL,0,_ms);
+}
+
+static void op_test_report(int _fd,long _requests,ogg_int64_t _bytes){
+  OpusTestReport report;
+  memset(&report,0,sizeof(report));
+  report.requests=_requests;
+  report.bytes=_bytes;
+  if(write(_fd,&report,sizeof(report))!=(ssize_t)sizeof(report))_exit(1);
+}
+
+/*Case-insensitive comparison of the first _n characters of two strings, as
+   used for header names.*/
+static int op_test_strncasecmp(const char *_a,const char *_b,size_t _n){
+  size_t i;
+  for(i=0;i<_n;i++){
+    int a;
+    int b;
+    a=(unsigned char)_a[i];
+    b=(unsigned char)_b[i];
+    if(a>='A'&&a<='Z')a+='a'-'A';
+    if(b>='A'&&b<='Z')b+='a'-'A';
+    if(a!=b)return a-b;
+    if(!a)break;
+  }
+  return 0;
+}
+
+/*Find the value of a header in a request.
+  Return: A pointer to the start of the value, or NULL if the header was not
+           present.*/
+static const char *op_test_find_header(const char *_req,const char *_name){
+  const char *p;
+  size_t      name_len;
+  name_len=strlen(_name);
+  for(p=strstr(_req,"\r\n");p!=NULL;p=strstr(p,"\r\n")){
+    p+=2;
+    if(op_test_strncasecmp(p,_name,name_len)==0&&p[name_len]==':'){
+      p+=name_len+1;
+      while(*p==' '||*p=='\t')p++;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/*Send a piece of a response body, at no more than the configured bandwidth.
+  The connection is dropped (by exiting) if it reaches its limit.
+  Return: 0 on success, or -1 if the client went away.*/
+static int op_test_send_body(int _fd,int _report_fd,
+ const unsigned char *_buf,size_t _size,long *_body_sent){
+  long bandwidth;
+  long drop_after;
+  bandwidth=op_test_conf->bandwidth;
+  drop_after=op_test_drop_after;
+  while(_size>0){
+    size_t  chunk;
+    ssize_t ret;
+    chunk=_size<OP_TEST_SEND_SIZE?_size:OP_TEST_SEND_SIZE;
+    /*Send about 50 pieces per second when pacing.*/
+    if(bandwidth>0&&chunk>(size_t)(bandwidth/50+1))chunk=bandwidth/50+1;
+    if(drop_after>0){
+      if(*_body_sent>=drop_after)_exit(0);
+      if(chunk>(size_t)(drop_after-*_body_sent)){
+        chunk=drop_after-*_body_sent;
+      }
+    }
+    /*Count the bytes before we send them, so that they're always included by
+       the time the client sees them.*/
+    op_test_report(_report_fd,0,(ogg_int64_t)chunk);
+    ret=send(_fd,_buf,chunk,0);
+    if(ret<(ssize_t)chunk){
+      op_test_report(_report_fd,0,-(ogg_int64_t)chunk+(ret>0?ret:0));
+      return -1;
+    }
+    _buf+=chunk;
+    _size-=chunk;
+    *_body_sent+=(long)chunk;
+    if(bandwidth>0)op_test_sleep_ms((int)(chunk*1000/bandwidth));
+  }
+  return 0;
+}
+
+static int op_test_send_all(int _fd,const char *_buf,size_t _size){
+  while(_size>0){
+    ssize_t ret;
+    ret=send(_fd,_buf,_size,0);
+    if(ret<=0)return -1;
+    _buf+=ret;
+    _size-=ret;
+  }
+  return 0;
+}
+
+/*Answer the requests on one connection until it is closed.*/
+static void op_test_serve_conn(int _fd,int _report_fd){
+  char   req[OP_TEST_REQUEST_MAX+1];
+  size_t nreq;
+  long   body_sent;
+  int    nresponses;
+  nreq=0;
+  body_sent=0;
+  nresponses=0;
+  for(;;){
+    char        header[512];
+    const char *range;
+    const char *conn;
+    char       *end;
+    size_t      req_len;
+    size_t      start;
+    size_t      size;
+    int         client_version;
+    int         keep_alive;
+    int         close;
+    int         status;
+    int         header_len;
+    /*Read until we have a complete request header.*/
+    req[nreq]='\0';
+    while((end=strstr(req,"\r\n\r\n"))==NULL){
+      ssize_t ret;
+      if(nreq>=OP_TEST_REQUEST_MAX)return;
+      ret=recv(_fd,req+nreq,OP_TEST_REQUEST_MAX-nreq,0);
+      if(ret<=0)return;
+      nreq+=ret;
+      req[nreq]='\0';
+    }
+    end[2]='\0';
+    req_len=end+4-req;
+    op_test_report(_report_fd,1,0);
+    if(strncmp(req,"GET ",4)!=0)return;
+    client_version=strstr(req,"HTTP/1.1\r\n")!=NULL?11:10;
+    conn=op_test_find_header(req,"Connection");
+    keep_alive=op_test_conf->version>=11&&client_version>=11;
+    if(conn!=NULL){
+      if(op_test_strncasecmp(conn,"close",5)==0)keep_alive=0;
+      else if(op_test_strncasecmp(conn,"keep-alive",10)==0
+       &&op_test_conf->version>=11){
+        keep_alive=1;
+      }
+    }
+    nresponses++;
+    if(op_test_conf->keep_alive_max>0
+     &&nresponses>=op_test_conf->keep_alive_max){
+      keep_alive=0;
+    }
+    /*An HTTP/1.0 client expects the connection to close, so only tell an
+       HTTP/1.1 client.*/
+    close=!keep_alive&&client_version>=11&&op_test_conf->version>=11;
+    start=0;
+    size=op_test_size;
+    status=200;
+    range=op_test_conf->ranges?op_test_find_header(req,"Range"):NULL;
+    if(range!=NULL&&strncmp(range,"bytes=",6)==0){
+      unsigned long first;
+      unsigned long last;
+      char         *next;
+      first=strtoul(range+6,&next,10);
+      if(next>range+6&&*next=='-'){
+        last=(unsigned long)op_test_size-1;
+        if(next[1]>='0'&&next[1]<='9'){
+          last=strtoul(next+1,NULL,10);
+          if(last>=(unsigned long)op_test_size){
+            last=(unsigned long)op_test_size-1;
+          }
+        }
+        if(first>=(unsigned long)op_test_size||last<first)status=416;
+        else{
+          status=206;
+          start=first;
+          size=last-first+1;
+        }
+      }
+    }
+    op_test_sleep_ms(op_test_conf->latency_ms);
+    if(status==416){
+      header_len=sprintf(header,
+       "HTTP/1.%i 416 Range Not Satisfiable\r\n"
+       "Server: opusfile-test\r\n"
+       "Content-Range: bytes */%lu\r\n"
+       "Content-Length: 0\r\n"
+       "%s\r\n",op_test_conf->version>=11,(unsigned long)op_test_size,
+       close?"Connection: close\r\n":"");
+      size=0;
+    }
+    else if(status==206){
+      header_len=sprintf(header,
+       "HTTP/1.%i 206 Partial Content\r\n"
+       "Server: opusfile-test\r\n"
+       "Content-Type: audio/ogg\r\n"
+       "Accept-Ranges: bytes\r\n"
+       "Content-Range: bytes %lu-%lu/%lu\r\n"
+       "Content-Length: %lu\r\n"
+       "%s\r\n",op_test_conf->version>=11,(unsigned long)start,
+       (unsigned long)(start+size-1),(unsigned long)op_test_size,
+       (unsigned long)size,close?"Connection: close\r\n":"");
+    }
+    else{
+      header_len=sprintf(header,
+       "HTTP/1.%i 200 OK\r\n"
+       "Server: opusfile-test\r\n"
+       "Content-Type: audio/ogg\r\n"
+       "%s"
+       "Content-Length: %lu\r\n"
+       "%s\r\n",op_test_conf->version>=11,
+       op_test_conf->ranges?"Accept-Ranges: bytes\r\n":"",
+       (unsigned long)size,close?"Connection: close\r\n":"");
+    }
+    if(op_test_send_all(_fd,header,header_len)<0
+     ||op_test_send_body(_fd,_report_fd,op_test_data+start,size,
+     &body_sent)<0){
+      return;
+    }
+    if(!keep_alive)return;
+    /*Keep any pipelined requests that arrived with this one.*/
+    memmove(req,req+req_len,nreq-req_len);
+    nreq-=req_len;
+  }
+}
+
+/*The main server process: accept connections, hand each to its own process,
+   and collect what they report.*/
+static void op_test_server_run(int _listen_fd,int _ctl_fd,int _stats_fd){
+  OpusTestServerStats stats;
+  int                 report_fds[2];
+  memset(&stats,0,sizeof(stats));
+  if(pipe(report_fds)<0)_exit(1);
+  for(;;){
+    struct pollfd fds[3];
+    OpusTestReport report;
+    char           c;
+    /*Reap any connections that have finished.*/
+    while(waitpid(-1,NULL,WNOHANG)>0);
+    fds[0].fd=_listen_fd;
+    fds[0].events=POLLIN;
+    fds[1].fd=report_fds[0];
+    fds[1].events=POLLIN;
+    fds[2].fd=_ctl_fd;
+    fds[2].events=POLLIN;
+    if(poll(fds,3,1000)<0){
+      if(errno==EINTR)continue;
+      _exit(1);
+    }
+    if(fds[0].revents&POLLIN){
+      int   fd;
+      pid_t pid;
+      int   one;
+      int   sndbuf;
+      fd=accept(_listen_fd,NULL,NULL);
+      if(fd>=0){
+        stats.connections++;
+        one=1;
+        setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+        /*Keep the send buffer to a realistic size, so that data we send is
+           not all sitting in the buffer when the client closes the
+           connection.*/
+        sndbuf=OP_TEST_SNDBUF_SIZE;
+        setsockopt(fd,SOL_SOCKET,SO_SNDBUF,&sndbuf,sizeof(sndbuf));
+        pid=fork();
+        if(pid==0){
+          close(_listen_fd);
+          close(_ctl_fd);
+          close(_stats_fd);
+          close(report_fds[0]);
+          /*Vary where each connection gets dropped, so that a client which
+             reconnects and retries the same read can get past the point
+             where the last connection failed.*/
+          op_test_drop_after=op_test_conf->drop_after
+           +op_test_conf->drop_after/4*(stats.connections%4);
+          op_test_serve_conn(fd,report_fds[1]);
+          _exit(0);
+        }
+        close(fd);
+      }
+    }
+    if(fds[1].revents&POLLIN){
+      if(read(report_fds[0],&report,sizeof(report))==(ssize_t)sizeof(report)){
+        stats.requests+=report.requests;
+        stats.bytes+=report.bytes;
+      }
+    }
+    if(fds[2].revents&(POLLIN|POLLHUP)){
+      if(read(_ctl_fd,&c,1)!=1)break;
+      /*Connections report what they send before they send it, so everything
+         the client has seen is already in the pipe.*/
+      for(;;){
+        struct pollfd rfd;
+        rfd.fd=report_fds[0];
+        rfd.events=POLLIN;
+        if(poll(&rfd,1,0)<=0)break;
+        if(read(report_fds[0],&report,sizeof(report))!=(ssize_t)sizeof(report)){
+          break;
+        }
+        stats.requests+=report.requests;
+        stats.bytes+=report.bytes;
+      }
+      if(write(_stats_fd,&stats,sizeof(stats))!=(ssize_t)sizeof(stats))break;
+    }
+  }
+  _exit(0);
+}
+
+int op_test_server_start(OpusTestServer *_srv,
+ const unsigned char *_data,size_t _size,const OpusTestServerConfig *_conf){
+  struct sockaddr_in addr;
+  socklen_t          addr_len;
+  int                listen_fd;
+  int                ctl_fds[2];
+  int                stats_fds[2];
+  int                one;
+  listen_fd=socket(AF_INET,SOCK_STREAM,0);
+  if(listen_fd<0)return -1;
+  one=1;
+  setsockopt(listen_fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family=AF_INET;
+  addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  /*Let the system pick a free port.*/
+  addr.sin_port=0;
+  addr_len=sizeof(addr);
+  if(bind(listen_fd,(struct sockaddr *)&addr,sizeof(addr))<0
+   ||listen(listen_fd,64)<0
+   ||getsockname(listen_fd,(struct sockaddr *)&addr,&addr_len)<0){
+    close(listen_fd);
+    return -1;
+  }
+  if(pipe(ctl_fds)<0){
+    close(listen_fd);
+    return -1;
+  }
+  if(pipe(stats_fds)<0){
+    close(ctl_fds[0]);
+    close(ctl_fds[1]);
+    close(listen_fd);
+    return -1;
+  }
+  /*The server exits with _exit(), so it never flushes our output, but flush it
+     anyway in case something else does.*/
+  fflush(NULL);
+  _srv->pid=fork();
+  if(_srv->pid==0){
+    /*Put the server and all of its connections in their own process group,
+       so they can be stopped together.*/
+    setpgid(0,0);
+    signal(SIGPIPE,SIG_IGN);
+    close(ctl_fds[1]);
+    close(stats_fds[0]);
+    op_test_conf=_conf;
+    op_test_data=_data;
+    op_test_size=_size;
+    op_test_server_run(listen_fd,ctl_fds[0],stats_fds[1]);
+  }
+  close(listen_fd);
+  close(ctl_fds[0]);
+  close(stats_fds[1]);
+  if(_srv->pid<0){
+    close(ctl_fds[1]);
+    close(stats_fds[0]);
+    return -1;
+  }
+  /*Make sure the process group exists before anyone tries to stop it.*/
+  setpgid(_srv->pid,_srv->pid);
+  _srv->port=ntohs(addr.sin_port);
+  _srv->ctl_fd=ctl_fds[1];
+  _srv->stats_fd=stats_fds[0];
+  return 0;
+}
+
+int op_test_server_stats(OpusTestServer *_srv,OpusTestServerStats *_stats){
+  if(write(_srv->ctl_fd,"s",1)!=1)return -1;
+  if(read(_srv->stats_fd,_stats,sizeof(*_stats))!=(ssize_t)sizeof(*_stats)){
+    return -1;
+  }
+  return 0;
+}
+
+void op_test_server_stop(OpusTestServer *_srv){
+  close(_srv->ctl_fd);
+  close(_srv->stats_fd);
+  kill(-_srv->pid,SIGTERM);
+  waitpid(_srv->pid,NULL,0);
+}
@@ -0,0 +1,95 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE libopusfile SOFTWARE CODEC SOURCE CODE. *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE libopusfile SOURCE CODE IS (C) COPYRIGHT 2012-2020           *
+ * by the Xiph.Org Foundation and contributors https://xiph.org/    *
+ *                                                                  *
+ ********************************************************************/
+#if !defined(_opusfile_tests_http_server_h)
+# define _opusfile_tests_http_server_h (1)
+
+/*A stand-in for an HTTP server, used to measure how libopusurl behaves
+   against servers with different capabilities and network conditions without
+   touching the network.
+  The server runs in its own process, listening on a loopback address, and
+   serves a single resource from memory for every request path.*/
+
+# include <stddef.h>
+# include <sys/types.h>
+# include <ogg/ogg.h>
+
+typedef struct OpusTestServerConfig OpusTestServerConfig;
+typedef struct OpusTestServerStats  OpusTestServerStats;
+typedef struct OpusTestServer       OpusTestServer;
+
+/*How the server behaves.*/
+struct OpusTestServerConfig{
+  /*The HTTP version to respond with: 10 for HTTP/1.0 or 11 for HTTP/1.1.
+    An HTTP/1.0 server closes the connection after every response.*/
+  int          version;
+  /*Whether or not to honor Range requests.
+    If not, every request gets the whole resource, and the stream is not
+     seekable.*/
+  int          ranges;
+  /*The time to wait before sending each response, in milliseconds.*/
+  int          latency_ms;
+  /*The maximum rate at which to send response bodies, in bytes per second,
+     or 0 for no limit.*/
+  long         bandwidth;
+  /*The maximum number of requests to answer on one connection, or 0 for no
+     limit.
+    The last response allowed on a connection says "Connection: close".*/
+  int          keep_alive_max;
+  /*Drop each connection without warning after it has sent this many bytes of
+     response bodies, or 0 to never drop a connection.
+    Later connections are allowed up to 75% more before being dropped, in a
+     repeating pattern, so that the drops do not always land in the same
+     place.*/
+  long         drop_after;
+};
+
+/*What the server has done since it was started.*/
+struct OpusTestServerStats{
+  /*The number of requests received.*/
+  long        requests;
+  /*The number of connections accepted.*/
+  long        connections;
+  /*The number of response body bytes sent.*/
+  ogg_int64_t bytes;
+};
+
+/*A running server.*/
+struct OpusTestServer{
+  /*The process running the server.*/
+  pid_t pid;
+  /*The port the server is listening on.*/
+  int   port;
+  /*The pipe used to ask the server for its statistics.*/
+  int   ctl_fd;
+  /*The pipe the server returns its statistics on.*/
+  int   stats_fd;
+};
+
+/*Start a server in a new process.
+  _data:   The resource to serve.
+           The server keeps its own copy.
+  _size:   The size of the resource, in bytes.
+  _conf:   How the server should behave.
+  Return: 0 on success, or -1 on error.*/
+int op_test_server_start(OpusTestServer *_srv,
+ const unsigned char *_data,size_t _size,const OpusTestServerConfig *_conf);
+
+/*Retrieve the statistics accumulated since the server was started.
+  Every request and every byte sent before the client received a response is
+   included.
+  Return: 0 on success, or -1 on error.*/
+int op_test_server_stats(OpusTestServer *_srv,OpusTestServerStats *_stats);
+
+/*Stop a server and close all of its connections.*/
+void op_test_server_stop(OpusTestServer *_srv);
+
+#endif